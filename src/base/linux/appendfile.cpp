@@ -0,0 +1,131 @@
+#include "../mtb-system.hxx"
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <format>
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace MTB {
+
+class LinuxAppendFile final: public AppendFile {
+public:
+    using fd_t = int;
+public:
+    LinuxAppendFile(std::string_view filename);
+    ~LinuxAppendFile() override;
+
+    std::string_view get_filename() override {
+        return std::string_view(_filename);
+    }
+    size_t get_file_size() override { return _size; }
+
+    void append(const void *data, size_t size) override;
+    void sync() override;
+    std::string readAll() override;
+    void truncate() override;
+private:
+    std::string _filename;
+    fd_t        _fd;
+    size_t      _size;
+
+    [[noreturn]] void _throwErrno(std::string_view operation);
+}; // class LinuxAppendFile
+
+LinuxAppendFile::LinuxAppendFile(std::string_view filename)
+    : _filename(filename), _fd(-1), _size(0) {
+    _fd = open(_filename.c_str(),
+               O_CREAT | O_RDWR | O_APPEND | O_CLOEXEC,
+               S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (_fd == -1)
+        _throwErrno("open");
+    struct stat file_stat;
+    if (fstat(_fd, &file_stat) == -1)
+        _throwErrno("fstat");
+    if ((file_stat.st_mode & S_IFMT) != S_IFREG) {
+        close(_fd);
+        throw Exception {
+            ErrorLevel::FATAL,
+            std::format("required file {} is not regular", _filename)
+        };
+    }
+    _size = file_stat.st_size;
+}
+
+LinuxAppendFile::~LinuxAppendFile()
+{
+    if (_fd != -1) {
+        fdatasync(_fd);
+        close(_fd);
+    }
+}
+
+void LinuxAppendFile::_throwErrno(std::string_view operation)
+{
+    throw Exception {
+        ErrorLevel::FATAL,
+        std::format("{} on append file {} failed: {}",
+                    operation, _filename, strerror(errno))
+    };
+}
+
+void LinuxAppendFile::append(const void *data, size_t size)
+{
+    auto cur = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t written = write(_fd, cur, size);
+        if (written == -1) {
+            if (errno == EINTR)
+                continue;
+            _throwErrno("write");
+        }
+        cur   += written;
+        size  -= written;
+        _size += written;
+    }
+}
+
+void LinuxAppendFile::sync()
+{
+    if (fdatasync(_fd) == -1)
+        _throwErrno("fdatasync");
+}
+
+std::string LinuxAppendFile::readAll()
+{
+    std::string ret(_size, '\0');
+    size_t done = 0;
+    while (done < ret.size()) {
+        ssize_t nread = pread(_fd, ret.data() + done, ret.size() - done, done);
+        if (nread == -1) {
+            if (errno == EINTR)
+                continue;
+            _throwErrno("pread");
+        }
+        if (nread == 0)
+            break;
+        done += nread;
+    }
+    ret.resize(done);
+    return ret;
+}
+
+void LinuxAppendFile::truncate()
+{
+    if (ftruncate(_fd, 0) == -1)
+        _throwErrno("ftruncate");
+    _size = 0;
+    sync();
+}
+
+AppendFile* CreateAppendFile(std::string_view filename)
+{
+    return new LinuxAppendFile(filename);
+}
+
+} // namespace MTB
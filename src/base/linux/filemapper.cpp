@@ -1,4 +1,5 @@
 #include "../mtb-system.hxx"
+#include <algorithm>
 #include <cerrno>
 #include <cstddef>
 #include <cstdint>
@@ -16,6 +17,8 @@ constexpr int   line_size = 512 + 512;
 
 namespace MTB {
 
+static FileMapper::GrowthPolicy default_growth_policy{};
+
 uint32_t FileMapper::GetLogicalBlockSize() {
     return logical_block_size;
 }
@@ -25,6 +28,22 @@ bool FileMapper::SetLogicalBlockSize(uint32_t block_size) {
     logical_block_size = block_size;
     return true;
 }
+FileMapper::GrowthPolicy FileMapper::GetDefaultGrowthPolicy() {
+    return default_growth_policy;
+}
+void FileMapper::SetDefaultGrowthPolicy(GrowthPolicy policy) {
+    default_growth_policy = policy;
+}
+
+size_t FileMapper::_nextSize(size_t least_size)
+{
+    size_t block = get_logical_block_size();
+    size_t size  = get_file_size();
+    size_t step  = size / 100 * _growth_policy.factor_percent;
+    step = std::min(step, _growth_policy.max_step);
+    size_t ret = std::max(least_size, size + step);
+    return (ret + block - 1) / block * block;
+}
 
 class LinuxFileMapper final: public FileMapper {
 public:
@@ -39,21 +58,28 @@ public:
     std::string_view get_filename() override {
         return std::string_view(_filename);
     }
-    int get_file_size() override {
+    size_t get_file_size() override {
         return _size;
     }
     int get_logical_block_size() override {
         return _logical_block;
     }
+    void sync() override {
+        msync(_memory, _size, MS_SYNC);
+        fsync(_fd);
+        _size_changed = false;
+    }
+    void syncRange(size_t offset, size_t size) override;
 private:
     std::string _filename;
     pointer     _memory;
     size_t      _size, _logical_block;
     fd_t        _fd;
     stat_t      _file_stat;
+    bool        _size_changed = false; // 上次同步以后文件是否扩容过
 
     void _createFile();
-    void _doResizeAppend() override;
+    void _doResize(size_t new_size) override;
 }; // class
 
 static inline void check_file_state(LinuxFileMapper::stat_t &self,
@@ -96,7 +122,7 @@ LinuxFileMapper::LinuxFileMapper(std::string_view filename)
                    PROT_READ | PROT_WRITE,
                    MAP_SHARED,
                    _fd,       0);
-    if (_memory == nullptr) {
+    if (_memory == MAP_FAILED) {
         perror("mmap");
         throw Exception{
             ErrorLevel::FATAL,
@@ -105,14 +131,27 @@ LinuxFileMapper::LinuxFileMapper(std::string_view filename)
     }
 }
 
+/** 析构时不同步映射区: 映射是共享的, 解除映射以后修改仍然留在页缓存里由内核写回.
+ *  同步整个映射区的代价与文件大小有关, 持久化交给调用者按需要的范围去做. */
 LinuxFileMapper::~LinuxFileMapper()
 {
-    msync(_memory, _size, MS_SYNC);
-    fsync(_fd);
     munmap(_memory, _size);
     close(_fd);
 }
 
+void LinuxFileMapper::syncRange(size_t offset, size_t size)
+{
+    static const size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t begin = offset / page_size * page_size;
+    size_t end   = std::min(_size, offset + size);
+    if (begin < end)
+        msync(static_cast<char*>(_memory) + begin, end - begin, MS_SYNC);
+    if (_size_changed) {
+        fdatasync(_fd);
+        _size_changed = false;
+    }
+}
+
 void LinuxFileMapper::_createFile()
 {
     _fd = open(_filename.c_str(), 
@@ -126,13 +165,20 @@ void LinuxFileMapper::_createFile()
             "fallocate failed"
         };
     }
+    fstat(_fd, &_file_stat);
+    _size_changed = true;
 }
 
-void LinuxFileMapper::_doResizeAppend()
+/** 扩容不再先把整个映射区写回磁盘: 映射是共享的, 扩大文件不会丢失映射区里的修改.
+ *  持久化由调用者(比如预写日志的检查点)负责. 优先用mremap原地扩大映射,
+ *  内核只在原地放不下时才移动映射. */
+void LinuxFileMapper::_doResize(size_t new_size)
 {
-    msync(_memory, _size, MS_SYNC);
-    munmap(_memory, _size);
-    int result = fallocate(_fd, 0, _size, _logical_block);
+    if (new_size <= _size)
+        return;
+    int result = fallocate(_fd, 0, _size, new_size - _size);
+    if (result == -1 && errno == EOPNOTSUPP)
+        result = ftruncate(_fd, new_size);
     if (result == -1) {
         perror("fallocate");
         throw FileMapper::Exception {
@@ -140,21 +186,18 @@ void LinuxFileMapper::_doResizeAppend()
             "fallocate failed"
         };
     }
-    check_file_state(_file_stat, *this);
-    _size += _logical_block;
-
-    // then map the file to the `_memory` pointer
-    _memory = mmap(nullptr, _size,
-                   PROT_READ | PROT_WRITE,
-                   MAP_DENYWRITE | MAP_SHARED,
-                   _fd, 0);
-    if (_memory == nullptr) {
-        perror("mmap");
+    pointer memory = mremap(_memory, _size, new_size, MREMAP_MAYMOVE);
+    if (memory == MAP_FAILED) {
+        perror("mremap");
         throw Exception{
             ErrorLevel::FATAL,
-            "mmap for LinuxFileMapper failed!"
+            "mremap for LinuxFileMapper failed!"
         };
     }
+    _memory = memory;
+    _size   = new_size;
+    _size_changed = true;
+    _remap_count++;
 }
 
 FileMapper* CreateFileMapper(std::string_view filename)
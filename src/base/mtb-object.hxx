@@ -62,8 +62,8 @@ namespace MTB {
         ~owned() {
             if (__ptr == nullptr)
                 return;
-            __ptr->__ref_count__--;
-            if (__ptr->__ref_count__ == 0)
+            /* 减一与判断要用同一个原子操作, 否则两个线程可能都看到0 */
+            if (--__ptr->__ref_count__ == 0)
                 delete __ptr;
         }
 
@@ -94,7 +94,7 @@ namespace MTB {
         operator ObjT* () && = delete;
         ObjT *get() const { return __ptr; }
 
-        ObjT *operator->() { return __ptr; }
+        ObjT *operator->() const { return __ptr; }
         ObjT &operator*() & { return *__ptr; }
         ObjT &operator*() && = delete;
         owned &operator=(owned const &ptr) {
@@ -158,8 +158,8 @@ namespace MTB {
         int ref_count() { return __ptr->Object::__ref_count__; }
         owned &ref() { __ptr->__ref_count__++; return *this; }
         void unref() {
-            __ptr->__ref_count__--;
-            if (__ptr->__ref_count__ == 0)
+            /* 减一与判断要用同一个原子操作, 否则两个线程可能都看到0 */
+            if (--__ptr->__ref_count__ == 0)
                 delete __ptr;
         }
         void reset() {
@@ -4,8 +4,10 @@
 
 #include "mtb-object.hxx"
 #include "mtb-exception.hxx"
+#include <cstddef>
 #include <cstdint>
 #include <mutex>
+#include <string>
 #include <string_view>
 
 namespace MTB {
@@ -17,11 +19,28 @@ namespace MTB {
         class Exception: public MTB::Exception {
             using MTB::Exception::Exception;
         }; // class FileMapper::Exception
+
+        /** @struct GrowthPolicy
+         * @brief 文件扩容策略。每次扩容至少增长当前大小的`factor_percent`%,
+         *        但单次不超过`max_step`字节, 结果向上对齐到逻辑块。
+         *        这样扩容与重映射的次数只与文件大小成对数关系。
+         *        `factor_percent`为0时退化成每次只增长需要的块数。 */
+        struct GrowthPolicy {
+            uint32_t factor_percent = 100;
+            size_t   max_step       = size_t(1) << 30;
+        }; // struct GrowthPolicy
     protected:
-        FileMapper() = default;
-        std::mutex _modify_lock;    // 修改锁, 在重映射的时候使用.
+        FileMapper(): _growth_policy(GetDefaultGrowthPolicy()) {}
+        std::mutex   _modify_lock;    // 修改锁, 在重映射的时候使用.
+        GrowthPolicy _growth_policy;  // 扩容策略
+        uint64_t     _remap_count = 0; // 重映射次数, 每次重映射都会让之前取得的地址失效
 
-        virtual void _doResizeAppend() = 0;
+        /** @fn _doResize(new_size) abstract
+         * @brief 把文件扩大到`new_size`字节并重新映射. `new_size`已经按逻辑块对齐. */
+        virtual void _doResize(size_t new_size) = 0;
+        /** @fn _nextSize(least_size)
+         * @brief 根据扩容策略计算能放下`least_size`字节的新文件大小 */
+        size_t _nextSize(size_t least_size);
     public:
         virtual ~FileMapper() = default;
         /** @fn get() abstract
@@ -38,21 +57,56 @@ namespace MTB {
 
         /** @fn get_file_size() abstract
          * @brief getter: 获取文件大小 */
-        virtual int get_file_size() = 0;
+        virtual size_t get_file_size() = 0;
 
-        /** @fn resizeAppend()
-         * @brief 往文件的末尾附加一块 */
-        void resizeAppend() {
+        /** @fn sync() abstract
+         * @brief 把整个映射区同步写回磁盘 */
+        virtual void sync() = 0;
+
+        /** @fn syncRange(offset, size) abstract
+         * @brief 只把文件里`[offset, offset + size)`范围的映射区同步写回磁盘,
+         *        范围会向外对齐到系统页面。文件扩容过时顺便同步文件大小等元数据。
+         * @warning 析构时不会同步映射区, 需要持久化的调用者必须自己调用`sync`或者`syncRange`. */
+        virtual void syncRange(size_t offset, size_t size) = 0;
+
+        /** @brief getter: 重映射的次数 */
+        uint64_t get_remap_count() const { return _remap_count; }
+
+        /** @brief getter & setter: 当前实例的扩容策略 */
+        GrowthPolicy get_growth_policy() const { return _growth_policy; }
+        void set_growth_policy(GrowthPolicy policy) { _growth_policy = policy; }
+
+        /** @fn reserve(least_size)
+         * @brief 保证文件至少有`least_size`字节. 需要扩容时按扩容策略一次扩到位,
+         *        所以调用者不需要循环调用. */
+        void reserve(size_t least_size) {
             modifyLock();
-            _doResizeAppend();
+            try {
+                if (least_size > get_file_size())
+                    _doResize(_nextSize(least_size));
+            } catch (...) {
+                modifyUnlock();
+                throw;
+            }
             modifyUnlock();
         }
+
+        /** @fn resizeAppend()
+         * @brief 往文件的末尾附加空间, 至少一个块, 增长量由扩容策略决定 */
+        void resizeAppend() {
+            reserve(get_file_size() + 1);
+        }
         /** @fn tryResizeAppend()
-         * @brief 往文件的末尾附加一块, 如果这个对象被锁定则返回false */
+         * @brief 往文件的末尾附加空间, 如果这个对象被锁定则返回false */
         bool tryResizeAppend() {
             if (tryModifyLock() == false)
                 return false;
-            _doResizeAppend();
+            try {
+                _doResize(_nextSize(get_file_size() + 1));
+            } catch (...) {
+                modifyUnlock();
+                throw;
+            }
             modifyUnlock();
             return true;
         }
@@ -66,6 +120,14 @@ namespace MTB {
          *        逻辑块的大小必须是2的n次方. */
         static bool SetLogicalBlockSize(uint32_t block_size);
 
+        /** @fn GetDefaultGrowthPolicy() static
+         * @brief Global getter: 新建实例时使用的扩容策略 */
+        static GrowthPolicy GetDefaultGrowthPolicy();
+
+        /** @fn SetDefaultGrowthPolicy() static
+         * @brief Global setter: 设置新建实例时使用的扩容策略, 不影响已经存在的实例 */
+        static void SetDefaultGrowthPolicy(GrowthPolicy policy);
+
         /* 自带的锁操作函数 */
         inline void modifyLock()    { _modify_lock.lock(); }
         inline bool tryModifyLock() { return _modify_lock.try_lock(); }
@@ -75,6 +137,49 @@ namespace MTB {
     /** @fn CreateFileMapper(string_view)
      * @brief 根据文件名创建一个文件映射器,  */
     FileMapper* CreateFileMapper(std::string_view filename);
+
+    /** @class AppendFile abstract
+     * @brief   只追加文件抽象类, 给日志一类顺序写、批量落盘的文件使用.
+     *          与`FileMapper`不同, 写入的数据不经过映射区, 落盘的代价只与写入的数据量有关.
+     * @warning 这个类不能被实例化! 你需要调用`MTB::CreateAppendFile()`函数! */
+    class AppendFile: public Object {
+    public:
+        class Exception: public MTB::Exception {
+            using MTB::Exception::Exception;
+        }; // class AppendFile::Exception
+    protected:
+        AppendFile() = default;
+    public:
+        virtual ~AppendFile() = default;
+
+        /** @fn get_filename() abstract
+         * @brief getter: 获取文件名 */
+        virtual std::string_view get_filename() = 0;
+
+        /** @fn get_file_size() abstract
+         * @brief getter: 获取文件大小, 包括已经写入但还没有落盘的数据 */
+        virtual size_t get_file_size() = 0;
+
+        /** @fn append(data, size) abstract
+         * @brief 把`size`字节的数据追加到文件末尾. 数据只写进内核缓冲区, 不保证落盘. */
+        virtual void append(const void *data, size_t size) = 0;
+
+        /** @fn sync() abstract
+         * @brief 把已经追加的数据同步写回磁盘 */
+        virtual void sync() = 0;
+
+        /** @fn readAll() abstract
+         * @brief 从头读取整个文件 */
+        virtual std::string readAll() = 0;
+
+        /** @fn truncate() abstract
+         * @brief 清空文件并同步写回磁盘 */
+        virtual void truncate() = 0;
+    }; // abstract class AppendFile
+
+    /** @fn CreateAppendFile(string_view)
+     * @brief 打开名为`filename`的只追加文件, 文件不存在时会创建它. */
+    AppendFile* CreateAppendFile(std::string_view filename);
 } // namespace MTB
 
 #endif
\ No newline at end of file
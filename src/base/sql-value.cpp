@@ -28,6 +28,15 @@ std::string_view ValueTypeGetString(Value::Type self)
 }
 
 
+void Value::operator delete(Value *value, std::destroying_delete_t)
+{
+    bool in_arena = value->_in_arena;
+    void *memory = dynamic_cast<void*>(value);
+    value->~Value();
+    if (!in_arena)
+        ::operator delete(memory);
+}
+
 std::weak_ordering Value::operator<=>(Value const& another) {
     int64_t comp_result = compare(&another);
     if (comp_result == 0xFFFF'FFFF) {
@@ -43,14 +52,8 @@ std::weak_ordering Value::operator<=>(Value const& another) {
         return std::weak_ordering::greater;
 }
 
-bool ValueMeetsCondition(TotalOrderRelation contition, Value *left, Value *right)
+static inline bool relation_accepts(TotalOrderRelation contition, int64_t compare_result)
 {
-    if (left->get_value_type() != right->get_value_type()) {
-        throw Value::InconsistantTypeException(
-            left->get_value_type(),
-            right->get_value_type());
-    }
-    int compare_result = left->compare(right);
     if (((int8_t)contition & (int8_t)TotalOrderRelation::EQ) != 0 &&
         compare_result == 0) {
         return true;
@@ -66,6 +69,111 @@ bool ValueMeetsCondition(TotalOrderRelation contition, Value *left, Value *right
     return false;
 }
 
+bool ValueMeetsCondition(TotalOrderRelation contition, Value *left, Value *right)
+{
+    if (left->get_value_type() != right->get_value_type()) {
+        throw Value::InconsistantTypeException(
+            left->get_value_type(),
+            right->get_value_type());
+    }
+    int compare_result = left->compare(right);
+    return relation_accepts(contition, compare_result);
+}
+
+bool ValueMeetsCondition(TotalOrderRelation contition,
+                         ValueView const &left, const Value *right)
+{
+    if (left.type != right->get_value_type()) {
+        throw Value::InconsistantTypeException(
+            left.type, right->get_value_type());
+    }
+    return relation_accepts(contition, left.compare(right));
+}
+
+bool ValueMeetsCondition(TotalOrderRelation contition,
+                         ValueView const &left, ValueView const &right)
+{
+    if (left.type != right.type)
+        throw Value::InconsistantTypeException(left.type, right.type);
+    return relation_accepts(contition, left.compare(right));
+}
+
+int64_t ValueView::compare(const Value *another) const
+{
+    if (another->get_value_type() != type)
+        return 0xFFFF'FFFF;
+    switch (type) {
+    case Value::Type::INT: {
+        int32_t rhs = static_cast<const IntValue*>(another)->value();
+        return (int_value > rhs) - (int_value < rhs);
+    }
+    case Value::Type::STRING: {
+        std::string_view rhs = static_cast<const StringValue*>(another)->value();
+        int result = string_value.compare(rhs);
+        return (result > 0) - (result < 0);
+    }
+    default:
+        return 0xFFFF'FFFF;
+    }
+}
+
+int64_t ValueView::compare(ValueView const &another) const
+{
+    if (another.type != type)
+        return 0xFFFF'FFFF;
+    switch (type) {
+    case Value::Type::INT:
+        return (int_value > another.int_value) - (int_value < another.int_value);
+    case Value::Type::STRING: {
+        int result = string_value.compare(another.string_value);
+        return (result > 0) - (result < 0);
+    }
+    default:
+        return 0xFFFF'FFFF;
+    }
+}
+
+MTB::owned<Value> ValueView::materialize(std::pmr::memory_resource *arena) const
+{
+    switch (type) {
+    case Value::Type::INT:
+        return MTB::owned<Value>(Value::New<IntValue>(arena, int_value));
+    case Value::Type::STRING:
+        return MTB::owned<Value>(Value::New<StringValue>(arena, string_value));
+    default:
+        return nullptr;
+    }
+}
+
+size_t ValueView::hash() const
+{
+    switch (type) {
+    case Value::Type::INT:
+        return std::hash<int>()(int_value);
+    case Value::Type::STRING:
+        return std::hash<std::string_view>()(string_value);
+    default:
+        return 0;
+    }
+}
+
+ValueView ValueView::FromValue(const Value *value)
+{
+    ValueView ret;
+    ret.type = value->get_value_type();
+    switch (ret.type) {
+    case Value::Type::INT:
+        ret.int_value = static_cast<const IntValue*>(value)->value();
+        break;
+    case Value::Type::STRING:
+        ret.string_value = static_cast<const StringValue*>(value)->value();
+        break;
+    default:
+        break;
+    }
+    return ret;
+}
+
 IntValue::~IntValue() {
     _value = 0;
 }
@@ -3,13 +3,20 @@
 
 #include "base/mtb-exception.hxx"
 #include "mtb-object.hxx"
+#include <bit>
 #include <compare>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
 #include <format>
 #include <functional>
+#include <memory_resource>
+#include <new>
+#include <string>
 #include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace mygsql {
 
@@ -50,10 +57,33 @@ public:
     virtual size_t hash() const = 0;
 
     Type get_value_type() const { return _value_type; }
+
+    /** @fn New<ValueT>(arena, args...) static
+     * @brief 同`new ValueT(args...)`, 但是`arena`不为空时从内存池`arena`分配,
+     *        字符串的内容也放在内存池里。查询用一条语句的内存池创建结果行的值,
+     *        语句结束时整个内存池一次释放, 扫描每一行都不需要调用malloc.
+     * @warning 从内存池分配的值要在内存池释放以前全部析构, 不要跨语句保存它们 */
+    template<typename ValueT, typename... ArgT>
+    static ValueT *New(std::pmr::memory_resource *arena, ArgT &&...args);
+    /** @fn operator delete(value, destroying_delete_t) static
+     * @brief 引用计数归零时析构值。从内存池分配的值只析构, 内存随内存池一起释放 */
+    static void operator delete(Value *value, std::destroying_delete_t);
 protected:
-    Type _value_type;   // 值类型
+    Type _value_type;       // 值类型
+    bool _in_arena = false; // 是否从内存池分配
 }; // class Value
 
+/** 值列表: 一个条目的所有列, 或者查询输出的一行。查询的结果行从语句的内存池分配,
+ *  默认在堆上分配 */
+using ValueListT = std::pmr::vector<MTB::owned<Value>>;
+
+/** @fn ValueListCreate(arena)
+ * @brief 空的值列表, `arena`不为空时从这个内存池分配, 否则在堆上分配 */
+inline ValueListT ValueListCreate(std::pmr::memory_resource *arena)
+{
+    return ValueListT(arena != nullptr ? arena : std::pmr::get_default_resource());
+}
+
 extern std::string_view ValueTypeGetString(Value::Type self);
 
 /** @class IntValue
@@ -69,6 +99,7 @@ public:
     ~IntValue() override;
 
     int32_t &value()   { return _value; }
+    int32_t value() const { return _value; }
     operator int32_t() { return value(); }
 
     std::string getString() const override {
@@ -92,32 +123,51 @@ private:
 
 class StringValue: public Value {
 public:
-    StringValue(std::string_view value)
-        : _value(value) { _value_type = Type::STRING; }
+    /** @param resource 字符串内容的分配器, 从内存池创建时是内存池 */
+    StringValue(std::string_view value,
+                std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+        : _value(value, resource) { _value_type = Type::STRING; }
 
     size_t hash() const override {
         std::string_view value(_value);
         return std::hash<std::string_view>()(value);
     }
-    std::string getString() const override { return _value; }
+    std::string getString() const override { return std::string(_value); }
     int64_t compare(const Value *another) override {
         if (another->get_value_type() != get_value_type())
             return 0xFFFF'FFFF;
         auto sval = reinterpret_cast<const StringValue*>(another);
-        return strcmp(_value.c_str(), sval->_value.c_str());
+        /* 按长度比较, 不需要像strcmp一样先找结尾 */
+        int result = _value.compare(sval->_value);
+        return (result > 0) - (result < 0);
     }
     void setFromString(std::string_view value) override {
         _value = value;
     }
-    std::string const &value() const { return _value; }
+    std::string_view value() const { return _value; }
 
     /** 转化为普通字符串 */
     operator std::string_view() const& { return value(); }
-    operator std::string() && { return _value; }
+    operator std::string() && { return std::string(_value); }
 private:
-    std::string _value;
+    std::pmr::string _value;
 }; // class StringValue
 
+template<typename ValueT, typename... ArgT>
+ValueT *Value::New(std::pmr::memory_resource *arena, ArgT &&...args)
+{
+    if (arena == nullptr)
+        return new ValueT(std::forward<ArgT>(args)...);
+    void *memory = arena->allocate(sizeof(ValueT), alignof(ValueT));
+    ValueT *ret;
+    if constexpr (std::is_constructible_v<ValueT, ArgT..., std::pmr::memory_resource*>)
+        ret = new(memory) ValueT(std::forward<ArgT>(args)..., arena);
+    else
+        ret = new(memory) ValueT(std::forward<ArgT>(args)...);
+    ret->_in_arena = true;
+    return ret;
+}
+
 /** @enum 全序关系枚举，是一个二进制掩码. */
 enum class TotalOrderRelation: int8_t {
     NONE  = 0b0000, // 不应该使用的值
@@ -129,12 +179,238 @@ enum class TotalOrderRelation: int8_t {
     NE    = 0b0011  // 不等于(LT|GT)
 }; // enum class TotalOrderRelation
 
+/** @struct ValueView
+ * @brief 不持有所有权的值视图。整数直接存放值，字符串指向存储区里的原始字节，
+ *        读取时不需要在堆上分配`Value`.
+ * @warning 字符串视图只在映射区没有被重新映射之前有效，不要跨语句保存它。 */
+struct ValueView {
+    Value::Type      type = Value::Type::NONE;
+    int32_t          int_value = 0;
+    std::string_view string_value;
+
+    /** @fn compare(another)
+     * @brief 语义与`Value::compare`相同，类型不一致时返回0xFFFF'FFFF */
+    int64_t compare(const Value *another) const;
+    /** @fn compare(another)
+     * @brief 同上, 右值也是值视图 */
+    int64_t compare(ValueView const &another) const;
+    /** @fn materialize(arena)
+     * @brief 复制出一个持有所有权的`Value`, `arena`不为空时从这个内存池分配(见`Value::New`) */
+    MTB::owned<Value> materialize(std::pmr::memory_resource *arena = nullptr) const;
+    /** @fn hash()
+     * @brief 与`materialize()->hash()`相同, 但是不创建`Value` */
+    size_t hash() const;
+
+    /** @fn FromValue(value) static
+     * @brief 指向`value`内部的值视图, 只在`value`存活并且没有被修改时有效 */
+    static ValueView FromValue(const Value *value);
+}; // struct ValueView
+
+/** @class CompactValue
+ * @brief 执行引擎内层循环(扫描的条件、排序、聚合、连接)用的16字节的值, 代替`Value`与
+ *        `ValueView`: 没有虚函数表与引用计数, 按值复制, 比较与哈希不调用虚函数。
+ *        - 整数直接存放在值里。
+ *        - 不超过`INLINE_MAX`字节的短字符串也直接存放在值里, 其余字节填0. 两个短字符串的比较
+ *          是两个按大端序读出的64位整数的比较, 不调用memcmp.
+ *        - 长字符串是指针与长度, 与`ValueView`一样不持有所有权。
+ *        最后一个字节是标签: 高4位是种类, 低4位是短字符串的长度。同一个字符串总是同一种表示,
+ *        所以相等的值的字节也相等。
+ * @warning 长字符串只在它指向的内存有效时有效; 短字符串的`string_value()`指向这个值本身 */
+class CompactValue {
+public:
+    /** 直接存放在值里的字符串的最大长度 */
+    static constexpr size_t INLINE_MAX = 15;
+
+    /** 空值, 类型是`Value::Type::NONE` */
+    CompactValue() = default;
+
+    static CompactValue FromInt(int32_t value);
+    /** @fn FromString(value) static
+     * @brief 长字符串只引用`value`指向的内存 */
+    static CompactValue FromString(std::string_view value);
+    static CompactValue FromView(ValueView const &view);
+    /** @fn FromValue(value) static
+     * @brief 不调用虚函数。长字符串引用`value`内部, 只在`value`存活并且没有被修改时有效 */
+    static CompactValue FromValue(Value const *value);
+
+    Value::Type type() const {
+        switch (_kind()) {
+        case Kind::INT:    return Value::Type::INT;
+        case Kind::INLINE:
+        case Kind::REF:    return Value::Type::STRING;
+        default:           return Value::Type::NONE;
+        }
+    }
+    int32_t int_value() const {
+        int32_t ret;
+        std::memcpy(&ret, _bytes, sizeof(ret));
+        return ret;
+    }
+    std::string_view string_value() const;
+    /** @fn view()
+     * @brief 值视图, 短字符串指向这个值本身 */
+    ValueView view() const;
+
+    /** @fn compare(another)
+     * @brief 语义与`ValueView::compare`相同: 返回-1、0、1, 类型不一致时返回0xFFFF'FFFF */
+    int64_t compare(CompactValue const &another) const;
+    /** @fn meets(relation, right)
+     * @brief 与右值的比较结果是否满足`relation`. 不检查类型, 类型不一致时返回false;
+     *        调用者在进入循环以前检查一次类型(见`ValueMeetsCondition`) */
+    bool meets(TotalOrderRelation relation, CompactValue const &right) const {
+        /* 比较结果-1、0、1分别对应关系掩码的LT、EQ、GT位 */
+        static constexpr int8_t relation_bits[3] = { 0b0001, 0b0100, 0b0010 };
+        int64_t result = compare(right);
+        if (result == 0xFFFF'FFFF)
+            return false;
+        return (int8_t(relation) & relation_bits[result + 1]) != 0;
+    }
+    /** @fn hash()
+     * @brief 与`ValueView::hash`相同 */
+    size_t hash() const;
+    /** @fn materialize(arena)
+     * @brief 复制出一个持有所有权的`Value`, `arena`不为空时从这个内存池分配(见`Value::New`) */
+    MTB::owned<Value> materialize(std::pmr::memory_resource *arena = nullptr) const {
+        return view().materialize(arena);
+    }
+private:
+    /** @enum Kind
+     * @brief 标签的高4位 */
+    enum class Kind: uint8_t {
+        NONE = 0x00, INT = 0x10, INLINE = 0x20, REF = 0x30
+    }; // enum class Kind
+    static constexpr size_t TAG = 15;
+
+    /** 整数或者短字符串的内容, 长字符串是指针与长度; 最后一个字节是标签 */
+    alignas(8) uint8_t _bytes[16] = {};
+
+    Kind _kind() const { return Kind(_bytes[TAG] & 0xF0); }
+    /** 按大端序读出第`index`个64位字, 字节的次序就是整数的大小次序 */
+    uint64_t _bigEndianWord(size_t index) const {
+        uint64_t ret;
+        std::memcpy(&ret, _bytes + index * sizeof(ret), sizeof(ret));
+        if constexpr (std::endian::native == std::endian::little)
+            ret = std::byteswap(ret);
+        return ret;
+    }
+}; // class CompactValue
+static_assert(sizeof(CompactValue) == 16);
+
+inline CompactValue CompactValue::FromInt(int32_t value)
+{
+    CompactValue ret;
+    std::memcpy(ret._bytes, &value, sizeof(value));
+    ret._bytes[TAG] = uint8_t(Kind::INT);
+    return ret;
+}
+
+inline CompactValue CompactValue::FromString(std::string_view value)
+{
+    CompactValue ret;
+    if (value.size() <= INLINE_MAX) {
+        std::memcpy(ret._bytes, value.data(), value.size());
+        ret._bytes[TAG] = uint8_t(Kind::INLINE) | uint8_t(value.size());
+        return ret;
+    }
+    char const *data = value.data();
+    uint32_t    size = value.size();
+    std::memcpy(ret._bytes, &data, sizeof(data));
+    std::memcpy(ret._bytes + sizeof(data), &size, sizeof(size));
+    ret._bytes[TAG] = uint8_t(Kind::REF);
+    return ret;
+}
+
+inline CompactValue CompactValue::FromView(ValueView const &view)
+{
+    switch (view.type) {
+    case Value::Type::INT:    return FromInt(view.int_value);
+    case Value::Type::STRING: return FromString(view.string_value);
+    default:                  return {};
+    }
+}
+
+inline CompactValue CompactValue::FromValue(Value const *value)
+{
+    switch (value->get_value_type()) {
+    case Value::Type::INT:
+        return FromInt(static_cast<IntValue const*>(value)->value());
+    case Value::Type::STRING:
+        return FromString(static_cast<StringValue const*>(value)->value());
+    default:
+        return {};
+    }
+}
+
+inline std::string_view CompactValue::string_value() const
+{
+    if (_kind() == Kind::INLINE)
+        return { reinterpret_cast<char const*>(_bytes), size_t(_bytes[TAG] & 0x0F) };
+    char const *data;
+    uint32_t    size;
+    std::memcpy(&data, _bytes, sizeof(data));
+    std::memcpy(&size, _bytes + sizeof(data), sizeof(size));
+    return { data, size };
+}
+
+inline ValueView CompactValue::view() const
+{
+    ValueView ret;
+    ret.type = type();
+    if (ret.type == Value::Type::INT)
+        ret.int_value = int_value();
+    else if (ret.type == Value::Type::STRING)
+        ret.string_value = string_value();
+    return ret;
+}
+
+inline int64_t CompactValue::compare(CompactValue const &another) const
+{
+    Kind kind = _kind(), other = another._kind();
+    if (kind == Kind::INT && other == Kind::INT) {
+        int32_t lhs = int_value(), rhs = another.int_value();
+        return (lhs > rhs) - (lhs < rhs);
+    }
+    if (kind == Kind::INLINE && other == Kind::INLINE) {
+        /* 内容后面填的是0, 第二个字的最低字节是标签(种类相同, 只有长度不同),
+         * 所以内容相同时短的排在前面, 与字符串的字典序一致 */
+        uint64_t lhs = _bigEndianWord(0), rhs = another._bigEndianWord(0);
+        if (lhs == rhs) {
+            lhs = _bigEndianWord(1);
+            rhs = another._bigEndianWord(1);
+        }
+        return (lhs > rhs) - (lhs < rhs);
+    }
+    bool both_string = kind >= Kind::INLINE && other >= Kind::INLINE;
+    if (!both_string)
+        return 0xFFFF'FFFF;
+    int result = string_value().compare(another.string_value());
+    return (result > 0) - (result < 0);
+}
+
+inline size_t CompactValue::hash() const
+{
+    switch (_kind()) {
+    case Kind::INT:    return std::hash<int>()(int_value());
+    case Kind::INLINE:
+    case Kind::REF:    return std::hash<std::string_view>()(string_value());
+    default:           return 0;
+    }
+}
+
 /** @fn ValueMeetsCondition
  * @brief 判断两个Value是否满足condition所示的相等条件。
  * @warning 注意两个Value的类型是否相等。类型不同的Value比较，会
  *          抛出InconsistantTypeException. */
 bool ValueMeetsCondition(TotalOrderRelation contition,
                          Value *left, Value *right);
+/** @fn ValueMeetsCondition
+ * @brief 同上，左值是存储区里的值视图 */
+bool ValueMeetsCondition(TotalOrderRelation contition,
+                         ValueView const &left, const Value *right);
+/** @fn ValueMeetsCondition
+ * @brief 同上，左右值都是存储区里的值视图 */
+bool ValueMeetsCondition(TotalOrderRelation contition,
+                         ValueView const &left, ValueView const &right);
 
 } // namespace mygsql
 
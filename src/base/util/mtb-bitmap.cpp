@@ -0,0 +1,56 @@
+#include "mtb-bitmap.hxx"
+#include <algorithm>
+
+namespace MTB {
+
+/* @class Bitmap 定长位图 */
+
+void Bitmap::resize(size_t nbits)
+{
+    _words.resize((nbits + WORD_BITS - 1) / WORD_BITS, 0);
+    /* 缩小时把最后一个字里超出范围的位清零, 保证count()与traverseSet()不越界 */
+    if (nbits % WORD_BITS != 0)
+        _words.back() &= (WordT(1) << (nbits % WORD_BITS)) - 1;
+    _nbits = nbits;
+}
+
+void Bitmap::clear()
+{
+    std::fill(_words.begin(), _words.end(), 0);
+}
+
+size_t Bitmap::count() const
+{
+    size_t ret = 0;
+    for (WordT word: _words)
+        ret += std::popcount(word);
+    return ret;
+}
+
+bool Bitmap::any() const
+{
+    return std::any_of(_words.begin(), _words.end(), [](WordT word) { return word != 0; });
+}
+
+void Bitmap::andWith(Bitmap const &another)
+{
+    size_t common = std::min(_words.size(), another._words.size());
+    for (size_t i = 0; i < common; i++)
+        _words[i] &= another._words[i];
+    std::fill(_words.begin() + common, _words.end(), 0);
+}
+
+void Bitmap::andNot(Bitmap const &another)
+{
+    size_t common = std::min(_words.size(), another._words.size());
+    for (size_t i = 0; i < common; i++)
+        _words[i] &= ~another._words[i];
+}
+
+void Bitmap::orWith(Bitmap const &another)
+{
+    for (size_t i = 0; i < another._words.size(); i++)
+        _words[i] |= another._words[i];
+}
+
+} // namespace MTB
@@ -0,0 +1,92 @@
+#ifndef __MTB_UTIL_BITMAP_H__
+#define __MTB_UTIL_BITMAP_H__
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace MTB {
+    /** @class Bitmap
+     * @brief 定长位图, 以64位字为单位存放。扫描内核用它作为选择向量:
+     *        第i位为1表示第i个条目被选中。
+     * @warning 位图线程不安全。 */
+    class Bitmap {
+    public:
+        using WordT = uint64_t;
+        static constexpr size_t WORD_BITS = 64;
+    public:
+        /** @fn Bitmap()
+         * @brief 构造一个空位图 */
+        Bitmap() = default;
+        /** @fn Bitmap(nbits)
+         * @brief 构造一个有`nbits`位的全0位图 */
+        explicit Bitmap(size_t nbits) { resize(nbits); }
+
+        /** @fn resize(nbits)
+         * @brief 改变位图的位数, 新增的位为0 */
+        void resize(size_t nbits);
+        /** @fn clear()
+         * @brief 所有位清零, 位数不变 */
+        void clear();
+
+        size_t size() const { return _nbits; }
+        bool   empty() const { return _nbits == 0; }
+
+        bool test(size_t pos) const {
+            return (_words[pos / WORD_BITS] >> (pos % WORD_BITS)) & 1;
+        }
+        void set(size_t pos) {
+            _words[pos / WORD_BITS] |= WordT(1) << (pos % WORD_BITS);
+        }
+        void reset(size_t pos) {
+            _words[pos / WORD_BITS] &= ~(WordT(1) << (pos % WORD_BITS));
+        }
+        /** @fn orBits(pos, bits, nbits)
+         * @brief 把`bits`的低`nbits`位(nbits <= 64)按位或到从`pos`开始的位置上。
+         *        `pos`不需要对齐。 */
+        void orBits(size_t pos, WordT bits, size_t nbits) {
+            if (nbits < WORD_BITS)
+                bits &= (WordT(1) << nbits) - 1;
+            size_t word = pos / WORD_BITS, shift = pos % WORD_BITS;
+            _words[word] |= bits << shift;
+            if (shift != 0 && shift + nbits > WORD_BITS)
+                _words[word + 1] |= bits >> (WORD_BITS - shift);
+        }
+
+        /** @fn count()
+         * @brief 值为1的位的个数 */
+        size_t count() const;
+        /** @fn any()
+         * @brief 是否有值为1的位 */
+        bool any() const;
+
+        /** @fn andWith(another)
+         * @brief 按位与: 只保留`another`里也为1的位。`another`比较短时超出的位清零 */
+        void andWith(Bitmap const &another);
+        /** @fn andNot(another)
+         * @brief 清除`another`里为1的位 */
+        void andNot(Bitmap const &another);
+        /** @fn orWith(another)
+         * @brief 按位或. `another`不能比这个位图长 */
+        void orWith(Bitmap const &another);
+
+        /** @fn traverseSet(fn)
+         * @brief 按下标的升序遍历所有值为1的位, `fn`的参数是位的下标 */
+        template<typename FnT>
+        void traverseSet(FnT &&fn) const {
+            for (size_t w = 0; w < _words.size(); w++) {
+                for (WordT word = _words[w]; word != 0; word &= word - 1)
+                    fn(w * WORD_BITS + std::countr_zero(word));
+            }
+        }
+
+        WordT       *data()       { return _words.data(); }
+        WordT const *data() const { return _words.data(); }
+    private:
+        std::vector<WordT> _words;
+        size_t             _nbits = 0;
+    }; // class Bitmap
+} // namespace MTB
+
+#endif
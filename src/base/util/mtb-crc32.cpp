@@ -0,0 +1,25 @@
+#include "mtb-crc32.hxx"
+#include <array>
+
+namespace MTB {
+
+static constexpr std::array<uint32_t, 256> crc32_table = []() {
+    std::array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc & 1) ? (crc >> 1) ^ 0xEDB8'8320 : crc >> 1;
+        table[i] = crc;
+    }
+    return table;
+}();
+
+uint32_t Crc32Update(uint32_t crc, const void *data, size_t size)
+{
+    auto bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++)
+        crc = crc32_table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+} // namespace MTB
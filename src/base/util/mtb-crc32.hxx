@@ -0,0 +1,20 @@
+#ifndef __MTB_UTIL_CRC32_H__
+#define __MTB_UTIL_CRC32_H__
+
+#include <cstddef>
+#include <cstdint>
+
+namespace MTB {
+    /** @fn Crc32Update(crc, data, size)
+     * @brief 把`data`累加进CRC32(IEEE 802.3多项式)的中间状态。
+     *        初始状态是0xFFFF'FFFF, 最终结果要取反。用于分段计算校验和。 */
+    uint32_t Crc32Update(uint32_t crc, const void *data, size_t size);
+
+    /** @fn Crc32(data, size)
+     * @brief 计算`data`的CRC32校验和 */
+    inline uint32_t Crc32(const void *data, size_t size) {
+        return ~Crc32Update(0xFFFF'FFFF, data, size);
+    }
+} // namespace MTB
+
+#endif
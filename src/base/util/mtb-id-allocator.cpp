@@ -7,7 +7,7 @@ namespace MTB {
 constexpr auto UNREACHABLE = -1;
 
 IDAllocator::IDAllocator()
-    : _cur_max_id(2) {
+    : _cur_max_id(1) {
     _entry_list.push_back({
         UNREACHABLE, UNREACHABLE, false
     }); // [0] = Not Allocated
@@ -17,62 +17,78 @@ IDAllocator::IDAllocator()
 }
 
 IDAllocator::IDAllocator(std::initializer_list<bool> allocated_list)
-    : IDAllocator() {
-    int cur_real_id = 2;
-    for (bool item: allocated_list) {
-        if (item == true) {
-            _entry_list.push_back({1, -1, true});
-            _entry_list[1].next = cur_real_id;
-            int next_id = _entry_list[cur_real_id].next;
-        } else {
-            _entry_list.push_back({0, -1, false});
-            _entry_list[0].next = cur_real_id;
-            int next_id = _entry_list[cur_real_id].next;
-        }
-    }
-    _cur_max_id = cur_real_id;
+    : IDAllocator(bool8vec(allocated_list.begin(), allocated_list.end())) {
 }
 
 IDAllocator::IDAllocator(bool8vec const &allocated_list)
     : IDAllocator() {
     for (bool item: allocated_list)
         allocate();
-    for (int id = 0;
-         bool is_allocated: allocated_list) {
-        if (!is_allocated)
+    /* 倒序归还, 这样编号小的空闲ID会先被分配出去 */
+    for (int id = int(allocated_list.size()) - 1; id >= 0; id--) {
+        if (!allocated_list[id])
             free(id);
-        id++;
     }
-    return;
 }
 
 int IDAllocator::allocate()
 {
-    if (_entry_list[0].next == -1) {
+    if (_entry_list[0].next == UNREACHABLE) {
         int current_id = _entry_list.size();
-        _entry_list.push_back({0, -1, false});
+        _entry_list.push_back({0, UNREACHABLE, false});
         _entry_list[0].next = current_id;
-        _cur_max_id++;
+        _cur_max_id = current_id;
     }
 
     /* remove the first "unused" id */
     int ret = _entry_list[0].next;
     int ret_next = _entry_list[ret].next;
     _entry_list[0].next = ret_next;
-    if (ret_next != -1)
-        _entry_list[ret_next].prev = ret;
-
+    if (ret_next != UNREACHABLE)
+        _entry_list[ret_next].prev = 0;
 
     /* and let it join in the "used" list. */
     ret_next = _entry_list[1].next;
     _entry_list[ret] = {1, ret_next, true};
-    if (ret_next != -1)
+    if (ret_next != UNREACHABLE)
         _entry_list[ret_next].prev = ret;
     _entry_list[1].next = ret;
     
     return ret - 2;
 }
 
+bool IDAllocator::allocateAt(int id)
+{
+    if (id < 0 || isAllocated(id))
+        return false;
+    int index = id + 2;
+    /* 范围之外的id先逐个放进"unused"链表 */
+    while (int(_entry_list.size()) <= index) {
+        int current_id = _entry_list.size();
+        int next = _entry_list[0].next;
+        _entry_list.push_back({0, next, false});
+        if (next != UNREACHABLE)
+            _entry_list[next].prev = current_id;
+        _entry_list[0].next = current_id;
+        _cur_max_id = current_id;
+    }
+
+    /* remove the target id from the "unused" list */
+    int prev = _entry_list[index].prev;
+    int next = _entry_list[index].next;
+    _entry_list[prev].next = next;
+    if (next != UNREACHABLE)
+        _entry_list[next].prev = prev;
+
+    /* and let it join in the "used" list. */
+    next = _entry_list[1].next;
+    _entry_list[index] = {1, next, true};
+    if (next != UNREACHABLE)
+        _entry_list[next].prev = index;
+    _entry_list[1].next = index;
+    return true;
+}
+
 bool IDAllocator::isAllocated(int id)
 {
     id += 2;
@@ -83,21 +99,21 @@ bool IDAllocator::isAllocated(int id)
 
 void IDAllocator::free(int id)
 {
-    id += 2;
-    if (isAllocated(id))
+    if (!isAllocated(id))
         return;
+    id += 2;
     /* remove the target id */
     int prev = _entry_list[id].prev;
     int next = _entry_list[id].next;
     _entry_list[prev].next = next;
-    if (next != -1)
+    if (next != UNREACHABLE)
         _entry_list[next].prev = prev;
 
     /* and let it join in the "unused" list. */
     next = _entry_list[0].next;
     _entry_list[id] = {0, next, false};
-    if (next != -1)
-        _entry_list[next].prev = UNREACHABLE;
+    if (next != UNREACHABLE)
+        _entry_list[next].prev = id;
     _entry_list[0].next = id;
 }
 
@@ -106,7 +122,7 @@ void IDAllocator::traverseAllocated(IDAllocator::ItemTraverseFunc fn)
     for (int i = _entry_list[1].next;
          i != UNREACHABLE;
          i = _entry_list[i].next) {
-        fn(i);
+        fn(i - 2);
     }
 }
 
@@ -115,7 +131,7 @@ void IDAllocator::traverseUnallocated(IDAllocator::ItemTraverseFunc fn)
     for (int i = _entry_list[0].next;
          i != UNREACHABLE;
          i = _entry_list[i].next) {
-        fn(i);
+        fn(i - 2);
     }
 }
 
@@ -47,6 +47,10 @@ namespace MTB {
          * @brief 在给定的AllocList对象中分配一个新的ID，并将其添加到已分配的元素链表中。
          * @return 返回分配的ID */
         int  allocate();
+        /** @fn allocateAt(int)
+         * @brief 分配指定的id, id超出目前的范围时扩大范围。
+         * @return id已经被分配时返回false */
+        bool allocateAt(int id);
         /** @fn free(int)
          * @brief 释放已分配的ID, 并将该ID分配到未分配的链表中。 */
         void free(int id);
@@ -0,0 +1,130 @@
+#include "mtb-thread-pool.hxx"
+
+namespace MTB {
+
+ThreadPool::ThreadPool(size_t nworkers)
+{
+    if (nworkers == 0)
+        nworkers = 1;
+    for (size_t i = 0; i < nworkers; i++)
+        _queues.push_back(std::make_unique<TaskQueue>());
+    for (size_t i = 1; i < nworkers; i++)
+        _threads.emplace_back(&ThreadPool::_workerMain, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard lock(_mutex);
+        _stopping = true;
+    }
+    _start_cond.notify_all();
+    for (std::thread &thread: _threads)
+        thread.join();
+}
+
+void ThreadPool::parallelFor(size_t count, TaskFunc const &fn)
+{
+    if (count == 0)
+        return;
+    std::lock_guard submit_lock(_submit_mutex);
+    /* 任务按编号连续地分给各个线程 */
+    size_t nworkers = _queues.size();
+    for (size_t i = 0; i < nworkers; i++) {
+        std::lock_guard lock(_queues[i]->mutex);
+        _queues[i]->begin = count * i / nworkers;
+        _queues[i]->end   = count * (i + 1) / nworkers;
+    }
+    _failed = false;
+    _error  = nullptr;
+    {
+        std::lock_guard lock(_mutex);
+        _fn      = &fn;
+        _running = _threads.size();
+        _generation++;
+    }
+    _start_cond.notify_all();
+    _runTasks(0);
+    {
+        std::unique_lock lock(_mutex);
+        _done_cond.wait(lock, [this]() { return _running == 0; });
+        _fn = nullptr;
+    }
+    if (_error != nullptr)
+        std::rethrow_exception(_error);
+}
+
+void ThreadPool::_workerMain(size_t worker)
+{
+    size_t seen_generation = 0;
+    while (true) {
+        {
+            std::unique_lock lock(_mutex);
+            _start_cond.wait(lock, [this, seen_generation]() {
+                return _stopping || _generation != seen_generation;
+            });
+            if (_stopping)
+                return;
+            seen_generation = _generation;
+        }
+        _runTasks(worker);
+        {
+            std::lock_guard lock(_mutex);
+            _running--;
+        }
+        _done_cond.notify_one();
+    }
+}
+
+void ThreadPool::_runTasks(size_t worker)
+{
+    size_t task;
+    while (_popTask(worker, task) || (_stealTasks(worker) && _popTask(worker, task))) {
+        if (_failed.load(std::memory_order_relaxed))
+            continue; /* 出错以后把剩下的任务取完但不执行 */
+        try {
+            (*_fn)(task, worker);
+        } catch (...) {
+            std::lock_guard lock(_mutex);
+            if (!_failed.exchange(true))
+                _error = std::current_exception();
+        }
+    }
+}
+
+bool ThreadPool::_popTask(size_t worker, size_t &out_task)
+{
+    TaskQueue &queue = *_queues[worker];
+    std::lock_guard lock(queue.mutex);
+    if (queue.begin >= queue.end)
+        return false;
+    out_task = queue.begin++;
+    return true;
+}
+
+bool ThreadPool::_stealTasks(size_t worker)
+{
+    size_t nworkers = _queues.size();
+    for (size_t i = 1; i < nworkers; i++) {
+        TaskQueue &victim = *_queues[(worker + i) % nworkers];
+        size_t begin, end;
+        {
+            std::lock_guard lock(victim.mutex);
+            if (victim.begin >= victim.end)
+                continue;
+            size_t remain = victim.end - victim.begin;
+            /* 窃取后一半, 只剩一个任务时也拿走它 */
+            end   = victim.end;
+            begin = victim.end - (remain + 1) / 2;
+            victim.end = begin;
+        }
+        TaskQueue &mine = *_queues[worker];
+        std::lock_guard lock(mine.mutex);
+        mine.begin = begin;
+        mine.end   = end;
+        return true;
+    }
+    return false;
+}
+
+} // namespace MTB
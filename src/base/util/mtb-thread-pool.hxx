@@ -0,0 +1,74 @@
+#ifndef __MTB_UTIL_THREAD_POOL_H__
+#define __MTB_UTIL_THREAD_POOL_H__
+
+#include "../mtb-object.hxx"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace MTB {
+    /** @class ThreadPool
+     * @brief 工作窃取线程池, 用来并行处理编号为`[0, count)`的一批任务(morsel)。
+     *
+     *        每个工作线程有一个任务区间, 开始时按编号把任务连续地分给各个线程, 这样相邻的
+     *        任务大概率在同一个线程上执行。线程从自己区间的前端取任务; 自己的区间空了就
+     *        从别的线程区间的后端窃取一半, 所以任务耗时不均匀时负载也能平衡。
+     *        调用`parallelFor`的线程自己也是一个工作线程。
+     * @warning 同一时刻只能有一个`parallelFor`在执行, 后来的调用会等待。
+     *          不要在任务里再调用同一个线程池的`parallelFor`, 会死锁。 */
+    class ThreadPool: public Object {
+    public:
+        using TaskFunc = std::function<void(size_t task, size_t worker)>;
+    public:
+        /** @fn ThreadPool(nworkers)
+         * @brief 构造一个有`nworkers`个工作线程的线程池(包括调用者, 至少为1),
+         *        会启动`nworkers - 1`个后台线程 */
+        explicit ThreadPool(size_t nworkers);
+        ~ThreadPool() override;
+
+        /** @fn parallelFor(count, fn)
+         * @brief 对`[0, count)`里的每个任务调用一次`fn(task, worker)`, 所有任务完成后返回。
+         *        `worker`是执行任务的工作线程编号, 在`[0, get_worker_count())`之间,
+         *        可以用来索引每个线程自己的结果。
+         *        任务抛出异常时, 剩下的任务不再执行, 第一个异常会在这里重新抛出。 */
+        void parallelFor(size_t count, TaskFunc const &fn);
+
+        size_t get_worker_count() const { return _queues.size(); }
+    private:
+        /** 一个工作线程的任务区间`[begin, end)` */
+        struct alignas(64) TaskQueue {
+            std::mutex mutex;
+            size_t     begin = 0;
+            size_t     end   = 0;
+        }; // struct TaskQueue
+
+        std::vector<std::unique_ptr<TaskQueue>> _queues;
+        std::vector<std::thread> _threads;
+        std::mutex              _submit_mutex; // 串行化parallelFor
+        std::mutex              _mutex;        // 保护下面的任务状态
+        std::condition_variable _start_cond;   // 通知后台线程有新的一批任务
+        std::condition_variable _done_cond;    // 通知调用者所有线程都做完了
+        TaskFunc const *_fn = nullptr;         // 这一批任务
+        size_t          _generation = 0;       // 批次编号, 后台线程据此判断有没有新任务
+        size_t          _running    = 0;       // 还没有做完这一批任务的后台线程个数
+        bool            _stopping   = false;
+        std::atomic<bool>  _failed  = false;   // 有任务抛出了异常
+        std::exception_ptr _error;             // 第一个异常
+
+        void _workerMain(size_t worker);
+        /** 工作线程`worker`处理任务, 直到所有区间都空了 */
+        void _runTasks(size_t worker);
+        /** 从自己的区间前端取一个任务, 没有时返回false */
+        bool _popTask(size_t worker, size_t &out_task);
+        /** 从别的线程的区间后端窃取一半任务放进自己的区间, 都空了时返回false */
+        bool _stealTasks(size_t worker);
+    }; // class ThreadPool
+} // namespace MTB
+
+#endif
@@ -0,0 +1,158 @@
+#include "driver-server.hxx"
+#include "sql-lang/sql-lang-interpreter.hxx"
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <netinet/in.h>
+#include <ostream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+namespace mygsql {
+
+SocketStreamBuf::SocketStreamBuf(int fd)
+    : _fd(fd) {
+    setp(_buffer, _buffer + sizeof(_buffer));
+}
+
+SocketStreamBuf::int_type SocketStreamBuf::overflow(int_type ch)
+{
+    if (sync() != 0)
+        return traits_type::eof();
+    if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(ch);
+        pbump(1);
+    }
+    return traits_type::not_eof(ch);
+}
+
+int SocketStreamBuf::sync()
+{
+    const char *begin = pbase();
+    while (!_closed && begin < pptr()) {
+        /* 对方已经断开时不要收到SIGPIPE */
+        ssize_t nsent = send(_fd, begin, pptr() - begin, MSG_NOSIGNAL);
+        if (nsent < 0 && errno == EINTR)
+            continue;
+        if (nsent <= 0)
+            _closed = true;
+        else
+            begin += nsent;
+    }
+    setp(_buffer, _buffer + sizeof(_buffer));
+    return 0;
+}
+
+/** 从套接字读一行, 去掉行尾的`\r\n`. 连接关闭时返回false */
+static bool socket_read_line(int fd, std::string &buffer, std::string &out_line)
+{
+    while (true) {
+        size_t newline = buffer.find('\n');
+        if (newline != std::string::npos) {
+            out_line.assign(buffer, 0, newline);
+            buffer.erase(0, newline + 1);
+            if (!out_line.empty() && out_line.back() == '\r')
+                out_line.pop_back();
+            return true;
+        }
+        char chunk[4096];
+        ssize_t nread = recv(fd, chunk, sizeof(chunk), 0);
+        if (nread < 0 && errno == EINTR)
+            continue;
+        if (nread <= 0) {
+            /* 最后一行可能没有换行 */
+            if (buffer.empty())
+                return false;
+            out_line = std::move(buffer);
+            buffer.clear();
+            return true;
+        }
+        buffer.append(chunk, nread);
+    }
+}
+
+Server::Server(engine::Engine &engine, std::string_view socket_path)
+    : _engine(engine), _socket_path(socket_path), _port(0), _listen_fd(-1) {}
+
+Server::Server(engine::Engine &engine, uint16_t port)
+    : _engine(engine), _port(port), _listen_fd(-1) {}
+
+Server::~Server()
+{
+    if (_listen_fd >= 0)
+        close(_listen_fd);
+    if (!_socket_path.empty())
+        std::filesystem::remove(_socket_path);
+}
+
+void Server::_listen()
+{
+    if (!_socket_path.empty()) {
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        if (_socket_path.size() >= sizeof(address.sun_path))
+            throw Exception(_socket_path, ENAMETOOLONG);
+        strcpy(address.sun_path, _socket_path.c_str());
+        std::filesystem::remove(_socket_path);
+        _listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (_listen_fd < 0 ||
+            bind(_listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0)
+            throw Exception(_socket_path, errno);
+    } else {
+        sockaddr_in address{};
+        address.sin_family      = AF_INET;
+        address.sin_port        = htons(_port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        _listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+        int reuse = 1;
+        if (_listen_fd < 0 ||
+            setsockopt(_listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0 ||
+            bind(_listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0)
+            throw Exception(std::format("127.0.0.1:{}", _port), errno);
+    }
+    if (listen(_listen_fd, SOMAXCONN) < 0)
+        throw Exception("listen", errno);
+}
+
+void Server::run()
+{
+    _listen();
+    if (_socket_path.empty())
+        std::cout << std::format("listening on 127.0.0.1:{}", _port) << std::endl;
+    else
+        std::cout << std::format("listening on {}", _socket_path) << std::endl;
+    while (true) {
+        int fd = accept(_listen_fd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            throw Exception("accept", errno);
+        }
+        std::thread(&Server::_serveSession, this, fd).detach();
+    }
+}
+
+void Server::_serveSession(int fd)
+{
+    {
+        MTB::owned<engine::Engine> session = _engine.openSession();
+        SocketStreamBuf streambuf(fd);
+        std::ostream    out(&streambuf);
+        Interpreter     interpreter(*session, out);
+        std::string buffer, line;
+        while (interpreter.get_state() != Interpreter::State::EXIT) {
+            out << "> " << std::flush;
+            if (!socket_read_line(fd, buffer, line))
+                break;
+            interpreter.run(line);
+        }
+        out << std::flush;
+    }
+    close(fd);
+}
+
+} // namespace mygsql
@@ -0,0 +1,70 @@
+#ifndef __MYG_SQL_DRIVER_SERVER_H__
+#define __MYG_SQL_DRIVER_SERVER_H__
+
+#include "base/mtb-exception.hxx"
+#include "engine/engine.hxx"
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <streambuf>
+#include <string>
+#include <string_view>
+
+namespace mygsql {
+
+/** @class SocketStreamBuf
+ * @brief 把输出流写进一个套接字的流缓冲区。缓冲区满了或者刷新流(`std::endl`)时才发送,
+ *        对方断开连接以后的输出都被丢弃。 */
+class SocketStreamBuf: public std::streambuf {
+public:
+    explicit SocketStreamBuf(int fd);
+    ~SocketStreamBuf() override { sync(); }
+protected:
+    int_type overflow(int_type ch) override;
+    int      sync() override;
+private:
+    int  _fd;
+    bool _closed = false;
+    char _buffer[4096];
+}; // class SocketStreamBuf
+
+/** @class Server
+ * @brief 服务器模式: 在Unix域套接字或者本机的TCP端口上接受客户端连接, 每个连接一个线程。
+ *        每个连接有自己的执行引擎会话(`Engine::openSession`)与解释器, 协议与标准输入相同:
+ *        服务器先发送提示符`> `, 客户端发送一行命令, 服务器发送命令的输出。
+ *        客户端发送`exit`或者关闭连接时会话结束。 */
+class Server {
+public:
+    /** @class Exception
+     * @brief 服务器无法监听 */
+    class Exception: public MTB::Exception {
+    public:
+        Exception(std::string_view what, int error)
+            : MTB::Exception(MTB::ErrorLevel::FATAL,
+                std::format("ServerException: {}: {}", what, strerror(error))) {}
+    }; // class Exception
+public:
+    /** @brief 监听Unix域套接字`socket_path`. 文件已经存在时会先删除它 */
+    Server(engine::Engine &engine, std::string_view socket_path);
+    /** @brief 监听`127.0.0.1:port` */
+    Server(engine::Engine &engine, uint16_t port);
+    ~Server();
+
+    /** @fn run()
+     * @brief 接受连接, 直到监听套接字出错。
+     * @throw Exception 无法监听 */
+    void run();
+private:
+    engine::Engine &_engine;
+    std::string     _socket_path; // 为空时监听TCP端口
+    uint16_t        _port;
+    int             _listen_fd;
+
+    void _listen();
+    /** 在自己的线程上服务一个客户端连接, 结束时关闭`fd` */
+    void _serveSession(int fd);
+}; // class Server
+
+} // namespace mygsql
+
+#endif
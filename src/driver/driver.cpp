@@ -3,9 +3,16 @@
 #include "base/mtb-object.hxx"
 #include "sql-lang/sql-lang-interpreter.hxx"
 #include "engine/engine.hxx"
+#include "engine/engine-sort.hxx"
+#include "engine/engine-table.hxx"
+#include "storage/storage-scan.hxx"
+#include "driver-server.hxx"
+#include <algorithm>
 #include <filesystem>
 #include <iostream>
+#include <cstdlib>
 #include <string>
+#include <string_view>
 #include <vector>
 
 using namespace mygsql;
@@ -22,11 +29,29 @@ static std::string help_text =
 "create table <table-name> (\n    <column> <type>,\n    ...\n"+
 "); (创建表，目前只考虑 int 和 string 类型)\n"+
 "drop table <table-name> (删除表)\n"+
-"select <column> from <table>[where <cond>] (根据条件(如果有)查询表，显示查询结果)\n"+
+"create index <index-name> on <table>(<column>) [using btree|hash] (在一列上创建二级索引, 以这一列为条件的查询会自动使用它; 哈希索引只用于等值条件)\n"+
+"select <column>, ... from <table>[where <cond>] (根据条件(如果有)查询表，显示查询结果. 列可以是`*`或者列的列表, 只读取被选中的列)\n"+
+"select <column|agg(<column>)>, ... from <table> [where <cond>] [group by <column>, ...]"+
+" (聚合查询, agg是count/sum/min/max/avg, 还可以写count(*). 普通列必须出现在group by里)\n"+
+"select <column>, ... from <a> join <b> on <a.column> = <b.column> [where <cond>]"+
+" (两张表的等值连接. 列可以写成`表名.列名`; where条件的每个and子条件只能涉及一张表)\n"+
+"select ... [order by <column|agg(<column>)> [asc|desc]] [limit <n>]"+
+" (按一列或者聚合查询的一项排序, 只输出前n行. 升序排列的列有B+树索引时不需要排序)\n"+
 "delete <table> [where <cond>] (根据条件(如果有)删除表中的记录)\n"+
+"<cond>: <column> <op> <const-value|column>, 可以用and/or/not与括号组合, op是= != <> < <= > >=\n"+
 "insert <table> values (<const-value>,<const-value>, ...)"+
 " (在表中插入数据，注意和上面一样，最后一个的右边也没有',')\n"+
-"sync (把表中的数据同步到映射缓冲区)\n";
+"load <table> from '<file>' (从CSV/TSV文件批量导入数据, 扩展名为.tsv时按制表符分隔)\n"+
+"sync (把表中的数据写回磁盘, 并清空预写日志)\n"+
+"begin / commit / rollback (开始、提交与回滚事务。事务修改已有的条目以前先把前像落盘到撤销日志; 崩溃或者掉电时没有提交的事务在重启后被撤销, 修改多张表的事务也整体提交或者撤销, 其他会话在提交以前看不到)\n"+
+"prepare <name> as <select/insert/update/delete语句> (编译并保存一条语句, 常量可以写成参数`?`)\n"+
+"execute <name> [(<const-value>, ...)] (按次序填入参数, 执行保存的语句)\n"+
+"\n启动参数:\n"+
+"--eager-load (打开表时把所有条目读进内存缓存。默认在查询时直接读映射区)\n"+
+"--scan-threads=<n> (全表扫描使用的线程数。默认为0, 表示使用所有CPU核; 1表示不并行)\n"+
+"--sort-memory=<MiB> (没有limit的order by在内存里缓冲的大小, 超过时写成临时文件再归并。默认为64)\n"+
+"--socket=<path> (服务器模式: 在Unix域套接字上接受多个客户端连接, 每个连接有自己的当前数据库)\n"+
+"--port=<n> (服务器模式: 在127.0.0.1:<n>上接受多个客户端连接)\n";
 
 /** @class Driver
  * @brief  驱动类。用于保存运行时的上下文，同时管理输入。 */
@@ -39,11 +64,23 @@ public:
         for (int i = 0; i < argc; i++) {
             // args.push_back(argv[i]);
             argset.insert(argv[i]);
+            std::string_view arg = argv[i];
+            if (arg.starts_with("--scan-threads="))
+                ScanSetThreadCount(std::strtoul(arg.data() + arg.find('=') + 1, nullptr, 10));
+            else if (arg.starts_with("--sort-memory=")) {
+                size_t mib = std::strtoul(arg.data() + arg.find('=') + 1, nullptr, 10);
+                Sorter::SetMemoryBudget(std::max<size_t>(mib, 1) * 1024 * 1024);
+            } else if (arg.starts_with("--socket="))
+                socket_path = arg.substr(arg.find('=') + 1);
+            else if (arg.starts_with("--port="))
+                port = std::strtoul(arg.data() + arg.find('=') + 1, nullptr, 10);
         }
         if (argset.contains("-h") || argset.contains("--help"))
             state = HELP;
         else
             state = RUN;
+        if (argset.contains("--eager-load"))
+            Table::SetDefaultAccessMode(Table::AccessMode::EAGER);
         engine      = new Engine(file_dir_name);
         interpreter = new Interpreter(*engine);
     }
@@ -53,6 +90,15 @@ public:
             std::cout << help_text << std::endl;
             return 0;
         }
+        if (!socket_path.empty() || port != 0) try {
+            Server server = socket_path.empty() ? Server(*engine, port)
+                                                : Server(*engine, socket_path);
+            server.run();
+            return 0;
+        } catch (Server::Exception &e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
         while (interpreter->get_state() != Interpreter::State::EXIT) {
             if (prompt_input() == false)
                 return 0;
@@ -81,6 +127,8 @@ public:
     std::vector<std::string>       args;
     std::multiset<std::string>   argset;
     std::string                inputstr;
+    std::string             socket_path; // 服务器模式的Unix域套接字
+    uint16_t                       port = 0; // 服务器模式的TCP端口
 }; // class Driver
 
 
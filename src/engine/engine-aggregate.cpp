@@ -0,0 +1,171 @@
+#include "engine-aggregate.hxx"
+#include <cstring>
+#include <format>
+#include <limits>
+
+namespace mygsql::engine {
+
+/** 把值视图追加到分组键的末尾。字符串先写长度, 所以不同的分组不会编码成同一个键 */
+static void group_key_append(std::string &key, ValueView const &view)
+{
+    if (view.type == Value::Type::INT) {
+        key.append(reinterpret_cast<char const*>(&view.int_value), sizeof(int32_t));
+        return;
+    }
+    uint32_t length = view.string_value.size();
+    key.append(reinterpret_cast<char const*>(&length), sizeof(uint32_t));
+    key.append(view.string_value);
+}
+
+/** 从分组键的`offset`处解码一个类型为`type`的值, 并把`offset`移到下一个值 */
+static owned<Value> group_key_decode(std::string_view key, size_t &offset, Value::Type type,
+                                     std::pmr::memory_resource *arena)
+{
+    if (type == Value::Type::INT) {
+        int32_t value;
+        std::memcpy(&value, key.data() + offset, sizeof(int32_t));
+        offset += sizeof(int32_t);
+        return owned<Value>(Value::New<IntValue>(arena, value));
+    }
+    uint32_t length;
+    std::memcpy(&length, key.data() + offset, sizeof(uint32_t));
+    offset += sizeof(uint32_t);
+    owned<Value> ret(Value::New<StringValue>(arena, key.substr(offset, length)));
+    offset += length;
+    return ret;
+}
+
+/** 64位的计数与和: 在32位整数的范围内时是整数, 否则是十进制文本 */
+static owned<Value> int64_make_value(int64_t value, std::pmr::memory_resource *arena)
+{
+    if (value >= std::numeric_limits<int32_t>::min() &&
+        value <= std::numeric_limits<int32_t>::max())
+        return owned<Value>(Value::New<IntValue>(arena, int32_t(value)));
+    return owned<Value>(Value::New<StringValue>(arena, std::format("{}", value)));
+}
+
+HashAggregate::HashAggregate(ItemListT const &items, ColumnListT const &group_by)
+    : _items(items), _group_by(group_by)
+{
+    /* 没有group by时只有一个分组, 没有条目也要输出它 */
+    if (_group_by.empty()) {
+        auto [iter, inserted] = _group_map.emplace(std::string(), 0);
+        _group_keys.push_back(&iter->first);
+        _accumulators.resize(_items.size());
+    }
+}
+
+uint32_t HashAggregate::_findGroup()
+{
+    auto iter = _group_map.find(_key_buffer);
+    if (iter != _group_map.end())
+        return iter->second;
+    uint32_t group = _group_keys.size();
+    iter = _group_map.emplace(_key_buffer, group).first;
+    _group_keys.push_back(&iter->first);
+    _accumulators.resize(_accumulators.size() + _items.size());
+    return group;
+}
+
+template<typename ViewFnT>
+void HashAggregate::_accumulate(ViewFnT const &view_of)
+{
+    uint32_t group = 0;
+    if (!_group_by.empty()) {
+        _key_buffer.clear();
+        for (ColumnRef const &column: _group_by)
+            group_key_append(_key_buffer, view_of(column.index));
+        group = _findGroup();
+    }
+
+    Accumulator *accumulators = &_accumulators[size_t(group) * _items.size()];
+    for (size_t i = 0; i < _items.size(); i++) {
+        AggregateItem const &item = _items[i];
+        Accumulator &acc = accumulators[i];
+        switch (item.function) {
+        case AggregateFunction::NONE:
+            continue;
+        case AggregateFunction::COUNT:
+            break;
+        case AggregateFunction::SUM:
+        case AggregateFunction::AVG:
+            acc.sum += view_of(item.column.index).int_value;
+            break;
+        case AggregateFunction::MIN:
+        case AggregateFunction::MAX: {
+            CompactValue value = CompactValue::FromView(view_of(item.column.index));
+            int64_t order = (item.function == AggregateFunction::MIN) ? -1 : 1;
+            if (acc.count != 0 && value.compare(acc.get_extreme()) != order)
+                break;
+            if (value.type() == Value::Type::STRING &&
+                value.string_value().size() > CompactValue::INLINE_MAX) {
+                acc.long_string.assign(value.string_value());
+            } else {
+                acc.extreme = value;
+                acc.long_string.clear();
+            }
+            break;
+        }
+        }
+        acc.count++;
+    }
+}
+
+void HashAggregate::visitEntry(StorageTable::Entry const &entry)
+{
+    _accumulate([&entry](int32_t index) { return entry.view(index); });
+}
+
+void HashAggregate::visitValues(ValueListT const &values)
+{
+    _accumulate([&values](int32_t index) {
+        return ValueView::FromValue(values[index].get());
+    });
+}
+
+void HashAggregate::traverseResults(Table::SnapshotRowFunc const &fn,
+                                    std::pmr::memory_resource *arena) const
+{
+    ValueListT group_values;
+    for (size_t group = 0; group < _group_keys.size(); group++) {
+        std::string_view key = *_group_keys[group];
+        size_t offset = 0;
+        group_values.clear();
+        for (ColumnRef const &column: _group_by)
+            group_values.push_back(group_key_decode(key, offset, column.type, arena));
+
+        Accumulator const *accumulators = &_accumulators[group * _items.size()];
+        ValueListT values = ValueListCreate(arena);
+        values.reserve(_items.size());
+        for (size_t i = 0; i < _items.size(); i++) {
+            AggregateItem const &item = _items[i];
+            Accumulator const &acc = accumulators[i];
+            bool is_empty = (acc.count == 0);
+            switch (item.function) {
+            case AggregateFunction::NONE:
+                values.push_back(group_values[item.group_index]);
+                break;
+            case AggregateFunction::COUNT:
+                values.push_back(int64_make_value(acc.count, arena));
+                break;
+            case AggregateFunction::SUM:
+                values.push_back(int64_make_value(acc.sum, arena));
+                break;
+            case AggregateFunction::AVG:
+                values.push_back(owned<Value>(Value::New<StringValue>(arena, is_empty ? "NULL"
+                    : std::format("{}", double(acc.sum) / double(acc.count)))));
+                break;
+            case AggregateFunction::MIN:
+            case AggregateFunction::MAX:
+                if (is_empty)
+                    values.push_back(owned<Value>(Value::New<StringValue>(arena, "NULL")));
+                else
+                    values.push_back(acc.get_extreme().materialize(arena));
+                break;
+            }
+        }
+        fn(std::move(values));
+    }
+}
+
+} // namespace mygsql::engine
@@ -0,0 +1,106 @@
+#ifndef __MYG_SQL_ENGINE_AGGREGATE_H__
+#define __MYG_SQL_ENGINE_AGGREGATE_H__
+
+#include "base/sql-value.hxx"
+#include "engine-condition.hxx"
+#include "engine-table.hxx"
+#include "storage/storage-table.hxx"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace mygsql::engine {
+
+/** @enum AggregateFunction
+ * @brief 聚合函数 */
+enum class AggregateFunction: int32_t {
+    NONE,  // 不是聚合函数, 输出分组列本身
+    COUNT, SUM, MIN, MAX, AVG
+}; // enum class AggregateFunction
+
+/** @struct AggregateItem
+ * @brief 聚合查询的一个输出列: 分组列, 或者聚合函数`function(column)` */
+struct AggregateItem {
+    AggregateFunction function = AggregateFunction::NONE;
+    /** 参数列。`count(*)`的列名称为空, 不绑定 */
+    ColumnRef   column;
+    /** 输出列的名称, 比如`count(*)`、`sum(a)` */
+    std::string name;
+    /** NONE: 这一列在group by列表里的位置, 绑定时填入 */
+    int32_t     group_index = -1;
+
+    bool has_column() const { return !column.name.empty(); }
+}; // struct AggregateItem
+
+/** @class HashAggregate
+ * @brief 流式的哈希聚合算子。作为快照扫描的访问者, 每看到一个条目就直接在映射区上读出
+ *        分组列与参数列, 更新所在分组的累加器, 不为任何一格创建`Value`; 内存里只有每个
+ *        分组的键与累加器, 与条目个数无关。
+ *
+ *        分组键是分组列的值依次编码成的字节串(整数4个字节, 字符串是长度加内容), 编码用的
+ *        缓冲区在条目之间复用, 只有新的分组才会复制一次键。没有group by时所有条目属于
+ *        同一个分组, 不查哈希表。 */
+class HashAggregate final: public Table::RowVisitor {
+public:
+    using ValueListT  = Table::ValueListT;
+    using ItemListT   = std::vector<AggregateItem>;
+    using ColumnListT = std::vector<ColumnRef>;
+
+    /** @param items    输出列, 已经绑定到扫描的表上
+     *  @param group_by 分组列, 已经绑定到扫描的表上
+     * @warning 算子引用`items`与`group_by`, 它们要比算子活得更久 */
+    HashAggregate(ItemListT const &items, ColumnListT const &group_by);
+
+    void visitEntry(StorageTable::Entry const &entry) override;
+    void visitValues(ValueListT const &values) override;
+
+    /** @brief getter: 目前为止的分组个数 */
+    size_t get_group_count() const { return _group_keys.size(); }
+
+    /** @fn traverseResults(fn, arena)
+     * @brief 按每个分组第一次出现的次序对每个分组调用`fn(values)`, `values`是输出列的值。
+     *        没有group by时即使没有条目也输出一行: 计数与和为0, 其余为`NULL`.
+     *        和超出32位整数的范围时输出它的十进制文本; 平均值是文本形式的小数。
+     *        `arena`不为空时输出的行与值从这个内存池分配 */
+    void traverseResults(Table::SnapshotRowFunc const &fn,
+                         std::pmr::memory_resource *arena = nullptr) const;
+private:
+    /** @struct Accumulator
+     * @brief 一个分组的一个输出列的中间结果 */
+    struct Accumulator {
+        int64_t      count = 0;       // 累加过的条目个数
+        int64_t      sum   = 0;       // SUM, AVG
+        CompactValue extreme;         // MIN, MAX: 整数或者短字符串
+        std::string  long_string;     // MIN, MAX: 长字符串的内容, 不为空时`extreme`无效
+
+        /** MIN, MAX: 目前的最值。长字符串每次从`long_string`打包, 所以累加器
+         *  在`_accumulators`扩容时移动也不会悬空 */
+        CompactValue get_extreme() const {
+            return long_string.empty() ? extreme : CompactValue::FromString(long_string);
+        }
+    }; // struct Accumulator
+
+    ItemListT const   &_items;
+    ColumnListT const &_group_by;
+    /** 分组键到分组编号的映射 */
+    std::unordered_map<std::string, uint32_t> _group_map;
+    /** 每个分组的键, 按分组编号排列, 指向`_group_map`里的键 */
+    std::vector<std::string const*> _group_keys;
+    /** 第g个分组的第i个输出列的累加器在`g * _items.size() + i` */
+    std::vector<Accumulator> _accumulators;
+    /** 编码分组键的缓冲区 */
+    std::string _key_buffer;
+
+    /** 找到`_key_buffer`所表示的分组, 没有时新建, 返回分组编号 */
+    uint32_t _findGroup();
+    /** 把一个条目累加进它的分组, `view_of(column_index)`读一列的值 */
+    template<typename ViewFnT>
+    void _accumulate(ViewFnT const &view_of);
+}; // class HashAggregate
+
+} // namespace mygsql::engine
+
+#endif
@@ -0,0 +1,187 @@
+#include "engine-condition.hxx"
+#include <algorithm>
+
+namespace mygsql::engine {
+
+/** 没有统计信息时按关系估计选择率: 等值很少满足, 不等很容易满足, 范围条件取三分之一 */
+static double relation_estimate_selectivity(TotalOrderRelation relation, double equal)
+{
+    switch (relation) {
+    case TotalOrderRelation::EQ: return equal;
+    case TotalOrderRelation::NE: return 1.0 - equal;
+    default:                     return 1.0 / 3.0;
+    }
+}
+
+/** ID在`[first, last)`之间的已分配条目 */
+static MTB::Bitmap allocated_entries(StorageTable const &table, uint32_t first, uint32_t last)
+{
+    MTB::Bitmap ret(last - first);
+    for (uint32_t id = first; id < last; id++) {
+        if (table.isEntryAllocated(id))
+            ret.set(id - first);
+    }
+    return ret;
+}
+
+void Condition::optimize(StorageTable const &table)
+{
+    switch (kind) {
+    case Kind::COMPARE: {
+        /* 主键的等值条件最多选中一个条目 */
+        double equal = 0.05;
+        if (table.has_primary_key() && column.index == int32_t(table.get_primary_index_order()))
+            equal = 1.0 / double(std::max<size_t>(table.get_entry_count(), 1));
+        _selectivity = relation_estimate_selectivity(relation, equal);
+        return;
+    }
+    case Kind::COMPARE_COLUMNS:
+        _selectivity = relation_estimate_selectivity(relation, 0.1);
+        return;
+    case Kind::NOT:
+        children[0]->optimize(table);
+        _selectivity = 1.0 - children[0]->_selectivity;
+        return;
+    case Kind::AND:
+    case Kind::OR:
+        break;
+    }
+    for (std::unique_ptr<Condition> &child: children)
+        child->optimize(table);
+    /* AND先求选择率低的, OR先求选择率高的; 选择率相同时先求常量比较, 它可以用扫描内核 */
+    bool is_and = (kind == Kind::AND);
+    std::stable_sort(children.begin(), children.end(),
+        [is_and](std::unique_ptr<Condition> const &a, std::unique_ptr<Condition> const &b) {
+            if (a->_selectivity != b->_selectivity)
+                return is_and ? a->_selectivity < b->_selectivity
+                              : a->_selectivity > b->_selectivity;
+            return a->kind == Kind::COMPARE && b->kind != Kind::COMPARE;
+        });
+    double product = 1.0;
+    for (std::unique_ptr<Condition> const &child: children)
+        product *= is_and ? child->_selectivity : 1.0 - child->_selectivity;
+    _selectivity = is_and ? product : 1.0 - product;
+}
+
+void Condition::filterRange(StorageTable const &table, uint32_t first, uint32_t last,
+                            MTB::Bitmap &out) const
+{
+    /* 版本存储里可能有超出条目总数的ID, 这些条目当前都不存在 */
+    uint32_t end = std::max(first, std::min(last, table.get_entry_list_num()));
+    _filter(table, first, end, nullptr, out);
+    out.resize(last - first);
+}
+
+void Condition::_filter(StorageTable const &table, uint32_t first, uint32_t last,
+                        MTB::Bitmap const *candidates, MTB::Bitmap &out) const
+{
+    switch (kind) {
+    case Kind::COMPARE:
+        /* 候选条目很稀疏时逐个比较, 否则扫描整段再与候选条目求交 */
+        if (candidates != nullptr &&
+            candidates->count() * DENSE_CANDIDATE_RATIO < size_t(last - first)) {
+            _filterRows(table, first, last, candidates, out);
+            return;
+        }
+        table.filterEntryRange(first, last, column.index, relation, value, out);
+        if (candidates != nullptr)
+            out.andWith(*candidates);
+        return;
+    case Kind::COMPARE_COLUMNS:
+        _filterRows(table, first, last, candidates, out);
+        return;
+    case Kind::AND: {
+        children[0]->_filter(table, first, last, candidates, out);
+        MTB::Bitmap next;
+        for (size_t i = 1; i < children.size() && out.any(); i++) {
+            children[i]->_filter(table, first, last, &out, next);
+            std::swap(out, next);
+        }
+        return;
+    }
+    case Kind::OR: {
+        children[0]->_filter(table, first, last, candidates, out);
+        /* 还没有满足任何子条件的候选条目 */
+        MTB::Bitmap undecided = (candidates != nullptr) ? *candidates
+                                                        : allocated_entries(table, first, last);
+        MTB::Bitmap matched;
+        undecided.andNot(out);
+        for (size_t i = 1; i < children.size() && undecided.any(); i++) {
+            children[i]->_filter(table, first, last, &undecided, matched);
+            out.orWith(matched);
+            undecided.andNot(matched);
+        }
+        return;
+    }
+    case Kind::NOT: {
+        MTB::Bitmap matched;
+        children[0]->_filter(table, first, last, candidates, matched);
+        out = (candidates != nullptr) ? *candidates : allocated_entries(table, first, last);
+        out.andNot(matched);
+        return;
+    }
+    }
+}
+
+void Condition::_filterRows(StorageTable const &table, uint32_t first, uint32_t last,
+                            MTB::Bitmap const *candidates, MTB::Bitmap &out) const
+{
+    out.resize(last - first);
+    out.clear();
+    auto test = [this, &table, first, &out](size_t bit) {
+        if (matches(StorageTable::Entry(table, first + bit)))
+            out.set(bit);
+    };
+    if (candidates != nullptr) {
+        candidates->traverseSet(test);
+        return;
+    }
+    for (uint32_t id = first; id < last; id++) {
+        if (table.isEntryAllocated(id))
+            test(id - first);
+    }
+}
+
+template<typename LeafFnT>
+bool Condition::_evaluate(LeafFnT const &compare_leaf) const
+{
+    switch (kind) {
+    case Kind::COMPARE:
+    case Kind::COMPARE_COLUMNS:
+        return compare_leaf(*this);
+    case Kind::AND:
+        return std::all_of(children.begin(), children.end(),
+            [&compare_leaf](auto const &child) { return child->_evaluate(compare_leaf); });
+    case Kind::OR:
+        return std::any_of(children.begin(), children.end(),
+            [&compare_leaf](auto const &child) { return child->_evaluate(compare_leaf); });
+    case Kind::NOT:
+        return !children[0]->_evaluate(compare_leaf);
+    }
+    return false;
+}
+
+bool Condition::matches(StorageTable::Entry const &entry) const
+{
+    /* 常量与两边列的类型在`Plan::checkValues`里检查过, 这里只比较 */
+    return _evaluate([&entry](Condition const &leaf) {
+        CompactValue left = CompactValue::FromView(entry.view(leaf.column.index));
+        if (leaf.kind == Kind::COMPARE)
+            return left.meets(leaf.relation, leaf.constant);
+        return left.meets(leaf.relation,
+                          CompactValue::FromView(entry.view(leaf.other_column.index)));
+    });
+}
+
+bool Condition::matches(ValueListT const &values) const
+{
+    return _evaluate([&values](Condition const &leaf) {
+        CompactValue left = CompactValue::FromValue(values[leaf.column.index].get());
+        if (leaf.kind == Kind::COMPARE)
+            return left.meets(leaf.relation, leaf.constant);
+        return left.meets(leaf.relation,
+                          CompactValue::FromValue(values[leaf.other_column.index].get()));
+    });
+}
+
+} // namespace mygsql::engine
@@ -0,0 +1,137 @@
+#ifndef __MYG_SQL_ENGINE_CONDITION_H__
+#define __MYG_SQL_ENGINE_CONDITION_H__
+
+#include "base/mtb-object.hxx"
+#include "base/sql-value.hxx"
+#include "base/util/mtb-bitmap.hxx"
+#include "storage/storage-table.hxx"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace mygsql::engine {
+using MTB::owned;
+
+/** @struct ColumnRef
+ * @brief 语句里出现的列: 名称(可以用表名限定, 比如`a.x`), 以及绑定以后的列下标与类型 */
+struct ColumnRef {
+    std::string name;
+    /** 限定列的表名, 为空表示没有限定 */
+    std::string table;
+    int32_t     index = -1;
+    Value::Type type  = Value::Type::NONE;
+    /** 连接查询: 列属于哪一张表, 0是from的表, 1是join的表 */
+    int32_t     side  = 0;
+
+    /** @brief 语句里写的名字, 有限定时是`表名.列名` */
+    std::string get_full_name() const {
+        return table.empty() ? name : table + "." + name;
+    }
+}; // struct ColumnRef
+
+/** @class Condition
+ * @brief where条件的表达式树。叶子是比较`列 关系 常量`或者`列 关系 列`, 内部结点是
+ *        AND、OR与NOT. AND与OR可以有任意多个子条件。
+ *
+ *        绑定列以后用`optimize`估计每个子条件的选择率并重排子条件: AND先求最可能为假的,
+ *        OR先求最可能为真的, 这样短路求值跳过的条目最多。求值有两种方式:
+ *        - `filterRange`在一段条目上求条件, 结果是位图。常量比较的叶子用存储表的扫描内核;
+ *          AND的后一个子条件只在前面的子条件都满足的条目上求值, OR的后一个子条件只在
+ *          前面的子条件都不满足的条目上求值, 前面已经决定了所有条目时后面的子条件不再求值。
+ *        - `matches`对一个条目求值, 用于索引选出的候选条目与版本存储里的旧版本。 */
+class Condition {
+public:
+    using ValueListT = mygsql::ValueListT;
+    using ChildListT = std::vector<std::unique_ptr<Condition>>;
+
+    /** @enum Kind
+     * @brief 条件结点的种类 */
+    enum class Kind: int32_t {
+        COMPARE,         // 列 关系 常量
+        COMPARE_COLUMNS, // 列 关系 列
+        AND, OR, NOT
+    }; // enum class Kind
+
+    /** 候选条目超过这个比例时, 常量比较用扫描内核扫描整段条目, 否则逐个比较候选条目 */
+    static constexpr size_t DENSE_CANDIDATE_RATIO = 8;
+public:
+    explicit Condition(Kind kind): kind(kind) {}
+
+    Kind               kind;
+    /** COMPARE, COMPARE_COLUMNS: 左边的列 */
+    ColumnRef          column;
+    TotalOrderRelation relation = TotalOrderRelation::NONE;
+    /** COMPARE: 右边的常量, 可以是参数`?`(执行以前为空) */
+    owned<Value>       value;
+    /** COMPARE: 打包成`CompactValue`的`value`, 逐个条目求值时用它比较。
+     *  每次执行以前由`Plan::checkValues`更新, 长字符串引用`value`的内容 */
+    CompactValue       constant;
+    /** COMPARE_COLUMNS: 右边的列 */
+    ColumnRef          other_column;
+    /** AND, OR: 至少两个子条件; NOT: 一个子条件 */
+    ChildListT         children;
+
+    bool is_leaf() const {
+        return kind == Kind::COMPARE || kind == Kind::COMPARE_COLUMNS;
+    }
+    /** @brief getter: 估计的选择率, 即满足条件的条目所占的比例. `optimize`以后才有意义 */
+    double get_selectivity() const { return _selectivity; }
+
+    /** @fn traverseLeaves(fn)
+     * @brief 按子条件的次序对每个叶子调用`fn(leaf)` */
+    template<typename FnT>
+    void traverseLeaves(FnT &&fn) {
+        if (is_leaf()) {
+            fn(*this);
+            return;
+        }
+        for (std::unique_ptr<Condition> &child: children)
+            child->traverseLeaves(fn);
+    }
+    template<typename FnT>
+    void traverseLeaves(FnT &&fn) const {
+        if (is_leaf()) {
+            fn(*this);
+            return;
+        }
+        for (std::unique_ptr<Condition> const &child: children)
+            static_cast<Condition const&>(*child).traverseLeaves(fn);
+    }
+
+    /** @fn optimize(table)
+     * @brief 估计每个结点的选择率, 然后重排AND与OR的子条件。列绑定到`table`以后调用 */
+    void optimize(StorageTable const &table);
+
+    /** @fn filterRange(table, first, last, out)
+     * @brief 对ID在`[first, last)`之间的已分配条目求条件. `out`有`last - first`位,
+     *        第i位为1表示ID为`first + i`的条目满足条件。
+     * @throw Value::InconsistantTypeException 比较的两边类型不一致 */
+    void filterRange(StorageTable const &table, uint32_t first, uint32_t last,
+                     MTB::Bitmap &out) const;
+
+    /** @fn matches(entry)
+     * @brief 存储表的条目是否满足条件。直接读映射区, 不创建`Value`; 常量比较用`constant` */
+    bool matches(StorageTable::Entry const &entry) const;
+    /** @fn matches(values)
+     * @brief 值列表(比如版本存储里的旧版本)是否满足条件。`values`按列的次序排列 */
+    bool matches(ValueListT const &values) const;
+private:
+    double _selectivity = 1.0;
+
+    /** `filterRange`的实现: `candidates`不为空时只在它选中的条目上求值,
+     *  结果是`candidates`的子集; 为空时在所有已分配的条目上求值 */
+    void _filter(StorageTable const &table, uint32_t first, uint32_t last,
+                 MTB::Bitmap const *candidates, MTB::Bitmap &out) const;
+    /** 逐个条目求值, 用于列与列的比较与稀疏的候选条目 */
+    void _filterRows(StorageTable const &table, uint32_t first, uint32_t last,
+                     MTB::Bitmap const *candidates, MTB::Bitmap &out) const;
+    /** 按子条件的次序短路求值, `compare_leaf(leaf)`求一个叶子 */
+    template<typename LeafFnT>
+    bool _evaluate(LeafFnT const &compare_leaf) const;
+}; // class Condition
+
+} // namespace mygsql::engine
+
+#endif
@@ -9,7 +9,7 @@ namespace mygsql::engine {
 DataBaseManager::DataBaseManager(std::string_view path)
     : _storage_manager(path) {
     for (auto &i: _storage_manager.get_database_map()) {
-        owned<DataBase> db = new DataBase(*(i.second.get()));
+        owned<DataBase> db = new DataBase(*(i.second.get()), _version_manager);
         _database_map.insert({i.first, std::move(db)});
     }
 }
@@ -19,7 +19,7 @@ DataBase *DataBaseManager::createDataBase(std::string_view name)
     StorageDataBase *sdb = _storage_manager.createDataBase(name);
     if (sdb == nullptr)
         return nullptr;
-    owned<DataBase> db = new DataBase(*sdb);
+    owned<DataBase> db = new DataBase(*sdb, _version_manager);
     DataBase *unowned_db = db.get();
     _database_map.insert({db->get_name(), std::move(db)});
     return unowned_db;
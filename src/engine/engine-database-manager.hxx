@@ -3,7 +3,9 @@
 
 #include "base/mtb-object.hxx"
 #include "engine-database.hxx"
+#include "engine-version.hxx"
 #include "storage/storage-manager.hxx"
+#include <shared_mutex>
 #include <string_view>
 #include <unordered_map>
 
@@ -31,9 +33,15 @@ public:
     StorageManager &storage_manager() {
         return _storage_manager;
     }
+    /** 所有表共享的版本管理器 */
+    VersionManager &version_manager() { return _version_manager; }
+    /** 数据库目录的读写锁。创建与删除数据库持有写锁, 其他语句持有读锁 */
+    std::shared_mutex &rwlock() const { return _rwlock; }
 private:
     StorageManager  _storage_manager;
+    VersionManager  _version_manager; // 要比所有的表活得久
     DataBaseMapT    _database_map;
+    mutable std::shared_mutex _rwlock;
 }; // class DataBaseManager
 
 
@@ -8,10 +8,11 @@
 namespace mygsql::engine {
 using MTB::owned;
 
-DataBase::DataBase(StorageDataBase &storage_database)
-    : _storage_database(storage_database) {
+DataBase::DataBase(StorageDataBase &storage_database, VersionManager &version_manager)
+    : _storage_database(storage_database),
+      _version_manager(version_manager) {
     for (auto &i: storage_database.get_table_map()) {
-        Table *table = new Table(*i.second.get());
+        Table *table = new Table(*i.second.get(), _version_manager);
         _table_map.insert({i.first, table});
     }
 }
@@ -22,7 +23,7 @@ Table *DataBase::createTable(std::string_view name,
     StorageTable *storage_table = _storage_database.createTable(name, type_item_list);
     if (storage_table == nullptr)
         return nullptr;
-    owned<Table> table = new Table(*storage_table);
+    owned<Table> table = new Table(*storage_table, _version_manager);
     Table *ret = table.get();
     _table_map.insert({table->get_name(), std::move(table)});
     return ret;
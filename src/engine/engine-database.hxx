@@ -5,6 +5,7 @@
 #include "engine-table.hxx"
 #include "storage/storage-database.hxx"
 #include "storage/storage-table.hxx"
+#include <shared_mutex>
 #include <string_view>
 #include <unordered_map>
 
@@ -25,8 +26,8 @@ public:
     using TablePtrT = owned<Table>;
     using TableMapT = std::unordered_map<std::string_view, TablePtrT>;
 public:
-    /** 构造函数：从已经存在的存储池管理器构造 */
-    DataBase(StorageDataBase &storage_database);
+    /** 构造函数：从已经存在的存储池管理器构造, 表的旧版本由`version_manager`管理 */
+    DataBase(StorageDataBase &storage_database, VersionManager &version_manager);
 
     /** getter: 依赖的存储池管理器指针 */
     StorageDataBase const &get_storage_database() const {
@@ -47,9 +48,14 @@ public:
     /** 删除一张表，返回是否删除成功。倘若表不存在，会返回false.
      *  这个函数最后会调用存储引擎中的表删除函数，所以不要额外管理存储表。 */
     bool dropTable(std::string_view name);
+
+    /** 表集合的读写锁。创建与删除表持有写锁, 读写表里的条目持有读锁 */
+    std::shared_mutex &rwlock() const { return _rwlock; }
 private:
     StorageDataBase &_storage_database;
+    VersionManager  &_version_manager;
     TableMapT        _table_map;
+    mutable std::shared_mutex _rwlock;
 }; // class DataBase
 
 } // namespace mygsql::engine
@@ -0,0 +1,150 @@
+#include "engine-join.hxx"
+#include <algorithm>
+#include <bit>
+#include <mutex>
+#include <shared_mutex>
+
+namespace mygsql::engine {
+
+/** @class RowAdapter
+ * @brief 把扫描的两种输出(存储条目与旧版本的值列表)统一成两个操作交给`fn`:
+ *        `view_of(column)`读一列的值视图, `value_of(column)`复制一列的值 */
+template<typename FnT>
+class RowAdapter final: public Table::RowVisitor {
+public:
+    /** `arena`不为空时`value_of`从这个内存池复制存储条目的值 */
+    RowAdapter(std::pmr::memory_resource *arena, FnT fn): _arena(arena), _fn(std::move(fn)) {}
+
+    void visitEntry(StorageTable::Entry const &entry) override {
+        _fn([&entry](int32_t column) { return entry.view(column); },
+            [this, &entry](int32_t column) { return entry.getFromIndex(column, _arena); });
+    }
+    void visitValues(Table::ValueListT const &values) override {
+        _fn([&values](int32_t column) { return ValueView::FromValue(values[column].get()); },
+            [&values](int32_t column) { return values[column]; });
+    }
+private:
+    std::pmr::memory_resource *_arena;
+    FnT _fn;
+}; // class RowAdapter
+
+void Join::_plan()
+{
+    StorageTable const &left  = _sides[0].table->get_storage_table();
+    StorageTable const &right = _sides[1].table->get_storage_table();
+    bool ordered = left.hasOrderedIndex(_sides[0].key) &&
+                   right.hasOrderedIndex(_sides[1].key);
+    _method = ordered ? Method::MERGE : Method::HASH;
+    _build_side = (right.get_entry_count() <= left.get_entry_count()) ? 1 : 0;
+}
+
+void Join::_scan(int32_t side, Timestamp snapshot, Table::RowVisitor &visitor)
+{
+    JoinSide const &join_side = _sides[side];
+    if (_method == Method::MERGE) {
+        join_side.table->scanIndexOrder(snapshot, join_side.key,
+                                        join_side.condition, visitor);
+    } else {
+        join_side.table->scanSnapshot(snapshot, join_side.condition, visitor);
+    }
+}
+
+void Join::_buildHashTable()
+{
+    size_t nbuckets = std::bit_ceil(std::max<size_t>(_keys.size() * 2, 16));
+    _heads.assign(nbuckets, NIL);
+    _next.assign(_keys.size(), NIL);
+    /* 倒着插入链表头, 链表里的条目就是扫描的次序 */
+    for (uint32_t row = _keys.size(); row-- > 0; ) {
+        uint32_t &head = _heads[_hashes[row] & (nbuckets - 1)];
+        _next[row] = head;
+        head = row;
+    }
+}
+
+Join::ValueListT Join::_makeOutput(uint32_t row, ValueListT const &stream_values) const
+{
+    ValueListT ret = ValueListCreate(_arena);
+    ret.reserve(_outputs.size());
+    for (auto [side, slot]: _outputs)
+        ret.push_back(side == _build_side ? _rows[row][slot] : stream_values[slot]);
+    return ret;
+}
+
+void Join::execute(Table::SnapshotRowFunc const &fn)
+{
+    Table &left  = *_sides[0].table;
+    Table &right = *_sides[1].table;
+    /* 同时持有两张表的读锁时取快照, 两张表的结果与同一时刻一致 */
+    std::shared_lock left_lock(left.rwlock(), std::defer_lock);
+    std::shared_lock right_lock(right.rwlock(), std::defer_lock);
+    std::lock(left_lock, right_lock);
+    Snapshot snapshot(left.get_version_manager());
+    _plan();
+    left_lock.unlock();
+    right_lock.unlock();
+    auto snapshot_of = [this, &snapshot](int32_t side) {
+        return _sides[side].read_current ? VersionStore::PENDING : snapshot.get_timestamp();
+    };
+
+    /* 缓冲边: 复制连接列与要读的列 */
+    int32_t build = _build_side, stream = 1 - _build_side;
+    JoinSide const &build_side  = _sides[build];
+    JoinSide const &stream_side = _sides[stream];
+    _keys.clear();
+    _key_values.clear();
+    _hashes.clear();
+    _rows.clear();
+    RowAdapter buffer(_arena, [this, &build_side](auto const &, auto const &value_of) {
+        _keys.push_back(value_of(build_side.key));
+        _key_values.push_back(CompactValue::FromValue(_keys.back().get()));
+        _hashes.push_back(_key_values.back().hash());
+        ValueListT row = ValueListCreate(_arena);
+        row.reserve(build_side.columns->size());
+        for (int32_t column: *build_side.columns)
+            row.push_back(value_of(column));
+        _rows.push_back(std::move(row));
+    });
+    _scan(build, snapshot_of(build), buffer);
+    if (_keys.empty())
+        return;
+
+    /* 流式边: 连接列直接读映射区, 匹配上以后才复制要读的列 */
+    ValueListT stream_values = ValueListCreate(_arena);
+    auto emit_matches = [&](auto const &value_of, uint32_t row) {
+        if (stream_values.empty()) {
+            for (int32_t column: *stream_side.columns)
+                stream_values.push_back(value_of(column));
+        }
+        fn(_makeOutput(row, stream_values));
+    };
+    if (_method == Method::MERGE) {
+        /* 两边都按连接列升序, 缓冲边的游标只向前推 */
+        size_t cursor = 0;
+        RowAdapter merge(_arena, [&](auto const &view_of, auto const &value_of) {
+            CompactValue key = CompactValue::FromView(view_of(stream_side.key));
+            while (cursor < _keys.size() && key.compare(_key_values[cursor]) > 0)
+                cursor++;
+            stream_values.clear();
+            for (size_t row = cursor;
+                 row < _keys.size() && key.compare(_key_values[row]) == 0; row++)
+                emit_matches(value_of, row);
+        });
+        _scan(stream, snapshot_of(stream), merge);
+        return;
+    }
+    _buildHashTable();
+    size_t mask = _heads.size() - 1;
+    RowAdapter probe(_arena, [&](auto const &view_of, auto const &value_of) {
+        CompactValue key = CompactValue::FromView(view_of(stream_side.key));
+        size_t hash = key.hash();
+        stream_values.clear();
+        for (uint32_t row = _heads[hash & mask]; row != NIL; row = _next[row]) {
+            if (_hashes[row] == hash && key.compare(_key_values[row]) == 0)
+                emit_matches(value_of, row);
+        }
+    });
+    _scan(stream, snapshot_of(stream), probe);
+}
+
+} // namespace mygsql::engine
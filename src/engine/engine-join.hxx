@@ -0,0 +1,100 @@
+#ifndef __MYG_SQL_ENGINE_JOIN_H__
+#define __MYG_SQL_ENGINE_JOIN_H__
+
+#include "base/sql-value.hxx"
+#include "engine-condition.hxx"
+#include "engine-table.hxx"
+#include "engine-version.hxx"
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <utility>
+#include <vector>
+
+namespace mygsql::engine {
+
+/** @struct JoinSide
+ * @brief 等值连接的一边: 表, 下推到这张表的where子条件, 连接列, 以及要读的列 */
+struct JoinSide {
+    Table                      *table     = nullptr;
+    /** 只涉及这张表的where子条件, 扫描这张表时求值, 可以为空 */
+    Condition const            *condition = nullptr;
+    /** 连接列的下标 */
+    int32_t                     key       = -1;
+    /** 要读的列的下标, 输出列按下标在这里的位置引用它们 */
+    std::vector<int32_t> const *columns   = nullptr;
+    /** 事务修改过这张表时读当前状态, 否则读快照 */
+    bool                        read_current = false;
+}; // struct JoinSide
+
+/** @class Join
+ * @brief 两张表的等值连接`a join b on a.x = b.y`. 条目少的一边是缓冲边, 先扫描它并把
+ *        要读的列复制进内存; 再扫描另一边(流式边), 每个条目直接在映射区上读连接列去找
+ *        缓冲边里匹配的条目, 只有匹配上的条目才复制要读的列。内存只与缓冲边有关。
+ *
+ *        - 两边的连接列都有B+树索引(主键索引或者B+树二级索引)时用归并连接: 两边都按索引的
+ *          次序扫描, 不需要排序, 流式边的每个条目只要把缓冲边的游标向前推; 结果按连接列升序。
+ *        - 否则用哈希连接: 缓冲边建成链式哈希表, 流式边按ID升序扫描并探测哈希表。
+ *
+ *        两张表在同一个快照上读: 同时持有两张表的读锁时取快照, 然后逐张表扫描。 */
+class Join {
+public:
+    using ValueListT  = Table::ValueListT;
+    /** 输出列: 哪一边(0是from的表, 1是join的表), 以及是这一边要读的第几列 */
+    using OutputT     = std::pair<int32_t, int32_t>;
+    using OutputListT = std::vector<OutputT>;
+
+    /** @enum Method
+     * @brief 连接的算法 */
+    enum class Method: int32_t {
+        HASH,  // 哈希连接
+        MERGE  // 沿着两边的B+树索引归并
+    }; // enum class Method
+public:
+    /** @param left    from的表
+     *  @param right   join的表
+     *  @param outputs 输出列的来源
+     *  @param arena   不为空时缓冲边复制的值与输出的行从这个内存池分配(见`Value::New`)
+     * @warning 连接引用`outputs`与两边的`columns`, 它们要比连接活得更久 */
+    Join(JoinSide const &left, JoinSide const &right, OutputListT const &outputs,
+         std::pmr::memory_resource *arena = nullptr)
+        : _sides{left, right}, _outputs(outputs), _arena(arena),
+          _keys(ValueListCreate(arena)) {}
+
+    /** @fn execute(fn)
+     * @brief 执行连接, 对每一对匹配的条目调用一次`fn(values)`, `values`是输出列的值。
+     *        算法与缓冲边在持有两张表的读锁时选定。
+     * @warning 调用者不能持有两张表的锁; `fn`在持有流式边的读锁时被调用 */
+    void execute(Table::SnapshotRowFunc const &fn);
+private:
+    JoinSide           _sides[2];
+    OutputListT const &_outputs;
+    Method             _method     = Method::HASH;
+    int32_t            _build_side = 1;
+    std::pmr::memory_resource *_arena;
+
+    /* 缓冲边: 第i个条目的连接列的值、打包好的值、哈希值与要读的列。
+     * 探测与归并只比较打包好的值, 长字符串引用`_keys`里的值 */
+    ValueListT              _keys;
+    std::vector<CompactValue> _key_values;
+    std::vector<size_t>     _hashes;
+    std::vector<ValueListT> _rows;
+    /* 哈希连接的链式哈希表: 桶里是第一个条目的编号, `_next`是链表, 都以`NIL`结尾 */
+    static constexpr uint32_t NIL = UINT32_MAX;
+    std::vector<uint32_t>   _heads;
+    std::vector<uint32_t>   _next;
+
+    /** 选择算法与缓冲边: 两边的连接列都有B+树索引时归并, 条目少的一边缓冲
+     * @warning 调用者持有两张表的读锁 */
+    void _plan();
+    /** 扫描第`side`边, 归并连接按索引的次序扫描 */
+    void _scan(int32_t side, Timestamp snapshot, Table::RowVisitor &visitor);
+    /** 把缓冲边的条目建成哈希表 */
+    void _buildHashTable();
+    /** 把缓冲边的第`row`个条目与流式边的`stream_values`拼成一行输出 */
+    ValueListT _makeOutput(uint32_t row, ValueListT const &stream_values) const;
+}; // class Join
+
+} // namespace mygsql::engine
+
+#endif
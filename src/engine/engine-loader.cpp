@@ -0,0 +1,138 @@
+#include "engine-loader.hxx"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+
+namespace mygsql::engine {
+
+DelimitedFileReader::DelimitedFileReader(std::string_view path)
+    : _path(path), _file(nullptr), _file_size(0), _delimiter(',')
+{
+    _file = fopen(_path.c_str(), "rb");
+    if (_file == nullptr)
+        throw Exception(_path, 0, strerror(errno));
+    std::error_code ec;
+    _file_size = std::filesystem::file_size(_path, ec);
+    if (ec)
+        _file_size = 0;
+    if (std::filesystem::path(_path).extension() == ".tsv")
+        _delimiter = '\t';
+    _buffer.resize(CHUNK_SIZE);
+}
+
+DelimitedFileReader::~DelimitedFileReader()
+{
+    if (_file != nullptr)
+        fclose(_file);
+}
+
+bool DelimitedFileReader::_fill()
+{
+    if (_eof)
+        return false;
+    if (_begin > 0) {
+        memmove(_buffer.data(), _buffer.data() + _begin, _end - _begin);
+        _end  -= _begin;
+        _begin = 0;
+    }
+    if (_end == _buffer.size())     /* 一行比缓冲区还长 */
+        _buffer.resize(_buffer.size() * 2);
+    size_t nread = fread(_buffer.data() + _end, 1, _buffer.size() - _end, _file);
+    if (nread == 0) {
+        _eof = true;
+        return false;
+    }
+    if (_first_chunk_size == 0) {
+        _first_chunk_size  = nread;
+        _first_chunk_lines = std::count(_buffer.data(), _buffer.data() + nread, '\n');
+    }
+    _end += nread;
+    return true;
+}
+
+bool DelimitedFileReader::_parseRow(FieldListT &out_fields)
+{
+    char *buffer = _buffer.data();
+    /* 先找到行尾: 引号里的换行不算。数据不完整时不能修改缓冲区, 因为补齐以后要重新解析 */
+    size_t row_end = _begin, lines = 1;
+    bool   in_quote = false;
+    while (row_end < _end && (in_quote || buffer[row_end] != '\n')) {
+        in_quote ^= (buffer[row_end] == '"');
+        lines    += (buffer[row_end] == '\n') ? 1 : 0;
+        row_end++;
+    }
+    if (row_end >= _end && !_eof)
+        return false;
+    if (in_quote)
+        throw Exception(_path, _line + 1, "unterminated quoted field");
+    size_t next = std::min(row_end + 1, _end);
+    if (row_end > _begin && buffer[row_end - 1] == '\r')
+        row_end--;
+
+    out_fields.clear();
+    size_t pos = _begin;
+    while (true) {
+        if (pos < row_end && buffer[pos] == '"') {
+            /* 引号字段: 原地去掉转义, 写指针永远不超过读指针 */
+            size_t read = pos + 1, write = pos;
+            while (true) {
+                if (read >= row_end)
+                    throw Exception(_path, _line + 1, "unterminated quoted field");
+                if (buffer[read] == '"') {
+                    if (read + 1 < row_end && buffer[read + 1] == '"') {
+                        buffer[write++] = '"';
+                        read += 2;
+                        continue;
+                    }
+                    read++;
+                    break;
+                }
+                buffer[write++] = buffer[read++];
+            }
+            out_fields.emplace_back(buffer + pos, write - pos);
+            pos = read;
+            if (pos < row_end && buffer[pos] != _delimiter)
+                throw Exception(_path, _line + 1, "unexpected character after closing quote");
+        } else {
+            size_t field_end = pos;
+            while (field_end < row_end && buffer[field_end] != _delimiter)
+                field_end++;
+            out_fields.emplace_back(buffer + pos, field_end - pos);
+            pos = field_end;
+        }
+        if (pos >= row_end)
+            break;
+        pos++; /* 分隔符 */
+    }
+    _begin = next;
+    _line += lines;
+    return true;
+}
+
+bool DelimitedFileReader::nextRow(FieldListT &out_fields)
+{
+    while (true) {
+        /* 跳过空行 */
+        while (_begin < _end && (_buffer[_begin] == '\n' || _buffer[_begin] == '\r')) {
+            _line += (_buffer[_begin] == '\n') ? 1 : 0;
+            _begin++;
+        }
+        if (_begin < _end && _parseRow(out_fields))
+            return true;
+        if (!_fill() && _begin >= _end)
+            return false;
+    }
+}
+
+size_t DelimitedFileReader::estimateRowCount() const
+{
+    if (_first_chunk_size == 0)
+        return 0;
+    if (_first_chunk_lines == 0)
+        return 1;
+    double average = double(_first_chunk_size) / double(_first_chunk_lines);
+    return size_t(double(_file_size) / average) + 1;
+}
+
+} // namespace mygsql::engine
@@ -0,0 +1,83 @@
+#ifndef __MYG_SQL_ENGINE_LOADER_H__
+#define __MYG_SQL_ENGINE_LOADER_H__
+
+#include "base/mtb-exception.hxx"
+#include "base/mtb-object.hxx"
+#include <cstddef>
+#include <cstdio>
+#include <format>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mygsql::engine {
+
+/** @class DelimitedFileReader
+ * @brief 流式读取CSV/TSV文件。文件按大块读进一个缓冲区, 每一行的字段都是指向缓冲区的
+ *        字符串视图, 读取过程中不为字段分配内存。
+ *
+ *        支持用双引号括起来的字段, 字段里的`""`表示一个双引号, 引号里可以有分隔符与换行。
+ *        行尾的`\r`会被忽略。
+ * @warning 字段视图只在下一次调用`nextRow()`之前有效。 */
+class DelimitedFileReader: public MTB::Object {
+public:
+    using FieldListT = std::vector<std::string_view>;
+    /** 每次从文件读取的字节数 */
+    static constexpr size_t CHUNK_SIZE = 4 * 1024 * 1024;
+
+    /** @class Exception
+     * @brief 文件打不开, 或者第`line`行的格式不对 */
+    class Exception: public MTB::Exception {
+    public:
+        Exception(std::string_view path, size_t line, std::string_view reason)
+            : MTB::Exception(MTB::ErrorLevel::CRITICAL,
+                line == 0 ? std::format("LoadException: {}: {}", path, reason)
+                          : std::format("LoadException: {} line {}: {}", path, line, reason)),
+              line(line) {}
+        size_t line;
+    }; // class Exception
+public:
+    /** @brief 打开文件。扩展名为`.tsv`时用制表符分隔, 否则用逗号分隔。
+     * @throw Exception 文件打不开 */
+    explicit DelimitedFileReader(std::string_view path);
+    ~DelimitedFileReader() override;
+
+    /** @fn nextRow(out_fields)
+     * @brief 读取下一行, 字段放进`out_fields`. 空行会被跳过。
+     * @return 文件已经读完时返回false
+     * @throw Exception 引号没有闭合 */
+    bool nextRow(FieldListT &out_fields);
+
+    /** @brief getter: 刚读到的行的行号, 从1开始 */
+    size_t get_line() const { return _line; }
+    /** @brief getter: 文件大小 */
+    size_t get_file_size() const { return _file_size; }
+    /** @brief getter: 分隔符 */
+    char get_delimiter() const { return _delimiter; }
+
+    /** @fn estimateRowCount()
+     * @brief 按第一块数据的平均行长估计文件的行数。需要在第一次`nextRow()`之后调用。 */
+    size_t estimateRowCount() const;
+private:
+    std::string _path;
+    FILE       *_file;
+    size_t      _file_size;
+    char        _delimiter;
+    std::vector<char> _buffer;  // 读缓冲区
+    size_t      _begin = 0;     // 缓冲区里还没有解析的数据的开始位置
+    size_t      _end   = 0;     // 缓冲区里有效数据的结束位置
+    bool        _eof   = false; // 文件已经读完
+    size_t      _line  = 0;     // 已经读到的行数
+    size_t      _first_chunk_lines = 0; // 第一块数据里的换行个数, 用于估计行数
+    size_t      _first_chunk_size  = 0; // 第一块数据的大小
+
+    /** 把没有解析的数据移到缓冲区开头, 然后继续读文件。缓冲区满了就扩大一倍。
+     *  @return 读到了新数据时返回true */
+    bool _fill();
+    /** 从`_begin`开始解析一行。数据不完整时返回false, 不修改任何状态。 */
+    bool _parseRow(FieldListT &out_fields);
+}; // class DelimitedFileReader
+
+} // namespace mygsql::engine
+
+#endif
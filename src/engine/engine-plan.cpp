@@ -0,0 +1,324 @@
+#include "engine-plan.hxx"
+#include "storage/storage-table.hxx"
+#include <algorithm>
+#include <format>
+
+namespace mygsql::engine {
+
+void Plan::setParameters(ValueListT const &values)
+{
+    if (values.size() != _parameters.size()) {
+        throw Exception(table_name, std::format("expected {} parameters, got {}",
+                                                _parameters.size(), values.size()));
+    }
+    for (size_t i = 0; i < values.size(); i++)
+        *_parameters[i] = owned<Value>(values[i]);
+}
+
+/** 把条件按AND展开, 移进`out` */
+static void condition_take_conjuncts(std::unique_ptr<Condition> &condition,
+                                     Condition::ChildListT &out)
+{
+    if (condition == nullptr)
+        return;
+    if (condition->kind != Condition::Kind::AND) {
+        out.push_back(std::move(condition));
+        return;
+    }
+    for (std::unique_ptr<Condition> &child: condition->children)
+        out.push_back(std::move(child));
+    condition.reset();
+}
+
+/** 把子条件重新组合成一个条件: 没有子条件时为空, 只有一个时就是它, 否则是它们的AND */
+static std::unique_ptr<Condition> condition_from_conjuncts(Condition::ChildListT &&conjuncts)
+{
+    if (conjuncts.empty())
+        return nullptr;
+    if (conjuncts.size() == 1)
+        return std::move(conjuncts[0]);
+    auto ret = std::make_unique<Condition>(Condition::Kind::AND);
+    ret->children = std::move(conjuncts);
+    return ret;
+}
+
+void Plan::bind(Table const &table, Table const *other)
+{
+    if (is_bound_to(table, other))
+        return;
+    StorageTable const *storage_tables[2] = {
+        &table.get_storage_table(),
+        (other != nullptr) ? &other->get_storage_table() : nullptr
+    };
+    std::string_view table_names[2] = {table_name, join_table};
+    int32_t ntables = (other != nullptr) ? 2 : 1;
+    /* 连接查询的列按限定的表名, 或者在两张表里按名称查找 */
+    auto bind_column = [&](ColumnRef &column) {
+        column.index = -1;
+        for (int32_t side = 0; side < ntables; side++) {
+            if (!column.table.empty() && column.table != table_names[side])
+                continue;
+            int32_t index = storage_tables[side]->getTypeIndex(column.name);
+            if (index < 0)
+                continue;
+            if (column.index >= 0) {
+                throw Exception(table_name, std::format("column `{}` is ambiguous",
+                                                        column.get_full_name()));
+            }
+            column.index = index;
+            column.type  = storage_tables[side]->get_type_item_list()[index].type;
+            column.side  = side;
+        }
+        if (column.index < 0)
+            throw TableEntry::ColumnUnmatchedException(column.get_full_name());
+    };
+
+    _column_indices.clear();
+    _column_names.clear();
+    _column_types.clear();
+    _side_columns[0].clear();
+    _side_columns[1].clear();
+    _join_outputs.clear();
+    _aggregate_items.clear();
+    _order_output = -1;
+    /* 连接查询的输出列: 记下来自哪一张表, 每张表要读的列不重复 */
+    auto add_join_output = [this](int32_t side, int32_t index) {
+        std::vector<int32_t> &side_columns = _side_columns[side];
+        auto iter = std::find(side_columns.begin(), side_columns.end(), index);
+        if (iter == side_columns.end())
+            iter = side_columns.insert(side_columns.end(), index);
+        _join_outputs.push_back({side, int32_t(iter - side_columns.begin())});
+    };
+    if (kind == Kind::SELECT && select_all) {
+        for (int32_t side = 0; side < ntables; side++) {
+            auto &ti_list = storage_tables[side]->get_type_item_list();
+            for (int32_t i = 0; i < int32_t(ti_list.size()); i++) {
+                if (other != nullptr) {
+                    add_join_output(side, i);
+                    _column_names.push_back(std::format("{}.{}", table_names[side],
+                                                        ti_list[i].name));
+                } else {
+                    _column_indices.push_back(i);
+                    _column_names.emplace_back(ti_list[i].name);
+                }
+            }
+        }
+    }
+    for (ColumnRef &column: columns) {
+        bind_column(column);
+        if (other != nullptr)
+            add_join_output(column.side, column.index);
+        else
+            _column_indices.push_back(column.index);
+        _column_names.push_back(column.get_full_name());
+    }
+    for (ColumnRef &column: group_by)
+        bind_column(column);
+    for (AggregateItem &item: aggregates) {
+        if (item.has_column())
+            bind_column(item.column);
+        _column_names.push_back(item.name);
+        _bindAggregate(item);
+    }
+    if (has_order()) {
+        /* 排序的项不在输出列里时作为隐藏列多读一列, 输出以前去掉 */
+        if (order_by.has_column())
+            bind_column(order_by.column);
+        if (is_aggregate()) {
+            _aggregate_items = aggregates;
+            _bindAggregateOrder();
+        } else if (order_by.function != AggregateFunction::NONE) {
+            throw Exception(table_name, std::format(
+                "cannot order by `{}` in a query without aggregates", order_by.name));
+        } else if (other != nullptr) {
+            ColumnRef const &key = order_by.column;
+            std::vector<int32_t> const &side_columns = _side_columns[key.side];
+            auto iter = std::find_if(_join_outputs.begin(), _join_outputs.end(),
+                [&](JoinOutputT const &output) {
+                    return output.first == key.side &&
+                           side_columns[output.second] == key.index;
+                });
+            _order_output = int32_t(iter - _join_outputs.begin());
+            if (iter == _join_outputs.end())
+                add_join_output(key.side, key.index);
+        } else {
+            auto iter = std::find(_column_indices.begin(), _column_indices.end(),
+                                  order_by.column.index);
+            _order_output = int32_t(iter - _column_indices.begin());
+            if (iter == _column_indices.end())
+                _column_indices.push_back(order_by.column.index);
+        }
+    } else if (is_aggregate()) {
+        _aggregate_items = aggregates;
+    }
+    if (other != nullptr) {
+        bind_column(join_keys[0]);
+        bind_column(join_keys[1]);
+        if (join_keys[0].side == join_keys[1].side) {
+            throw Exception(table_name,
+                "join condition must compare a column of each joined table");
+        }
+        if (join_keys[0].side != 0)
+            std::swap(join_keys[0], join_keys[1]);
+        if (join_keys[0].type != join_keys[1].type)
+            throw Value::InconsistantTypeException(join_keys[0].type, join_keys[1].type);
+        /* 上次绑定拆开的where条件先合并回来, 整个重新绑定 */
+        Condition::ChildListT conjuncts;
+        condition_take_conjuncts(_side_conditions[0], conjuncts);
+        condition_take_conjuncts(_side_conditions[1], conjuncts);
+        if (!conjuncts.empty()) {
+            condition_take_conjuncts(condition, conjuncts);
+            condition = condition_from_conjuncts(std::move(conjuncts));
+        }
+    }
+    if (has_condition()) {
+        condition->traverseLeaves([&bind_column](Condition &leaf) {
+            bind_column(leaf.column);
+            if (leaf.kind == Condition::Kind::COMPARE_COLUMNS)
+                bind_column(leaf.other_column);
+        });
+        if (other != nullptr)
+            _splitJoinCondition(storage_tables);
+        else
+            condition->optimize(*storage_tables[0]);
+    }
+    if (kind == Kind::INSERT) {
+        for (StorageTypeItem const &item: storage_tables[0]->get_type_item_list())
+            _column_types.push_back(item.type);
+    }
+    _schema_id = table.get_schema_id();
+    _other_schema_id = (other != nullptr) ? other->get_schema_id() : 0;
+}
+
+void Plan::_splitJoinCondition(StorageTable const *storage_tables[2])
+{
+    /* 每个AND子条件的所有列都要来自同一张表, 先检查再移动, 出错时条件保持原样 */
+    auto conjunct_side = [](Condition const &conjunct) {
+        int32_t side = -1;
+        bool mixed = false;
+        conjunct.traverseLeaves([&side, &mixed](Condition const &leaf) {
+            for (ColumnRef const *column: {&leaf.column, &leaf.other_column}) {
+                if (column->index < 0)
+                    continue;
+                mixed |= (side >= 0 && side != column->side);
+                side = column->side;
+            }
+        });
+        return mixed ? -1 : side;
+    };
+    auto check = [this, &conjunct_side](Condition const &conjunct) {
+        if (conjunct_side(conjunct) < 0) {
+            throw Exception(table_name,
+                "each 'and' operand of a join's where condition must refer to one table");
+        }
+    };
+    if (condition->kind == Condition::Kind::AND) {
+        for (std::unique_ptr<Condition> const &child: condition->children)
+            check(*child);
+    } else {
+        check(*condition);
+    }
+
+    Condition::ChildListT conjuncts, sides[2];
+    condition_take_conjuncts(condition, conjuncts);
+    for (std::unique_ptr<Condition> &conjunct: conjuncts) {
+        int32_t side = conjunct_side(*conjunct);
+        sides[side].push_back(std::move(conjunct));
+    }
+    for (int32_t side = 0; side < 2; side++) {
+        _side_conditions[side] = condition_from_conjuncts(std::move(sides[side]));
+        if (_side_conditions[side] != nullptr)
+            _side_conditions[side]->optimize(*storage_tables[side]);
+    }
+}
+
+void Plan::_bindAggregate(AggregateItem &item) const
+{
+    switch (item.function) {
+    case AggregateFunction::NONE:
+        for (size_t i = 0; i < group_by.size(); i++) {
+            if (group_by[i].index == item.column.index) {
+                item.group_index = int32_t(i);
+                return;
+            }
+        }
+        throw Exception(table_name, std::format("column `{}` must appear in 'group by'",
+                                                item.column.name));
+    case AggregateFunction::SUM:
+    case AggregateFunction::AVG:
+        if (item.column.type != Value::Type::INT) {
+            throw Exception(table_name, std::format("`{}` requires an int column",
+                                                    item.name));
+        }
+        return;
+    default:
+        return;
+    }
+}
+
+void Plan::_bindAggregateOrder()
+{
+    for (size_t i = 0; i < _aggregate_items.size(); i++) {
+        AggregateItem const &item = _aggregate_items[i];
+        bool same = (order_by.function == AggregateFunction::NONE)
+            ? (item.function == AggregateFunction::NONE &&
+               item.column.index == order_by.column.index)
+            : (item.name == order_by.name);
+        if (same) {
+            _order_output = int32_t(i);
+            return;
+        }
+    }
+    AggregateItem hidden = order_by;
+    _bindAggregate(hidden);
+    _order_output = int32_t(_aggregate_items.size());
+    _aggregate_items.push_back(std::move(hidden));
+}
+
+void Plan::_checkValue(ColumnRef const &column, Value const *value) const
+{
+    if (value == nullptr) {
+        throw Exception(table_name, std::format("value for column `{}` is not given",
+                                                column.name));
+    }
+    if (value->get_value_type() != column.type)
+        throw Value::InconsistantTypeException(column.type, value->get_value_type());
+}
+
+template<typename FnT>
+void Plan::_traverseConditionLeaves(FnT &&fn)
+{
+    for (Condition *root: {condition.get(), _side_conditions[0].get(),
+                           _side_conditions[1].get()}) {
+        if (root != nullptr)
+            root->traverseLeaves(fn);
+    }
+}
+
+void Plan::checkValues()
+{
+    _traverseConditionLeaves([this](Condition &leaf) {
+        if (leaf.kind == Condition::Kind::COMPARE) {
+            _checkValue(leaf.column, leaf.value);
+            leaf.constant = CompactValue::FromValue(leaf.value.get());
+        } else if (leaf.column.type != leaf.other_column.type)
+            throw Value::InconsistantTypeException(leaf.column.type, leaf.other_column.type);
+    });
+    if (kind == Kind::UPDATE)
+        _checkValue(columns[0], values[0]);
+    if (kind != Kind::INSERT)
+        return;
+    if (values.size() != _column_types.size()) {
+        throw Exception(table_name, std::format("expected {} values, got {}",
+                                                _column_types.size(), values.size()));
+    }
+    for (size_t i = 0; i < values.size(); i++) {
+        if (values[i].get() == nullptr) {
+            throw Exception(table_name, std::format("value #{} is not given", i));
+        }
+        if (values[i]->get_value_type() != _column_types[i])
+            throw Value::InconsistantTypeException(_column_types[i], values[i]->get_value_type());
+    }
+}
+
+} // namespace mygsql::engine
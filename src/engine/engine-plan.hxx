@@ -0,0 +1,183 @@
+#ifndef __MYG_SQL_ENGINE_PLAN_H__
+#define __MYG_SQL_ENGINE_PLAN_H__
+
+#include "base/mtb-exception.hxx"
+#include "base/mtb-object.hxx"
+#include "base/sql-value.hxx"
+#include "engine/engine-aggregate.hxx"
+#include "engine/engine-condition.hxx"
+#include "engine/engine-table.hxx"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace mygsql::engine {
+using MTB::owned;
+
+/** @class Plan
+ * @brief 编译好的数据操作语句(select/insert/update/delete), 也就是查询计划。
+ *        解释器只解析一次语句文本, 得到计划; 计划第一次在一张表上执行时把列名称绑定成列下标与
+ *        类型, 之后重复执行同一个计划既不解析语句, 也不按名称查找列。
+ *
+ *        绑定记录了表的结构编号(`Table::get_schema_id()`), 表被删除重建以后编号会变,
+ *        执行时发现编号不一致就重新绑定。
+ *
+ *        计划里的常量可以是参数`?`, 每次执行以前用`setParameters`填入实际的值。
+ * @warning 计划不是线程安全的, 一个计划同一时刻只能被一个会话执行。 */
+class Plan: public MTB::Object {
+public:
+    using ValueListT = TableEntry::ValueListT;
+    /** 连接查询的输出列: 哪一张表(0或者1), 以及是这张表要读的第几列 */
+    using JoinOutputT = std::pair<int32_t, int32_t>;
+
+    /** @enum Kind
+     * @brief 语句的种类 */
+    enum class Kind: int32_t {
+        SELECT, INSERT, UPDATE, DELETE
+    }; // enum class Kind
+
+    using ColumnRef     = engine::ColumnRef;
+    using AggregateItem = engine::AggregateItem;
+    /** 没有limit */
+    static constexpr size_t NO_LIMIT = SIZE_MAX;
+
+    /** @class Exception
+     * @brief 计划与表的结构不符(比如插入的值的个数不对), 或者参数的个数不对 */
+    class Exception: public MTB::Exception {
+    public:
+        Exception(std::string_view table_name, std::string_view reason)
+            : MTB::Exception(MTB::ErrorLevel::CRITICAL,
+                std::format("Plan::Exception on table `{}`: {}", table_name, reason)) {}
+    }; // class Plan::Exception
+public:
+    Plan(Kind kind, std::string_view table_name)
+        : kind(kind), table_name(table_name) {}
+
+    Kind        kind;
+    std::string table_name;
+    /** SELECT: 选择所有的列(`select *`), 这时`columns`为空 */
+    bool        select_all = false;
+    /** SELECT: 输出的列; UPDATE: 被修改的列 */
+    std::vector<ColumnRef> columns;
+    /** SELECT: 聚合查询的输出列, 包括聚合函数与分组列, 这时`columns`为空 */
+    std::vector<AggregateItem> aggregates;
+    /** SELECT: group by的列 */
+    std::vector<ColumnRef> group_by;
+    /** SELECT: join的另一张表, 为空表示不是连接查询 */
+    std::string join_table;
+    /** SELECT: 连接条件`on 列 = 列`的两边。绑定以后第0个是from的表的列 */
+    std::array<ColumnRef, 2> join_keys;
+    /** SELECT: order by的项, 函数为`NONE`时是一列, 否则是聚合函数(只用于聚合查询)。
+     *  `name`为空表示没有order by */
+    AggregateItem order_by;
+    /** SELECT: order by ... desc */
+    bool        order_desc = false;
+    /** SELECT: limit, 最多输出的行数 */
+    size_t      limit = NO_LIMIT;
+    /** where条件的表达式树, 为空表示没有where条件。连接查询绑定以后它被拆成两张表各自的
+     *  子条件(见`get_side_condition`), 这里为空 */
+    std::unique_ptr<Condition> condition;
+    /** INSERT: 插入的值列表; UPDATE: 新值(只有一个) */
+    ValueListT         values;
+
+    /** @brief 有没有where条件 */
+    bool has_condition() const { return condition != nullptr; }
+    /** @brief 是不是连接查询 */
+    bool is_join() const { return !join_table.empty(); }
+    /** @brief 连接查询: where条件里只涉及第`side`张表的部分, 扫描这张表时求值。
+     *         已经绑定时才有意义, 为空表示没有 */
+    Condition const *get_side_condition(int32_t side) const {
+        return _side_conditions[side].get();
+    }
+    /** @brief 连接查询: 第`side`张表要读的列的下标, 已经绑定时才有意义 */
+    std::vector<int32_t> const &get_side_columns(int32_t side) const {
+        return _side_columns[side];
+    }
+    /** @brief 连接查询: 输出列的来源, 已经绑定时才有意义 */
+    std::vector<JoinOutputT> const &get_join_outputs() const { return _join_outputs; }
+    /** @brief 有没有order by */
+    bool has_order() const { return !order_by.name.empty(); }
+    /** @brief 有没有limit */
+    bool has_limit() const { return limit != NO_LIMIT; }
+    /** @brief order by的项在输出行里的位置, 已经绑定时才有意义。
+     *         输出行可能在输出列(`get_column_names()`)以后多出只为排序而读的隐藏列 */
+    int32_t get_order_output() const { return _order_output; }
+    /** @brief 聚合查询实际计算的项: `aggregates`以后可能多一个只为排序而计算的隐藏项,
+     *         已经绑定时才有意义 */
+    std::vector<AggregateItem> const &get_aggregate_items() const { return _aggregate_items; }
+    /** @brief 是不是聚合查询(有聚合函数或者group by) */
+    bool is_aggregate() const { return !aggregates.empty() || !group_by.empty(); }
+    /** @brief 输出列的下标, 已经绑定时才有意义 */
+    std::vector<int32_t> const &get_column_indices() const { return _column_indices; }
+    /** @brief 输出列的名称, 已经绑定时才有意义 */
+    std::vector<std::string> const &get_column_names() const { return _column_names; }
+
+    /** @fn addParameter(slot)
+     * @brief 编译时登记一个参数`?`, `slot`是计划里存放这个常量的位置。
+     *        参数按登记的次序编号。
+     * @warning `slot`要在计划的生命周期里保持有效, 所以要在值列表不再增长以后登记 */
+    void addParameter(owned<Value> &slot) { _parameters.push_back(&slot); }
+    /** @brief getter: 参数的个数 */
+    size_t get_parameter_count() const { return _parameters.size(); }
+    /** @fn setParameters(values)
+     * @brief 按次序填入所有参数的值
+     * @throw Exception 值的个数与参数的个数不一致 */
+    void setParameters(ValueListT const &values);
+
+    /** @fn is_bound_to(table, other)
+     * @brief 计划是不是已经绑定到了`table`(连接查询还有join的表`other`)的当前结构上 */
+    bool is_bound_to(Table const &table, Table const *other = nullptr) const {
+        return _schema_id == table.get_schema_id() &&
+               (other == nullptr || _other_schema_id == other->get_schema_id());
+    }
+    /** @fn bind(table, other)
+     * @brief 把列名称绑定成`table`的列下标与类型, 然后按估计的选择率重排where条件。
+     *        连接查询的列在`table`与join的表`other`里查找, where条件按AND拆成两张表各自的
+     *        子条件。已经绑定时什么都不做。
+     * @throw TableEntry::ColumnUnmatchedException 列不存在
+     * @throw Exception 连接查询的列有歧义, 连接条件不是两张表的列, 或者where的某个子条件
+     *        同时涉及两张表
+     * @throw Exception 聚合查询输出的普通列不在group by里, 或者对字符串列求和、求平均
+     * @throw Exception 不是聚合查询却按聚合函数排序 */
+    void bind(Table const &table, Table const *other = nullptr);
+    /** @fn checkValues()
+     * @brief 检查常量与参数的类型是否与绑定的列一致, 然后把where条件的常量打包成
+     *        `CompactValue`(见`Condition::constant`)。参数每次执行都可能不同,
+     *        所以每次执行以前都要检查。
+     * @throw Value::InconsistantTypeException 类型不一致, 包括where条件里比较的两列
+     * @throw Exception 值为空(参数还没有填入), 或者插入的值的个数与列数不一致 */
+    void checkValues();
+private:
+    uint64_t              _schema_id = 0;   // 绑定的表结构编号, 0表示还没有绑定
+    uint64_t              _other_schema_id = 0;   // 连接查询: join的表的结构编号
+    std::unique_ptr<Condition> _side_conditions[2]; // 连接查询: 两张表各自的where子条件
+    std::vector<int32_t>       _side_columns[2];    // 连接查询: 两张表要读的列
+    std::vector<JoinOutputT>   _join_outputs;       // 连接查询: 输出列的来源
+    std::vector<int32_t>  _column_indices;  // 输出列的下标
+    std::vector<std::string> _column_names; // 输出列的名称
+    std::vector<Value::Type> _column_types; // INSERT: 表的每一列的类型
+    std::vector<owned<Value>*> _parameters; // 参数在计划里的位置
+    std::vector<AggregateItem> _aggregate_items; // 聚合查询: 实际计算的项
+    int32_t               _order_output = -1; // order by的项在输出行里的位置
+
+    void _checkValue(ColumnRef const &column, Value const *value) const;
+    /** 连接查询: 把where条件按AND拆成两张表各自的子条件。重新绑定时先把上次拆开的合并回来 */
+    void _splitJoinCondition(StorageTable const *storage_tables[2]);
+    /** 对where条件(连接查询是拆开以后的子条件)的每个叶子调用`fn(leaf)` */
+    template<typename FnT>
+    void _traverseConditionLeaves(FnT &&fn);
+    /** 检查聚合查询的一个输出列, 分组列填入它在group by里的位置 */
+    void _bindAggregate(AggregateItem &item) const;
+    /** 聚合查询: 在实际计算的项里找order by的项, 找不到时加一个隐藏项 */
+    void _bindAggregateOrder();
+}; // class Plan
+
+} // namespace mygsql::engine
+
+#endif
@@ -0,0 +1,222 @@
+#include "engine-sort.hxx"
+#include <algorithm>
+#include <atomic>
+#include <system_error>
+#include <utility>
+
+namespace mygsql::engine {
+
+static std::atomic_size_t sort_memory_budget = 64 * 1024 * 1024;
+/** 顺串文件的编号, 同一个进程里的排序器不会用同一个文件名 */
+static std::atomic_uint64_t next_run_id = 0;
+
+size_t Sorter::GetMemoryBudget() { return sort_memory_budget; }
+void Sorter::SetMemoryBudget(size_t bytes) { sort_memory_budget = bytes; }
+
+/** 估计一行在内存里占的字节数: 值的指针与对象, 以及字符串的内容 */
+static size_t row_estimate_bytes(Table::ValueListT const &values)
+{
+    size_t ret = sizeof(Table::ValueListT) + sizeof(uint64_t) +
+                 values.size() * (sizeof(Table::ValuePtrT) + sizeof(StringValue));
+    for (Table::ValuePtrT const &value: values) {
+        if (value->get_value_type() == Value::Type::STRING)
+            ret += static_cast<StringValue const*>(value.get())->value().size();
+    }
+    return ret;
+}
+
+/** @class Sorter::Run
+ * @brief 一个顺串文件。每一行依次写出列数与每一列的值: 类型一个字节, 整数4个字节,
+ *        字符串是4个字节的长度加内容。先写完整个顺串, 再从头读 */
+class Sorter::Run {
+public:
+    explicit Run(std::filesystem::path path): _path(std::move(path)) {
+        _out.open(_path, std::ios::binary | std::ios::trunc);
+        if (!_out)
+            throw Exception(_path, "cannot create the file");
+    }
+    ~Run() {
+        _out.close();
+        _in.close();
+        std::error_code ec;
+        std::filesystem::remove(_path, ec);
+    }
+
+    void write(ValueListT const &row) {
+        _writeU32(row.size());
+        for (ValuePtrT const &value: row) {
+            _out.put(char(value->get_value_type()));
+            if (value->get_value_type() == Value::Type::INT) {
+                _writeU32(uint32_t(static_cast<IntValue const*>(value.get())->value()));
+                continue;
+            }
+            std::string_view str = static_cast<StringValue const*>(value.get())->value();
+            _writeU32(str.size());
+            _out.write(str.data(), str.size());
+        }
+    }
+    /** 写完了, 准备从头读 */
+    void rewind() {
+        _out.close();
+        if (_out.fail())
+            throw Exception(_path, "failed to write the file");
+        _in.open(_path, std::ios::binary);
+        if (!_in)
+            throw Exception(_path, "cannot open the file");
+    }
+    /** 读出下一行, 值从`arena`分配, 读完时返回false */
+    bool read(ValueListT &row, std::pmr::memory_resource *arena) {
+        row.clear();
+        uint32_t ncolumns;
+        if (!_readU32(ncolumns))
+            return false;
+        row.reserve(ncolumns);
+        for (uint32_t i = 0; i < ncolumns; i++) {
+            auto type = Value::Type(_in.get());
+            uint32_t u32;
+            if (!_readU32(u32))
+                throw Exception(_path, "unexpected end of file");
+            if (type == Value::Type::INT) {
+                row.push_back(ValuePtrT(Value::New<IntValue>(arena, int32_t(u32))));
+                continue;
+            }
+            _buffer.resize(u32);
+            if (!_in.read(_buffer.data(), u32))
+                throw Exception(_path, "unexpected end of file");
+            row.push_back(ValuePtrT(Value::New<StringValue>(arena, _buffer)));
+        }
+        return true;
+    }
+private:
+    using ValuePtrT = Table::ValuePtrT;
+    std::filesystem::path _path;
+    std::ofstream         _out;
+    std::ifstream         _in;
+    std::string           _buffer; // 读字符串的缓冲区
+
+    void _writeU32(uint32_t value) {
+        _out.write(reinterpret_cast<char const*>(&value), sizeof(uint32_t));
+    }
+    bool _readU32(uint32_t &value) {
+        return bool(_in.read(reinterpret_cast<char*>(&value), sizeof(uint32_t)));
+    }
+}; // class Sorter::Run
+
+Sorter::Sorter(int32_t key, bool descending, size_t limit,
+               std::filesystem::path temp_directory)
+    : _key(key), _descending(descending), _limit(limit),
+      _temp_directory(std::move(temp_directory)) {}
+
+Sorter::~Sorter() = default;
+
+bool Sorter::_keyBefore(CompactValue const &a, CompactValue const &b) const
+{
+    Value::Type lhs = a.type(), rhs = b.type();
+    int64_t result = (lhs != rhs) ? int64_t(lhs) - int64_t(rhs) : a.compare(b);
+    return _descending ? (result > 0) : (result < 0);
+}
+
+bool Sorter::_before(Row const &a, Row const &b) const
+{
+    if (_keyBefore(a.key, b.key))
+        return true;
+    if (_keyBefore(b.key, a.key))
+        return false;
+    return a.seq < b.seq;
+}
+
+void Sorter::push(ValueListT &&values)
+{
+    /* 长字符串的键引用行里的`Value`, 行移动时`Value`对象不动 */
+    CompactValue key = CompactValue::FromValue(values[_key].get());
+    Row row{std::move(values), key, _seq++};
+    auto before = [this](Row const &a, Row const &b) { return _before(a, b); };
+    if (_limit != NO_LIMIT) {
+        /* top-k: 堆没满时直接放进去, 满了以后只有排在堆顶前面的行才替换堆顶 */
+        if (_rows.size() < _limit) {
+            _rows.push_back(std::move(row));
+            std::push_heap(_rows.begin(), _rows.end(), before);
+        } else if (_limit > 0 && _before(row, _rows.front())) {
+            std::pop_heap(_rows.begin(), _rows.end(), before);
+            _rows.back() = std::move(row);
+            std::push_heap(_rows.begin(), _rows.end(), before);
+        }
+        return;
+    }
+    _buffer_bytes += row_estimate_bytes(row.values);
+    _rows.push_back(std::move(row));
+    if (_buffer_bytes > GetMemoryBudget())
+        _spill();
+}
+
+void Sorter::_spill()
+{
+    /* 缓冲区按输入的次序排列, 稳定排序就能保持键相同的行的次序 */
+    std::stable_sort(_rows.begin(), _rows.end(), [this](Row const &a, Row const &b) {
+        return _keyBefore(a.key, b.key);
+    });
+    auto path = _temp_directory / std::format(".sort-{}.run", next_run_id++);
+    auto run = std::make_unique<Run>(path);
+    for (Row const &row: _rows)
+        run->write(row.values);
+    _runs.push_back(std::move(run));
+    _rows.clear();
+    _buffer_bytes = 0;
+}
+
+void Sorter::finish(Table::SnapshotRowFunc const &fn, std::pmr::memory_resource *arena)
+{
+    if (_limit != NO_LIMIT) {
+        std::sort_heap(_rows.begin(), _rows.end(),
+                       [this](Row const &a, Row const &b) { return _before(a, b); });
+    } else if (_runs.empty()) {
+        std::stable_sort(_rows.begin(), _rows.end(), [this](Row const &a, Row const &b) {
+            return _keyBefore(a.key, b.key);
+        });
+    }
+    if (_runs.empty()) {
+        for (Row &row: _rows)
+            fn(std::move(row.values));
+        _rows.clear();
+        return;
+    }
+
+    /* 多路归并: 每个顺串的当前行放进小根堆, 键相同时先输出先写出的顺串 */
+    if (!_rows.empty())
+        _spill();
+    std::vector<ValueListT> heads;
+    std::vector<CompactValue> head_keys(_runs.size());
+    heads.reserve(_runs.size());
+    for (size_t i = 0; i < _runs.size(); i++)
+        heads.push_back(ValueListCreate(arena));
+    auto after = [this, &head_keys](size_t a, size_t b) {
+        if (_keyBefore(head_keys[b], head_keys[a]))
+            return true;
+        return !_keyBefore(head_keys[a], head_keys[b]) && b < a;
+    };
+    auto read_head = [this, &heads, &head_keys, arena](size_t run) {
+        if (!_runs[run]->read(heads[run], arena))
+            return false;
+        head_keys[run] = CompactValue::FromValue(heads[run][_key].get());
+        return true;
+    };
+    std::vector<size_t> heap;
+    for (size_t i = 0; i < _runs.size(); i++) {
+        _runs[i]->rewind();
+        if (read_head(i))
+            heap.push_back(i);
+    }
+    std::make_heap(heap.begin(), heap.end(), after);
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), after);
+        size_t run = heap.back();
+        fn(std::move(heads[run]));
+        if (read_head(run))
+            std::push_heap(heap.begin(), heap.end(), after);
+        else
+            heap.pop_back();
+    }
+    _runs.clear();
+}
+
+} // namespace mygsql::engine
@@ -0,0 +1,101 @@
+#ifndef __MYG_SQL_ENGINE_SORT_H__
+#define __MYG_SQL_ENGINE_SORT_H__
+
+#include "base/mtb-exception.hxx"
+#include "base/sql-value.hxx"
+#include "engine-table.hxx"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <memory_resource>
+#include <string_view>
+#include <vector>
+
+namespace mygsql::engine {
+
+/** @class Sorter
+ * @brief order by与limit的排序算子: 按输出行的第`key`列排序, 列值相同的行保持输入的次序。
+ *        - 有limit时用大小为limit的堆只保留排在最前面的limit行(top-k), 内存与limit有关。
+ *        - 没有limit时把行缓冲在内存里, 缓冲区超过内存预算(`SetMemoryBudget`)时排好序写成
+ *          一个顺串文件, 放在数据库目录里; 最后多路归并所有顺串。顺串文件在排序器析构时删除。
+ *
+ *        不同类型的值(比如聚合查询输出的`NULL`文本与整数)按类型排序。排序键在输入时打包成
+ *        `CompactValue`, 比较不调用虚函数, 短字符串的比较不读`Value`对象。 */
+class Sorter {
+public:
+    using ValueListT = Table::ValueListT;
+    /** 没有limit */
+    static constexpr size_t NO_LIMIT = SIZE_MAX;
+
+    /** @class Exception
+     * @brief 顺串文件读写失败 */
+    class Exception: public MTB::Exception {
+    public:
+        Exception(std::filesystem::path const &path, std::string_view reason)
+            : MTB::Exception(MTB::ErrorLevel::CRITICAL,
+                std::format("Sorter::Exception on run file {}: {}", path.string(), reason)) {}
+    }; // class Sorter::Exception
+public:
+    /** @param key            排序的列在输出行里的位置
+     *  @param descending     降序
+     *  @param limit          只输出排在最前面的`limit`行
+     *  @param temp_directory 顺串文件所在的目录 */
+    Sorter(int32_t key, bool descending, size_t limit,
+           std::filesystem::path temp_directory);
+    ~Sorter();
+    Sorter(Sorter const &) = delete;
+    Sorter &operator=(Sorter const &) = delete;
+
+    /** @fn push(row)
+     * @brief 输入一行
+     * @throw Exception 写顺串文件失败 */
+    void push(ValueListT &&row);
+    /** @fn finish(fn, arena)
+     * @brief 输入结束, 按次序对每一行调用`fn(values)`. `arena`不为空时从顺串文件读出的行
+     *        从这个内存池分配(见`Value::New`)
+     * @throw Exception 读写顺串文件失败 */
+    void finish(Table::SnapshotRowFunc const &fn, std::pmr::memory_resource *arena = nullptr);
+    /** @brief getter: 写出的顺串个数, 0表示在内存里排完 */
+    size_t get_run_count() const { return _runs.size(); }
+
+    /** @fn GetMemoryBudget() static
+     * @brief Global getter: 不带limit的排序在内存里缓冲的字节数上限 */
+    static size_t GetMemoryBudget();
+    /** @fn SetMemoryBudget(bytes) static
+     * @brief Global setter: 设置排序的内存预算, 默认64MiB */
+    static void SetMemoryBudget(size_t bytes);
+private:
+    /** @struct Row
+     * @brief 缓冲的一行, `key`是打包好的排序键, `seq`是输入的次序 */
+    struct Row {
+        ValueListT   values;
+        CompactValue key;
+        uint64_t     seq;
+    }; // struct Row
+    class Run;
+
+    int32_t               _key;
+    bool                  _descending;
+    size_t                _limit;
+    std::filesystem::path _temp_directory;
+    uint64_t              _seq = 0;
+    /** top-k: 按输出次序的大根堆, 堆顶是保留的行里排在最后的 */
+    std::vector<Row>      _rows;
+    /** 不带limit: `_rows`是缓冲区, 估计的字节数 */
+    size_t                _buffer_bytes = 0;
+    std::vector<std::unique_ptr<Run>> _runs;
+
+    /** 键`a`是否排在键`b`前面 */
+    bool _keyBefore(CompactValue const &a, CompactValue const &b) const;
+    /** `a`是否排在`b`前面: 键相同时按输入的次序 */
+    bool _before(Row const &a, Row const &b) const;
+    /** 把缓冲区排好序写成一个顺串 */
+    void _spill();
+}; // class Sorter
+
+} // namespace mygsql::engine
+
+#endif
@@ -1,4 +1,5 @@
 #include "engine-table.hxx"
+#include "engine-loader.hxx"
 #include "base/mtb-object.hxx"
 #include "base/sql-value.hxx"
 #include "storage/storage-table.hxx"
@@ -6,7 +7,12 @@
 #include <cstdint>
 #include <deque>
 #include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <shared_mutex>
 #include <string_view>
+#include <utility>
 
 namespace mygsql::engine {
 
@@ -17,11 +23,12 @@ TableEntry::TableEntry(Table &table, ValueListT const &value_list)
         table._storage_table->appendEntry(value_list)) {}
 
 TableEntry::TableEntry(Table &table, StorageTable::Entry const &entry)
-    : _table(table),
+    : _table(table), _has_error(false),
       _internal_storage_entry(entry) {
-    for (StorageTypeItem const& i: _table._storage_table->get_type_item_list()) {
-        _value_list.push_back(entry.get(i.name));
-    }
+    size_t column_count = _table._storage_table->get_type_item_list().size();
+    _value_list.reserve(column_count);
+    for (size_t index = 0; index < column_count; index++)
+        _value_list.push_back(entry.getFromIndex(index));
 }
 
 Value *TableEntry::get(std::string_view key)
@@ -34,205 +41,583 @@ Value *TableEntry::get(std::string_view key)
 
 bool TableEntry::set(std::string_view key, Value *value)
 {
-    size_t index = _table._storage_table->getTypeIndex(key);
-    if (index == -1)
+    int32_t index = _table._storage_table->getTypeIndex(key);
+    if (index < 0)
+        return false;
+    return setFromIndex(index, value);
+}
+bool TableEntry::setFromIndex(int32_t index, Value *value)
+{
+    // 直接写入存储表, 这样懒加载的查询和主键的B+树索引才能看到新值。主键重复时写入会失败。
+    if (!_internal_storage_entry.setFromIndex(index, *value))
         return false;
     _value_list[index] = value;
     return true;
 }
 bool TableEntry::set(std::string_view key, std::string_view value)
 {
-    size_t index = _table._storage_table->getTypeIndex(key);
-    if (index == -1)
-        return false;
-    _value_list[index] = new StringValue(value);
-    return true;
+    owned<Value> new_value = new StringValue(value);
+    return set(key, new_value.get());
 }
 bool TableEntry::set(std::string_view key, int32_t value)
 {
-    size_t index = _table._storage_table->getTypeIndex(key);
-    if (index == -1)
-        return false;
-    _value_list[index] = new IntValue(value);
-    return true;
+    owned<Value> new_value = new IntValue(value);
+    return set(key, new_value.get());
 }
 
 void TableEntry::sync()
 {
+    if (!_dirty)
+        return;
+    _dirty = false;
     StorageTable::TypeItemListT const &ti_list {
         _table._storage_table->get_type_item_list()
     };
     for (int index = 0; Value *value: _value_list) {
-        StorageTypeItem const &item = ti_list[index];
-        _internal_storage_entry.set(item.name, *value);
+        _internal_storage_entry.setFromIndex(index, *value);
         index++;
     }
 }
 
+void TableEntry::markDirty()
+{
+    if (_dirty || _has_error)
+        return;
+    _dirty = true;
+    _table._dirty_entries.push_back(get_storage_id());
+}
+
 void TableEntry::removeAndMakeUnavailable()
 {
     _table._storage_table->deleteEntry(&_internal_storage_entry);
     _has_error = true;
 }
 
-Table::Table(StorageTable &table)
+static Table::AccessMode default_access_mode = Table::AccessMode::LAZY;
+/** 下一张被打开的表的结构编号, 从1开始, 0表示没有绑定 */
+static std::atomic_uint64_t next_schema_id = 1;
+
+Table::AccessMode Table::GetDefaultAccessMode() {
+    return default_access_mode;
+}
+void Table::SetDefaultAccessMode(AccessMode mode) {
+    default_access_mode = mode;
+}
+
+Table::Table(StorageTable &table, VersionManager &version_manager, AccessMode access_mode)
     : _storage_table(&table),
       _name(table.get_name()),
-      _primary_key_index(table.get_primary_index_order()) {
+      _access_mode(access_mode),
+      _version_manager(version_manager),
+      _version_store(version_manager, _rwlock),
+      _primary_key_index(table.get_primary_index_order()),
+      _schema_id(next_schema_id++) {
     _initializeFromStorageTable();
 }
 
 void Table::_initializeFromStorageTable()
 {
+    if (_access_mode != AccessMode::EAGER)
+        return;
     _storage_table->traverseReadEntries(
         [this](StorageTable::Entry const &entry) mutable {
             owned<TableEntry> tentry = new TableEntry(*this, entry);
-            _entry_list.push_back(std::move(tentry));
+            _entry_map.insert({entry.get_header_index(), std::move(tentry)});
         });
-    // 主键代码涉及外部修改，不能使用! 不能使用! 不能使用!
-    // if (_primary_key_index != -1) {
-    //     for (auto &i: _entry_list) {
-    //         _entry_map.insert({
-    //             i->_value_list[_primary_key_index].get(),
-    //             i});
-    //     }
-    // }
 }
 
-TableEntry *Table::insert(TableEntry::ValueListT const &value_list)
+int32_t Table::_getColumnIndex(std::string_view column) const
+{
+    int32_t index = _storage_table->getTypeIndex(column);
+    if (index < 0)
+        throw TableEntry::ColumnUnmatchedException(column);
+    return index;
+}
+
+bool Table::_selectByIndex(Condition const &condition, EntrySelectListT &out_list)
+{
+    auto select_leaf = [this, &out_list](Condition const &leaf) {
+        if (leaf.kind != Condition::Kind::COMPARE ||
+            !_storage_table->hasIndex(leaf.column.index))
+            return false;
+        return _storage_table->traverseByIndex(leaf.column.index, leaf.relation, leaf.value,
+            [&out_list](uint32_t id) {
+                out_list.push_back(id);
+                return true;
+            });
+    };
+    if (select_leaf(condition))
+        return true;
+    if (condition.kind != Condition::Kind::AND)
+        return false;
+    /* 子条件已经按选择率排好了序, 第一个能用索引的子条件选出的候选条目最少 */
+    for (auto const &child: condition.children) {
+        if (!select_leaf(*child))
+            continue;
+        std::erase_if(out_list, [this, &condition](uint32_t id) {
+            return !condition.matches(StorageTable::Entry(*_storage_table, id));
+        });
+        return true;
+    }
+    return false;
+}
+
+bool Table::createIndex(std::string_view name, std::string_view column,
+                        StorageTable::IndexKind kind)
+{
+    return _storage_table->createIndex(name, _getColumnIndex(column), kind);
+}
+
+Table::EntryPtrT Table::getEntry(uint32_t id)
+{
+    auto iter = _entry_map.find(id);
+    if (iter != _entry_map.end())
+        return iter->second;
+    StorageTable::Entry storage_entry(*_storage_table, id);
+    return new TableEntry(*this, storage_entry);
+}
+
+Table::ValuePtrT Table::_getValue(uint32_t id, int32_t column_index)
+{
+    auto iter = _entry_map.find(id);
+    if (iter != _entry_map.end())
+        return iter->second->_value_list[column_index];
+    return StorageTable::Entry(*_storage_table, id).getFromIndex(column_index);
+}
+
+Table::ValueListT Table::_captureValues(uint32_t id) const
+{
+    StorageTable::Entry entry(*_storage_table, id);
+    size_t column_count = _storage_table->get_type_item_list().size();
+    ValueListT values;
+    values.reserve(column_count);
+    for (size_t index = 0; index < column_count; index++)
+        values.push_back(entry.getFromIndex(index));
+    return values;
+}
+
+bool Table::_setValue(uint32_t id, int32_t column_index, Value *value)
+{
+    _version_store.recordBefore(id, true, [this, id]() { return _captureValues(id); });
+    auto iter = _entry_map.find(id);
+    if (iter != _entry_map.end())
+        return iter->second->setFromIndex(column_index, value);
+    StorageTable::Entry storage_entry(*_storage_table, id);
+    return storage_entry.setFromIndex(column_index, *value);
+}
+
+Table::EntryPtrT Table::insert(ValueListT const &value_list)
 {
     owned<TableEntry> entry = new TableEntry(*this, value_list);
-    if (nullptr == entry.get())
-        return nullptr;
-    TableEntry *ret = entry;
-    _entry_list.push_back(std::move(entry));
-    return ret;
+    _version_store.recordInsert(entry->get_storage_id());
+    if (_access_mode == AccessMode::EAGER)
+        _entry_map.insert({entry->get_storage_id(), entry});
+    return entry;
+}
+
+size_t Table::loadFromFile(std::string_view path)
+{
+    DelimitedFileReader reader(path);
+    DelimitedFileReader::FieldListT fields;
+    TypeItemListT const &type_list = get_type_item_list();
+    std::vector<ValueView> row(type_list.size());
+    for (size_t i = 0; i < type_list.size(); i++)
+        row[i].type = type_list[i].type;
+
+    if (!reader.nextRow(fields))
+        return 0;
+    /* 第一行与列名称相同时是表头 */
+    bool is_header = (fields.size() == type_list.size()) &&
+        std::equal(fields.begin(), fields.end(), type_list.begin(),
+                   [](std::string_view field, StorageTypeItem const &item) {
+                       return field == item.name;
+                   });
+    if (is_header && !reader.nextRow(fields))
+        return 0;
+
+    syncToStorageTable();
+    uint32_t first_id = _storage_table->get_entry_list_num();
+    _storage_table->beginBulkLoad(reader.estimateRowCount());
+    size_t count = 0;
+    try {
+        do {
+            if (fields.size() != type_list.size()) {
+                throw DelimitedFileReader::Exception(path, reader.get_line(),
+                        std::format("expected {} fields, got {}", type_list.size(), fields.size()));
+            }
+            for (size_t i = 0; i < fields.size(); i++) {
+                std::string_view field = fields[i];
+                if (row[i].type != Value::Type::INT) {
+                    row[i].string_value = field;
+                    continue;
+                }
+                auto [end, ec] = std::from_chars(field.data(), field.data() + field.size(),
+                                                 row[i].int_value);
+                if (ec != std::errc() || end != field.data() + field.size()) {
+                    throw DelimitedFileReader::Exception(path, reader.get_line(),
+                            std::format("column {}: '{}' is not an integer", type_list[i].name, field));
+                }
+            }
+            _storage_table->bulkAppend(row.data());
+            count++;
+        } while (reader.nextRow(fields));
+    } catch (...) {
+        _storage_table->abortBulkLoad();
+        throw;
+    }
+    _storage_table->finishBulkLoad();
+    /* 导入的条目都追加在原来的条目之后, 记成一个区间就够了 */
+    _version_store.recordInsertedRange(first_id, _storage_table->get_entry_list_num());
+    if (_access_mode == AccessMode::EAGER) {
+        /* 导入的条目不在缓存里, 重新建立缓存 */
+        _entry_map.clear();
+        _initializeFromStorageTable();
+    }
+    return count;
 }
 
 Table::EntrySelectListT Table::selectAll()
 {
     EntrySelectListT list = {};
-    for (EntryListT::iterator i = _entry_list.begin();
-         i != _entry_list.end();
-         i++) {
-        list.push_back(std::move(i));
-    }
+    _storage_table->traverseReadEntries(
+        [&list](StorageTable::Entry const &entry) {
+            list.push_back(entry.get_header_index());
+        });
     return list;
 }
 
-std::deque<Value*> Table::selectAllValue(std::string_view column)
+Table::ValueListT Table::selectAllValue(std::string_view column)
 {
-    std::deque<Value*> ret{};
-    for (auto &i: _entry_list) {
-        Value *val = i->get(column);
-        if (val == nullptr) {
-            throw TableEntry::ColumnUnmatchedException(column);
-        }
-        ret.push_back(val);
-    }
+    int32_t column_index = _getColumnIndex(column);
+    ValueListT ret{};
+    for (uint32_t id: selectAll())
+        ret.push_back(_getValue(id, column_index));
     return ret;
 }
 
-Table::EntrySelectListT Table::selectByCondition(
-                            std::string_view   condition_column,
-                            TotalOrderRelation relation,
-                            Value             *condition_value)
+MTB::Bitmap Table::_filterByCondition(Condition const &condition)
 {
-    // AC
-    // std::cout << "DEBUGGING" << std::endl;
-    EntrySelectListT ret{};
-    for (EntryListT::iterator i = _entry_list.begin();
-         i != _entry_list.end();
-         i++) {
-        Value *iteratored_value = (*i)->get(condition_column);
-        // std::cout << condition_column
-        //           << " type: "
-        //           << ValueTypeGetString(iteratored_value->get_value_type())
-        //           << std::endl;
-        if (iteratored_value == nullptr) {
-            throw TableEntry::ColumnUnmatchedException(condition_column);
-        }
-        if (ValueMeetsCondition(relation, iteratored_value, condition_value)) {
-            ret.push_back(i);
-        }
+    MTB::Bitmap selection;
+    EntrySelectListT indexed{};
+    if (_selectByIndex(condition, indexed)) {
+        if (!indexed.empty())
+            selection.resize(*std::max_element(indexed.begin(), indexed.end()) + 1);
+        for (uint32_t id: indexed)
+            selection.set(id);
+        return selection;
     }
-    // throw TableEntry::ColumnUnmatchedException(condition_column);
+    /* 全表扫描: 每一段求一次整个条件, 常量比较由存储表的扫描内核直接在映射区上判断,
+     * 不创建任何Value */
+    uint32_t limit = _storage_table->get_entry_list_num();
+    selection.resize(limit);
+    MTB::Bitmap chunk;
+    for (uint32_t first = 0; first < limit; first += SNAPSHOT_CHUNK_SIZE) {
+        uint32_t last = std::min(first + SNAPSHOT_CHUNK_SIZE, limit);
+        condition.filterRange(*_storage_table, first, last, chunk);
+        chunk.traverseSet([&selection, first](size_t bit) { selection.set(first + bit); });
+    }
+    return selection;
+}
+
+Table::EntrySelectListT Table::selectByCondition(Condition const &condition)
+{
+    EntrySelectListT ret{};
+    _filterByCondition(condition).traverseSet([&ret](size_t id) { ret.push_back(id); });
     return ret;
 }
 
-std::deque<Value*> Table::selectValueByCondition(
-                        std::string_view   column,
-                        std::string_view   condition_column,
-                        TotalOrderRelation relation,
-                        Value             *condition_value)
+Table::ValueListT Table::selectValueByCondition(std::string_view column,
+                                                Condition const &condition)
 {
-    EntrySelectListT list = selectByCondition(condition_column, relation, condition_value);
-    std::deque<Value*> ret;
-    for (auto &i: list) {
-        TableEntry *entry = (*i).get();
-        Value *value = entry->get(column);
-        if (value == nullptr) {
-            throw TableEntry::ColumnUnmatchedException(column);
-        }
-        ret.push_back(value);
-    }
+    int32_t column_index = _getColumnIndex(column);
+    EntrySelectListT list = selectByCondition(condition);
+    ValueListT ret;
+    for (uint32_t id: list)
+        ret.push_back(_getValue(id, column_index));
     return ret;
 }
 
-size_t Table::updateEntireTable(std::string_view column, Value *value)
+size_t Table::updateEntireTable(int32_t column_index, Value *value)
 {
     size_t ret_update_count = 0;
-    for (auto &i: _entry_list) {
-        if (i->set(column, value) == false)
-            return 0;
+    for (uint32_t id: selectAll()) {
+        if (_setValue(id, column_index, value) == false)
+            return ret_update_count;
         ret_update_count++;
     }
     return ret_update_count;
 }
 
-size_t Table::updateTableByCondition(
-            std::string_view column,     Value *value,
-            /* condition */
-            std::string_view   condition_column,
-            TotalOrderRelation relation, Value *condition_value)
+size_t Table::updateTableByCondition(int32_t column_index, Value *value,
+                                     Condition const &condition)
 {
     size_t ret_update_count = 0;
-    for (auto &i: _entry_list) {
-        if (ValueMeetsCondition(relation,
-                                i->get(condition_column),
-                                condition_value)) {
-            i->set(column, value);
+    MTB::Bitmap selection = _filterByCondition(condition);
+    selection.traverseSet([&](size_t id) {
+        if (_setValue(id, column_index, value))
             ret_update_count++;
-        }
-    }
+    });
     return ret_update_count;
 }
 
-size_t Table::deleteEntryByCondition(std::string_view   condition_column,
-                                     TotalOrderRelation relation,
-                                     Value *condition_value)
+void Table::clear()
 {
-    std::list<owned<TableEntry>> remove_list;
-    for (auto &i: _entry_list) {
-        Value *iter_value = i->get(condition_column);
-        if (iter_value == nullptr) {
-            throw TableEntry::ColumnUnmatchedException(condition_column);
-        }
-        if (ValueMeetsCondition(relation, iter_value, condition_value)) {
-            remove_list.push_back(i);
+    for (uint32_t id: selectAll()) {
+        _version_store.recordBefore(id, true, [this, id]() { return _captureValues(id); });
+        _storage_table->deleteEntryByID(id);
+    }
+    _entry_map.clear();
+}
+
+size_t Table::deleteEntryByCondition(Condition const &condition)
+{
+    MTB::Bitmap selection = _filterByCondition(condition);
+    selection.traverseSet([this](size_t id) {
+        _version_store.recordBefore(id, true, [this, id]() { return _captureValues(id); });
+        _deleteEntry(id);
+    });
+    return selection.count();
+}
+
+void Table::_deleteEntry(uint32_t id)
+{
+    auto iter = _entry_map.find(id);
+    if (iter != _entry_map.end()) {
+        iter->second->removeAndMakeUnavailable();
+        _entry_map.erase(iter);
+    } else {
+        _storage_table->deleteEntryByID(id);
+    }
+}
+
+void Table::ProjectingVisitor::visitEntry(StorageTable::Entry const &entry)
+{
+    if (is_done())
+        return;
+    ValueListT values = ValueListCreate(_arena);
+    values.reserve(_columns.size());
+    for (int32_t column: _columns)
+        values.push_back(entry.getFromIndex(column, _arena));
+    _count++;
+    _fn(std::move(values));
+}
+
+void Table::ProjectingVisitor::visitValues(ValueListT const &all_values)
+{
+    if (is_done())
+        return;
+    ValueListT values = ValueListCreate(_arena);
+    values.reserve(_columns.size());
+    for (int32_t column: _columns)
+        values.push_back(all_values[column]);
+    _count++;
+    _fn(std::move(values));
+}
+
+void Table::scanSnapshot(std::vector<int32_t> const &columns,
+                         Condition const *condition,
+                         SnapshotRowFunc const &fn)
+{
+    ProjectingVisitor visitor(columns, fn);
+    scanSnapshot(condition, visitor);
+}
+
+void Table::scanSnapshot(Condition const *condition, RowVisitor &visitor)
+{
+    std::shared_lock lock(_rwlock);
+    /* 在读锁下取快照, 之后修改这张表的写者都会为它保存旧版本 */
+    Snapshot snapshot(_version_manager);
+    _scanVersion(snapshot.get_timestamp(), &lock, condition, visitor);
+}
+
+void Table::scanSnapshot(Timestamp snapshot, Condition const *condition, RowVisitor &visitor)
+{
+    std::shared_lock lock(_rwlock);
+    /* 读当前状态时调用者持有写者锁, 不需要分段释放读锁 */
+    bool is_current = (snapshot == VersionStore::PENDING);
+    _scanVersion(snapshot, is_current ? nullptr : &lock, condition, visitor);
+}
+
+bool Table::scanIndexOrder(Timestamp snapshot, int32_t column, Condition const *condition,
+                           RowVisitor &visitor)
+{
+    std::shared_lock lock(_rwlock);
+    return _scanIndexOrder(snapshot, column, condition, visitor);
+}
+
+bool Table::scanIndexOrder(int32_t column, Condition const *condition, RowVisitor &visitor)
+{
+    std::shared_lock lock(_rwlock);
+    Snapshot snapshot(_version_manager);
+    return _scanIndexOrder(snapshot.get_timestamp(), column, condition, visitor);
+}
+
+bool Table::_scanIndexOrder(Timestamp snapshot, int32_t column, Condition const *condition,
+                            RowVisitor &visitor)
+{
+    if (!_storage_table->hasOrderedIndex(column))
+        return false;
+
+    MTB::Bitmap selection;
+    if (condition != nullptr)
+        selection = _filterByCondition(*condition);
+    /* 当前状态对快照不可见的条目, 以及快照看到的满足条件的旧版本 */
+    MTB::Bitmap hidden(std::max(_storage_table->get_entry_list_num(),
+                                _version_store.get_id_limit()));
+    std::vector<VersionStore::Version const*> old_rows;
+    _version_store.traverseHidden(0, hidden.size(), snapshot,
+        [&](uint32_t id, VersionStore::Version const *version) {
+            hidden.set(id);
+            if (version != nullptr &&
+                (condition == nullptr || condition->matches(version->values)))
+                old_rows.push_back(version);
+        });
+    auto old_key = [column](VersionStore::Version const *version) {
+        return ValueView::FromValue(version->values[column].get());
+    };
+    std::stable_sort(old_rows.begin(), old_rows.end(),
+        [&old_key](auto const *a, auto const *b) {
+            return old_key(a).compare(old_key(b)) < 0;
+        });
+
+    auto old_iter = old_rows.begin();
+    _storage_table->traverseInIndexOrder(column, [&](uint32_t id) {
+        if (hidden.test(id))
+            return true;
+        if (condition != nullptr && (id >= selection.size() || !selection.test(id)))
+            return true;
+        StorageTable::Entry entry(*_storage_table, id);
+        ValueView key = entry.view(column);
+        for (; old_iter != old_rows.end() && old_key(*old_iter).compare(key) < 0; old_iter++)
+            visitor.visitValues((*old_iter)->values);
+        visitor.visitEntry(entry);
+        return !visitor.is_done();
+    });
+    for (; old_iter != old_rows.end() && !visitor.is_done(); old_iter++)
+        visitor.visitValues((*old_iter)->values);
+    return true;
+}
+
+void Table::scanCurrent(std::vector<int32_t> const &columns,
+                        Condition const *condition,
+                        SnapshotRowFunc const &fn)
+{
+    ProjectingVisitor visitor(columns, fn);
+    scanCurrent(condition, visitor);
+}
+
+void Table::scanCurrent(Condition const *condition, RowVisitor &visitor)
+{
+    /* 还没有提交的修改的时间戳是PENDING, 在这个时间戳上所有修改都可见 */
+    std::shared_lock lock(_rwlock);
+    _scanVersion(VersionStore::PENDING, nullptr, condition, visitor);
+}
+
+void Table::_scanVersion(Timestamp timestamp, std::shared_lock<std::shared_mutex> *lock,
+                         Condition const *condition, RowVisitor &visitor)
+{
+    auto get_id_limit = [this]() {
+        return std::max(_storage_table->get_entry_list_num(), _version_store.get_id_limit());
+    };
+
+    MTB::Bitmap selection;
+    EntrySelectListT indexed{};
+    if (condition != nullptr && _selectByIndex(*condition, indexed)) {
+        uint32_t limit = get_id_limit();
+        selection.resize(limit);
+        for (uint32_t id: indexed)
+            selection.set(id);
+        _emitSnapshotRange(0, limit, timestamp, condition, selection, visitor);
+        return;
+    }
+    for (uint32_t first = 0; ; first += SNAPSHOT_CHUNK_SIZE) {
+        if (lock != nullptr && !lock->owns_lock())
+            lock->lock();
+        uint32_t limit = get_id_limit();
+        if (first >= limit)
+            break;
+        uint32_t last = std::min(first + SNAPSHOT_CHUNK_SIZE, limit);
+        if (condition != nullptr) {
+            condition->filterRange(*_storage_table, first, last, selection);
+        } else {
+            selection.resize(last - first);
+            selection.clear();
+            for (uint32_t id = first; id < last; id++) {
+                if (_storage_table->isEntryAllocated(id))
+                    selection.set(id - first);
+            }
         }
+        _emitSnapshotRange(first, last, timestamp, condition, selection, visitor);
+        if (visitor.is_done())
+            break;
+        /* 两段之间让写者有机会修改这张表 */
+        if (lock != nullptr)
+            lock->unlock();
     }
-    for (auto &i: remove_list) {
-        i->removeAndMakeUnavailable();
-        _entry_list.remove(i);
+}
+
+void Table::_emitSnapshotRange(uint32_t first, uint32_t last, Timestamp snapshot,
+                               Condition const *condition, MTB::Bitmap &selection,
+                               RowVisitor &visitor)
+{
+    /* 当前状态对快照不可见的条目: 去掉它们, 旧版本满足条件的另外输出 */
+    std::vector<std::pair<uint32_t, VersionStore::Version const*>> old_rows;
+    _version_store.traverseHidden(first, last, snapshot,
+        [&](uint32_t id, VersionStore::Version const *version) {
+            selection.reset(id - first);
+            if (version == nullptr)
+                return;
+            if (condition == nullptr || condition->matches(version->values)) {
+                old_rows.push_back({id, version});
+            }
+        });
+
+    auto old_iter = old_rows.begin();
+    auto emit_old_rows_before = [&](uint32_t id) {
+        for (; old_iter != old_rows.end() && old_iter->first < id; old_iter++)
+            visitor.visitValues(old_iter->second->values);
+    };
+    selection.traverseSet([&](size_t bit) {
+        uint32_t id = first + bit;
+        emit_old_rows_before(id);
+        visitor.visitEntry(StorageTable::Entry(*_storage_table, id));
+    });
+    emit_old_rows_before(last);
+}
+
+void Table::commit(bool durable)
+{
+    _storage_table->commit(durable);
+    _version_store.commit(_version_manager.allocateCommitTimestamp());
+}
+
+void Table::rollback()
+{
+    auto images = _version_store.rollback();
+    /* 先删除被修改过的条目, 再按前像重建事务开始以前存在的条目。
+     * 事务开始以前的状态满足主键约束, 所以重建时主键不会冲突 */
+    for (auto &[id, version]: images) {
+        if (_storage_table->isEntryAllocated(id))
+            _deleteEntry(id);
     }
-    return remove_list.size();
+    for (auto &[id, version]: images) {
+        if (!version.exists)
+            continue;
+        StorageTable::Entry entry = _storage_table->restoreEntry(id, version.values);
+        if (_access_mode == AccessMode::EAGER)
+            _entry_map.insert({id, new TableEntry(*this, entry)});
+    }
+    _storage_table->commit();
 }
 
 void Table::syncToStorageTable()
 {
-    for (auto &i: _entry_list)
-        i->sync();
+    for (uint32_t id: _dirty_entries) {
+        auto iter = _entry_map.find(id);
+        if (iter != _entry_map.end())
+            iter->second->sync();
+    }
+    _dirty_entries.clear();
 }
 
-} // namespace mygsql
\ No newline at end of file
+} // namespace mygsql
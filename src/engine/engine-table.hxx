@@ -3,6 +3,8 @@
 
 #include "base/mtb-exception.hxx"
 #include "base/sql-value.hxx"
+#include "engine-condition.hxx"
+#include "engine-version.hxx"
 #include "storage/storage-table.hxx"
 #include "base/mtb-object.hxx"
 #include <cstddef>
@@ -10,8 +12,9 @@
 #include <deque>
 #include <format>
 #include <functional>
-#include <list>
-#include <map>
+#include <memory_resource>
+#include <shared_mutex>
+#include <unordered_map>
 #include <string_view>
 #include <vector>
 
@@ -26,7 +29,7 @@ class TableEntry: public MTB::Object {
 public:
     friend class Table;
     using ValuePtrT  = StorageTable::Entry::ValuePtrT;
-    using ValueListT = std::vector<ValuePtrT>;
+    using ValueListT = mygsql::ValueListT;
 
     /** @class ColumnUnmatchedException
      * @brief 字符串column或者下标column_index所表示的列不存在 */
@@ -55,31 +58,50 @@ public:
     /** 通过列名称获取该条目中某一列对应的值
      * @warning 注意，你不能直接调用entry对应的函数。你必须获取的是_value_list对象里的值 */
     Value* get(std::string_view key);
-    /** 通过列名称设置该条目中某一列对应的值
-     * @warning 注意，你不能直接调用Entry里对应的set函数。你必须设置_value_list里对应条目的值 */
+    /** 通过列名称设置该条目中某一列对应的值。新值会同时写入存储条目，类型不一致或者主键重复时
+     *  返回false, 这时条目不会被修改。 */
     bool   set(std::string_view key, Value *value);
+    /** 同上, 但是用列下标指定列, 不按名称查找 */
+    bool   setFromIndex(int32_t index, Value *value);
     bool   set(std::string_view key, std::string_view value);
     bool   set(std::string_view key, int32_t value);
     ValueListT const &get_value_list() const {
         return _value_list;
     }
     bool has_error() const { return _has_error; }
+    /** 对应的存储条目ID */
+    uint32_t get_storage_id() const {
+        return _internal_storage_entry.get_header_index();
+    }
 
     /** 把_value_list的内容同步到_internal_storage_entry里。你需要调用
-     *  _internal_storage_entry的set方法来把_value_list的值放进去 */
+     *  _internal_storage_entry的set方法来把_value_list的值放进去。
+     *  `set`已经会直接写入存储条目, 所以只有被`markDirty`标记过的条目才会真正写入,
+     *  干净的条目直接返回。 */
     void sync();
 
+    /** 标记这个条目的缓存与存储条目不一致。直接修改了`get`返回的值以后要调用它,
+     *  条目会被记进所属表的脏条目列表, 下一次`Table::syncToStorageTable`时写入。 */
+    void markDirty();
+    /** @brief getter:缓存是否有还没有写入存储条目的修改 */
+    bool is_dirty() const { return _dirty; }
+
     /** 移除条目。移除后条目不可用。 */
     void removeAndMakeUnavailable();
 private:
     bool                _has_error;
+    bool                _dirty = false;
     Table              &_table;
     ValueListT          _value_list;
     StorageTable::Entry _internal_storage_entry;
 }; // class TableEntry
 
 /** @class Table
- * @brief 执行引擎的表，存放条目 */
+ * @brief 执行引擎的表。条目默认是懒加载的：打开表时不读取任何条目，查询时直接在存储表的
+ *        映射区上用`ValueView`判断条件，只有被选中的条目才会被复制成`TableEntry`.
+ *
+ *        条目在存储表里原地修改, 修改以前的样子保存在表的版本存储(`VersionStore`)里,
+ *        查询用`scanSnapshot`在快照上读, 所以长查询不需要一直持有表的读锁。 */
 class Table: public MTB::Object {
 public:
     friend class TableEntry;
@@ -89,15 +111,67 @@ public:
     using TypeItemMapT  = StorageTable::TypeItemMapT;  // 用于快速查找的类型映射表
     /* 自己的类型定义 */
     using EntryPtrT  = owned<TableEntry>; // 查询表条目智能指针类型. 使用指针是防止可能的内存移动导致其他引用失效
-    using EntryMapT  = std::map<Value*, EntryPtrT>; // 查询表的索引表类型，根据主键排序。如果没有主键，那这个索引表就不会被使用。
-    using EntryListT = std::list<EntryPtrT>;        // 查询表的条目列表类型。
+    // 存储条目ID到查询表条目的映射表。只有EAGER模式会使用，作为所有条目的缓存。
+    using EntryMapT  = std::unordered_map<uint32_t, EntryPtrT>;
     // 检查值是否符合func的条件的函数类型。符合的话，就返回true.
     using ValueConditionCheckFunc = std::function<bool(Value*)>;
     /* 与外部交互的类型定义 */
-    using EntrySelectListT = std::deque<EntryListT::iterator>;
+    using EntrySelectListT = std::deque<uint32_t>; // 被选中条目的存储条目ID列表, 按ID升序
+    using ValuePtrT        = TableEntry::ValuePtrT;
+    using ValueListT       = TableEntry::ValueListT;
+    // 快照查询每选中一个条目调用一次, 参数是被选中的列的值
+    using SnapshotRowFunc  = std::function<void(ValueListT &&values)>;
+
+    /** @class RowVisitor
+     * @brief 快照查询的输出。当前状态可见的条目直接给出存储条目, 访问者只读它需要的列,
+     *        不必为每一格创建`Value`; 快照上看到的旧版本给出所有列的值。
+     *        两种输出按ID升序交替出现。 */
+    class RowVisitor {
+    public:
+        virtual ~RowVisitor() = default;
+        /** 当前状态的条目。`entry`只在这次调用里有效 */
+        virtual void visitEntry(StorageTable::Entry const &entry) = 0;
+        /** 版本存储里的旧版本, `values`按列的次序排列 */
+        virtual void visitValues(ValueListT const &values) = 0;
+        /** 访问者不再需要更多的条目(比如已经输出了limit行)时返回true, 扫描会尽早结束 */
+        virtual bool is_done() const { return false; }
+    }; // class RowVisitor
+
+    /** @class ProjectingVisitor
+     * @brief 把扫描到的条目投影成下标为`columns`的列的值, 交给`SnapshotRowFunc`.
+     *        输出`limit`行以后忽略之后的条目, 并让扫描尽早结束。
+     *        `arena`不为空时输出的行与值从这个内存池分配(见`Value::New`) */
+    class ProjectingVisitor final: public RowVisitor {
+    public:
+        ProjectingVisitor(std::vector<int32_t> const &columns, SnapshotRowFunc const &fn,
+                          size_t limit = SIZE_MAX,
+                          std::pmr::memory_resource *arena = nullptr)
+            : _columns(columns), _fn(fn), _limit(limit), _arena(arena) {}
+
+        void visitEntry(StorageTable::Entry const &entry) override;
+        void visitValues(ValueListT const &all_values) override;
+        bool is_done() const override { return _count >= _limit; }
+    private:
+        std::vector<int32_t> const &_columns;
+        SnapshotRowFunc const      &_fn;
+        size_t                      _limit;
+        size_t                      _count = 0;
+        std::pmr::memory_resource  *_arena;
+    }; // class ProjectingVisitor
+
+    /** 快照查询每持有一次表的读锁扫描的条目个数 */
+    static constexpr uint32_t SNAPSHOT_CHUNK_SIZE = 64 * 1024;
+
+    /** @enum AccessMode
+     * @brief 条目的访问模式 */
+    enum class AccessMode: int32_t {
+        LAZY,  // 打开表时不加载条目, 查询时直接读映射区. 打开表的开销与条目个数无关
+        EAGER  // 打开表时把所有条目加载成TableEntry并缓存起来, 适合反复查询的小表
+    }; // enum class AccessMode
 public:
     /** 从已经加载的存储表初始化一个查询表。你需要分解步骤，并调用下面的私有表创建函数。 */
-    Table(StorageTable &storage_table);
+    Table(StorageTable &storage_table, VersionManager &version_manager,
+          AccessMode access_mode = GetDefaultAccessMode());
     ~Table() override {
         syncToStorageTable();
     }
@@ -108,58 +182,126 @@ public:
     StorageTable::TypeItemListT const &get_type_item_list() const {
         return _storage_table->get_type_item_list();
     }
-    EntryMapT &entry_map() { return _entry_map; }
     EntryMapT const &get_entry_map() const {
         return _entry_map;
     }
-    EntryListT const &get_entry_list() const {
-        return _entry_list;
-    }
+    /** 已分配的条目个数 */
+    size_t get_entry_count() const { return _storage_table->get_entry_count(); }
     std::string_view get_name() const { return _name; }
+    /** 表结构的编号。每打开或者新建一张表都会得到一个新编号, 所以表被删除重建以后编号会变,
+     *  编译好的计划用它判断绑定的列下标是否仍然有效 */
+    uint64_t get_schema_id() const { return _schema_id; }
+    AccessMode get_access_mode() const { return _access_mode; }
     int32_t get_primary_key_index() const { return _primary_key_index; }
     bool has_primary_key_index() const { return (_primary_key_index != 0xFFFF'FFFF); }
 
+    /** 根据存储条目ID取出一个查询表条目。EAGER模式返回缓存的条目, LAZY模式会从映射区
+     *  读取一个新的条目。 */
+    EntryPtrT getEntry(uint32_t id);
+
     /** 根据值列表插入一个值。一个合法的值列表，每个值类型的次序就是type_item_list()的类型次序。
-     *  你需要遍历TypeItemList, 检查列表在类型次序上是否合法；然后，如果有主键，要检查主键是否重复。
-     *  最后，创建一个Entry对象，将其插入条目列表。如果有主键，就插入索引表。 */
-    TableEntry *insert(TableEntry::ValueListT const &value_list);
+     *  主键重复时, 存储表会抛出`StorageTable::DuplicateKeyException`. */
+    EntryPtrT insert(ValueListT const &value_list);
+
+    /** load语句: 从CSV/TSV文件批量导入条目。文件的每一行是一个条目, 字段按列的次序排列;
+     *  第一行与列名称完全相同时当作表头跳过。导入失败时这次导入的条目全部撤销。
+     * @return 导入的条目个数
+     * @throw DelimitedFileReader::Exception 文件打不开或者格式不对
+     * @throw StorageTable::DuplicateKeyException 主键重复 */
+    size_t loadFromFile(std::string_view path);
 
     /** select语句的部分实现：选择所有值，返回一整个列表 */
     EntrySelectListT selectAll();
-    /** select语句的部分实现：根据条件选择，得到一个列表 */
-    EntrySelectListT selectByCondition(std::string_view   condition_column,
-                                       TotalOrderRelation relation,
-                                       Value             *condition_value);
+    /** select语句的部分实现：根据绑定到这张表的条件选择，得到一个列表 */
+    EntrySelectListT selectByCondition(Condition const &condition);
     /** select语句的部分实现：选择所有值，返回值列表 */
-    std::deque<Value*> selectAllValue(std::string_view column);
+    ValueListT selectAllValue(std::string_view column);
     /** select语句的部分实现：根据条件选择，得到值列表 */
-    std::deque<Value*> selectValueByCondition(std::string_view   column,
-                                              std::string_view   condition_column,
-                                              TotalOrderRelation relation,
-                                              Value             *condition_value);
+    ValueListT selectValueByCondition(std::string_view column,
+                                      Condition const &condition);
+
+    /** @fn scanCurrent(columns, condition, fn)
+     * @brief 同`scanSnapshot`, 但是读当前状态, 包括还没有提交的修改。
+     *        事务读自己修改过的表时使用。在一把读锁下完成。
+     * @warning 调用者要持有这张表的写者锁 */
+    void scanCurrent(std::vector<int32_t> const &columns,
+                     Condition const *condition,
+                     SnapshotRowFunc const &fn);
+    /** @brief 同上, 但是把条目交给`visitor`, 不复制列的值 */
+    void scanCurrent(Condition const *condition, RowVisitor &visitor);
+
+    /** @fn scanSnapshot(columns, condition, fn)
+     * @brief MVCC的select语句: 在一个快照上按ID升序遍历满足条件的条目, 对每个条目调用
+     *        `fn(values)`, `values`是下标为`columns`的列的值。`condition`是绑定到这张表的
+     *        where条件, 为空时选择所有条目。结果与查询开始那一刻的表一致。
+     *
+     *        全表扫描每`SNAPSHOT_CHUNK_SIZE`个条目释放一次表的读锁, 写者可以在两段之间修改表,
+     *        整个where条件在每一段上一次求完; 用索引求解的查询很快, 在一把读锁下完成。
+     * @warning 调用者不能持有这张表的锁; `fn`在持有表的读锁时被调用, 不要在里面访问这张表 */
+    void scanSnapshot(std::vector<int32_t> const &columns,
+                      Condition const *condition,
+                      SnapshotRowFunc const &fn);
+    /** @fn scanSnapshot(condition, visitor)
+     * @brief 同上, 但是把条目交给`visitor`, 不复制列的值。聚合查询用它直接在映射区上求值
+     * @warning 同上, `visitor`在持有表的读锁时被调用 */
+    void scanSnapshot(Condition const *condition, RowVisitor &visitor);
+    /** @fn scanSnapshot(snapshot, condition, visitor)
+     * @brief 同上, 但是在调用者已经取好的快照上扫描, `snapshot`为`VersionStore::PENDING`时
+     *        同`scanCurrent`. 访问多张表的查询同时持有这些表的读锁时取一个快照, 再逐张表扫描,
+     *        所有表的结果都与同一时刻一致 */
+    void scanSnapshot(Timestamp snapshot, Condition const *condition, RowVisitor &visitor);
+
+    /** @fn scanIndexOrder(snapshot, column, condition, visitor)
+     * @brief 同`scanSnapshot(snapshot, condition, visitor)`, 但是按第`column`列的B+树索引的次序
+     *        (列值升序, 列值相同时ID升序)输出, 快照看到的旧版本按列值插入到相应的位置。
+     *        条件先分段求成位图, 再沿着索引输出被选中的条目。在一把读锁下完成。
+     * @return 这一列没有B+树索引时返回false, 这时什么都不输出 */
+    bool scanIndexOrder(Timestamp snapshot, int32_t column, Condition const *condition,
+                        RowVisitor &visitor);
+    /** @fn scanIndexOrder(column, condition, visitor)
+     * @brief 同上, 但是在持有读锁时自己取快照。order by的列有B+树索引时, 查询沿着索引输出,
+     *        不需要排序; 有limit时输出够了就停下。
+     * @warning 调用者不能持有这张表的锁 */
+    bool scanIndexOrder(int32_t column, Condition const *condition, RowVisitor &visitor);
 
-    /** update语句，更新整张表。
+    /** update语句，更新整张表。列由列下标指定。
      * @return 返回更新的条目数量 */
-    size_t updateEntireTable(std::string_view column, Value *value);
-    size_t updateTableByCondition(
-            std::string_view column,     Value *value,
-            /* condition */
-            std::string_view condition_column,
-            TotalOrderRelation relation, Value *condition_value);
+    size_t updateEntireTable(int32_t column_index, Value *value);
+    size_t updateTableByCondition(int32_t column_index, Value *value,
+                                  Condition const &condition);
     
     /** delete语句 */
-    void clear() {
-        for (auto &i: _entry_list) {
-            _storage_table->deleteEntry(&i->_internal_storage_entry);
-        }
-        _entry_list.clear();
+    void clear();
+    size_t deleteEntryByCondition(Condition const &condition);
+
+    /** create index语句: 在列`column`上建立名为`name`、种类为`kind`的二级索引。之后条件
+     *  (或者AND条件的一个子条件)是`column`与常量比较的查询、更新与删除都会自动使用这个索引
+     *  (哈希索引只用于等值条件)。
+     * @return 同名的索引已经存在, 或者这一列已经有索引时返回false
+     * @throw TableEntry::ColumnUnmatchedException 列不存在 */
+    bool createIndex(std::string_view name, std::string_view column,
+                     StorageTable::IndexKind kind = StorageTable::IndexKind::BTREE);
+
+    /** 提交: 等待这张表目前为止的修改写入存储表的预写日志并落盘, 然后给这次提交保存的旧版本
+     *  打上提交时间戳, 之后的快照能看到这些修改。每条修改语句结束时调用。
+     *  `durable`为false时不等待落盘, 只在多表事务已经写了数据库的提交日志以后使用。 */
+    void commit(bool durable = true);
+    /** 两阶段提交的准备: 等待存储表目前为止的修改落盘, 见`StorageTable::prepare` */
+    void prepare() { _storage_table->prepare(); }
+    /** 开始ID为`transaction_id`的事务: 之后的修改都保存前像, 直到`commit`或者`rollback`.
+     *  存储表同时把前像写进预写日志, 崩溃以后没有提交的修改会被撤销。
+     *  事务期间调用者一直持有表的写者锁, 语句结束时不调用`commit`. */
+    void beginTransaction(uint64_t transaction_id) {
+        _version_store.beginTransaction();
+        _storage_table->beginTransaction(transaction_id);
     }
-    size_t deleteEntryByCondition(std::string_view   condition_column,
-                                  TotalOrderRelation relation,
-                                  Value              *condition_value);
+    /** 回滚: 用事务保存的前像把条目恢复成事务开始以前的样子, 恢复的条目ID不变 */
+    void rollback();
+    /** 检查点: 把存储表的文件写回磁盘并清空预写日志。 */
+    void checkpoint() { _storage_table->checkpoint(); }
 
-    /** 把当前查询表的内容同步到存储表中。你需要遍历整个查询表的每个条目，检查
-     *  条目的主键是否重复。然后调用条目的`sync()`成员函数。 */
+    /** 把缓存的条目同步到存储表中。条目的修改是直接写入存储表的，所以只检查脏条目列表里的
+     *  条目, 代价与修改过的条目个数有关而与表的大小无关。 */
     void syncToStorageTable();
 
     /** @brief 把{column, value_type, is_primary}三元组转换成一个类型描述对象。
@@ -172,26 +314,71 @@ public:
                                 bool             is_primary) {
         return StorageTypeItem{column, value_type, is_primary, 0};
     }
+
+    /** 表的读写锁。查询持有读锁, 所以多个会话可以同时查询; 修改条目持有写锁 */
+    std::shared_mutex &rwlock() const { return _rwlock; }
+    /** 写者锁。修改这张表的语句或者事务持有它, 所以同一时刻只有一个写者; 事务在两条语句之间
+     *  只持有写者锁, 不持有读写锁, 查询可以继续在快照上读。先加写者锁再加读写锁 */
+    std::timed_mutex &writer_lock() const { return _writer_lock; }
+    /** getter: 所有表共享的版本管理器 */
+    VersionManager &get_version_manager() const { return _version_manager; }
+    /** getter: 这张表的旧版本 */
+    VersionStore const &get_version_store() const { return _version_store; }
+
+    /** @fn GetDefaultAccessMode() static
+     * @brief Global getter: 新打开的表使用的访问模式 */
+    static AccessMode GetDefaultAccessMode();
+    /** @fn SetDefaultAccessMode() static
+     * @brief Global setter: 设置新打开的表使用的访问模式, 已经打开的表不受影响 */
+    static void SetDefaultAccessMode(AccessMode mode);
 private:
     StorageTableT _storage_table; // 存储表
-    EntryMapT     _entry_map;   // 索引表，根据主键排序。
-    EntryListT    _entry_list;  // 条目列表
+    EntryMapT     _entry_map;   // EAGER模式下的条目缓存
+    std::vector<uint32_t> _dirty_entries; // 被标记为脏的缓存条目ID, 可能包含已经删除的条目
     std::string   _name;        // 表名称。初始化时可以从_storage_table读取。
+    AccessMode    _access_mode; // 条目访问模式
+    mutable std::shared_mutex _rwlock;      // 表的读写锁
+    mutable std::timed_mutex  _writer_lock; // 写者锁. 事务要能在等待超时以后放弃
+    VersionManager &_version_manager;  // 所有表共享的版本管理器
+    VersionStore    _version_store;    // 这张表的旧版本, 由_rwlock保护
     /** 表的状态 */
     int32_t   _primary_key_index;
+    uint64_t  _schema_id;
 
     /* 表创建函数 */
     /** @brief 在创建表时使用，根据内置的StorageTable对象初始化自己。
-     * 步骤包括：
-     * - 检查有没有主键(Primary Key)
-     * - 使用_storage_table.traverseReadEntries()+柯里化的方式遍历已经
-     *   分配的存储条目(StorageTable::Entry)
-     *   然后调用MTB::make_owned<TableEntry>(TableEntry构造函数的参数)
-     *   创建一个查询条目(TableEntry)
-     *   最后把这个查询条目插入条目列表 */
+     *  LAZY模式什么都不做; EAGER模式会遍历已经分配的存储条目, 为每一个条目
+     *  创建一个查询条目(TableEntry)并放进缓存。 */
     void _initializeFromStorageTable();
-    /** @brief 倘若有主键，就遍历条目列表，把条目插入索引表。 */
-    void _loadEntryMap();
+    /** @brief 倘若条件是索引列与常量的比较，且关系可以用索引求解，就用索引选择条目。
+     *  条件是AND时按子条件的次序找第一个可以用索引求解的子条件, 再对选出的条目求整个条件。
+     * @return 没有使用索引时返回false, 调用者需要做全表扫描。 */
+    bool _selectByIndex(Condition const &condition, EntrySelectListT &out_list);
+    /** @brief 求满足条件的条目集合, 第i位为1表示ID为i的条目被选中。
+     *  可以用索引时用索引, 否则按`SNAPSHOT_CHUNK_SIZE`分段, 每一段求一次整个条件。 */
+    MTB::Bitmap _filterByCondition(Condition const &condition);
+    /** @brief 根据列下标取值。有缓存时取缓存的值，否则从映射区复制一个值。 */
+    ValuePtrT _getValue(uint32_t id, int32_t column_index);
+    /** @brief 把值写入存储条目, 并更新缓存。 */
+    bool _setValue(uint32_t id, int32_t column_index, Value *value);
+    /** @brief 读出条目`id`所有列的值, 作为修改以前的旧版本 */
+    ValueListT _captureValues(uint32_t id) const;
+    /** @brief 删除条目`id`, 有缓存时同时删除缓存的条目 */
+    void _deleteEntry(uint32_t id);
+    /** @brief `scanSnapshot`与`scanCurrent`的实现: 在时间戳`snapshot`上扫描。
+     *  `lock`不为空时每扫描一段释放一次读锁 */
+    void _scanVersion(Timestamp snapshot, std::shared_lock<std::shared_mutex> *lock,
+                      Condition const *condition, RowVisitor &visitor);
+    /** @brief `scanIndexOrder`的实现, 调用者持有这张表的读锁 */
+    bool _scanIndexOrder(Timestamp snapshot, int32_t column, Condition const *condition,
+                         RowVisitor &visitor);
+    /** @brief 快照查询的一段: `selection`的第i位表示ID为`first + i`的条目的当前状态被选中,
+     *  用快照修正以后按ID升序输出`[first, last)`里的结果 */
+    void _emitSnapshotRange(uint32_t first, uint32_t last, Timestamp snapshot,
+                            Condition const *condition, MTB::Bitmap &selection,
+                            RowVisitor &visitor);
+    /** @brief 列名称转换为列下标, 列不存在时抛出ColumnUnmatchedException */
+    int32_t _getColumnIndex(std::string_view column) const;
 }; // class Table
 
 } // namespace mygsql::engine
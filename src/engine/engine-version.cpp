@@ -0,0 +1,207 @@
+#include "engine-version.hxx"
+#include <chrono>
+
+namespace mygsql::engine {
+
+VersionManager::VersionManager()
+{
+    _gc_thread = std::thread(&VersionManager::_gcMain, this);
+}
+
+VersionManager::~VersionManager()
+{
+    {
+        std::lock_guard lock(_store_mutex);
+        _stopping = true;
+    }
+    _gc_cond.notify_all();
+    _gc_thread.join();
+}
+
+Timestamp VersionManager::acquireSnapshot()
+{
+    std::lock_guard lock(_mutex);
+    _active_snapshots.insert(_clock);
+    return _clock;
+}
+
+void VersionManager::releaseSnapshot(Timestamp snapshot)
+{
+    std::lock_guard lock(_mutex);
+    auto iter = _active_snapshots.find(snapshot);
+    if (iter != _active_snapshots.end())
+        _active_snapshots.erase(iter);
+}
+
+Timestamp VersionManager::allocateCommitTimestamp()
+{
+    std::lock_guard lock(_mutex);
+    return ++_clock;
+}
+
+bool VersionManager::has_active_snapshots() const
+{
+    std::lock_guard lock(_mutex);
+    return !_active_snapshots.empty();
+}
+
+Timestamp VersionManager::get_oldest_snapshot() const
+{
+    std::lock_guard lock(_mutex);
+    return _active_snapshots.empty() ? _clock : *_active_snapshots.begin();
+}
+
+void VersionManager::registerStore(VersionStore *store)
+{
+    std::lock_guard lock(_store_mutex);
+    _stores.insert(store);
+}
+
+void VersionManager::unregisterStore(VersionStore *store)
+{
+    std::lock_guard lock(_store_mutex);
+    _stores.erase(store);
+}
+
+void VersionManager::collectGarbage()
+{
+    std::lock_guard lock(_store_mutex);
+    Timestamp oldest = get_oldest_snapshot();
+    for (VersionStore *store: _stores) {
+        /* 不等待正在被读写的表, 下一轮再回收它 */
+        std::unique_lock table_lock(store->table_lock(), std::try_to_lock);
+        if (table_lock.owns_lock())
+            store->collect(oldest);
+    }
+}
+
+void VersionManager::_gcMain()
+{
+    std::unique_lock lock(_store_mutex);
+    while (!_stopping) {
+        _gc_cond.wait_for(lock, std::chrono::milliseconds(GC_INTERVAL_MS));
+        if (_stopping)
+            break;
+        lock.unlock();
+        collectGarbage();
+        lock.lock();
+    }
+}
+
+VersionStore::VersionStore(VersionManager &manager, std::shared_mutex &table_lock)
+    : _manager(manager), _table_lock(table_lock)
+{
+    _manager.registerStore(this);
+}
+
+VersionStore::~VersionStore()
+{
+    _manager.unregisterStore(this);
+}
+
+Timestamp VersionStore::_getInitialBegin(uint32_t id) const
+{
+    for (InsertedRange const &range: _inserted_ranges) {
+        if (id >= range.first && id < range.last)
+            return range.timestamp;
+    }
+    return 0;
+}
+
+void VersionStore::_recordBefore(uint32_t id, bool exists, ValueListT &&values)
+{
+    auto [iter, inserted] = _chains.try_emplace(id);
+    VersionChain &chain = iter->second;
+    if (inserted)
+        chain.current_begin = _getInitialBegin(id);
+    chain.versions.push_back({chain.current_begin, PENDING, exists, std::move(values)});
+    chain.current_begin = PENDING;
+    _pending.push_back(id);
+}
+
+void VersionStore::recordInsertedRange(uint32_t first, uint32_t last)
+{
+    if (first >= last || !_manager.has_active_snapshots())
+        return;
+    _inserted_ranges.push_back({first, last, PENDING});
+    _pending_ranges++;
+}
+
+void VersionStore::commit(Timestamp timestamp)
+{
+    for (size_t i = _inserted_ranges.size() - _pending_ranges; i < _inserted_ranges.size(); i++)
+        _inserted_ranges[i].timestamp = timestamp;
+    _pending_ranges = 0;
+    for (uint32_t id: _pending) {
+        VersionChain &chain = _chains.at(id);
+        Version &version = chain.versions.back();
+        if (version.begin == PENDING) /* 同一次提交里导入又修改的条目 */
+            version.begin = timestamp;
+        version.end         = timestamp;
+        chain.current_begin = timestamp;
+    }
+    _pending.clear();
+    _in_transaction = false;
+}
+
+std::vector<std::pair<uint32_t, VersionStore::Version>> VersionStore::rollback()
+{
+    _inserted_ranges.resize(_inserted_ranges.size() - _pending_ranges);
+    _pending_ranges = 0;
+    std::vector<std::pair<uint32_t, Version>> images;
+    images.reserve(_pending.size());
+    for (uint32_t id: _pending) {
+        auto iter = _chains.find(id);
+        VersionChain &chain = iter->second;
+        /* 前像开始的时间就是修改以前的当前状态开始的时间 */
+        chain.current_begin = chain.versions.back().begin;
+        images.push_back({id, std::move(chain.versions.back())});
+        chain.versions.pop_back();
+        if (chain.versions.empty() && chain.current_begin == _getInitialBegin(id))
+            _chains.erase(iter);
+    }
+    _pending.clear();
+    _in_transaction = false;
+    return images;
+}
+
+VersionStore::Visibility
+VersionStore::lookup(uint32_t id, Timestamp snapshot, Version const *&out_version) const
+{
+    auto iter = _chains.find(id);
+    if (iter == _chains.end()) {
+        return (_getInitialBegin(id) <= snapshot) ? Visibility::CURRENT
+                                                  : Visibility::INVISIBLE;
+    }
+    VersionChain const &chain = iter->second;
+    if (chain.current_begin <= snapshot)
+        return Visibility::CURRENT;
+    for (auto version = chain.versions.rbegin(); version != chain.versions.rend(); version++) {
+        if (version->begin <= snapshot && snapshot < version->end) {
+            if (!version->exists)
+                return Visibility::INVISIBLE;
+            out_version = &*version;
+            return Visibility::OLD;
+        }
+    }
+    return Visibility::INVISIBLE;
+}
+
+void VersionStore::collect(Timestamp oldest)
+{
+    for (auto iter = _chains.begin(); iter != _chains.end(); ) {
+        VersionChain &chain = iter->second;
+        std::erase_if(chain.versions, [oldest](Version const &version) {
+            return version.end <= oldest;
+        });
+        if (chain.versions.empty() && chain.current_begin <= oldest)
+            iter = _chains.erase(iter);
+        else
+            iter++;
+    }
+    std::erase_if(_inserted_ranges, [oldest](InsertedRange const &range) {
+        return range.timestamp <= oldest;
+    });
+}
+
+} // namespace mygsql::engine
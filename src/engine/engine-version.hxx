@@ -0,0 +1,233 @@
+#ifndef __MYG_SQL_ENGINE_VERSION_H__
+#define __MYG_SQL_ENGINE_VERSION_H__
+
+#include "base/mtb-object.hxx"
+#include "base/sql-value.hxx"
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace mygsql::engine {
+using MTB::owned;
+
+/** 提交时间戳。每次提交把全局时钟加一, 快照的时间戳是取快照时的时钟 */
+using Timestamp = uint64_t;
+
+class VersionStore;
+
+/** @class VersionManager
+ * @brief 多版本并发控制的全局部分: 版本时钟、活跃快照集合与后台垃圾回收线程。
+ *        所有会话共享一个版本管理器。
+ *
+ *        快照的时间戳为`S`时, 提交时间戳不超过`S`的修改都可见。没有活跃快照时, 写者不需要保存
+ *        旧版本, 因为之后取的快照一定能看到它的修改。 */
+class VersionManager: public MTB::Object {
+public:
+    /** 后台垃圾回收的周期(毫秒) */
+    static constexpr int GC_INTERVAL_MS = 100;
+public:
+    VersionManager();
+    ~VersionManager() override;
+
+    /** @fn acquireSnapshot()
+     * @brief 取一个快照并登记为活跃快照。
+     * @warning 要在持有被读的表的读锁时调用, 这样取快照时没有正在写这张表的语句,
+     *          之后的写者都能看到这个快照并为它保存旧版本。 */
+    Timestamp acquireSnapshot();
+    /** @fn releaseSnapshot(snapshot)
+     * @brief 快照用完了, 它需要的旧版本可以回收 */
+    void releaseSnapshot(Timestamp snapshot);
+    /** @fn allocateCommitTimestamp()
+     * @brief 为一次提交分配时间戳 */
+    Timestamp allocateCommitTimestamp();
+
+    /** @brief 有没有活跃快照 */
+    bool has_active_snapshots() const;
+    /** @brief 最老的活跃快照; 没有活跃快照时是当前时钟。
+     *         结束时间不超过它的旧版本对所有快照都不可见 */
+    Timestamp get_oldest_snapshot() const;
+
+    /** 登记与注销一张表的版本存储, 后台线程会定期回收它的旧版本 */
+    void registerStore(VersionStore *store);
+    void unregisterStore(VersionStore *store);
+
+    /** @fn collectGarbage()
+     * @brief 立即回收所有表的旧版本。正在被写的表会被跳过 */
+    void collectGarbage();
+private:
+    mutable std::mutex         _mutex;
+    Timestamp                  _clock = 0;
+    std::multiset<Timestamp>   _active_snapshots;
+
+    std::mutex                        _store_mutex; // 保护_stores, 回收时一直持有
+    std::unordered_set<VersionStore*> _stores;
+    std::condition_variable           _gc_cond;
+    bool                              _stopping = false;
+    std::thread                       _gc_thread;
+
+    void _gcMain();
+}; // class VersionManager
+
+/** @class Snapshot
+ * @brief 快照的RAII包装: 构造时取快照, 析构时释放 */
+class Snapshot {
+public:
+    explicit Snapshot(VersionManager &manager)
+        : _manager(manager), _timestamp(manager.acquireSnapshot()) {}
+    ~Snapshot() { _manager.releaseSnapshot(_timestamp); }
+    Snapshot(Snapshot const &) = delete;
+    Snapshot &operator=(Snapshot const &) = delete;
+
+    Timestamp get_timestamp() const { return _timestamp; }
+private:
+    VersionManager &_manager;
+    Timestamp       _timestamp;
+}; // class Snapshot
+
+/** @class VersionStore
+ * @brief 一张表的旧版本。条目在存储表里是原地修改的, 修改一个条目以前先把它修改前的样子
+ *        (前像)保存在这里, 提交时打上提交时间戳。读者按快照判断每个条目应该看到存储表里的
+ *        当前值, 还是这里的某一个旧版本。
+ *
+ *        版本存储由表的读写锁保护: 写者持有写锁, 读者持有读锁, 回收线程尝试获取写锁。
+ *
+ *        显式事务也用前像撤销修改: 事务期间总是保存前像, 回滚时把它们交还给表。 */
+class VersionStore {
+public:
+    using ValueListT = mygsql::ValueListT;
+    /** 还没有提交的时间戳 */
+    static constexpr Timestamp PENDING = UINT64_MAX;
+
+    /** @struct Version
+     * @brief 条目在`[begin, end)`期间的样子。`exists`为false表示这段时间条目不存在 */
+    struct Version {
+        Timestamp  begin;
+        Timestamp  end;
+        bool       exists;
+        ValueListT values;
+    }; // struct Version
+
+    /** @enum Visibility
+     * @brief 一个条目对快照的可见性 */
+    enum class Visibility {
+        CURRENT,    // 看到存储表里的当前状态
+        OLD,        // 看到一个旧版本
+        INVISIBLE,  // 条目对这个快照不存在
+    }; // enum class Visibility
+public:
+    VersionStore(VersionManager &manager, std::shared_mutex &table_lock);
+    ~VersionStore();
+
+    /** @fn recordBefore(id, exists, values)
+     * @brief 写者修改条目`id`以前调用, 保存它的前像。同一次提交里只有第一次调用生效。
+     *        没有活跃快照而且不在事务里时不保存。`capture`只在需要保存时被调用,
+     *        返回前像的值列表。 */
+    template<typename CaptureFnT>
+    void recordBefore(uint32_t id, bool exists, CaptureFnT &&capture) {
+        auto iter = _chains.find(id);
+        if (iter != _chains.end() && iter->second.current_begin == PENDING)
+            return;
+        if (!_in_transaction && !_manager.has_active_snapshots()) {
+            if (iter != _chains.end())
+                _chains.erase(iter);
+            return;
+        }
+        _recordBefore(id, exists, exists ? capture() : ValueListT{});
+    }
+    /** @fn recordInsert(id)
+     * @brief 写者新建了条目`id`, 它在这次提交以前不存在 */
+    void recordInsert(uint32_t id) {
+        recordBefore(id, false, []() { return ValueListT{}; });
+    }
+    /** @fn recordInsertedRange(first, last)
+     * @brief 批量导入了ID在`[first, last)`之间的条目, 它们在导入以前都不存在 */
+    void recordInsertedRange(uint32_t first, uint32_t last);
+
+    /** @fn beginTransaction()
+     * @brief 开始一个事务: 到提交或者回滚为止, 每个被修改的条目都保存前像 */
+    void beginTransaction() { _in_transaction = true; }
+    /** @fn commit(timestamp)
+     * @brief 给这次提交保存的所有前像打上提交时间戳, 结束事务 */
+    void commit(Timestamp timestamp);
+    /** @fn rollback()
+     * @brief 撤销这次提交: 丢弃这次提交保存的前像并结束事务。
+     * @return 被丢弃的前像, 调用者据此把条目恢复原样 */
+    std::vector<std::pair<uint32_t, Version>> rollback();
+
+    /** @fn lookup(id, snapshot, out_version)
+     * @brief 条目`id`对快照`snapshot`的可见性。结果为`OLD`时旧版本放进`out_version` */
+    Visibility lookup(uint32_t id, Timestamp snapshot, Version const *&out_version) const;
+
+    /** @fn traverseHidden(first, last, snapshot, fn)
+     * @brief 按ID升序遍历`[first, last)`里当前状态对快照不可见的条目, 调用`fn(id, version)`.
+     *        `version`为nullptr表示条目对快照不存在 */
+    template<typename FnT>
+    void traverseHidden(uint32_t first, uint32_t last, Timestamp snapshot, FnT &&fn) const {
+        for (auto iter = _chains.lower_bound(first);
+             iter != _chains.end() && iter->first < last; iter++) {
+            Version const *version = nullptr;
+            if (lookup(iter->first, snapshot, version) != Visibility::CURRENT)
+                fn(iter->first, version);
+        }
+        for (InsertedRange const &range: _inserted_ranges) {
+            if (range.timestamp <= snapshot)
+                continue;
+            for (uint32_t id = std::max(first, range.first); id < std::min(last, range.last); id++) {
+                if (!_chains.contains(id))
+                    fn(id, nullptr);
+            }
+        }
+    }
+
+    /** @fn get_id_limit()
+     * @brief 有旧版本的条目的最大ID加一, 扫描时至少要扫描到这里 */
+    uint32_t get_id_limit() const {
+        return _chains.empty() ? 0 : _chains.rbegin()->first + 1;
+    }
+    /** @brief 保存着旧版本的条目个数 */
+    size_t get_chain_count() const { return _chains.size(); }
+
+    /** @fn collect(oldest)
+     * @brief 回收结束时间不超过`oldest`的旧版本。调用者要持有表的写锁 */
+    void collect(Timestamp oldest);
+    /** @brief 回收线程用来给表加写锁 */
+    std::shared_mutex &table_lock() const { return _table_lock; }
+private:
+    /** @struct VersionChain
+     * @brief 一个条目的所有旧版本, 按时间升序排列 */
+    struct VersionChain {
+        Timestamp            current_begin; // 存储表里的当前状态从什么时候开始可见
+        std::vector<Version> versions;
+    }; // struct VersionChain
+    /** @struct InsertedRange
+     * @brief 批量导入的条目: 时间戳以前它们都不存在。这样导入不需要为每个条目建立版本链 */
+    struct InsertedRange {
+        uint32_t  first, last;
+        Timestamp timestamp;
+    }; // struct InsertedRange
+
+    VersionManager                   &_manager;
+    std::shared_mutex          &_table_lock;
+    std::map<uint32_t, VersionChain>  _chains;
+    std::vector<InsertedRange>        _inserted_ranges;
+    std::vector<uint32_t>             _pending;        // 这次提交修改过的条目
+    size_t                            _pending_ranges = 0; // 这次提交导入的区间个数
+    bool                              _in_transaction = false;
+
+    void _recordBefore(uint32_t id, bool exists, ValueListT &&values);
+    /** 条目`id`在版本链建立以前从什么时候开始存在 */
+    Timestamp _getInitialBegin(uint32_t id) const;
+}; // class VersionStore
+
+} // namespace mygsql::engine
+
+#endif
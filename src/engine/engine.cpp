@@ -1,8 +1,12 @@
 #include "engine.hxx"
 #include "base/sql-value.hxx"
+#include "engine/engine-aggregate.hxx"
 #include "engine/engine-database.hxx"
+#include "engine/engine-join.hxx"
+#include "engine/engine-sort.hxx"
 #include "engine/engine-table.hxx"
 #include "storage/storage-table.hxx"
+#include <algorithm>
 #include <cstddef>
 #include <deque>
 #include <format>
@@ -12,23 +16,69 @@
 namespace mygsql::engine {
 
 Engine::Engine(std::string_view path)
-    : _database_manager(path),
-      _current_database(nullptr),
-      _current_database_name("<undefined>") {
+    : _database_manager(new DataBaseManager(path)),
+      _current_database_name("<undefined>"),
+      _is_session(false) {
+}
+
+Engine::Engine(owned<DataBaseManager> const &database_manager)
+    : _database_manager(database_manager),
+      _current_database_name("<undefined>"),
+      _is_session(true) {
 }
 
 Engine::~Engine() {
-    syncAll();
+    /* 会话结束时还没有提交的事务被回滚 */
+    if (_transaction != nullptr)
+        rollbackTransaction();
+    if (!_is_session)
+        syncAll();
+}
+
+Engine *Engine::openSession()
+{
+    return new Engine(_database_manager);
 }
 
 /** private table */
 
-inline Table *Engine::_tryGetTable(std::string_view name)
+DataBase *Engine::_getCurrentDataBase()
 {
-    if (_current_database == nullptr) {
+    DataBase *database = _database_manager->getDataBase(_current_database_name);
+    if (database == nullptr)
         throw DataBaseExpiredException(this);
+    return database;
+}
+
+Table *Engine::_lockTable(std::string_view name, LockMode mode, TableLock &out_lock)
+{
+    if (_transaction != nullptr)
+        return _lockTableInTransaction(name, mode, out_lock);
+    out_lock.catalog = std::shared_lock(_database_manager->rwlock());
+    DataBase *database = _getCurrentDataBase();
+    out_lock.database = std::shared_lock(database->rwlock());
+    Table *table = database->useTable(name);
+    if (table == nullptr) {
+        throw TableUnexistException(
+            this,
+            std::format("{}[{}]",
+                    _current_database_name, name)
+        );
     }
-    Table *table = _current_database->useTable(name);
+    if (mode == LockMode::READ) {
+        out_lock.table_read = std::shared_lock(table->rwlock());
+    } else if (mode == LockMode::WRITE) {
+        out_lock.table_writer = std::unique_lock(table->writer_lock());
+        out_lock.table_write  = std::unique_lock(table->rwlock());
+    }
+    return table;
+}
+
+Table *Engine::_lockTableInTransaction(std::string_view name, LockMode mode,
+                                       TableLock &out_lock)
+{
+    /* 目录与数据库的读锁已经由事务持有 */
+    Table *table = _transaction->current_database->useTable(name);
     if (table == nullptr) {
         throw TableUnexistException(
             this,
@@ -36,131 +86,288 @@ inline Table *Engine::_tryGetTable(std::string_view name)
                     _current_database_name, name)
         );
     }
+    bool owned = std::any_of(_transaction->tables.begin(), _transaction->tables.end(),
+                             [table](auto const &item) { return item.first == table; });
+    if (mode == LockMode::READ) {
+        out_lock.table_read = std::shared_lock(table->rwlock());
+    } else if (mode == LockMode::WRITE) {
+        if (!owned) {
+            std::unique_lock writer(table->writer_lock(), std::defer_lock);
+            if (!writer.try_lock_for(TRANSACTION_LOCK_TIMEOUT)) {
+                rollbackTransaction();
+                throw TransactionException(std::format(
+                    "lock wait timeout on table {}, transaction rolled back", name));
+            }
+            _transaction->tables.push_back({table, std::move(writer)});
+            owned = true;
+        }
+        out_lock.table_write = std::unique_lock(table->rwlock());
+        table->beginTransaction(_transaction->id);
+    }
+    out_lock.in_transaction = owned;
     return table;
 }
 
+void Engine::_finishStatement(Table *table, TableLock const &lock)
+{
+    if (!lock.in_transaction)
+        table->commit();
+}
+
+void Engine::_checkNoTransaction(std::string_view operation) const
+{
+    if (_transaction != nullptr) {
+        throw TransactionException(std::format(
+            "{} is not allowed inside a transaction", operation));
+    }
+}
+
+void Engine::beginTransaction()
+{
+    if (_transaction != nullptr)
+        throw TransactionException("already inside a transaction");
+    auto transaction = std::make_unique<Transaction>();
+    transaction->catalog = std::shared_lock(_database_manager->rwlock());
+    transaction->current_database = _getCurrentDataBase();
+    transaction->database = std::shared_lock(transaction->current_database->rwlock());
+    transaction->id = transaction->current_database->get_storage_database().allocateTransactionID();
+    _transaction = std::move(transaction);
+}
+
+void Engine::commitTransaction()
+{
+    if (_transaction == nullptr)
+        throw TransactionException("no transaction to commit");
+    /* 先把所有表的修改落盘, 再一起释放写者锁。修改了多张表时做两阶段提交: 每张表的日志
+     * 都落盘以后, 数据库的提交日志里的一条记录才是提交点, 各表的提交记录不必再落盘 */
+    std::unique_ptr<Transaction> transaction = std::move(_transaction);
+    bool two_phase = transaction->tables.size() > 1;
+    if (two_phase) {
+        for (auto &[table, writer]: transaction->tables) {
+            std::unique_lock lock(table->rwlock());
+            table->prepare();
+        }
+        transaction->current_database->get_storage_database().logCommit(transaction->id);
+    }
+    for (auto &[table, writer]: transaction->tables) {
+        std::unique_lock lock(table->rwlock());
+        table->commit(!two_phase);
+    }
+}
+
+void Engine::rollbackTransaction()
+{
+    if (_transaction == nullptr)
+        throw TransactionException("no transaction to roll back");
+    std::unique_ptr<Transaction> transaction = std::move(_transaction);
+    for (auto &[table, writer]: transaction->tables) {
+        std::unique_lock lock(table->rwlock());
+        table->rollback();
+    }
+}
+
+const DataBase *Engine::get_current_database() const
+{
+    std::shared_lock lock(_database_manager->rwlock());
+    return _database_manager->getDataBase(_current_database_name);
+}
+
 
 /** public Table */
 
 DataBase *Engine::createDataBase(std::string_view name)
 {
-    return _database_manager.createDataBase(name);
+    _checkNoTransaction("create database");
+    std::unique_lock lock(_database_manager->rwlock());
+    return _database_manager->createDataBase(name);
 }
 
 DataBase *Engine::useDataBase(std::string_view name)
 {
-    DataBase *ret = _database_manager.getDataBase(name);
+    _checkNoTransaction("use");
+    std::shared_lock lock(_database_manager->rwlock());
+    DataBase *ret = _database_manager->getDataBase(name);
     if (ret == nullptr)
         return nullptr;
-    _current_database = ret;
-    _current_database_name = _current_database->get_name();
+    _current_database_name = ret->get_name();
     return ret;
 }
 
 bool Engine::dropDataBase(std::string_view name)
 {
-    if (name == _current_database_name) {
-        _current_database = nullptr;
-    }
-    return _database_manager.dropDataBase(name);
+    _checkNoTransaction("drop database");
+    /* 其他会话如果正在使用这个数据库, 它们的下一条语句会得到DataBaseExpiredException */
+    std::unique_lock lock(_database_manager->rwlock());
+    return _database_manager->dropDataBase(name);
 }
 
 Table *Engine::createTable(std::string_view name,
                            StorageTable::TypeItemListT &&type_item_list)
 {
-    if (_current_database == nullptr) {
-        throw DataBaseExpiredException(this);
-    }
-    return _current_database->createTable(name, type_item_list);
+    _checkNoTransaction("create table");
+    std::shared_lock catalog_lock(_database_manager->rwlock());
+    DataBase *database = _getCurrentDataBase();
+    std::unique_lock database_lock(database->rwlock());
+    return database->createTable(name, type_item_list);
 }
 
 bool Engine::dropTable(std::string_view name)
 {
-    if (_current_database == nullptr) {
-        throw DataBaseExpiredException(this);
-    }
-    return _current_database->dropTable(name);
+    _checkNoTransaction("drop table");
+    std::shared_lock catalog_lock(_database_manager->rwlock());
+    DataBase *database = _getCurrentDataBase();
+    std::unique_lock database_lock(database->rwlock());
+    return database->dropTable(name);
 }
 
-Engine::NameValueMatrixT Engine::selectFromTable(std::string_view table_name)
+bool Engine::createIndex(std::string_view table_name, std::string_view index_name,
+                         std::string_view column, StorageTable::IndexKind kind)
 {
-    NameValueMatrixT ret{};
-    Table *table = _tryGetTable(table_name);
-    StorageTable::TypeItemListT const &ti_list = table->get_type_item_list();
-    for (TableEntry *i: table->get_entry_list()) {
-        NameValueListT ret_item;
-        for (int cnt = 0; Value *i: i->get_value_list()) {
-            ret_item.push_back({
-                ti_list[cnt].name, i    
-            });
-            cnt++;
-        }
-        ret.push_back(std::move(ret_item));
-    }
+    _checkNoTransaction("create index");
+    TableLock lock;
+    Table *table = _lockTable(table_name, LockMode::WRITE, lock);
+    bool ret = table->createIndex(index_name, column, kind);
+    _finishStatement(table, lock);
     return ret;
 }
-Engine::NameValueMatrixT Engine::selectFromTable(std::string_view table_name,
-                                                 Condition const &condition)
+
+Table *Engine::_lockJoinedTable(std::string_view name, TableLock &out_lock)
 {
-    Table *table = _tryGetTable(table_name);
-    NameValueMatrixT ret{};
-    StorageTable::TypeItemListT const &ti_list = table->get_type_item_list();
-    Table::EntrySelectListT select_list {
-        table->selectByCondition(condition.name,
-                                 condition.relation,
-                                 condition.condition_value)
-    };
-    for (auto &i: select_list) {
-        NameValueListT ret_list;
-        for (int cnt = 0; auto &j: i->get()->get_value_list()) {
-            ret_list.push_back({ti_list[cnt].name, j.get()});
-            cnt++;
-        }
-        ret.push_back(std::move(ret_list));
+    if (_transaction != nullptr)
+        return _lockTableInTransaction(name, LockMode::SNAPSHOT, out_lock);
+    Table *table = _getCurrentDataBase()->useTable(name);
+    if (table == nullptr) {
+        throw TableUnexistException(
+            this,
+            std::format("{}[{}]",
+                    _current_database_name, name)
+        );
     }
-    return ret;
+    return table;
 }
-std::deque<Value*> Engine::selectValueFromTable(std::string_view table_name,
-                                                std::string_view column)
+
+Table *Engine::_lockPlanTable(Plan &plan, LockMode mode, TableLock &out_lock)
 {
-    std::deque<Value*> ret{};
-    Table *table = _tryGetTable(table_name);
-    ret = table->selectAllValue(column);
-    return ret;
+    Table *table = _lockTable(plan.table_name, mode, out_lock);
+    plan.bind(*table);
+    plan.checkValues();
+    return table;
+}
+
+void Engine::_executeJoin(Plan const &plan, Table *tables[2], bool const in_transaction[2],
+                          RowFunc const &fn, std::pmr::memory_resource *arena)
+{
+    JoinSide sides[2];
+    for (int32_t side = 0; side < 2; side++) {
+        sides[side].table        = tables[side];
+        sides[side].condition    = plan.get_side_condition(side);
+        sides[side].key          = plan.join_keys[side].index;
+        sides[side].columns      = &plan.get_side_columns(side);
+        sides[side].read_current = in_transaction[side];
+    }
+    Join(sides[0], sides[1], plan.get_join_outputs(), arena).execute(fn);
 }
-std::deque<Value*> Engine::selectValueFromTable(std::string_view table_name,
-                                                std::string_view column,
-                                                Condition const &condition)
+
+void Engine::_scanSelect(Plan const &plan, Table *tables[2], bool const in_transaction[2],
+                         size_t limit, RowFunc const &fn, std::pmr::memory_resource *arena)
 {
-    ValueListT ret{};
-    Table *table = _tryGetTable(table_name);
-    return table->selectValueByCondition(column, condition.name,
-                                         condition.relation,
-                                         condition.condition_value);
+    if (plan.is_join()) {
+        _executeJoin(plan, tables, in_transaction, fn, arena);
+        return;
+    }
+    Table *table = tables[0];
+    if (plan.is_aggregate()) {
+        /* 扫描时只累加, 扫描结束以后再输出每个分组 */
+        HashAggregate aggregate(plan.get_aggregate_items(), plan.group_by);
+        if (in_transaction[0])
+            table->scanCurrent(plan.condition.get(), aggregate);
+        else
+            table->scanSnapshot(plan.condition.get(), aggregate);
+        aggregate.traverseResults(fn, arena);
+        return;
+    }
+    /* 事务读自己修改过的表时读当前状态 */
+    Table::ProjectingVisitor visitor(plan.get_column_indices(), fn, limit, arena);
+    if (in_transaction[0])
+        table->scanCurrent(plan.condition.get(), visitor);
+    else
+        table->scanSnapshot(plan.condition.get(), visitor);
 }
 
-size_t Engine::deleteValueFromTable(std::string_view table_name)
+void Engine::executeSelect(Plan &plan, RowFunc const &fn, std::pmr::memory_resource *arena)
 {
-    Table *table = _tryGetTable(table_name);
-    size_t ret = table->get_entry_list().size();
-    table->clear();
-    return ret;
+    if (plan.is_join() && plan.join_table == plan.table_name)
+        throw Plan::Exception(plan.table_name, "cannot join a table with itself");
+    TableLock lock, joined_lock;
+    Table *tables[2] = {_lockTable(plan.table_name, LockMode::SNAPSHOT, lock), nullptr};
+    if (plan.is_join())
+        tables[1] = _lockJoinedTable(plan.join_table, joined_lock);
+    plan.bind(*tables[0], tables[1]);
+    plan.checkValues();
+    bool in_transaction[2] = {lock.in_transaction, joined_lock.in_transaction};
+
+    /* 为order by多读的隐藏列在输出以前去掉 */
+    size_t width = plan.get_column_names().size();
+    RowFunc output = [&fn, width](ValueListT &&values) {
+        if (values.size() > width)
+            values.resize(width);
+        fn(std::move(values));
+    };
+    if (!plan.has_order()) {
+        if (!plan.has_limit()) {
+            _scanSelect(plan, tables, in_transaction, Plan::NO_LIMIT, fn, arena);
+            return;
+        }
+        /* 普通查询输出够了就停止扫描, 聚合查询与连接查询丢掉多余的行 */
+        size_t count = 0;
+        _scanSelect(plan, tables, in_transaction, plan.limit,
+            [&fn, &count, limit = plan.limit](ValueListT &&values) {
+                if (count++ < limit)
+                    fn(std::move(values));
+            }, arena);
+        return;
+    }
+
+    /* 升序排列的列有B+树索引时沿着索引输出, 不需要排序。B+树只能正向遍历, 所以降序要排序 */
+    int32_t order_column = plan.order_by.column.index;
+    if (!plan.is_join() && !plan.is_aggregate() && !plan.order_desc) {
+        Table::ProjectingVisitor visitor(plan.get_column_indices(), output, plan.limit, arena);
+        bool streamed = in_transaction[0]
+            ? tables[0]->scanIndexOrder(VersionStore::PENDING, order_column,
+                                        plan.condition.get(), visitor)
+            : tables[0]->scanIndexOrder(order_column, plan.condition.get(), visitor);
+        if (streamed)
+            return;
+    }
+    Sorter sorter(plan.get_order_output(), plan.order_desc, plan.limit,
+                  tables[0]->get_storage_table().get_work_directory());
+    /* 缓冲的行有的会被丢掉(top-k)或者写进顺串文件, 不从内存池分配 */
+    _scanSelect(plan, tables, in_transaction, Plan::NO_LIMIT,
+                [&sorter](ValueListT &&values) { sorter.push(std::move(values)); }, nullptr);
+    sorter.finish(output, arena);
 }
 
-size_t Engine::deleteValueFromTable(std::string_view table_name,
-                                    Condition const &condition)
+size_t Engine::executeDelete(Plan &plan)
 {
-    Table *table = _tryGetTable(table_name);
-    return table->deleteEntryByCondition(condition.name,
-                                  condition.relation,
-                                  condition.condition_value);
+    TableLock lock;
+    Table *table = _lockPlanTable(plan, LockMode::WRITE, lock);
+    size_t ret = 0;
+    if (plan.has_condition()) {
+        ret = table->deleteEntryByCondition(*plan.condition);
+    } else {
+        ret = table->get_storage_table().get_entry_count();
+        table->clear();
+    }
+    _finishStatement(table, lock);
+    return ret;
 }
 
-Engine::NameValueListT Engine::insertToTable(std::string_view table_name,
-                                             Engine::ValueListT const &value_list)
+Engine::NameValueListT Engine::executeInsert(Plan &plan)
 {
-    Table *table = _tryGetTable(table_name);
-    TableEntry *entry = table->insert(value_list);
+    TableLock lock;
+    Table *table = _lockPlanTable(plan, LockMode::WRITE, lock);
+    Table::EntryPtrT entry = table->insert(plan.values);
+    _finishStatement(table, lock);
     NameValueListT ret;
     auto &ti_list = table->get_type_item_list();
     auto &entry_value_list = entry->get_value_list();
@@ -170,49 +377,58 @@ Engine::NameValueListT Engine::insertToTable(std::string_view table_name,
     return ret;
 }
 
-size_t Engine::updateTable(std::string_view table_name,
-                           std::string_view column,
-                           Value *value)
+size_t Engine::executeUpdate(Plan &plan)
 {
-    // /*DEBUG*/
-    // std::cout << "DEBUGGGGG" << std::endl;
-    // std::cout << std::format("table name:'{}',column:'{}',value:'{}'",
-    //                 table_name, column, value->getString())
-    //           << std::endl;
-    // return 0;
-    Table *table = _tryGetTable(table_name);
-    return table->updateEntireTable(column, value);
+    TableLock lock;
+    Table *table = _lockPlanTable(plan, LockMode::WRITE, lock);
+    size_t ret = 0;
+    if (plan.has_condition()) {
+        ret = table->updateTableByCondition(plan.columns[0].index, plan.values[0],
+                                            *plan.condition);
+    } else {
+        ret = table->updateEntireTable(plan.columns[0].index, plan.values[0]);
+    }
+    _finishStatement(table, lock);
+    return ret;
 }
 
-size_t Engine::updateTable(std::string_view table_name,
-                           std::string_view column,
-                           Value *value, Condition const &condition)
+size_t Engine::loadToTable(std::string_view table_name, std::string_view path)
 {
-    // /*DEBUG*/
-    // std::cout << "DEBUGGGGG" << std::endl;
-    // std::cout << std::format("table name:'{}',column:'{}',value:'{}'",
-    //                 table_name, column, value->getString())
-    //           << std::endl;
-    // return 0;
-    Table *table = _tryGetTable(table_name);
-    return table->updateTableByCondition(column, value, condition.name,
-                                         condition.relation,
-                                         condition.condition_value);
+    /* 批量导入自己做检查点, 不能回滚 */
+    _checkNoTransaction("load");
+    TableLock lock;
+    Table *table = _lockTable(table_name, LockMode::WRITE, lock);
+    size_t ret = table->loadFromFile(path);
+    _finishStatement(table, lock);
+    return ret;
+}
+
+void Engine::_syncTable(Table *table)
+{
+    std::unique_lock lock(table->rwlock());
+    table->syncToStorageTable();
+    table->checkpoint();
 }
 
 void Engine::syncAll()
 {
-    for (auto &i: _database_manager.get_database_map()) {
+    _checkNoTransaction("sync");
+    std::shared_lock catalog_lock(_database_manager->rwlock());
+    for (auto &i: _database_manager->get_database_map()) {
+        std::shared_lock database_lock(i.second->rwlock());
         for (auto &j: i.second.get()->get_table_map())
-            j.second.get()->syncToStorageTable();
+            _syncTable(j.second.get());
     }
 }
 
 void Engine::syncCurrent()
 {
-    for (auto &j: _current_database->get_table_map()) {
-        j.second.get()->syncToStorageTable();
-    }
+    _checkNoTransaction("sync");
+    std::shared_lock catalog_lock(_database_manager->rwlock());
+    DataBase *database = _getCurrentDataBase();
+    std::shared_lock database_lock(database->rwlock());
+    for (auto &j: database->get_table_map())
+        _syncTable(j.second.get());
 }
 
 } // namespace mygsql
\ No newline at end of file
@@ -6,11 +6,17 @@
 #include "base/sql-value.hxx"
 #include "engine-database-manager.hxx"
 #include "engine/engine-database.hxx"
+#include "engine/engine-plan.hxx"
 #include "engine/engine-table.hxx"
 #include "storage/storage-table.hxx"
+#include <chrono>
 #include <cstddef>
 #include <deque>
 #include <format>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <shared_mutex>
 #include <string_view>
 #include <utility>
 #include <vector>
@@ -20,7 +26,15 @@ using MTB::owned;
 using MTB::Object;
 
 /** @class Engine
- * @brief 执行引擎，负责汇总各模块，负责最终所有命令的实现 */
+ * @brief 执行引擎，负责汇总各模块，负责最终所有命令的实现。
+ *        一个执行引擎就是一个会话: 用`openSession()`打开的会话共享数据库, 但有各自的当前数据库。
+ *        每条语句按"数据库目录 -> 数据库 -> 表"的次序加读写锁, 修改同一张表的语句互斥。
+ *        查询在快照上执行(MVCC), 只在扫描每一段条目时短暂持有表的读锁,
+ *        所以长查询不会阻塞写者, 也不会看到查询开始以后的修改。
+ *
+ *        `beginTransaction`开始显式事务: 事务修改过的表的写者锁一直持有到提交或者回滚,
+ *        其他会话不能修改这些表, 它们的查询看到的是事务开始以前的版本;
+ *        提交时每张表只落盘一次。 */
 class Engine final: public MTB::Object {
 public:
     friend class DataBaseExpiredException;
@@ -65,27 +79,39 @@ R"(TableUnexistException at at function<{}> file<{}> line<{}>: table {} does not
         std::string_view table_name;
     }; // class TableUnexistException
 
-    /** @struct Condition
-     * @brief 表示where条件的三元组 */
-    struct Condition {
-        std::string            name;
-        TotalOrderRelation relation;
-        Value      *condition_value;
-    }; // struct Condition
+    /** @class TransactionException
+     * @brief 事务的状态不允许执行这个操作, 或者等待表锁超时。
+     *        等待表锁超时时事务已经被回滚了。 */
+    class TransactionException: public MTB::Exception {
+    public:
+        TransactionException(std::string_view reason)
+            : MTB::Exception(MTB::ErrorLevel::CRITICAL,
+                std::format("TransactionException: {}", reason)) {}
+    }; // class TransactionException
+
+    /** 事务等待其他会话释放表锁的最长时间, 超时就回滚, 这样互相等待的事务不会死锁 */
+    static constexpr std::chrono::milliseconds TRANSACTION_LOCK_TIMEOUT{5000};
 
-    /** 键-值对，first存储的是列名称, second存储的是被选中的列的值 */
-    using NameValuePairT   = std::pair<std::string_view, Value*>;
-    /** 键-值对列表, 存储一行条目的所有值，或者存储一列条目的所有值 */
-    using NameValueListT   = std::vector<NameValuePairT>;
-    /** 键-值对矩阵, 存储的是若干被选中的条目 */
-    using NameValueMatrixT = std::deque<NameValueListT>;
     /** Value智能指针 */
     using ValuePtrT  = TableEntry::ValuePtrT; // owned<Value>
     /** Value智能指针列表, 类型为vector. */
     using ValueListT = TableEntry::ValueListT;
+    /** 键-值对，first存储的是列名称, second存储的是被选中的列的值。
+     *  查询表默认不缓存条目，所以值由键-值对自己持有。 */
+    using NameValuePairT   = std::pair<std::string_view, ValuePtrT>;
+    /** 键-值对列表, 存储一行条目的所有值，或者存储一列条目的所有值 */
+    using NameValueListT   = std::vector<NameValuePairT>;
+    /** select计划每选中一个条目调用一次, 参数是输出列的值 */
+    using RowFunc          = Table::SnapshotRowFunc;
 public:
     Engine(std::string_view storage_path);
     ~Engine() override;
+
+    /** @fn openSession()
+     * @brief 打开一个会话: 新的执行引擎与这个引擎共享数据库与锁, 当前数据库是独立的。
+     *        会话析构时不做检查点, 由最初的引擎负责。
+     * @return 新会话, 调用者用`owned<Engine>`持有它 */
+    Engine *openSession();
     
     /** database 管理命令 */
     DataBase *createDataBase(std::string_view name);
@@ -96,61 +122,118 @@ public:
     Table *createTable(std::string_view name,
                        StorageTable::TypeItemListT &&type_item_list);
     bool dropTable(std::string_view name);
-
-    /** select table命令 */
-    NameValueMatrixT selectFromTable(std::string_view table_name);
-    NameValueMatrixT selectFromTable(std::string_view table_name,
-                                     Condition const &condition);
-    std::deque<Value*> selectValueFromTable(std::string_view table_name,
-                                    std::string_view column);
-    std::deque<Value*> selectValueFromTable(std::string_view table_name,
-                                    std::string_view column,
-                                    Condition const &condition);
-
-    /** delete table命令. 返回删除了多少元素。 */
-    size_t deleteValueFromTable(std::string_view table_name);
-    size_t deleteValueFromTable(std::string_view table_name,
-                                Condition const &condition);
-
-    /** insert命令，返回插入的值列表 */
-    NameValueListT insertToTable(std::string_view table_name,
-                                 ValueListT const &value_list);
-    /** @brief update-set命令
-     * @param table_name 表名称
-     * @param column     列名称
-     * @param value      新值 */
-    size_t updateTable(std::string_view table_name,
-                       std::string_view column,
-                       Value *value);
-    /** @brief update-set命令
+    /** @brief create index命令: 在表`table_name`的列`column`上建立二级索引`index_name`
+     * @param kind 索引的种类, B+树或者哈希
+     * @return 同名的索引已经存在, 或者这一列已经有索引时返回false */
+    bool createIndex(std::string_view table_name, std::string_view index_name,
+                     std::string_view column,
+                     StorageTable::IndexKind kind = StorageTable::IndexKind::BTREE);
+
+    /** 数据操作语句由编译好的计划执行。每个函数都先给计划的表加锁, 计划还没有绑定到这张表的
+     *  当前结构上时先绑定, 然后检查常量与参数的类型。
+     * @throw TableEntry::ColumnUnmatchedException 计划里的列不存在
+     * @throw Value::InconsistantTypeException 常量的类型与列的类型不一致
+     * @throw Plan::Exception 插入的值的个数不对, 或者有参数没有填入 */
+    /** @brief select命令: 在快照上按ID升序对每个被选中的条目调用`fn(values)`,
+     *         `values`是计划的输出列的值。聚合查询用`HashAggregate`扫描, 对每个分组调用一次;
+     *         连接查询用`Join`, 对每一对匹配的条目调用一次。
+     *         有order by时按它排序: 升序排列的列有B+树索引时沿着索引输出, 否则用`Sorter`排序;
+     *         有limit时最多调用`limit`次。
+     *         `arena`不为空时输出的行与值从这个内存池分配(见`Value::New`), 调用者要在释放内存池
+     *         以前丢掉所有的行; 排序时缓冲的行仍然在堆上分配, 所以内存预算不受影响
+     * @throw Sorter::Exception 排序的顺串文件读写失败 */
+    void executeSelect(Plan &plan, RowFunc const &fn,
+                       std::pmr::memory_resource *arena = nullptr);
+    /** @brief delete命令. 返回删除了多少元素 */
+    size_t executeDelete(Plan &plan);
+    /** @brief update-set命令. 返回更新了多少元素 */
+    size_t executeUpdate(Plan &plan);
+    /** @brief insert命令，返回插入的值列表 */
+    NameValueListT executeInsert(Plan &plan);
+    /** @brief load命令: 从CSV/TSV文件批量导入条目
      * @param table_name 表名称
-     * @param column     列名称
-     * @param value      新值
-     * @param condition  Where条件 */
-    size_t updateTable(std::string_view table_name,
-                       std::string_view column,
-                       Value *value, Condition const &condition);
+     * @param path       文件路径
+     * @return 导入的条目个数 */
+    size_t loadToTable(std::string_view table_name, std::string_view path);
     
+    /** @brief begin命令: 开始显式事务
+     * @throw TransactionException 已经在事务里 */
+    void beginTransaction();
+    /** @brief commit命令: 提交事务, 每张被修改的表落盘一次, 然后释放所有锁
+     * @throw TransactionException 不在事务里 */
+    void commitTransaction();
+    /** @brief rollback命令: 撤销事务的所有修改, 然后释放所有锁
+     * @throw TransactionException 不在事务里 */
+    void rollbackTransaction();
+    /** getter: 是否在显式事务里 */
+    bool in_transaction() const { return _transaction != nullptr; }
+
     /** @brief sync all命令 */
     void syncAll();
     /** @brief sync 命令 */
     void syncCurrent();
 
     /* getters */
-    /** getter:current_database 当前被use的数据库 */
-    const DataBase *get_current_database() const {
-        return _current_database;
-    }
+    /** getter:current_database 当前被use的数据库, 已经被删除时返回nullptr */
+    const DataBase *get_current_database() const;
     /** getter:current_database_name 当前被use的数据库的名称 */
     std::string_view get_current_database_name() const {
         return _current_database_name;
     }
 private:
-    DataBaseManager  _database_manager;
-    DataBase        *_current_database;
+    /** 语句访问表的方式. `SNAPSHOT`不给表加锁, 由`Table::scanSnapshot`自己分段加读锁 */
+    enum class LockMode { READ, WRITE, SNAPSHOT };
+    /** 一条语句访问一张表时持有的锁, 析构时按相反的次序释放 */
+    struct TableLock {
+        std::shared_lock<std::shared_mutex> catalog;
+        std::shared_lock<std::shared_mutex> database;
+        std::unique_lock<std::timed_mutex>  table_writer;
+        std::shared_lock<std::shared_mutex> table_read;
+        std::unique_lock<std::shared_mutex> table_write;
+        bool in_transaction = false; // 表的写者锁由事务持有, 语句结束时不提交
+    }; // struct TableLock
+    /** @struct Transaction
+     * @brief 显式事务持有的锁。目录与当前数据库的读锁从开始持有到结束,
+     *        表的写者锁在第一次修改这张表时获取 */
+    struct Transaction {
+        std::shared_lock<std::shared_mutex> catalog;
+        std::shared_lock<std::shared_mutex> database;
+        DataBase *current_database;
+        uint64_t  id; // 事务ID, 由当前数据库分配
+        std::vector<std::pair<Table*, std::unique_lock<std::timed_mutex>>> tables;
+    }; // struct Transaction
+
+    owned<DataBaseManager> _database_manager; // 所有会话共享的数据库管理器
     std::string      _current_database_name;
-
-    Table *_tryGetTable(std::string_view table_name);
+    bool             _is_session;
+    std::unique_ptr<Transaction> _transaction; // 正在进行的显式事务, 没有时为空
+
+    Engine(owned<DataBaseManager> const &database_manager);
+    /** 在持有目录读锁时查找当前数据库, 被删除了就抛出`DataBaseExpiredException` */
+    DataBase *_getCurrentDataBase();
+    /** 查找当前数据库里的表并加锁, 锁放进`out_lock` */
+    Table *_lockTable(std::string_view table_name, LockMode mode, TableLock &out_lock);
+    /** 在事务里查找表; 写语句第一次修改一张表时给它加写者锁 */
+    Table *_lockTableInTransaction(std::string_view table_name, LockMode mode,
+                                   TableLock &out_lock);
+    /** 连接查询: `_lockTable`以后查找同一条语句读的另一张表。目录与数据库的读锁已经持有,
+     *  `out_lock`只记录事务是否修改过这张表 */
+    Table *_lockJoinedTable(std::string_view table_name, TableLock &out_lock);
+    /** select命令的连接查询, 两张表都已经找到, 计划已经绑定 */
+    void _executeJoin(Plan const &plan, Table *tables[2], bool const in_transaction[2],
+                      RowFunc const &fn, std::pmr::memory_resource *arena);
+    /** select命令按扫描的次序输出, 不排序。普通查询输出`limit`行以后停止扫描
+     * @param in_transaction 事务是否修改过这张表, 修改过时读当前状态 */
+    void _scanSelect(Plan const &plan, Table *tables[2], bool const in_transaction[2],
+                     size_t limit, RowFunc const &fn, std::pmr::memory_resource *arena);
+    /** 给计划的表加锁, 必要时绑定计划并检查它的常量 */
+    Table *_lockPlanTable(Plan &plan, LockMode mode, TableLock &out_lock);
+    /** 语句结束: 不在事务里时提交这张表的修改 */
+    static void _finishStatement(Table *table, TableLock const &lock);
+    /** 事务里不能执行`operation`(会改变事务持有的锁) */
+    void _checkNoTransaction(std::string_view operation) const;
+    /** 给一张表加写锁并做检查点 */
+    static void _syncTable(Table *table);
 }; // class Engine
 
 
@@ -3,17 +3,18 @@
 #include "engine/engine-database.hxx"
 #include "engine/engine.hxx"
 #include "sql-lang-interpreter.hxx"
+#include "sql-lang-lexer.hxx"
 #include "storage/storage-table.hxx"
-#include <cctype>
+#include <charconv>
 #include <cstddef>
 #include <cstdint>
 #include <deque>
 #include <exception>
 #include <format>
 #include <iostream>
+#include <memory>
+#include <memory_resource>
 #include <ostream>
-#include <regex>
-#include <set>
 #include <string>
 #include <string_view>
 #include <unordered_map>
@@ -22,64 +23,91 @@
 using CommandType = mygsql::Interpreter::CommandType;
 using CommandTypeMapT = std::unordered_map<std::string_view, CommandType>;
 using IllegalCommandException = mygsql::Interpreter::IllegalCommandException;
+using mygsql::Lexer;
+using mygsql::Token;
 
-static char *cstring_jump_space(const char *begin, const char *end)
+/* 下面的函数从词法分析器里取出语法成分, 不符合语法时抛出IllegalCommandException,
+ * 异常里的命令是整条语句 */
+
+/** 取出下一个词法单元, 遇到非法字符时报错 */
+static Token next_token(Lexer &lexer)
+{
+    Token token = lexer.next();
+    if (!token.is(Token::Type::ILLEGAL))
+        return token;
+    if (token.text[0] == '"' || token.text[0] == '\'') {
+        throw IllegalCommandException(lexer.get_source(),
+                    "string is not closed with a quote");
+    }
+    throw IllegalCommandException(lexer.get_source(),
+                std::format("illegal character `{}`", token.text));
+}
+/** 看下一个词法单元, 遇到非法字符时报错 */
+static Token const &peek_token(Lexer &lexer)
 {
-    while (begin != end && std::isspace(*begin))
-        begin++;
-    return (char*)begin;
+    Token const &token = lexer.peek();
+    if (token.is(Token::Type::ILLEGAL))
+        next_token(lexer);
+    return token;
 }
-static char *cstring_to_space(const char *begin, const char *end)
+static std::string_view expect_identifier(Lexer &lexer, std::string_view reason)
 {
-    while (begin != end && !std::isspace(*begin))
-        begin++;
-    return (char*)begin;
+    Token token = next_token(lexer);
+    if (!token.is(Token::Type::IDENTIFIER))
+        throw IllegalCommandException(lexer.get_source(), reason);
+    return token.text;
 }
-static std::string_view cstring_get_word(const char *begin, const char *end)
+static void expect_keyword(Lexer &lexer, std::string_view keyword, std::string_view reason)
 {
-    begin = cstring_jump_space(begin, end);
-    const char *sentry_end = cstring_to_space(begin, end);
-    return {
-        begin, sentry_end
-    };
+    if (!next_token(lexer).isWord(keyword))
+        throw IllegalCommandException(lexer.get_source(), reason);
+}
+/** 下一个词法单元是关键字`keyword`时取出它 */
+static bool accept_keyword(Lexer &lexer, std::string_view keyword)
+{
+    if (!peek_token(lexer).isWord(keyword))
+        return false;
+    lexer.next();
+    return true;
 }
-static std::string_view cstring_get_identifier(const char *begin, const char *end)
+static void expect_symbol(Lexer &lexer, char symbol, std::string_view reason)
 {
-    begin = cstring_jump_space(begin, end);
-    const char *sentry_end = begin;
-    while (sentry_end != end && isalnum(*sentry_end))
-        sentry_end++;
-    return {begin, sentry_end};
+    if (!next_token(lexer).isSymbol(symbol))
+        throw IllegalCommandException(lexer.get_source(), reason);
 }
-static bool word_is_identifier(std::string_view word)
+/** 下一个词法单元是符号`symbol`时取出它 */
+static bool accept_symbol(Lexer &lexer, char symbol)
 {
-    if (!isalpha(word[0]))
+    if (!peek_token(lexer).isSymbol(symbol))
         return false;
-    for (char i: word) {
-        if (!isalnum(i))
-            return false;
-    }
+    lexer.next();
     return true;
 }
-
-struct CommandTypeContext {
-    CommandType command_type;
-    const char *current_ptr;
-}; // struct CommandTypeContext
-static CommandTypeContext
-handle_second_opcode(const char *opcode_end, const char *end,
-                     CommandTypeMapT const &map)
+/** Column: WORD | WORD '.' WORD
+ * 列名称, 可以用表名限定 */
+static mygsql::engine::ColumnRef expect_column(Lexer &lexer, std::string_view reason)
+{
+    mygsql::engine::ColumnRef ret;
+    ret.name = expect_identifier(lexer, reason);
+    if (accept_symbol(lexer, '.')) {
+        ret.table = std::move(ret.name);
+        ret.name  = expect_identifier(lexer, reason);
+    }
+    return ret;
+}
+/** 语句结束, 后面可以有一个分号 */
+static void expect_end(Lexer &lexer)
 {
-    const char *begin_sentry = cstring_jump_space(opcode_end, end);
-    const char *end_sentry   = cstring_to_space(begin_sentry, end);
-    std::string_view _2nd_opcode = {begin_sentry, end_sentry};
-    if (map.contains(_2nd_opcode))
-        return {map.at(_2nd_opcode), end_sentry};
-    return {CommandType::_NONE, end_sentry};
+    accept_symbol(lexer, ';');
+    Token token = next_token(lexer);
+    if (!token.is(Token::Type::END)) {
+        throw IllegalCommandException(lexer.get_source(),
+                    std::format("unexpected `{}` after the end of statement", token.text));
+    }
 }
 
-static CommandTypeContext
-command_get_type(std::string_view command)
+static CommandType
+command_get_type(Lexer &lexer)
 {
     using namespace mygsql;
     static CommandTypeMapT command_type_map {
@@ -89,111 +117,100 @@ command_get_type(std::string_view command)
         {"insert", CommandType::INSERT},
         {"update", CommandType::UPDATE},
         {"sync",   CommandType::SYNC},
+        {"load",   CommandType::LOAD},
+        {"begin",    CommandType::BEGIN},
+        {"commit",   CommandType::COMMIT},
+        {"rollback", CommandType::ROLLBACK},
+        {"prepare",  CommandType::PREPARE},
+        {"execute",  CommandType::EXECUTE},
         {"exit",   CommandType::QUIT},
         {"quit",   CommandType::QUIT}
     };
     static CommandTypeMapT create_2nd_opcode_map {
         {"database", CommandType::CREATE_DATABASE},
-        {"table",    CommandType::CREATE_TABLE}
+        {"table",    CommandType::CREATE_TABLE},
+        {"index",    CommandType::CREATE_INDEX}
     };
     static CommandTypeMapT drop_2nd_opcode_map {
         {"database", CommandType::DROP_DATABASE},
         {"table",    CommandType::DROP_TABLE}
     };
 
-    const char *begin_sentry = cstring_jump_space(command.data(), command.end());
-    const char *end_sentry   = cstring_to_space(begin_sentry, command.end());
-    if (std::string_view{begin_sentry, end_sentry} == "create") {
-        auto [ret, new_end] = handle_second_opcode(end_sentry,
-                                               command.end(),
-                                               create_2nd_opcode_map);
-        if (ret == CommandType::_NONE) {
-            throw mygsql::Interpreter::IllegalCommandException(
-                command, "word 'create' must follow 'database' or 'table'");
-        }
-        return {ret, new_end};
-    }
-    if (std::string_view{begin_sentry, end_sentry} == "drop") {
-        auto [ret, new_end] = handle_second_opcode(end_sentry,
-                                               command.end(),
-                                               drop_2nd_opcode_map);
-        if (ret == CommandType::_NONE) {
-            throw mygsql::Interpreter::IllegalCommandException(
-                command, "word 'drop' must follow 'database' or 'table'");
+    Token opcode = next_token(lexer);
+    if (opcode.isWord("create") || opcode.isWord("drop")) {
+        bool is_create = opcode.isWord("create");
+        CommandTypeMapT const &map = is_create ? create_2nd_opcode_map
+                                               : drop_2nd_opcode_map;
+        Token _2nd_opcode = next_token(lexer);
+        auto iter = map.find(_2nd_opcode.text);
+        if (!_2nd_opcode.is(Token::Type::IDENTIFIER) || iter == map.end()) {
+            throw IllegalCommandException(lexer.get_source(), is_create
+                ? "word 'create' must follow 'database', 'table' or 'index'"
+                : "word 'drop' must follow 'database' or 'table'");
         }
-        return {ret, new_end};
+        return iter->second;
     }
-    std::string_view opcode = {begin_sentry, end_sentry};
-    if (command_type_map.contains(opcode))
-        return {command_type_map.at(opcode), end_sentry};
+    auto iter = command_type_map.find(opcode.text);
+    if (opcode.is(Token::Type::IDENTIFIER) && iter != command_type_map.end())
+        return iter->second;
 
     /* 所有可能的命令都枚举完了，现在必有错 */
-    std::string error_message = std::format("unknown opcode `{}`", opcode);
-    throw IllegalCommandException(command, error_message);
+    std::string error_message = std::format("unknown opcode `{}`", opcode.text);
+    throw IllegalCommandException(lexer.get_source(), error_message);
 }
 
 namespace mygsql {
 
 using namespace engine;
-using Condition = Engine::Condition;
 
-Interpreter::Interpreter(engine::Engine &engine)
-    : _executor_engine(engine),
+Interpreter::Interpreter(engine::Engine &engine, std::ostream &out)
+    : _executor_engine(engine), _out(out),
       _current_command(""),
       _state(State::IDLE) {
 }
-const std::set<char> Interpreter::_illegal_characters {
-    '\\', '/', ':', '?', '|',
-};
 
 void Interpreter::set_current_command(std::string_view command)
 {
-    for (char i: command) {
-        if (_illegal_characters.contains(i)) {
-            throw IllegalCommandException(command,
-                std::format("illegal character `{}`", i));
-        }
-    }
     _current_command = command;
-    _current_sentry  = &_current_command[0];
-}
-void Interpreter::set_current_command(std::string &&command)
-{
-    for (char i: command) {
-        if (_illegal_characters.contains(i)) {
-            throw IllegalCommandException(command,
-                std::format("illegal character `{}`", i));
-        }
-    }
-    _current_command = std::move(command);
-    _current_sentry  = &_current_command[0];
+    _lexer = Lexer(command);
 }
 
-void Interpreter::run(std::string_view command)
-{
+void Interpreter::run(std::string_view command) try {
     set_current_command(command);
     run();
+} catch (IllegalCommandException &e) {
+    _reportIllegalCommand(e);
+}
+
+void Interpreter::_reportIllegalCommand(IllegalCommandException const &e)
+{
+    _out << "Encountered illegal command!" << std::endl;
+    _out << e.what() << std::endl;
+    _out << "you can run this database program with parameter '--help'"
+         << " to see verbose help" << std::endl;
 }
 
 void Interpreter::_do_quit() {
+    expect_end(_lexer);
+    if (_executor_engine.in_transaction()) {
+        _executor_engine.rollbackTransaction();
+        _out << "transaction rolled back." << std::endl;
+    }
     _executor_engine.syncAll();
     _state = State::EXIT;
 }
 void Interpreter::_do_create_database()
 {
-    const char *end = _current_command.end().base();
-    _current_sentry = cstring_jump_space(_current_sentry, end);
-    const char *sentry_end = cstring_to_space(_current_sentry, end);
-    std::string_view database_name = {
-        _current_sentry, sentry_end
-    };
+    std::string_view database_name = expect_identifier(_lexer,
+                    "database creation requires a database name");
+    expect_end(_lexer);
     engine::DataBase *db = _executor_engine.createDataBase(database_name);
     if (db == nullptr) {
-        std::cout << "Database "<< database_name
+        _out << "Database "<< database_name
             << " has already created, or there exists an error."
             << std::endl;
     } else {
-        std::cout << std::format("Database {} successfully created.", database_name)
+        _out << std::format("Database {} successfully created.", database_name)
                   << std::endl;
     }
     _state = State::COMMAND_END;
@@ -201,32 +218,34 @@ void Interpreter::_do_create_database()
 
 void Interpreter::_do_drop_database()
 {
-    const char *end         = _current_command.end().base();
-    std::string_view dbname = cstring_get_word(_current_sentry, end);
+    std::string_view dbname = expect_identifier(_lexer,
+                    "dropping database requires a database name");
+    expect_end(_lexer);
     bool drop_result        = _executor_engine.dropDataBase(dbname);
     if (drop_result == false) {
-        std::cout << std::format("database named '{}' not exist",
+        _out << std::format("database named '{}' not exist",
                                  dbname)
                   << std::endl;
         return;
     }
-    std::cout << std::format("Database named '{}' successfully removed",
+    _out << std::format("Database named '{}' successfully removed",
                              dbname)
               << std::endl;
 }
 
 void Interpreter::_do_use()
 {
-    const char *end         = _current_command.end().base();
-    std::string_view dbname = cstring_get_word(_current_sentry, end);
+    std::string_view dbname = expect_identifier(_lexer,
+                    "'use' requires a database name");
+    expect_end(_lexer);
     engine::DataBase *db = _executor_engine.useDataBase(dbname);
     if (db == nullptr) {
-        std::cout << std::format("Database named '{}' not exist",
+        _out << std::format("Database named '{}' not exist",
                                  dbname)
                   << std::endl;
         return;
     }
-    std::cout << std::format("Now using '{}' as current data base.",
+    _out << std::format("Now using '{}' as current data base.",
                              dbname)
               << std::endl;
 }
@@ -234,7 +253,7 @@ void Interpreter::_do_use()
 bool Interpreter::_do_check_if_use()
 {
     if (_executor_engine.get_current_database() == nullptr) {
-        std::cout << std::format("Critical: current database `{}` is NOT available",
+        _out << std::format("Critical: current database `{}` is NOT available",
                                  _executor_engine.get_current_database_name())
                   << std::endl;
         return false;
@@ -242,523 +261,700 @@ bool Interpreter::_do_check_if_use()
     return true;
 }
 
-static StorageTable::TypeItemListT
-create_tilist_from_string(std::string_view tilist_string_view,
-                          std::vector<std::string> &out_cut_string);
+/** 语法:
+ * StorageTypeItem: column type
+ *                | column type 'primary'
+ * 列名称是语句文本的视图, 语句执行完以前一直有效 */
+static StorageTypeItem
+interpret_get_typeitem(Lexer &lexer)
+{
+    StorageTypeItem ti{};
+    ti.name = expect_identifier(lexer, "type item should look like `column type`");
+    Token type = next_token(lexer);
+    if (type.isWord("int")) {
+        ti.type = Value::Type::INT;
+    } else if (type.isWord("string")) {
+        ti.type = Value::Type::STRING;
+    } else {
+        throw IllegalCommandException(lexer.get_source(),
+            "you must set 'int' or 'string' as type");
+    }
+    if (accept_keyword(lexer, "primary"))
+        ti.is_primary = true;
+    return ti;
+}
 
 /** 语法:
- * CreateTable: 'create' 'table' WORD '(' TypeItemList ')' */
+ * CreateTable: 'create' 'table' WORD '(' TypeItemList ')'
+ * TypeItemList: TypeItem
+ *             | TypeItem ',' TypeItemList */
 void Interpreter::_do_create_table()
 {
-    /* "create table" */
-    const char *end = _current_command.end().base();
-
     /* WORD */
-    std::string_view table_name = cstring_get_identifier(_current_sentry, end);
-    if (table_name.length() == 0) {
-        throw IllegalCommandException(_current_command,
+    std::string_view table_name = expect_identifier(_lexer,
                     "table creation requires a table name");
-    }
 
     /* '(' */
-    _current_sentry = cstring_jump_space(table_name.end(), end);
-    if (*_current_sentry != '(') {
-        throw IllegalCommandException(_current_command,
-                    "table creation requires a type item list");
-    } _current_sentry++; // jumps '('
+    expect_symbol(_lexer, '(', "table creation requires a type item list");
     /* 错误情况: "()" */
-    _current_sentry = cstring_jump_space(_current_sentry, end);
-    if (*_current_sentry == ')') {
+    if (accept_symbol(_lexer, ')')) {
         throw IllegalCommandException(_current_command,
                     "table creation encounters an empty type item list");
     }
 
     /* 获取类型初始化列表 */
-    std::string_view init_list_str;
-    const char *ilist_begin = _current_sentry;
-    const char *ilist_end   = ilist_begin;
-    while (ilist_end != _current_command.end().base() &&
-           *ilist_end != ')') {
-        ilist_end++;
-    }
+    StorageTable::TypeItemListT ti_list;
+    do {
+        ti_list.push_back(interpret_get_typeitem(_lexer));
+    } while (accept_symbol(_lexer, ','));
     // 判断括号是否闭合
-    if (_current_sentry == _current_command.end().base()) {
-        throw IllegalCommandException(_current_command,
-                    "table creation encounters non-closed quote");
-    }
-    // 通过初始化列表字符串得到类型列表
-    init_list_str = {ilist_begin, ilist_end};
-    std::vector<std::string> init_list;
-    StorageTable::TypeItemListT ti_list = create_tilist_from_string(
-            init_list_str, init_list);
-    
+    expect_symbol(_lexer, ')', "table creation encounters non-closed quote");
+    expect_end(_lexer);
+
     // 构建Table
-    std::cout << "creating table " << table_name << std::endl;
+    _out << "creating table " << table_name << std::endl;
     engine::Table *table = _executor_engine.createTable(table_name, std::move(ti_list));
     if (table == nullptr) {
-        std::cout << "Table creation failed." << std::endl;
+        _out << "Table creation failed." << std::endl;
     }
     /* 输出 */
-    std::cout << "created table {\n";
+    _out << "created table {\n";
     for (auto &i: ti_list) {
-        std::cout << std::format("  [name:'{}', type:'{}', is primary:{}]\n",
+        _out << std::format("  [name:'{}', type:'{}', is primary:{}]\n",
             i.name, ValueTypeGetString(i.type),
             i.is_primary ? "true":"false");
     }
-    std::cout << "}" << std::endl;
-}
-
-static StorageTypeItem
-create_typeitem_from_string(std::string const &str);
-
-/** 语法:
- * TypeItemList: TypeItem
- *             | TypeItem ',' TypeItemList */
-static StorageTable::TypeItemListT
-create_tilist_from_string(std::string_view tilist_string_view,
-                          std::vector<std::string> &out_cut_string)
-{
-    std::string tilist_string(tilist_string_view);
-    static std::regex splitter("[,]");
-    StorageTable::TypeItemListT ret;
-    out_cut_string = std::vector<std::string> {
-        std::sregex_token_iterator(
-            tilist_string.begin(),
-            tilist_string.end(),
-            splitter, -1
-        ),
-        std::sregex_token_iterator()
-    };
-    for (std::string const &i: out_cut_string) {
-        ret.push_back(create_typeitem_from_string(i));
-    }
-    // for (auto &ti: ret) {
-    //     std::cout << "prebuild: ti.name    =" << ti.name << std::endl
-    //               << "          ti.primary =" << ti.is_primary << std::endl
-    //               << "          ti.type    =" << ValueTypeGetString(ti.type) << std::endl;
-    // } // comfirmed
-    return ret;
-}
-
-/** 语法:
- * StorageTypeItem: column type
- *                | column type 'primary' */
-static StorageTypeItem
-create_typeitem_from_string(std::string const &str)
-{
-    StorageTypeItem ti{};
-    const char *end    = str.end().base();
-    const char *cursor = cstring_jump_space(str.begin().base(), end);
-    // std::cout << "got type string: '" << str << "'" << std::endl;
-
-    std::string_view column = cstring_get_identifier(cursor, end);
-    ti.name = column;
-    cursor = column.end();
-
-    std::string_view type = cstring_get_identifier(cursor, end);
-    if (type == "int") {
-        ti.type = Value::Type::INT;
-    } else if (type == "string") {
-        ti.type = Value::Type::STRING;
-    } else {
-        throw IllegalCommandException(str,
-            std::format("you must set 'int' or 'string' as type",
-            type));
-    }
-    cursor = type.end();
-
-    cursor = cstring_jump_space(cursor, end);
-    // std::cout << "prebuild: ti.name    =" << ti.name << std::endl
-    //           << "          ti.primary =" << ti.is_primary << std::endl
-    //           << "          ti.type    =" << ValueTypeGetString(ti.type) << std::endl;
-    if (cursor == end || *cursor == ',' || *cursor == ')')
-        return ti;
-    std::string_view primary = cstring_get_identifier(cursor, end);
-    // std::cout << "primary:" << primary << std::endl;
-    if (primary == "primary")
-        ti.is_primary = true;
-    // std::cout << "aftbuild: ti.name    =" << ti.name << std::endl
-    //           << "          ti.primary =" << ti.is_primary << std::endl
-    //           << "          ti.type    =" << ValueTypeGetString(ti.type) << std::endl;
-    return ti;
+    _out << "}" << std::endl;
 }
 
 void Interpreter::_do_drop_table()
 {
-    const char *end = _current_command.end().base();
-    std::string_view table_name = cstring_get_word(_current_sentry, end);
+    std::string_view table_name = expect_identifier(_lexer,
+                    "dropping table requires a table name");
+    expect_end(_lexer);
     bool drop_result = _executor_engine.dropTable(table_name);
     if (drop_result == false) {
-        std::cout << std::format("drop table '{}' failed", table_name)
+        _out << std::format("drop table '{}' failed", table_name)
                   << std::endl;
     }
-    std::cout << std::format("Successfully deleted table '{}'", table_name)
+    _out << std::format("Successfully deleted table '{}'", table_name)
               << std::endl;
 }
 
-struct StringValueContext {
-    std::string string_value;
-    const char *current_position;
-
-    operator std::string() && {
-        return std::move(string_value);
-    }
-    operator std::string() const& {
-        return string_value;
-    }
-    operator const char*() const {
-        return current_position;
+/** 语法:
+ * CreateIndex: 'create' 'index' WORD 'on' WORD '(' WORD ')'
+ *            | 'create' 'index' WORD 'on' WORD '(' WORD ')' 'using' ('btree' | 'hash') */
+void Interpreter::_do_create_index()
+{
+    std::string_view index_name = expect_identifier(_lexer,
+                    "index creation requires an index name");
+    expect_keyword(_lexer, "on", "index name should follow 'on'");
+    std::string_view table_name = expect_identifier(_lexer,
+                    "index creation requires a table name");
+    expect_symbol(_lexer, '(', "index creation requires a column quoted by '(' and ')'");
+    std::string_view column = expect_identifier(_lexer,
+                    "index creation requires a column quoted by '(' and ')'");
+    expect_symbol(_lexer, ')', "index creation requires a column quoted by '(' and ')'");
+    /* 'using' */
+    auto kind = StorageTable::IndexKind::BTREE;
+    if (!peek_token(_lexer).is(Token::Type::END) && !peek_token(_lexer).isSymbol(';')) {
+        Token keyword_using = next_token(_lexer);
+        Token kind_name     = next_token(_lexer);
+        if (!keyword_using.isWord("using") ||
+            (!kind_name.isWord("btree") && !kind_name.isWord("hash"))) {
+            throw IllegalCommandException(_current_command,
+                        "index kind should look like `using btree` or `using hash`");
+        }
+        if (kind_name.isWord("hash"))
+            kind = StorageTable::IndexKind::HASH;
+    }
+    expect_end(_lexer);
+    if (!_executor_engine.createIndex(table_name, index_name, column, kind)) {
+        _out << std::format("index '{}' already exists, or column '{}' is already indexed",
+                            index_name, column)
+             << std::endl;
+        return;
     }
-}; // struct StringValueContext
-static StringValueContext interpret_get_string_value(std::string_view value_string)
+    _out << std::format("Index '{}' on {}({}) successfully created.",
+                        index_name, table_name, column)
+         << std::endl;
+}
+
+/** 字符串常量去掉引号, 处理转义字符 */
+static std::string interpret_get_string_value(std::string_view quoted)
 {
     std::string ret;
-    if (value_string[0] != '"')
-        return {};
-    const char *end = value_string.end();
-    const char *cur = value_string.begin() + 1;
-    while (cur != end) {
-        if (*cur == '"')
-            break;
-        if (*cur == '\\') {
-            cur++;
-            if (cur == end) break;
-            switch (*cur) {
-            case 'n': ret += '\n'; break;
-            case 't': ret += '\t'; break;
-            default: ret += *cur;
-            }
-        } else {
+    ret.reserve(quoted.size() - 2);
+    const char *end = quoted.end() - 1;
+    for (const char *cur = quoted.begin() + 1; cur != end; cur++) {
+        if (*cur != '\\') {
             ret += *cur;
+            continue;
         }
         cur++;
+        switch (*cur) {
+        case 'n': ret += '\n'; break;
+        case 't': ret += '\t'; break;
+        default: ret += *cur;
+        }
     }
-    if (cur != end)
-        cur++;
-    // AC
-    // std::cout << "got string value:" << ret << std::endl;
-    // throw IllegalCommandException(value_string, "debug purpous");
-    return {ret, cur};
-}
-
-struct ValuePositionContext {
-    Value *owned_value;
-    const char *current_position;
-}; // struct ValueStringContext
-static ValuePositionContext interpret_get_value(std::string_view value_string)
-{
-    if (value_string.empty()) {
-        return {nullptr, value_string.begin()};
-    }
-    Value *ret_value;
-    const char *end = value_string.end();
-    const char *cur = cstring_jump_space(value_string.begin(), end);
-    if (end == cur)
-        return {nullptr, cur};
-    if (*cur == '"') {
-        // interpret get string value
-        auto [value_raw, new_cur] = interpret_get_string_value({cur, end});
+    return ret;
+}
+
+/** 语法:
+ * Value: STRING | INTEGER | '-' INTEGER | '?'
+ * @return 新建的常量。常量是参数`?`时返回空指针, `is_parameter`为true */
+static Value *interpret_get_value(Lexer &lexer, bool &is_parameter)
+{
+    is_parameter = false;
+    Token token = next_token(lexer);
+    if (token.isSymbol('?')) {
+        is_parameter = true;
+        return nullptr;
+    }
+    if (token.is(Token::Type::STRING)) {
+        std::string value_raw = interpret_get_string_value(token.text);
         if (value_raw.empty()) {
             throw IllegalCommandException(
-                value_string, "empty value string");
-        }
-        ret_value = new StringValue(value_raw);
-        cur = new_cur;
-    } else {
-        // interpret get int value
-        int64_t i64value = 0;
-        int sign = 1;
-        if (*cur == '-') {
-            sign = -1;
-            cur++;
-        }
-        while (cur != end && isdigit(*cur)) {
-            i64value = i64value * 10 + *cur - '0';
-            cur++;
+                lexer.get_source(), "empty value string");
         }
-        i64value *= sign;
-        // AC
-        // std::cout << "int value: " << i64value << std::endl;
-        // throw IllegalCommandException(value_string, "debug purpous");
-        ret_value = new IntValue(i64value);
+        return new StringValue(value_raw);
     }
-    return {ret_value, cur};
+    bool negative = token.isSymbol('-');
+    if (negative)
+        token = next_token(lexer);
+    if (!token.is(Token::Type::INTEGER)) {
+        throw IllegalCommandException(lexer.get_source(),
+                std::format("expected a constant value, got `{}`", token.text));
+    }
+    int64_t i64value = 0;
+    auto [ptr, ec] = std::from_chars(token.text.begin(), token.text.end(), i64value);
+    i64value = negative ? -i64value : i64value;
+    if (ec != std::errc() || i64value < INT32_MIN || i64value > INT32_MAX) {
+        throw IllegalCommandException(lexer.get_source(),
+                std::format("integer constant {} is out of range", token.text));
+    }
+    return new IntValue(int32_t(i64value));
 }
 
-static Engine::ValueListT interpret_get_value_list(std::string_view value_string)
+/** 语法:
+ * ValueList: Value
+ *          | Value ',' ValueList
+ * 值列表以')'结尾, ')'也会被取出。参数`?`在值列表里是空指针 */
+static Engine::ValueListT interpret_get_value_list(Lexer &lexer)
 {
-    const char *end = value_string.end();
     Engine::ValueListT ret;
-    const char *cur = value_string.begin();
-    // std::cout << "===============[Debug]===============" << std::endl;
-    while (cur != end) {
-        cur = cstring_jump_space(cur, end);
-        auto [value, new_cur] = interpret_get_value({cur, end});
-        new_cur = cstring_jump_space(new_cur, end);
-        if (value == nullptr) {
-            throw IllegalCommandException(value_string,
-                    "Value string contains illegal character");
-        }
-        ret.push_back(value);
-        // std::cout << std::format("type:{}, value:'{}'",
-        //                 ValueTypeGetString(value->get_value_type()),
-        //                 value->getString())
-        //           << std::format(" new cur: {}", std::string_view{new_cur, end})
-        //           << std::endl;
-        if (new_cur == end) {
-            throw IllegalCommandException(value_string,
-                    "Value string should end with ')'");
-        }
-        if (*new_cur == ')') {
-            break;
-        }
-        if (*new_cur != ',') {
-            throw IllegalCommandException(value_string,
-                    "Value list should be separated with comma");
-        }
+    do {
+        bool is_parameter = false;
+        Value *value = interpret_get_value(lexer, is_parameter);
+        if (is_parameter)
+            ret.emplace_back();
+        else
+            ret.push_back(value);
+    } while (accept_symbol(lexer, ','));
+    expect_symbol(lexer, ')', "Value string should end with ')'");
+    return ret;
+}
+
+using ConditionPtrT = std::unique_ptr<Condition>;
+static ConditionPtrT interpret_get_or_condition(Lexer &lexer, Plan &plan);
+
+/** 语法:
+ * Comparison: Column RelationOperator Value
+ *           | Column RelationOperator Column */
+static ConditionPtrT interpret_get_comparison(Lexer &lexer, Plan &plan)
+{
+    ColumnRef column = expect_column(lexer,
+                    "where condition should look like `column operator value`");
+    Token op = next_token(lexer);
+    if (!op.is(Token::Type::OPERATOR)) {
+        throw IllegalCommandException(lexer.get_source(),
+                "where condition should look like `column operator value`");
+    }
+    static const std::unordered_map<std::string_view, TotalOrderRelation> relation_map {
+        {"=",  TotalOrderRelation::EQ}, {"!=", TotalOrderRelation::NE},
+        {"<>", TotalOrderRelation::NE}, {"<",  TotalOrderRelation::LT},
+        {"<=", TotalOrderRelation::LE}, {">",  TotalOrderRelation::GT},
+        {">=", TotalOrderRelation::GE},
+    };
+    ConditionPtrT ret;
+    if (peek_token(lexer).is(Token::Type::IDENTIFIER)) {
+        ret = std::make_unique<Condition>(Condition::Kind::COMPARE_COLUMNS);
+        ret->other_column = expect_column(lexer, "expected a column name");
+    } else {
+        ret = std::make_unique<Condition>(Condition::Kind::COMPARE);
+        bool is_parameter = false;
+        Value *cond_value = interpret_get_value(lexer, is_parameter);
+        if (is_parameter)
+            plan.addParameter(ret->value);
+        else
+            ret->value = cond_value;
+    }
+    ret->column   = std::move(column);
+    ret->relation = relation_map.at(op.text);
+    return ret;
+}
 
-        cur = new_cur + 1;
+/** 语法:
+ * NotCondition: 'not' NotCondition
+ *             | '(' OrCondition ')'
+ *             | Comparison */
+static ConditionPtrT interpret_get_not_condition(Lexer &lexer, Plan &plan)
+{
+    if (accept_keyword(lexer, "not")) {
+        ConditionPtrT ret = std::make_unique<Condition>(Condition::Kind::NOT);
+        ret->children.push_back(interpret_get_not_condition(lexer, plan));
+        return ret;
     }
-    // AC
-    // throw IllegalCommandException(value_string, "debug purpous");
+    if (accept_symbol(lexer, '(')) {
+        ConditionPtrT ret = interpret_get_or_condition(lexer, plan);
+        expect_symbol(lexer, ')', "where condition has a non-closed '('");
+        return ret;
+    }
+    return interpret_get_comparison(lexer, plan);
+}
+
+/** 语法:
+ * AndCondition: NotCondition
+ *             | NotCondition 'and' AndCondition
+ * 连续的AND合并成一个结点 */
+static ConditionPtrT interpret_get_and_condition(Lexer &lexer, Plan &plan)
+{
+    ConditionPtrT first = interpret_get_not_condition(lexer, plan);
+    if (!peek_token(lexer).isWord("and"))
+        return first;
+    ConditionPtrT ret = std::make_unique<Condition>(Condition::Kind::AND);
+    ret->children.push_back(std::move(first));
+    while (accept_keyword(lexer, "and"))
+        ret->children.push_back(interpret_get_not_condition(lexer, plan));
     return ret;
 }
 
-static Condition interpret_get_condition(std::string_view condition)
+/** 语法:
+ * OrCondition: AndCondition
+ *            | AndCondition 'or' OrCondition
+ * 连续的OR合并成一个结点 */
+static ConditionPtrT interpret_get_or_condition(Lexer &lexer, Plan &plan)
 {
-    Condition ret = {
-        "", TotalOrderRelation::NONE, nullptr
-    };
-    const char *cur = condition.begin();
-    const char *end = condition.end();
-    std::string_view condition_column = cstring_get_identifier(cur, end);
-    if (!word_is_identifier(condition_column)) {
-        throw IllegalCommandException(condition,
-                "column detected illegal character");
-    }
-    ret.name = condition_column;
-    cur = condition_column.end();
-    std::string_view op = cstring_get_word(cur, end);
-    if (op.contains(">")) {
-        ret.relation = TotalOrderRelation::GT;
-    } else if (op.contains("<")) {
-        ret.relation = TotalOrderRelation(
-                (int32_t)ret.relation | (int32_t)TotalOrderRelation::LT);
-    } else if (op.contains("=")) {
-        ret.relation = TotalOrderRelation(
-                (int32_t)ret.relation | (int32_t)TotalOrderRelation::EQ);
-    }
-    cur = op.end();
-    auto [cond_value, new_cur] = interpret_get_value({cur, end});
-    ret.condition_value = cond_value;
-    // AC
-    // std::cout << "DEBUG:" << std::endl;
-    // std::cout << std::format("condition column='{}' op={:04b} value.type={} value={}",
-    //                          ret.name, int32_t(ret.relation),
-    //                          ValueTypeGetString(ret.condition_value->get_value_type()),
-    //                          ret.condition_value->getString())
-    //           << std::endl;
-    // throw IllegalCommandException(condition, "debugging...");
+    ConditionPtrT first = interpret_get_and_condition(lexer, plan);
+    if (!peek_token(lexer).isWord("or"))
+        return first;
+    ConditionPtrT ret = std::make_unique<Condition>(Condition::Kind::OR);
+    ret->children.push_back(std::move(first));
+    while (accept_keyword(lexer, "or"))
+        ret->children.push_back(interpret_get_and_condition(lexer, plan));
     return ret;
 }
 
-static void print_matrix_selector(Engine::NameValueMatrixT const &selector)
+/** 语法:
+ * WhereCondition: OrCondition
+ * 解析where条件, 放进计划`plan`里. 参数`?`按出现的次序登记 */
+static void interpret_get_condition(Lexer &lexer, Plan &plan)
+{
+    plan.condition = interpret_get_or_condition(lexer, plan);
+}
+
+using RowListT = std::pmr::deque<Engine::ValueListT>;
+static void print_matrix_selector(std::ostream &out, std::vector<std::string> const &columns,
+                                  RowListT const &selector)
 {
     if (selector.empty()) {
-        std::cout << "No value selected." << std::endl;
+        out << "No value selected." << std::endl;
     } else {
-        std::cout << "column head:" << std::endl;
-        for (auto &i: selector[0])
-            std::cout << std::format("{:16s}", i.first);
-        std::cout << std::endl;
+        out << "column head:" << std::endl;
+        for (auto &i: columns)
+            out << std::format("{:16s}", i);
+        out << std::endl;
         for (auto &i: selector) {
             for (auto &j: i)
-                std::cout << std::format("{:16s}", j.second->getString());
-            std::cout << std::endl;
+                out << std::format("{:16s}", j->getString());
+            out << std::endl;
         }
     }
 }
-static void print_listed_selector(std::deque<Value*> &selector)
+static void print_listed_selector(std::ostream &out, RowListT const &selector)
 {
     if (selector.empty()) {
-        std::cout << "No value selected." << std::endl;
+        out << "No value selected." << std::endl;
         return;
     }
     for (auto &i: selector)
-        std::cout << i->getString() << std::endl;
+        out << i[0]->getString() << std::endl;
 }
-static void print_listed_selector(Engine::ValueListT &selector)
+
+Interpreter::PlanPtrT Interpreter::_compile(CommandType command_type)
 {
-    if (selector.empty()) {
-        std::cout << "No value selected." << std::endl;
-        return;
+    PlanPtrT plan;
+    switch (command_type) {
+    case CommandType::SELECT: plan = _compile_select(); break;
+    case CommandType::DELETE: plan = _compile_delete(); break;
+    case CommandType::INSERT: plan = _compile_insert(); break;
+    case CommandType::UPDATE: plan = _compile_update(); break;
+    default:
+        throw IllegalCommandException(_current_command,
+            "only select, delete, insert and update statements can be compiled");
     }
-    for (auto &i: selector)
-        std::cout << i->getString() << std::endl;
+    expect_end(_lexer);
+    return plan;
 }
 
-/** Select: 'select' WORD 'from' WORD
- *        | 'select' WORD 'from' WORD 'where' WhereCondition */
-void Interpreter::_do_select()
+/** 语法:
+ * SelectItem: Column
+ *           | Aggregate '(' Column ')'
+ *           | 'count' '(' '*' ')'
+ * Aggregate:  'count' | 'sum' | 'min' | 'max' | 'avg'
+ * 解析select列表或者order by的一项, `name`是它作为输出列的名称 */
+static mygsql::engine::AggregateItem expect_select_item(Lexer &lexer, std::string_view reason)
+{
+    static std::unordered_map<std::string_view, AggregateFunction> const aggregate_map {
+        {"count", AggregateFunction::COUNT},
+        {"sum",   AggregateFunction::SUM},
+        {"min",   AggregateFunction::MIN},
+        {"max",   AggregateFunction::MAX},
+        {"avg",   AggregateFunction::AVG}
+    };
+
+    mygsql::engine::AggregateItem item;
+    item.column = expect_column(lexer, reason);
+    if (!item.column.table.empty() || !accept_symbol(lexer, '(')) {
+        item.name = item.column.get_full_name();
+        return item;
+    }
+    std::string word = std::move(item.column.name);
+    item.column = {};
+    auto iter = aggregate_map.find(word);
+    if (iter == aggregate_map.end()) {
+        throw IllegalCommandException(lexer.get_source(),
+                    std::format("unknown aggregate function `{}`", word));
+    }
+    item.function = iter->second;
+    if (!accept_symbol(lexer, '*')) {
+        item.column = expect_column(lexer, "aggregate function requires a column name");
+    } else if (item.function != AggregateFunction::COUNT) {
+        throw IllegalCommandException(lexer.get_source(),
+                    std::format("`{}` requires a column name", word));
+    }
+    expect_symbol(lexer, ')', "aggregate function is not closed with ')'");
+    item.name = std::format("{}({})", word,
+                            item.has_column() ? item.column.get_full_name() : "*");
+    return item;
+}
+
+/** Select:  'select' Columns 'from' WORD SelectTail
+ *          | 'select' Columns 'from' WORD 'join' WORD 'on' Column '=' Column SelectTail
+ * SelectTail: Where GroupBy OrderBy Limit, 每一部分都可以省略
+ * Where:      'where' WhereCondition
+ * Columns:    '*' | SelectList
+ * SelectList: SelectItem
+ *           | SelectItem ',' SelectList
+ * GroupBy:    'group' 'by' ColumnList
+ * ColumnList: Column
+ *           | Column ',' ColumnList
+ * OrderBy:    'order' 'by' SelectItem
+ *           | 'order' 'by' SelectItem 'asc'
+ *           | 'order' 'by' SelectItem 'desc'
+ * Limit:      'limit' INTEGER
+ * 只有列表里的列会从存储区解码。有聚合函数或者group by时是聚合查询, 这时列表里的普通列
+ * 必须出现在group by里。连接查询不能聚合, 只有聚合查询能按聚合函数排序 */
+Interpreter::PlanPtrT Interpreter::_compile_select()
 {
-    const char *end = _current_command.end().base();
-    std::string_view column = cstring_get_word(_current_sentry, end);
-    _current_sentry = column.end();
-    std::string_view from = cstring_get_identifier(_current_sentry, end);
-    if (from != "from") {
-        throw IllegalCommandException(_current_command,
-            std::format("'select' statement must follow 'from'"));
-    } _current_sentry = from.end();
-    std::string_view table = cstring_get_word(_current_sentry, end);
-    if (!word_is_identifier(table)) {
-        throw IllegalCommandException(_current_command, "deteted illegal character");
-    }
-    _current_sentry = table.end();
-    std::string_view where = cstring_get_identifier(_current_sentry, end);
-
-    /* select all */
-    if (where != "where") {
-        if (column == "*") {
-            auto selector = _executor_engine.selectFromTable(table);
-            print_matrix_selector(selector);
-        } else {
-            auto selector = _executor_engine.selectValueFromTable(table, column);
-            std::cout << "select column: " << column << std::endl;
-            print_listed_selector(selector);
+    std::vector<Plan::AggregateItem> items;
+    bool has_aggregate = false;
+    bool select_all = accept_symbol(_lexer, '*');
+    if (!select_all) {
+        do {
+            items.push_back(expect_select_item(_lexer,
+                "'select' statement requires a column list or '*'"));
+            has_aggregate |= (items.back().function != AggregateFunction::NONE);
+        } while (accept_symbol(_lexer, ','));
+    }
+    expect_keyword(_lexer, "from", "'select' statement must follow 'from'");
+    std::string_view table = expect_identifier(_lexer, "deteted illegal character");
+
+    PlanPtrT plan = new Plan(Plan::Kind::SELECT, table);
+    plan->select_all = select_all;
+    /* select join */
+    if (accept_keyword(_lexer, "join")) {
+        plan->join_table = expect_identifier(_lexer, "'join' requires a table name");
+        expect_keyword(_lexer, "on", "'join' requires an 'on' condition");
+        plan->join_keys[0] = expect_column(_lexer, "join condition requires a column name");
+        Token op = next_token(_lexer);
+        if (!op.is(Token::Type::OPERATOR) || op.text != "=") {
+            throw IllegalCommandException(_current_command,
+                        "join condition should look like `column = column`");
         }
-        return;
+        plan->join_keys[1] = expect_column(_lexer, "join condition requires a column name");
     }
     /* select where */
-    _current_sentry = where.end();
-    Condition condition = interpret_get_condition({_current_sentry, end});
-    MTB::owned<Value> value_lifetime_proxy = condition.condition_value;
-    if (column == "*") {
-        auto selector = _executor_engine.selectFromTable(table, condition);
-        print_matrix_selector(selector);
-    } else {
-        auto selector =
-            _executor_engine.selectValueFromTable(table, column, condition);
-        print_listed_selector(selector);
+    if (accept_keyword(_lexer, "where"))
+        interpret_get_condition(_lexer, *plan);
+    /* select group by */
+    if (accept_keyword(_lexer, "group")) {
+        expect_keyword(_lexer, "by", "word 'group' must follow 'by'");
+        do {
+            plan->group_by.push_back(expect_column(_lexer,
+                "'group by' requires a column list"));
+        } while (accept_symbol(_lexer, ','));
+        if (select_all) {
+            throw IllegalCommandException(_current_command,
+                        "'select *' cannot be used with 'group by'");
+        }
+    }
+    /* select order by */
+    if (accept_keyword(_lexer, "order")) {
+        expect_keyword(_lexer, "by", "word 'order' must follow 'by'");
+        plan->order_by = expect_select_item(_lexer, "'order by' requires a column");
+        if (accept_keyword(_lexer, "desc"))
+            plan->order_desc = true;
+        else
+            accept_keyword(_lexer, "asc");
+    }
+    /* select limit */
+    if (accept_keyword(_lexer, "limit")) {
+        Token token = next_token(_lexer);
+        size_t limit = 0;
+        auto [ptr, ec] = std::from_chars(token.text.begin(), token.text.end(), limit);
+        if (!token.is(Token::Type::INTEGER) || ec != std::errc()) {
+            throw IllegalCommandException(_current_command,
+                        "'limit' requires a non-negative integer");
+        }
+        plan->limit = limit;
+    }
+    if (has_aggregate || !plan->group_by.empty()) {
+        if (plan->is_join()) {
+            throw IllegalCommandException(_current_command,
+                        "aggregate functions and 'group by' cannot be used with 'join'");
+        }
+        plan->aggregates = std::move(items);
+        return plan;
+    }
+    if (plan->order_by.function != AggregateFunction::NONE) {
+        throw IllegalCommandException(_current_command,
+                    "'order by' an aggregate function requires an aggregate query");
     }
+    for (Plan::AggregateItem &item: items)
+        plan->columns.push_back(std::move(item.column));
+    return plan;
 }
-void Interpreter::_do_delete()
+
+/** Delete: 'delete' WORD
+ *        | 'delete' WORD 'where' WhereCondition */
+Interpreter::PlanPtrT Interpreter::_compile_delete()
 {
-    const char *end = _current_command.end().base();
-    std::string_view table = cstring_get_word(_current_sentry, end);
-    _current_sentry = table.end();
-    std::string_view where = cstring_get_identifier(_current_sentry, end);
-    if (where != "where") {
-        size_t nelems = _executor_engine.deleteValueFromTable(table);
-        std::cout << std::format("deleted {} elements.", nelems)
-                  << std::endl;
-        return;
-    }
-    _current_sentry = where.end();
-    Condition condition = interpret_get_condition({_current_sentry, end});
-    MTB::owned<Value> lifetime_proxy{condition.condition_value};
-    size_t nelems = _executor_engine.deleteValueFromTable(table, condition);
-    std::cout << "deleted " << nelems << " elements." << std::endl;
+    std::string_view table = expect_identifier(_lexer, "'delete' requires a table name");
+    PlanPtrT plan = new Plan(Plan::Kind::DELETE, table);
+    if (accept_keyword(_lexer, "where"))
+        interpret_get_condition(_lexer, *plan);
+    return plan;
 }
 
-void Interpreter::_do_insert()
+/** Insert: 'insert' WORD 'values' '(' ValueList ')' */
+Interpreter::PlanPtrT Interpreter::_compile_insert()
 {
-    const char *end = _current_command.end().base();
-    std::string_view table = cstring_get_word(_current_sentry, end);
-    _current_sentry = table.end();
-    std::string_view values = cstring_get_word(_current_sentry, end);
-    if (values != "values") {
-        throw IllegalCommandException(_current_command, 
-            "insert command should follow 'values'");
-    }
-    
+    std::string_view table = expect_identifier(_lexer, "'insert' requires a table name");
+    expect_keyword(_lexer, "values", "insert command should follow 'values'");
+
     /* '(' */
-    _current_sentry = cstring_jump_space(values.end(), end);
-    if (*_current_sentry != '(') {
-        throw IllegalCommandException(_current_command,
-                    "value insertion requires a value list");
-    } _current_sentry++; // jumps '('
+    expect_symbol(_lexer, '(', "value insertion requires a value list");
     /* 错误情况: "()" */
-    _current_sentry = cstring_jump_space(_current_sentry, end);
-    if (*_current_sentry == ')') {
+    if (accept_symbol(_lexer, ')')) {
         throw IllegalCommandException(_current_command,
                     "table insertion encounters an empty value list");
     }
 
     /* 获取值初始化列表 */
-    std::string_view init_list_str;
-    const char *ilist_begin = _current_sentry;
-    Engine::ValueListT value_list(
-        interpret_get_value_list({ilist_begin, end})
-    );
-    Engine::NameValueListT name_value_list {
-        _executor_engine.insertToTable(table, value_list)
-    };
-    std::cout << "inserted an entry:" << std::endl;
-    for (auto &i: name_value_list) {
-        std::cout << std::format("{}:{}", i.first, i.second->getString())
-                  << std::endl;
+    PlanPtrT plan = new Plan(Plan::Kind::INSERT, table);
+    plan->values = interpret_get_value_list(_lexer);
+    for (Engine::ValuePtrT &value: plan->values) {
+        if (value.get() == nullptr)
+            plan->addParameter(value);
     }
+    return plan;
 }
 
-void Interpreter::_do_update()
+/** Update: 'update' WORD 'set' WORD '=' Value
+ *        | 'update' WORD 'set' WORD '=' Value 'where' WhereCondition */
+Interpreter::PlanPtrT Interpreter::_compile_update()
 {
-    const char *end = _current_command.end().base();
     /* table */
-    std::string_view table = cstring_get_identifier(_current_sentry, end);
-    _current_sentry = table.end();
+    std::string_view table = expect_identifier(_lexer, "'update' requires a table name");
 
     /* 'set' */
-    std::string_view keyword_set = cstring_get_identifier(_current_sentry, end);
-    if (keyword_set != "set") {
+    if (!accept_keyword(_lexer, "set")) {
         _state = State::ERROR;
         throw IllegalCommandException(_current_command,
                     "update command should follow 'set'");
     }
-    _current_sentry = keyword_set.end();
 
-    /* column */
-    std::string_view column = cstring_get_identifier(_current_sentry, end);
-    _current_sentry = cstring_jump_space(column.end(), end);
-    if (*_current_sentry != '=') {
+    /* column '=' Value */
+    Token column = next_token(_lexer);
+    Token op     = next_token(_lexer);
+    if (!column.is(Token::Type::IDENTIFIER) || !op.is(Token::Type::OPERATOR) ||
+        op.text != "=") {
         _state = State::ERROR;
         throw IllegalCommandException(_current_command,
             "update command with 'set' expression should look like `column = value`");
     }
-    _current_sentry = cstring_jump_space(_current_sentry + 1, end);
-    auto [const_value, cur] = interpret_get_value({_current_sentry, end});
-    owned<Value> value_lifetime_proxy(const_value);
+    bool is_parameter = false;
+    Value *const_value = interpret_get_value(_lexer, is_parameter);
+    PlanPtrT plan = new Plan(Plan::Kind::UPDATE, table);
+    ColumnRef set_column;
+    set_column.name = column.text;
+    plan->columns.push_back(std::move(set_column));
+    if (is_parameter) {
+        plan->values.emplace_back();
+        plan->addParameter(plan->values.back());
+    } else {
+        plan->values.push_back(const_value);
+    }
+
+    /* 'where' WhereCondition */
+    if (accept_keyword(_lexer, "where"))
+        interpret_get_condition(_lexer, *plan);
+    return plan;
+}
 
-    /* 'where' */
-    _current_sentry = cstring_jump_space(cur, end);
-    std::string_view where = cstring_get_identifier(_current_sentry, end);
-    if (_current_sentry == end || where != "where") {
-        size_t nelems {
-            _executor_engine.updateTable(table, column, const_value)
+void Interpreter::_execute_plan(Plan &plan)
+{
+    switch (plan.kind) {
+    case Plan::Kind::SELECT: {
+        /* 结果行与它们的值从语句的内存池分配, 语句结束时一次释放。内存池要比结果行活得更久 */
+        std::pmr::monotonic_buffer_resource arena;
+        RowListT rows(&arena);
+        _executor_engine.executeSelect(plan, [&rows](Engine::ValueListT &&values) {
+            rows.push_back(std::move(values));
+        }, &arena);
+        if (plan.select_all || plan.is_aggregate() || plan.columns.size() > 1) {
+            print_matrix_selector(_out, plan.get_column_names(), rows);
+            return;
+        }
+        if (!plan.has_condition())
+            _out << "select column: " << plan.columns[0].name << std::endl;
+        print_listed_selector(_out, rows);
+        return;
+    }
+    case Plan::Kind::DELETE: {
+        size_t nelems = _executor_engine.executeDelete(plan);
+        _out << std::format("deleted {} elements.", nelems)
+                  << std::endl;
+        return;
+    }
+    case Plan::Kind::INSERT: {
+        Engine::NameValueListT name_value_list {
+            _executor_engine.executeInsert(plan)
         };
-        std::cout << "updated " << nelems << " elements" << std::endl;
+        _out << "inserted an entry:" << std::endl;
+        for (auto &i: name_value_list) {
+            _out << std::format("{}:{}", i.first, i.second->getString())
+                      << std::endl;
+        }
+        return;
+    }
+    case Plan::Kind::UPDATE: {
+        size_t nelems = _executor_engine.executeUpdate(plan);
+        _out << "updated " << nelems << " elements" << std::endl;
+        return;
+    }
+    }
+}
+
+/** 语法:
+ * Prepare: 'prepare' WORD 'as' Statement
+ * Statement是select/delete/insert/update语句, 里面的常量可以写成参数'?' */
+void Interpreter::_do_prepare()
+{
+    std::string_view name = expect_identifier(_lexer, "prepare requires a statement name");
+    expect_keyword(_lexer, "as", "statement name should follow 'as'");
+    PlanPtrT plan = _compile(command_get_type(_lexer));
+    _prepared_plans.insert_or_assign(std::string(name), plan);
+    _out << std::format("Statement '{}' prepared with {} parameters.",
+                        name, plan->get_parameter_count())
+         << std::endl;
+}
+
+/** 语法:
+ * Execute: 'execute' WORD
+ *        | 'execute' WORD '(' ')'
+ *        | 'execute' WORD '(' ValueList ')' */
+void Interpreter::_do_execute()
+{
+    std::string_view name = expect_identifier(_lexer, "execute requires a statement name");
+    Engine::ValueListT parameters;
+    if (accept_symbol(_lexer, '(') && !accept_symbol(_lexer, ')'))
+        parameters = interpret_get_value_list(_lexer);
+    expect_end(_lexer);
+    for (Engine::ValuePtrT const &value: parameters) {
+        if (value.get() == nullptr) {
+            throw IllegalCommandException(_current_command,
+                        "parameters of 'execute' should be constants");
+        }
+    }
+    auto iter = _prepared_plans.find(std::string(name));
+    if (iter == _prepared_plans.end()) {
+        _out << std::format("prepared statement '{}' does not exist", name)
+             << std::endl;
         return;
     }
-    /* WhereCondition */
-    _current_sentry = where.end();
-    Condition condition = interpret_get_condition({_current_sentry, end});
-    size_t nelems = _executor_engine.updateTable(table, column, const_value, condition);
-    std::cout << "updated " << nelems << " elements" << std::endl;
+    PlanPtrT plan = iter->second;
+    plan->setParameters(parameters);
+    _execute_plan(*plan);
 }
 
 void Interpreter::_do_sync()
 {
+    expect_end(_lexer);
     _executor_engine.syncAll();
 }
 
+/** 语法:
+ * Load: 'load' WORD 'from' STRING
+ * 文件名用单引号或者双引号括起来, 不处理转义字符 */
+void Interpreter::_do_load()
+{
+    std::string_view table = expect_identifier(_lexer, "deteted illegal character");
+    expect_keyword(_lexer, "from", "load command should follow 'from'");
+    Token path = next_token(_lexer);
+    if (!path.is(Token::Type::STRING)) {
+        throw IllegalCommandException(_current_command,
+            "load command requires a quoted file name");
+    }
+    expect_end(_lexer);
+    size_t nelems = _executor_engine.loadToTable(table, path.text.substr(1, path.text.size() - 2));
+    _out << "loaded " << nelems << " entries." << std::endl;
+}
+
+void Interpreter::_do_begin()
+{
+    expect_end(_lexer);
+    _executor_engine.beginTransaction();
+    _out << "transaction started." << std::endl;
+}
+
+void Interpreter::_do_commit()
+{
+    expect_end(_lexer);
+    _executor_engine.commitTransaction();
+    _out << "transaction committed." << std::endl;
+}
+
+void Interpreter::_do_rollback()
+{
+    expect_end(_lexer);
+    _executor_engine.rollbackTransaction();
+    _out << "transaction rolled back." << std::endl;
+}
+
 void Interpreter::run() try {
-    const char *cmd_begin = cstring_jump_space(
-            _current_command.begin().base(),
-            _current_command.end().base());
-    if (cmd_begin == _current_command.end().base())
+    _lexer = Lexer(_current_command);
+    if (peek_token(_lexer).is(Token::Type::END))
+        return;
+    /* 执行过的数据操作语句直接取出缓存的计划, 不再解析 */
+    PlanCache::Normalize(_current_command, _plan_key);
+    if (PlanPtrT plan = _plan_cache.find(_plan_key); plan.get() != nullptr) {
+        _execute_plan(*plan);
         return;
-    auto [command_type,
-          current_ptr] = command_get_type(_current_command);
-    _current_sentry = current_ptr;
+    }
+    CommandType command_type = command_get_type(_lexer);
     switch (command_type) {
     case CommandType::CREATE_DATABASE:
         _do_create_database();
@@ -775,21 +971,39 @@ void Interpreter::run() try {
     case CommandType::DROP_TABLE:
         _do_drop_table();
         break;
-    case CommandType::SELECT:
-        _do_select();
+    case CommandType::CREATE_INDEX:
+        _do_create_index();
         break;
+    case CommandType::SELECT:
     case CommandType::DELETE:
-        _do_delete();
-        break;
     case CommandType::INSERT:
-        _do_insert();
-        break;
-    case CommandType::UPDATE:
-        _do_update();
+    case CommandType::UPDATE: {
+        PlanPtrT plan = _compile(command_type);
+        _plan_cache.insert(std::string(_plan_key), plan);
+        _execute_plan(*plan);
         break;
+    }
     case CommandType::SYNC:
         _do_sync();
         break;
+    case CommandType::LOAD:
+        _do_load();
+        break;
+    case CommandType::BEGIN:
+        _do_begin();
+        break;
+    case CommandType::COMMIT:
+        _do_commit();
+        break;
+    case CommandType::ROLLBACK:
+        _do_rollback();
+        break;
+    case CommandType::PREPARE:
+        _do_prepare();
+        break;
+    case CommandType::EXECUTE:
+        _do_execute();
+        break;
     case CommandType::QUIT:
         _do_quit();
         break;
@@ -798,12 +1012,9 @@ void Interpreter::run() try {
         return;
     }
 } catch (IllegalCommandException &e) {
-    std::cout << "Encountered illegal command!" << std::endl;
-    std::cout << e.what() << std::endl;
-    std::cout << "you can run this database program with parameter '--help'"
-              << " to see verbose help" << std::endl;
+    _reportIllegalCommand(e);
 } catch (std::exception &e) {
-    std::cout << e.what() << std::endl;
+    _out << e.what() << std::endl;
 }
 
-} // namespace mygsql
\ No newline at end of file
+} // namespace mygsql
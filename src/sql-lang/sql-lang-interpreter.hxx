@@ -4,11 +4,15 @@
 #include "base/mtb-exception.hxx"
 #include "base/mtb-object.hxx"
 #include "engine/engine.hxx"
+#include "engine/engine-plan.hxx"
+#include "sql-lang-lexer.hxx"
+#include "sql-lang-plan-cache.hxx"
 #include <cstdint>
 #include <format>
-#include <set>
+#include <iostream>
 #include <string>
 #include <string_view>
+#include <unordered_map>
 
 namespace mygsql {
 using MTB::owned;
@@ -23,11 +27,18 @@ public:
         USE_DATABASE,   // 选择数据库
         CREATE_TABLE,   // 创建表
         DROP_TABLE,     // 删除表
+        CREATE_INDEX,   // 创建二级索引
         SELECT,         // 选择并打印表项
         DELETE,         // 删除表项
         INSERT,         // 插入表项
         UPDATE,         // 更新表列
         SYNC,           // 同步到磁盘映射区
+        LOAD,           // 从文件批量导入
+        BEGIN,          // 开始事务
+        COMMIT,         // 提交事务
+        ROLLBACK,       // 回滚事务
+        PREPARE,        // 编译并保存一条带名称的语句
+        EXECUTE,        // 执行保存的语句
         _COUNT,
     }; // enum class CommandType
 
@@ -52,24 +63,33 @@ R"(IllegalCommandException for command '{}': {})";
         std::string reason;
     }; // exception class IllegalCommandException
     using EnginePtrT = owned<engine::Engine>;
+    using PlanPtrT   = owned<engine::Plan>;
 public:
-    Interpreter(engine::Engine &engine);
+    /** 命令的输出写进`out`. 服务器模式下每个会话的输出是自己的连接 */
+    Interpreter(engine::Engine &engine, std::ostream &out = std::cout);
 
     void run(std::string_view command);
     void run();
     std::string_view get_current_command() const {
         return _current_command;
     }
+    /** 设置要执行的命令。解释器不复制命令文本, 文本在`run()`结束以前必须有效 */
     void set_current_command(std::string_view command);
-    void set_current_command(std::string &&command);
     State get_state() const { return _state; }
+    /** getter: 这个会话的计划缓存 */
+    PlanCache const &get_plan_cache() const { return _plan_cache; }
 private:
     engine::Engine  &_executor_engine;
-    std::string      _current_command;
-    const char*      _current_sentry;
+    std::ostream    &_out;
+    std::string_view _current_command;
+    Lexer            _lexer;          // 当前命令的词法分析器
     State            _state;
+    PlanCache        _plan_cache;     // 数据操作语句的计划缓存, 键是规范化的语句文本
+    std::string      _plan_key;       // 规范化语句文本的缓冲区, 每条命令重复使用
+    std::unordered_map<std::string, PlanPtrT> _prepared_plans; // prepare保存的计划
 private:
-    static const std::set<char> _illegal_characters;
+    //报告非法命令
+    void _reportIllegalCommand(IllegalCommandException const &e);
 
     //退出程序
     void _do_quit();
@@ -85,18 +105,33 @@ private:
     void _do_create_table();
     //删除表
     void _do_drop_table();
+    //在表的一列上创建二级索引
+    void _do_create_index();
+    //把数据操作语句编译成计划, 从_lexer的当前位置开始解析
+    PlanPtrT _compile(CommandType command_type);
     //查询表
-    void _do_select();
+    PlanPtrT _compile_select();
     //删除表中的记录
-    void _do_delete();
+    PlanPtrT _compile_delete();
     //在表中插入数据
-    void _do_insert();
+    PlanPtrT _compile_insert();
     //更新表中数据
-    void _do_update();
+    PlanPtrT _compile_update();
+    //执行计划并输出结果
+    void _execute_plan(engine::Plan &plan);
     //处理未知命令
     void _do_unknown();
     //同步到磁盘
     void _do_sync();
+    //从CSV/TSV文件批量导入
+    void _do_load();
+    //开始、提交与回滚事务
+    void _do_begin();
+    void _do_commit();
+    void _do_rollback();
+    //编译并保存带名称的语句; 执行保存的语句
+    void _do_prepare();
+    void _do_execute();
 }; // class Interpreter
 
 } // namespace mygsql
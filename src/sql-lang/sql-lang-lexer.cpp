@@ -0,0 +1,101 @@
+#include "sql-lang-lexer.hxx"
+#include <array>
+
+namespace mygsql {
+
+/** 字符的分类, 决定从这个字符开始的词法单元的种类 */
+enum class CharClass: uint8_t {
+    ILLEGAL, SPACE, ALPHA, DIGIT, QUOTE, OPERATOR, SYMBOL
+}; // enum class CharClass
+
+static constexpr std::array<CharClass, 256> make_char_class_table()
+{
+    std::array<CharClass, 256> table{};
+    for (CharClass &i: table)
+        i = CharClass::ILLEGAL;
+    for (unsigned char c: std::string_view(" \t\n\r\v\f"))
+        table[c] = CharClass::SPACE;
+    for (int c = 'a'; c <= 'z'; c++)
+        table[c] = CharClass::ALPHA;
+    for (int c = 'A'; c <= 'Z'; c++)
+        table[c] = CharClass::ALPHA;
+    table['_'] = CharClass::ALPHA;
+    for (int c = '0'; c <= '9'; c++)
+        table[c] = CharClass::DIGIT;
+    table['"']  = CharClass::QUOTE;
+    table['\''] = CharClass::QUOTE;
+    for (unsigned char c: std::string_view("=!<>"))
+        table[c] = CharClass::OPERATOR;
+    for (unsigned char c: std::string_view("(),*?;-."))
+        table[c] = CharClass::SYMBOL;
+    return table;
+}
+static constexpr std::array<CharClass, 256> char_class_table = make_char_class_table();
+
+static inline CharClass char_class(char c) {
+    return char_class_table[static_cast<unsigned char>(c)];
+}
+
+Token Lexer::_scan()
+{
+    const char *end = _source.data() + _source.size();
+    while (_cursor != end && char_class(*_cursor) == CharClass::SPACE)
+        _cursor++;
+    if (_cursor == end)
+        return {Token::Type::END, {end, size_t(0)}};
+
+    const char *begin = _cursor;
+    Token::Type type = Token::Type::ILLEGAL;
+    switch (char_class(*_cursor)) {
+    case CharClass::ALPHA:
+        type = Token::Type::IDENTIFIER;
+        do {
+            _cursor++;
+        } while (_cursor != end && (char_class(*_cursor) == CharClass::ALPHA ||
+                                    char_class(*_cursor) == CharClass::DIGIT));
+        break;
+    case CharClass::DIGIT:
+        type = Token::Type::INTEGER;
+        do {
+            _cursor++;
+        } while (_cursor != end && char_class(*_cursor) == CharClass::DIGIT);
+        break;
+    case CharClass::QUOTE: {
+        char quote = *_cursor++;
+        while (_cursor != end && *_cursor != quote) {
+            if (*_cursor == '\\' && _cursor + 1 != end)
+                _cursor++;
+            _cursor++;
+        }
+        /* 没有闭合的字符串是非法的 */
+        if (_cursor != end) {
+            _cursor++;
+            type = Token::Type::STRING;
+        }
+        break;
+    }
+    case CharClass::OPERATOR: {
+        /* 双字符运算符: != <> <= >= */
+        char first = *_cursor++;
+        char second = (_cursor != end) ? *_cursor : '\0';
+        if ((first == '!' && second == '=') || (first == '<' && second == '>') ||
+            ((first == '<' || first == '>') && second == '=')) {
+            _cursor++;
+        } else if (first == '!') {
+            break; // 单独的'!'是非法的
+        }
+        type = Token::Type::OPERATOR;
+        break;
+    }
+    case CharClass::SYMBOL:
+        type = Token::Type::SYMBOL;
+        _cursor++;
+        break;
+    default:
+        _cursor++;
+        break;
+    }
+    return {type, {begin, size_t(_cursor - begin)}};
+}
+
+} // namespace mygsql
@@ -0,0 +1,83 @@
+#ifndef __MYG_SQL_LANG_LEXER_H__
+#define __MYG_SQL_LANG_LEXER_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace mygsql {
+
+/** @struct Token
+ * @brief 词法单元。`text`指向语句文本里的原始字符, 字符串常量包括两边的引号。 */
+struct Token {
+    enum class Type: uint8_t {
+        END,        // 语句结束
+        IDENTIFIER, // 标识符与关键字: 字母或下划线开头, 由字母、数字和下划线组成
+        INTEGER,    // 非负整数常量. 负号是单独的符号
+        STRING,     // 用单引号或者双引号括起来的字符串, 反斜杠转义下一个字符
+        OPERATOR,   // 比较运算符: = != <> < <= > >=
+        SYMBOL,     // 单字符符号: ( ) , * ? ; - .
+        ILLEGAL,    // 非法字符, 或者没有闭合的字符串
+    }; // enum class Type
+
+    Type             type = Type::END;
+    std::string_view text;
+
+    bool is(Type type) const { return this->type == type; }
+    /** 是不是关键字或者标识符`word` */
+    bool isWord(std::string_view word) const {
+        return type == Type::IDENTIFIER && text == word;
+    }
+    /** 是不是符号`symbol` */
+    bool isSymbol(char symbol) const {
+        return type == Type::SYMBOL && text[0] == symbol;
+    }
+}; // struct Token
+
+/** @class Lexer
+ * @brief 手写的表驱动词法分析器。在语句文本的视图上一遍扫描, 每次产生一个词法单元,
+ *        不复制文本, 也不分配内存。字符的分类查一张256项的表, 不做逐个比较。
+ *        可以向前看一个词法单元。
+ * @warning 词法单元指向语句文本, 文本要比词法单元活得长 */
+class Lexer {
+public:
+    explicit Lexer(std::string_view source = {})
+        : _source(source), _cursor(source.data()) {}
+
+    /** @fn next()
+     * @brief 取出下一个词法单元. 到结尾以后一直返回`END` */
+    Token next() {
+        if (_has_peeked) {
+            _has_peeked = false;
+            return _peeked;
+        }
+        return _scan();
+    }
+    /** @fn peek()
+     * @brief 看下一个词法单元, 但是不取出它 */
+    Token const &peek() {
+        if (!_has_peeked) {
+            _peeked     = _scan();
+            _has_peeked = true;
+        }
+        return _peeked;
+    }
+    /** @fn rest()
+     * @brief 还没有被取出的文本, 包括向前看的词法单元 */
+    std::string_view rest() const {
+        const char *begin = _has_peeked ? _peeked.text.data() : _cursor;
+        return {begin, size_t(_source.data() + _source.size() - begin)};
+    }
+    std::string_view get_source() const { return _source; }
+private:
+    std::string_view _source;
+    const char      *_cursor;
+    Token            _peeked;
+    bool             _has_peeked = false;
+
+    Token _scan();
+}; // class Lexer
+
+} // namespace mygsql
+
+#endif
@@ -0,0 +1,53 @@
+#include "sql-lang-plan-cache.hxx"
+#include "sql-lang-lexer.hxx"
+
+namespace mygsql {
+
+void PlanCache::Normalize(std::string_view text, std::string &out)
+{
+    out.clear();
+    Lexer lexer(text);
+    for (Token token = lexer.next(); !token.is(Token::Type::END); token = lexer.next()) {
+        if (!out.empty())
+            out += ' ';
+        out += token.text;
+    }
+}
+
+PlanCache::PlanPtrT PlanCache::find(std::string_view key)
+{
+    auto iter = _index.find(key);
+    if (iter == _index.end()) {
+        _miss_count++;
+        return nullptr;
+    }
+    _hit_count++;
+    _entries.splice(_entries.begin(), _entries, iter->second);
+    return iter->second->second;
+}
+
+void PlanCache::insert(std::string &&key, PlanPtrT const &plan)
+{
+    if (_capacity == 0)
+        return;
+    auto iter = _index.find(key);
+    if (iter != _index.end()) {
+        iter->second->second = PlanPtrT(plan);
+        _entries.splice(_entries.begin(), _entries, iter->second);
+        return;
+    }
+    if (_entries.size() >= _capacity) {
+        _index.erase(_entries.back().first);
+        _entries.pop_back();
+    }
+    _entries.emplace_front(std::move(key), plan);
+    _index.emplace(_entries.front().first, _entries.begin());
+}
+
+void PlanCache::clear()
+{
+    _index.clear();
+    _entries.clear();
+}
+
+} // namespace mygsql
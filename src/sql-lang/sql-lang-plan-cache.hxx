@@ -0,0 +1,63 @@
+#ifndef __MYG_SQL_LANG_PLAN_CACHE_H__
+#define __MYG_SQL_LANG_PLAN_CACHE_H__
+
+#include "base/mtb-object.hxx"
+#include "engine/engine-plan.hxx"
+#include <cstddef>
+#include <list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+namespace mygsql {
+using MTB::owned;
+
+/** @class PlanCache
+ * @brief 编译好的计划的LRU缓存, 键是规范化以后的语句文本。同一条语句再次执行时直接取出计划,
+ *        不再解析语句, 计划也已经绑定好了列下标。缓存满了时淘汰最久没有使用的计划。
+ *
+ *        每个解释器(会话)有自己的缓存, 所以不需要加锁。 */
+class PlanCache {
+public:
+    using PlanPtrT = owned<engine::Plan>;
+    /** 默认最多缓存的计划个数 */
+    static constexpr size_t DEFAULT_CAPACITY = 256;
+public:
+    explicit PlanCache(size_t capacity = DEFAULT_CAPACITY)
+        : _capacity(capacity) {}
+
+    /** @fn Normalize(text, out) static
+     * @brief 规范化语句文本: 把语句切成词法单元, 词法单元之间用一个空格隔开, 结果写进`out`。
+     *        只有空白不同的两条语句共用一个计划。`out`可以反复使用, 缓存命中时不分配内存。 */
+    static void Normalize(std::string_view text, std::string &out);
+
+    /** @fn find(key)
+     * @brief 查找规范化文本为`key`的计划, 找到时把它标记为最近使用的。
+     * @return 没有找到时返回空指针 */
+    PlanPtrT find(std::string_view key);
+    /** @fn insert(key, plan)
+     * @brief 缓存计划。`key`已经在缓存里时替换原来的计划 */
+    void insert(std::string &&key, PlanPtrT const &plan);
+    /** @fn clear()
+     * @brief 清空缓存 */
+    void clear();
+
+    size_t size() const { return _entries.size(); }
+    size_t get_capacity() const { return _capacity; }
+    size_t get_hit_count()  const { return _hit_count; }
+    size_t get_miss_count() const { return _miss_count; }
+private:
+    using EntryListT = std::list<std::pair<std::string, PlanPtrT>>;
+
+    size_t     _capacity;
+    EntryListT _entries;    // 最近使用的在最前面
+    /* 键指向链表结点里的字符串, 结点不会移动, 所以视图一直有效 */
+    std::unordered_map<std::string_view, EntryListT::iterator> _index;
+    size_t     _hit_count  = 0;
+    size_t     _miss_count = 0;
+}; // class PlanCache
+
+} // namespace mygsql
+
+#endif
@@ -0,0 +1,420 @@
+#include "storage-btree.hxx"
+#include "base/mtb-system.hxx"
+#include "base/sql-value.hxx"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <endian.h>
+#include <format>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace mygsql {
+
+/** B+树文件格式(大端序, 4字节对齐):
+ *  - 第0页是文件头: {magic, 节点大小, 键类型, 键大小, 根节点页号, 页数, 项数}
+ *  - 其余每一页是一个节点, 节点头是{是否为叶子, 项数, 右兄弟叶子页号, 保留}
+ *    - 叶子节点: 节点头后面紧跟着`项数`个(键, 条目ID)
+ *    - 内部节点: 节点头后面是最左孩子页号, 然后是`项数`个(键, 条目ID, 右孩子页号) */
+constexpr uint32_t btree_magic       = 0x4D42'5054; // "MBPT"
+constexpr uint32_t btree_node_size   = 4096;
+constexpr uint32_t btree_node_header = 16;
+constexpr uint32_t btree_no_page     = 0;           // 第0页是文件头, 可以当成空页号
+
+enum BTreeHeaderField: uint32_t {
+    HEADER_MAGIC = 0, HEADER_NODE_SIZE, HEADER_KEY_TYPE, HEADER_KEY_SIZE,
+    HEADER_ROOT, HEADER_PAGE_COUNT, HEADER_ENTRY_COUNT
+}; // enum BTreeHeaderField
+enum BTreeNodeField: uint32_t {
+    NODE_IS_LEAF = 0, NODE_COUNT, NODE_NEXT
+}; // enum BTreeNodeField
+
+static inline uint32_t load_u32(const uint8_t *ptr) {
+    uint32_t ret;
+    memcpy(&ret, ptr, sizeof(ret));
+    return be32toh(ret);
+}
+static inline void store_u32(uint8_t *ptr, uint32_t value) {
+    value = htobe32(value);
+    memcpy(ptr, &value, sizeof(value));
+}
+static inline uint32_t field(const uint8_t *base, uint32_t index) {
+    return load_u32(base + index * 4);
+}
+static inline void set_field(uint8_t *base, uint32_t index, uint32_t value) {
+    store_u32(base + index * 4, value);
+}
+
+StorageBTree::StorageBTree(std::string_view path, Value::Type key_type, uint32_t key_size)
+    : _mapper(MTB::CreateFileMapper(path)),
+      _key_type(key_type),
+      _key_size(key_size) {
+    _leaf_max  = (btree_node_size - btree_node_header) / _leafItemSize();
+    _inner_max = (btree_node_size - btree_node_header - 4) / _innerItemSize();
+    uint8_t *header = _header();
+    if (field(header, HEADER_MAGIC) == 0) {
+        _initEmpty();
+        return;
+    }
+    if (field(header, HEADER_MAGIC)     != btree_magic     ||
+        field(header, HEADER_NODE_SIZE) != btree_node_size ||
+        field(header, HEADER_KEY_TYPE)  != uint32_t(key_type) ||
+        field(header, HEADER_KEY_SIZE)  != key_size) {
+        throw Exception(MTB::ErrorLevel::CRITICAL,
+            std::format("B+ tree file {} is broken or has another key type",
+                        _mapper->get_filename()));
+    }
+}
+
+uint8_t *StorageBTree::_header() const {
+    return static_cast<uint8_t*>(_mapper->get());
+}
+uint8_t *StorageBTree::_page(uint32_t page_no) const {
+    return _header() + size_t(page_no) * btree_node_size;
+}
+
+/** @fn _allocatePage
+ * @warning 分配页面可能会导致文件重新映射, 之前拿到的所有节点指针都会失效! */
+uint32_t StorageBTree::_allocatePage(bool is_leaf)
+{
+    uint32_t page_no = field(_header(), HEADER_PAGE_COUNT);
+    size_t   least_size = size_t(page_no + 1) * btree_node_size;
+    _mapper->reserve(least_size);
+    set_field(_header(), HEADER_PAGE_COUNT, page_no + 1);
+    uint8_t *node = _page(page_no);
+    memset(node, 0, btree_node_size);
+    set_field(node, NODE_IS_LEAF, is_leaf);
+    return page_no;
+}
+
+void StorageBTree::_initEmpty()
+{
+    uint8_t *header = _header();
+    memset(header, 0, btree_node_size);
+    set_field(header, HEADER_MAGIC,     btree_magic);
+    set_field(header, HEADER_NODE_SIZE, btree_node_size);
+    set_field(header, HEADER_KEY_TYPE,  uint32_t(_key_type));
+    set_field(header, HEADER_KEY_SIZE,  _key_size);
+    set_field(header, HEADER_PAGE_COUNT, 1);
+    uint32_t root = _allocatePage(true);
+    set_field(_header(), HEADER_ROOT, root);
+    set_field(_header(), HEADER_ENTRY_COUNT, 0);
+}
+
+void StorageBTree::clear() {
+    _initEmpty();
+}
+
+uint32_t StorageBTree::get_entry_count() const {
+    return field(_header(), HEADER_ENTRY_COUNT);
+}
+
+int StorageBTree::_compareKey(const uint8_t *lhs, const uint8_t *rhs) const
+{
+    switch (_key_type) {
+    case Value::Type::INT: {
+        int32_t l = int32_t(load_u32(lhs));
+        int32_t r = int32_t(load_u32(rhs));
+        return (l > r) - (l < r);
+    }
+    case Value::Type::STRING: {
+        uint32_t llen = load_u32(lhs);
+        uint32_t rlen = load_u32(rhs);
+        int result = memcmp(lhs + 4, rhs + 4, std::min(llen, rlen));
+        if (result != 0)
+            return result;
+        return (llen > rlen) - (llen < rlen);
+    }
+    default:
+        return memcmp(lhs, rhs, _key_size);
+    }
+}
+int StorageBTree::_compareItem(const uint8_t *lhs_key, uint32_t lhs_id,
+                               const uint8_t *rhs_key, uint32_t rhs_id) const
+{
+    int result = _compareKey(lhs_key, rhs_key);
+    if (result != 0)
+        return result;
+    return (lhs_id > rhs_id) - (lhs_id < rhs_id);
+}
+
+/** 内部节点: 返回第一个大于(key, entry_id)的分隔键下标, 也就是要进入的孩子下标 */
+uint32_t StorageBTree::_innerUpperBound(const uint8_t *node,
+                                        const uint8_t *key, uint32_t entry_id) const
+{
+    uint32_t low = 0, high = field(node, NODE_COUNT);
+    const uint8_t *items = node + btree_node_header + 4;
+    while (low < high) {
+        uint32_t mid = (low + high) / 2;
+        const uint8_t *item = items + mid * _innerItemSize();
+        if (_compareItem(item, load_u32(item + _key_size), key, entry_id) <= 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+/** 叶子节点: 返回第一个不小于(key, entry_id)的项的下标 */
+uint32_t StorageBTree::_leafLowerBound(const uint8_t *node,
+                                       const uint8_t *key, uint32_t entry_id) const
+{
+    uint32_t low = 0, high = field(node, NODE_COUNT);
+    const uint8_t *items = node + btree_node_header;
+    while (low < high) {
+        uint32_t mid = (low + high) / 2;
+        const uint8_t *item = items + mid * _leafItemSize();
+        if (_compareItem(item, load_u32(item + _key_size), key, entry_id) < 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+static inline uint32_t inner_child(const uint8_t *node, uint32_t index,
+                                   uint32_t item_size, uint32_t key_size)
+{
+    if (index == 0)
+        return field(node + btree_node_header, 0);
+    const uint8_t *item = node + btree_node_header + 4 + (index - 1) * item_size;
+    return load_u32(item + key_size + 4);
+}
+
+uint32_t StorageBTree::_findLeaf(const uint8_t *key, uint32_t entry_id,
+                                 std::vector<std::pair<uint32_t, uint32_t>> *path) const
+{
+    uint32_t page_no = field(_header(), HEADER_ROOT);
+    const uint8_t *node = _page(page_no);
+    while (field(node, NODE_IS_LEAF) == 0) {
+        uint32_t index = _innerUpperBound(node, key, entry_id);
+        if (path != nullptr)
+            path->push_back({page_no, index});
+        page_no = inner_child(node, index, _innerItemSize(), _key_size);
+        node    = _page(page_no);
+    }
+    return page_no;
+}
+uint32_t StorageBTree::_leftmostLeaf() const
+{
+    uint32_t page_no = field(_header(), HEADER_ROOT);
+    const uint8_t *node = _page(page_no);
+    while (field(node, NODE_IS_LEAF) == 0) {
+        page_no = inner_child(node, 0, _innerItemSize(), _key_size);
+        node    = _page(page_no);
+    }
+    return page_no;
+}
+
+bool StorageBTree::insert(const uint8_t *key, uint32_t entry_id)
+{
+    std::vector<std::pair<uint32_t, uint32_t>> path;
+    uint32_t leaf_no = _findLeaf(key, entry_id, &path);
+    uint8_t *leaf    = _page(leaf_no);
+    uint32_t count   = field(leaf, NODE_COUNT);
+    uint32_t index   = _leafLowerBound(leaf, key, entry_id);
+    uint32_t isize   = _leafItemSize();
+    uint8_t *items   = leaf + btree_node_header;
+    if (index < count &&
+        _compareItem(items + index * isize, load_u32(items + index * isize + _key_size),
+                     key, entry_id) == 0) {
+        return false;
+    }
+    set_field(_header(), HEADER_ENTRY_COUNT, get_entry_count() + 1);
+
+    /* 叶子没满, 直接插入 */
+    if (count < _leaf_max) {
+        memmove(items + (index + 1) * isize, items + index * isize,
+                (count - index) * isize);
+        memcpy(items + index * isize, key, _key_size);
+        store_u32(items + index * isize + _key_size, entry_id);
+        set_field(leaf, NODE_COUNT, count + 1);
+        return true;
+    }
+
+    /* 叶子满了, 在临时缓冲区里合并后对半分裂 */
+    std::vector<uint8_t> merged((count + 1) * isize);
+    memcpy(merged.data(), items, index * isize);
+    memcpy(merged.data() + index * isize, key, _key_size);
+    store_u32(merged.data() + index * isize + _key_size, entry_id);
+    memcpy(merged.data() + (index + 1) * isize, items + index * isize,
+           (count - index) * isize);
+
+    uint32_t right_no = _allocatePage(true);
+    leaf = _page(leaf_no);
+    uint8_t *right = _page(right_no);
+    uint32_t left_count  = (count + 1) / 2;
+    uint32_t right_count = count + 1 - left_count;
+    memcpy(leaf + btree_node_header, merged.data(), left_count * isize);
+    memcpy(right + btree_node_header, merged.data() + left_count * isize,
+           right_count * isize);
+    set_field(leaf,  NODE_COUNT, left_count);
+    set_field(right, NODE_COUNT, right_count);
+    set_field(right, NODE_NEXT, field(leaf, NODE_NEXT));
+    set_field(leaf,  NODE_NEXT, right_no);
+
+    std::vector<uint8_t> separator(merged.begin() + left_count * isize,
+                                   merged.begin() + (left_count + 1) * isize);
+    _insertIntoParent(path, leaf_no, separator, right_no);
+    return true;
+}
+
+void StorageBTree::_insertIntoParent(std::vector<std::pair<uint32_t, uint32_t>> &path,
+                                     uint32_t left_page,
+                                     std::vector<uint8_t> const &separator,
+                                     uint32_t right_page)
+{
+    uint32_t isize = _innerItemSize();
+    std::vector<uint8_t> sep = separator;
+    while (!path.empty()) {
+        auto [parent_no, index] = path.back();
+        path.pop_back();
+        uint8_t *parent = _page(parent_no);
+        uint32_t count  = field(parent, NODE_COUNT);
+        uint8_t *items  = parent + btree_node_header + 4;
+
+        /* 新的分隔键放在下标index处, 它的右孩子是right_page */
+        std::vector<uint8_t> new_item(isize);
+        memcpy(new_item.data(), sep.data(), _key_size + 4);
+        store_u32(new_item.data() + _key_size + 4, right_page);
+        if (count < _inner_max) {
+            memmove(items + (index + 1) * isize, items + index * isize,
+                    (count - index) * isize);
+            memcpy(items + index * isize, new_item.data(), isize);
+            set_field(parent, NODE_COUNT, count + 1);
+            return;
+        }
+
+        /* 内部节点也满了: 中间的分隔键上移, 左右各留一半 */
+        std::vector<uint8_t> merged((count + 1) * isize);
+        memcpy(merged.data(), items, index * isize);
+        memcpy(merged.data() + index * isize, new_item.data(), isize);
+        memcpy(merged.data() + (index + 1) * isize, items + index * isize,
+               (count - index) * isize);
+        uint32_t mid = (count + 1) / 2;
+        uint32_t right_no = _allocatePage(false);
+        parent = _page(parent_no);
+        uint8_t *right = _page(right_no);
+        const uint8_t *mid_item = merged.data() + mid * isize;
+        /* 右节点的最左孩子, 是上移分隔键原本的右孩子 */
+        set_field(right + btree_node_header, 0, load_u32(mid_item + _key_size + 4));
+        memcpy(right + btree_node_header + 4, mid_item + isize,
+               (count - mid) * isize);
+        set_field(right, NODE_COUNT, count - mid);
+        memcpy(parent + btree_node_header + 4, merged.data(), mid * isize);
+        set_field(parent, NODE_COUNT, mid);
+
+        sep.assign(mid_item, mid_item + _key_size + 4);
+        left_page  = parent_no;
+        right_page = right_no;
+    }
+
+    /* 根节点分裂, 树长高一层 */
+    uint32_t root_no = _allocatePage(false);
+    uint8_t *root = _page(root_no);
+    set_field(root + btree_node_header, 0, left_page);
+    uint8_t *item = root + btree_node_header + 4;
+    memcpy(item, sep.data(), _key_size + 4);
+    store_u32(item + _key_size + 4, right_page);
+    set_field(root, NODE_COUNT, 1);
+    set_field(_header(), HEADER_ROOT, root_no);
+}
+
+bool StorageBTree::remove(const uint8_t *key, uint32_t entry_id)
+{
+    uint32_t leaf_no = _findLeaf(key, entry_id, nullptr);
+    uint8_t *leaf    = _page(leaf_no);
+    uint32_t count   = field(leaf, NODE_COUNT);
+    uint32_t index   = _leafLowerBound(leaf, key, entry_id);
+    uint32_t isize   = _leafItemSize();
+    uint8_t *items   = leaf + btree_node_header;
+    if (index >= count ||
+        _compareItem(items + index * isize, load_u32(items + index * isize + _key_size),
+                     key, entry_id) != 0) {
+        return false;
+    }
+    memmove(items + index * isize, items + (index + 1) * isize,
+            (count - index - 1) * isize);
+    set_field(leaf, NODE_COUNT, count - 1);
+    set_field(_header(), HEADER_ENTRY_COUNT, get_entry_count() - 1);
+    return true;
+}
+
+void StorageBTree::_traverseFrom(uint32_t page_no, uint32_t index,
+                                 std::function<bool(const uint8_t*)> const &stop_fn,
+                                 TraverseFunc const &fn) const
+{
+    uint32_t isize = _leafItemSize();
+    while (page_no != btree_no_page) {
+        const uint8_t *leaf  = _page(page_no);
+        const uint8_t *items = leaf + btree_node_header;
+        uint32_t count = field(leaf, NODE_COUNT);
+        for (; index < count; index++) {
+            const uint8_t *item = items + index * isize;
+            if (stop_fn != nullptr && stop_fn(item))
+                return;
+            if (!fn(load_u32(item + _key_size)))
+                return;
+        }
+        page_no = field(leaf, NODE_NEXT);
+        index   = 0;
+    }
+}
+
+bool StorageBTree::contains(const uint8_t *key, uint32_t *out_entry_id) const
+{
+    bool found = false;
+    traverseByCondition(TotalOrderRelation::EQ, key,
+        [&found, out_entry_id](uint32_t entry_id) {
+            found = true;
+            if (out_entry_id != nullptr)
+                *out_entry_id = entry_id;
+            return false;
+        });
+    return found;
+}
+
+void StorageBTree::traverseAll(TraverseFunc fn) const
+{
+    _traverseFrom(_leftmostLeaf(), 0, nullptr, fn);
+}
+
+bool StorageBTree::traverseByCondition(TotalOrderRelation relation,
+                                       const uint8_t *key, TraverseFunc fn) const
+{
+    switch (relation) {
+    case TotalOrderRelation::LT:
+    case TotalOrderRelation::LE: {
+        bool inclusive = (relation == TotalOrderRelation::LE);
+        _traverseFrom(_leftmostLeaf(), 0,
+            [this, key, inclusive](const uint8_t *item) {
+                int result = _compareKey(item, key);
+                return inclusive ? (result > 0) : (result >= 0);
+            }, fn);
+        return true;
+    }
+    case TotalOrderRelation::EQ:
+    case TotalOrderRelation::GE:
+    case TotalOrderRelation::GT: {
+        /* GT从(key, 最大条目ID)开始找, 这样就跳过了所有与key相等的项 */
+        uint32_t entry_id = (relation == TotalOrderRelation::GT) ? UINT32_MAX : 0;
+        uint32_t leaf_no  = _findLeaf(key, entry_id, nullptr);
+        uint32_t index    = _leafLowerBound(_page(leaf_no), key, entry_id);
+        std::function<bool(const uint8_t*)> stop_fn = nullptr;
+        if (relation == TotalOrderRelation::EQ) {
+            stop_fn = [this, key](const uint8_t *item) {
+                return _compareKey(item, key) != 0;
+            };
+        }
+        _traverseFrom(leaf_no, index, stop_fn, fn);
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+} // namespace mygsql
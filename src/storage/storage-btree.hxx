@@ -0,0 +1,118 @@
+#ifndef __MYG_SQL_STORAGE_BTREE_H__
+#define __MYG_SQL_STORAGE_BTREE_H__
+
+#include "base/mtb-exception.hxx"
+#include "base/mtb-object.hxx"
+#include "base/mtb-system.hxx"
+#include "base/sql-value.hxx"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+namespace mygsql {
+
+/** @class StorageBTree
+ * @brief 持久化在映射文件里的B+树索引。
+ *        键是列在条目文件里的原始字节(大端序整数, 或者"长度+字符"的字符串),
+ *        值是条目ID。树里的每一项都按(键, 条目ID)排序，所以同一个键可以出现多次，
+ *        唯一性由调用者检查。
+ * @warning 删除时不做节点合并，被删空的叶子节点仍然留在叶子链表里。 */
+class StorageBTree: public MTB::Object {
+public:
+    using FileMapperT  = std::unique_ptr<MTB::FileMapper>;
+    /** 遍历函数，参数是条目ID. 返回false时停止遍历. */
+    using TraverseFunc = std::function<bool(uint32_t)>;
+
+    /** @class Exception
+     * @brief B+树文件损坏，或者文件里的键类型与打开时要求的不一致 */
+    class Exception: public MTB::Exception {
+    public:
+        using MTB::Exception::Exception;
+    }; // class StorageBTree::Exception
+public:
+    /** @fn StorageBTree(path, key_type, key_size)
+     * @brief 打开名为`path`的B+树文件，文件不存在时会创建一棵空树。
+     *        `key_type`与`key_size`只在创建时写入文件，打开时用于校验。 */
+    StorageBTree(std::string_view path, Value::Type key_type, uint32_t key_size);
+
+    /** @fn insert(key, entry_id)
+     * @brief 插入(key, entry_id)项。该项已经存在时返回false. */
+    bool insert(const uint8_t *key, uint32_t entry_id);
+
+    /** @fn remove(key, entry_id)
+     * @brief 删除(key, entry_id)项。该项不存在时返回false. */
+    bool remove(const uint8_t *key, uint32_t entry_id);
+
+    /** @fn contains(key)
+     * @brief 查找是否存在键为`key`的项, 存在时把第一个条目ID写入`out_entry_id`. */
+    bool contains(const uint8_t *key, uint32_t *out_entry_id = nullptr) const;
+
+    /** @fn traverseByCondition(relation, key, fn)
+     * @brief 按键的升序遍历所有满足`项的键 relation key`的条目ID.
+     * @return 关系不能用B+树求解(比如`NE`)时返回false, 此时不会调用fn. */
+    bool traverseByCondition(TotalOrderRelation relation,
+                             const uint8_t *key, TraverseFunc fn) const;
+
+    /** @fn traverseAll(fn)
+     * @brief 按键的升序遍历所有条目ID */
+    void traverseAll(TraverseFunc fn) const;
+
+    /** @fn clear()
+     * @brief 清空整棵树, 只保留一个空的根节点 */
+    void clear();
+
+    /** @fn sync()
+     * @brief 把树的映射区写回磁盘 */
+    void sync() { _mapper->sync(); }
+
+    /** @brief setter:树文件的扩容策略 */
+    void set_growth_policy(MTB::FileMapper::GrowthPolicy policy) {
+        _mapper->set_growth_policy(policy);
+    }
+
+    Value::Type get_key_type() const { return _key_type; }
+    uint32_t get_key_size()    const { return _key_size; }
+    uint32_t get_entry_count() const;
+    std::string_view get_filename() const { return _mapper->get_filename(); }
+private:
+    FileMapperT _mapper;     // 树文件的映射器
+    Value::Type _key_type;   // 键类型
+    uint32_t    _key_size;   // 键的字节数
+    uint32_t    _leaf_max;   // 叶子节点最多能存放的项数
+    uint32_t    _inner_max;  // 内部节点最多能存放的分隔键数
+
+    /** 项的大小: 叶子节点是(键, 条目ID), 内部节点是(键, 条目ID, 右孩子页号) */
+    uint32_t _leafItemSize()  const { return _key_size + 4; }
+    uint32_t _innerItemSize() const { return _key_size + 8; }
+
+    uint8_t *_header() const;
+    uint8_t *_page(uint32_t page_no) const;
+    uint32_t _allocatePage(bool is_leaf);
+    void     _initEmpty();
+
+    int  _compareKey(const uint8_t *lhs, const uint8_t *rhs) const;
+    int  _compareItem(const uint8_t *lhs_key, uint32_t lhs_id,
+                      const uint8_t *rhs_key, uint32_t rhs_id) const;
+    uint32_t _innerUpperBound(const uint8_t *node,
+                              const uint8_t *key, uint32_t entry_id) const;
+    uint32_t _leafLowerBound(const uint8_t *node,
+                             const uint8_t *key, uint32_t entry_id) const;
+    uint32_t _findLeaf(const uint8_t *key, uint32_t entry_id,
+                       std::vector<std::pair<uint32_t, uint32_t>> *path) const;
+    uint32_t _leftmostLeaf() const;
+    void     _insertIntoParent(std::vector<std::pair<uint32_t, uint32_t>> &path,
+                               uint32_t left_page,
+                               std::vector<uint8_t> const &separator,
+                               uint32_t right_page);
+    /** 从叶子节点`page`的第`index`项开始往后遍历, fn返回false或者stop_fn返回true时停止 */
+    void _traverseFrom(uint32_t page, uint32_t index,
+                       std::function<bool(const uint8_t*)> const &stop_fn,
+                       TraverseFunc const &fn) const;
+}; // class StorageBTree
+
+} // namespace mygsql
+
+#endif
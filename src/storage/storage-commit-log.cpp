@@ -0,0 +1,46 @@
+#include "storage-commit-log.hxx"
+#include <algorithm>
+#include <cstring>
+#include <endian.h>
+#include <string>
+
+namespace mygsql {
+
+/* 记录格式(大端序): | u64 事务ID | u64 事务ID按位取反 |
+ * 两个字段不一致的记录(比如写了一半)被忽略, 这个事务没有提交. */
+constexpr size_t commit_record_size = 16;
+
+StorageCommitLog::StorageCommitLog(std::string_view path)
+    : _file(MTB::CreateAppendFile(path)), _next_id(1) {
+    std::string content = _file->readAll();
+    uint64_t max_id = 0;
+    for (size_t offset = 0; offset + commit_record_size <= content.size();
+         offset += commit_record_size) {
+        uint64_t id, check;
+        memcpy(&id,    content.data() + offset,     sizeof(id));
+        memcpy(&check, content.data() + offset + 8, sizeof(check));
+        id = be64toh(id);
+        if (be64toh(check) != ~id)
+            break;
+        _committed.insert(id);
+        max_id = std::max(max_id, id);
+    }
+    _next_id = max_id + 1;
+}
+
+void StorageCommitLog::logCommit(uint64_t id)
+{
+    uint64_t record[2] = {htobe64(id), htobe64(~id)};
+    std::lock_guard<std::mutex> guard(_lock);
+    _file->append(record, sizeof(record));
+    _file->sync();
+}
+
+void StorageCommitLog::truncate()
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    _file->truncate();
+    _committed.clear();
+}
+
+} // namespace mygsql
@@ -0,0 +1,58 @@
+#ifndef __MYG_SQL_STORAGE_COMMIT_LOG_H__
+#define __MYG_SQL_STORAGE_COMMIT_LOG_H__
+
+#include "base/mtb-object.hxx"
+#include "base/mtb-system.hxx"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_set>
+
+namespace mygsql {
+
+/** @class StorageCommitLog
+ * @brief 数据库的事务提交日志`${数据库}/commit.log`, 给修改了多张表的事务做两阶段提交。
+ *        每张表的预写日志只能让这张表的修改原子地生效: 提交者先让每张表的日志落盘(准备),
+ *        再把事务ID写进这个文件并落盘, 这一次落盘就是整个事务的提交点。之后追加到各张表
+ *        日志里的`COMMIT`记录不必立即落盘。重放一张表的日志时, 没有`COMMIT`的事务如果
+ *        在这里有记录就算已经提交, 否则按撤销记录回滚。
+ *
+ *        打开数据库时所有的表都重放并清空了日志, 日志里不再引用任何事务ID,
+ *        所以数据库打开以后可以清空这个文件, 下一次打开时事务ID从头分配。 */
+class StorageCommitLog: public MTB::Object {
+public:
+    using AppendFileT = std::unique_ptr<MTB::AppendFile>;
+public:
+    /** @fn StorageCommitLog(path)
+     * @brief 打开名为`path`的提交日志, 文件不存在时会创建它, 并读入已经提交的事务ID */
+    StorageCommitLog(std::string_view path);
+
+    /** @fn allocateID()
+     * @brief 给一个新事务分配ID, 可以在多个会话里同时调用 */
+    uint64_t allocateID() { return _next_id.fetch_add(1); }
+
+    /** @fn logCommit(id)
+     * @brief 记录事务`id`已经提交, 返回时记录已经落盘 */
+    void logCommit(uint64_t id);
+
+    /** @fn contains(id)
+     * @brief 打开时读入的记录里有没有事务`id` */
+    bool contains(uint64_t id) const { return _committed.contains(id); }
+
+    /** @fn truncate()
+     * @brief 清空文件。数据库的所有表都重放完日志以后调用 */
+    void truncate();
+
+    std::string_view get_filename() const { return _file->get_filename(); }
+private:
+    AppendFileT                  _file;      // 日志文件
+    std::mutex                   _lock;      // 保护文件的追加与落盘
+    std::unordered_set<uint64_t> _committed; // 打开时读入的事务ID
+    std::atomic<uint64_t>        _next_id;   // 下一个事务ID
+}; // class StorageCommitLog
+
+} // namespace mygsql
+
+#endif
@@ -1,23 +1,29 @@
 #include "storage-database.hxx"
 #include "storage-table.hxx"
+#include <algorithm>
 #include <filesystem>
-#include <regex>
 #include <string_view>
 #include <unordered_set>
 
 namespace mygsql {
 
 using MTB::unowned;
-const std::regex extension_pattern(R"(\.[^\.]+$)");
 
 StorageDataBase::StorageDataBase(std::string_view twd, std::string_view name)
     : _name(name), _work_dir(twd), _has_error(false) {
     _work_dir /= name;
-    if (std::filesystem::exists(_work_dir)) {
-        _loadTables();
+    bool exists = std::filesystem::exists(_work_dir);
+    if (!exists)
+        std::filesystem::create_directory(_work_dir);
+    _commit_log = std::make_unique<StorageCommitLog>((_work_dir / "commit.log").string());
+    if (!exists)
         return;
-    }
-    std::filesystem::create_directory(_work_dir);
+    _loadTables();
+    /* 所有表都重放并清空了日志, 提交记录不再需要. 有表打不开时它的日志可能还要用 */
+    bool all_loaded = std::none_of(_table_map.begin(), _table_map.end(),
+        [](auto const &item) { return item.second->has_error(); });
+    if (all_loaded)
+        _commit_log->truncate();
 }
 
 void StorageDataBase::_loadTables()
@@ -26,13 +32,15 @@ void StorageDataBase::_loadTables()
         return;
     std::unordered_set<std::string> name_set;
     for (auto &entry: std::filesystem::directory_iterator(_work_dir)) {
-        std::string filename(entry.path().filename().string());
-        std::string name(std::regex_replace(filename, extension_pattern, ""));
+        /* 每张表有一个类型索引文件`${表名}.idx`; 其他文件(比如二级索引)的名称里可能有更多的点 */
+        if (entry.path().extension() != ".idx")
+            continue;
+        std::string name(entry.path().stem().string());
         if (!name_set.contains(name))
             name_set.insert(std::move(name));
     }
     for (std::string const &name: name_set) {
-        StorageTable *table = new StorageTable(_work_dir.string(), name);
+        StorageTable *table = new StorageTable(_work_dir.string(), name, _commit_log.get());
         _table_map.insert({
             table->get_name(), table
         });
@@ -43,8 +51,9 @@ unowned<StorageTable> StorageDataBase::createTable(std::string_view name,
                                                    TypeItemListT type_items)
 {
     if (!_table_map.contains(name)) {
-        _table_map.insert({name,
-            new StorageTable(_work_dir.string(), name, type_items)});
+        /* 键要指向表自己的名称, `name`可能指向调用者的临时缓冲区 */
+        StorageTable *table = new StorageTable(_work_dir.string(), name, type_items);
+        _table_map.insert({table->get_name(), table});
     }
     return _table_map.at(name).get();
 }
@@ -62,6 +71,8 @@ bool StorageDataBase::dropTable(std::string_view name)
 void StorageDataBase::eraseAndMakeUnavailable()
 {
     _table_map.clear();
+    _commit_log.reset();
+    std::filesystem::remove(_work_dir / "commit.log");
     std::filesystem::remove(_work_dir);
     _has_error = true;
 }
@@ -2,7 +2,9 @@
 #define __MYG_SQL_DATABASE_H__
 
 #include "base/mtb-object.hxx"
+#include "storage-commit-log.hxx"
 #include "storage-table.hxx"
+#include <memory>
 #include <string_view>
 
 namespace mygsql {
@@ -48,11 +50,19 @@ public:
         return _table_map;
     }
     bool has_error() const { return _has_error; }
+
+    /** @fn allocateTransactionID()
+     * @brief 给这个数据库里的一个新事务分配ID, 传给事务修改的每张表的`beginTransaction` */
+    uint64_t allocateTransactionID() const { return _commit_log->allocateID(); }
+    /** @fn logCommit(transaction_id)
+     * @brief 两阶段提交的提交点: 所有表都`prepare`以后调用, 返回时事务已经提交 */
+    void logCommit(uint64_t transaction_id) const { _commit_log->logCommit(transaction_id); }
 protected:
     TableMapT       _table_map;
     std::string     _name;
     std::filesystem::path _work_dir;
     bool            _has_error;
+    std::unique_ptr<StorageCommitLog> _commit_log; // 多表事务的提交日志
 
     void _loadTables();
 }; // class DataBase
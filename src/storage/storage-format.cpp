@@ -0,0 +1,109 @@
+#include "storage-format.hxx"
+#include "base/mtb-system.hxx"
+#include "base/util/mtb-crc32.hxx"
+#include <cstring>
+#include <endian.h>
+
+namespace mygsql {
+
+constexpr size_t FIELD_MAGIC       = 0;
+constexpr size_t FIELD_VERSION     = 4;
+constexpr size_t FIELD_BYTE_ORDER  = 6;
+constexpr size_t FIELD_PAGE_SIZE   = 8;
+constexpr size_t FIELD_HEADER_SIZE = 12;
+constexpr size_t FIELD_CHECKSUM    = 16;
+
+uint32_t StorageLoadU32(StorageByteOrder order, const void *ptr)
+{
+    uint32_t value;
+    memcpy(&value, ptr, sizeof(value));
+    return (order == StorageByteOrder::BIG) ? be32toh(value) : le32toh(value);
+}
+
+static inline void store_le32(uint8_t *ptr, uint32_t value) {
+    value = htole32(value);
+    memcpy(ptr, &value, sizeof(value));
+}
+static inline void store_le16(uint8_t *ptr, uint16_t value) {
+    value = htole16(value);
+    memcpy(ptr, &value, sizeof(value));
+}
+static inline uint16_t load_le16(const uint8_t *ptr) {
+    uint16_t value;
+    memcpy(&value, ptr, sizeof(value));
+    return le16toh(value);
+}
+
+StorageFileHeader StorageFileHeader::Create(uint32_t magic)
+{
+    StorageFileHeader ret;
+    ret.magic     = magic;
+    ret.page_size = MTB::FileMapper::GetLogicalBlockSize();
+    return ret;
+}
+
+StorageFileHeader::LoadResult
+StorageFileHeader::Load(const void *buffer, size_t size,
+                        uint32_t magic, StorageFileHeader &out)
+{
+    auto raw = static_cast<const uint8_t*>(buffer);
+    if (size < SIZE || StorageLoadU32(StorageByteOrder::LITTLE, raw) != magic)
+        return LoadResult::LEGACY;
+    /* 校验和按字段为0计算 */
+    uint8_t copy[SIZE];
+    memcpy(copy, raw, SIZE);
+    memset(copy + FIELD_CHECKSUM, 0, sizeof(uint32_t));
+    if (MTB::Crc32(copy, SIZE) != StorageLoadU32(StorageByteOrder::LITTLE, raw + FIELD_CHECKSUM))
+        return LoadResult::CORRUPT;
+    out.magic       = magic;
+    out.version     = load_le16(raw + FIELD_VERSION);
+    out.byte_order  = StorageByteOrder(raw[FIELD_BYTE_ORDER]);
+    out.page_size   = StorageLoadU32(StorageByteOrder::LITTLE, raw + FIELD_PAGE_SIZE);
+    out.header_size = StorageLoadU32(StorageByteOrder::LITTLE, raw + FIELD_HEADER_SIZE);
+    if (out.version > CURRENT_VERSION || out.header_size != SIZE)
+        return LoadResult::TOO_NEW;
+    if (out.byte_order != StorageByteOrder::LITTLE &&
+        out.byte_order != StorageByteOrder::BIG)
+        return LoadResult::CORRUPT;
+    return LoadResult::OK;
+}
+
+void StorageFileHeader::saveToBuffer(void *buffer) const
+{
+    auto raw = static_cast<uint8_t*>(buffer);
+    memset(raw, 0, SIZE);
+    store_le32(raw + FIELD_MAGIC, magic);
+    store_le16(raw + FIELD_VERSION, version);
+    raw[FIELD_BYTE_ORDER] = uint8_t(byte_order);
+    store_le32(raw + FIELD_PAGE_SIZE, page_size);
+    store_le32(raw + FIELD_HEADER_SIZE, header_size);
+    store_le32(raw + FIELD_CHECKSUM, MTB::Crc32(raw, SIZE));
+}
+
+StoragePageLayout StoragePageLayout::Create(uint32_t page_size, uint32_t entry_size)
+{
+    StoragePageLayout ret;
+    ret.page_size  = page_size;
+    ret.entry_size = entry_size;
+    /* 槽位数组按8字节对齐 */
+    auto data_offset_of = [](uint32_t slots) -> uint32_t {
+        uint32_t end = sizeof(StoragePageHeader) + slots * sizeof(uint16_t);
+        return (end + 7) & ~uint32_t(7);
+    };
+    uint32_t slots = (page_size - sizeof(StoragePageHeader)) / (entry_size + sizeof(uint16_t));
+    while (slots > 0 && data_offset_of(slots) + slots * entry_size > page_size)
+        slots--;
+    ret.slots_per_page = slots;
+    ret.data_offset    = data_offset_of(slots);
+    return ret;
+}
+
+void StoragePageLayout::initPage(void *page, uint32_t page_no) const
+{
+    memset(page, 0, data_offset);
+    auto header = static_cast<StoragePageHeader*>(page);
+    header->page_no       = page_no;
+    header->slot_capacity = slots_per_page;
+}
+
+} // namespace mygsql
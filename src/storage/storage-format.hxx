@@ -0,0 +1,134 @@
+#ifndef __MYG_SQL_STORAGE_FORMAT_H__
+#define __MYG_SQL_STORAGE_FORMAT_H__
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+namespace mygsql {
+
+/** @enum StorageByteOrder
+ * @brief 文件里整数字段的字节序 */
+enum class StorageByteOrder: uint8_t {
+    LITTLE = 1,
+    BIG    = 2,
+}; // enum class StorageByteOrder
+
+/** 本机字节序。新文件总是使用本机字节序, 读写条目时不需要转换。 */
+constexpr StorageByteOrder StorageNativeByteOrder =
+    (std::endian::native == std::endian::little) ? StorageByteOrder::LITTLE
+                                                 : StorageByteOrder::BIG;
+
+/** @fn StorageLoadU32(order, ptr)
+ * @brief 按字节序`order`读取一个32位整数 */
+uint32_t StorageLoadU32(StorageByteOrder order, const void *ptr);
+
+/** @struct StorageFileHeader
+ * @brief `.idx`与`.dat`文件开头的文件头, 固定占用`SIZE`字节。
+ *        文件头自己的字段总是小端序, 这样不论文件的字节序是什么都能读出来:
+ *
+ * | 偏移 | 大小 | 字段 |
+ * |:-----|:-----|:-----|
+ * | 0  | 4 | 魔数, 区分文件种类 |
+ * | 4  | 2 | 格式版本 |
+ * | 6  | 1 | 文件内容的字节序(StorageByteOrder) |
+ * | 7  | 1 | 保留 |
+ * | 8  | 4 | 创建文件时的页面大小 |
+ * | 12 | 4 | 文件头大小 |
+ * | 16 | 4 | 文件头的CRC32, 计算时这个字段按0处理 |
+ *
+ *        版本1是没有文件头的旧格式, 所有整数都是大端序; 版本2的条目文件没有分页,
+ *        条目紧接着条目个数存放; 版本3的条目文件按页存放, 见`StoragePageLayout`. */
+struct StorageFileHeader {
+    static constexpr size_t   SIZE        = 64;
+    static constexpr uint32_t INDEX_MAGIC = 0x4947'594D; // "MYGI"
+    static constexpr uint32_t ENTRY_MAGIC = 0x4447'594D; // "MYGD"
+    static constexpr uint16_t LEGACY_VERSION  = 1;
+    static constexpr uint16_t FLAT_VERSION    = 2;
+    static constexpr uint16_t CURRENT_VERSION = 3;
+
+    /** @enum LoadResult
+     * @brief 读取文件头的结果 */
+    enum class LoadResult {
+        OK,       // 文件头有效
+        LEGACY,   // 没有文件头, 是版本1的旧文件
+        CORRUPT,  // 魔数正确但校验和不对
+        TOO_NEW,  // 版本比当前程序支持的新
+    }; // enum class LoadResult
+
+    uint32_t         magic       = 0;
+    uint16_t         version     = CURRENT_VERSION;
+    StorageByteOrder byte_order  = StorageNativeByteOrder;
+    uint32_t         page_size   = 0;
+    uint32_t         header_size = SIZE;
+
+    /** @fn Create(magic)
+     * @brief 生成一个当前版本、本机字节序的文件头 */
+    static StorageFileHeader Create(uint32_t magic);
+
+    /** @fn Load(buffer, size, magic, out)
+     * @brief 从文件开头`size`字节的缓冲区读取魔数为`magic`的文件头 */
+    static LoadResult Load(const void *buffer, size_t size,
+                           uint32_t magic, StorageFileHeader &out);
+
+    /** @fn saveToBuffer(buffer)
+     * @brief 把文件头连同校验和写入缓冲区, 占用`SIZE`字节 */
+    void saveToBuffer(void *buffer) const;
+
+    /** @fn needsMigration()
+     * @brief 文件是否需要升级成当前版本、本机字节序的格式 */
+    bool needsMigration() const {
+        return version != CURRENT_VERSION || byte_order != StorageNativeByteOrder;
+    }
+}; // struct StorageFileHeader
+
+/** @struct StoragePageHeader
+ * @brief 条目文件数据页的页头, 本机字节序。页头后面是`slot_capacity`个u16的槽位目录,
+ *        每一项是槽位里的条目在页内的偏移量, 0表示这个槽位还没有用过。 */
+struct StoragePageHeader {
+    uint32_t page_no;         // 页号, 与页在文件里的位置一致. 为0表示这一页还没有初始化
+    uint16_t slot_capacity;   // 槽位个数
+    uint16_t slot_count;      // 用过的槽位个数, 槽位总是从前往后使用
+    uint32_t allocated_count; // 已分配的条目个数
+    uint32_t checksum;        // 保留给页校验和, 0表示没有计算
+}; // struct StoragePageHeader
+static_assert(sizeof(StoragePageHeader) == 16);
+
+/** @struct StoragePageLayout
+ * @brief 条目文件的分页方式。第0页是元数据页: 文件头后面依次是u32的条目个数与u32的
+ *        数据页个数; 第1页开始是数据页, 页头与槽位目录后面是定长条目组成的槽位数组。
+ *        ID为`id`的条目放在第`1 + id / slots_per_page`页的第`id % slots_per_page`个槽位。
+ *
+ *        目前条目是定长的, 槽位从不移动, 所以目录项总是等于`data_offset + slot * entry_size`,
+ *        一页里的条目可以直接按步长扫描。 */
+struct StoragePageLayout {
+    /** 页内偏移量用u16存放, 所以页面不能超过64KiB */
+    static constexpr uint32_t MAX_PAGE_SIZE = 64 * 1024;
+
+    uint32_t page_size      = 0; // 页面大小, 0表示没有分页的旧格式
+    uint32_t entry_size     = 0; // 条目大小
+    uint32_t slots_per_page = 0; // 每页的槽位个数
+    uint32_t data_offset    = 0; // 第一个槽位在页内的偏移量
+
+    /** @fn Create(page_size, entry_size)
+     * @brief 计算每页能放下多少条目。一个条目也放不下时`slots_per_page`为0. */
+    static StoragePageLayout Create(uint32_t page_size, uint32_t entry_size);
+
+    bool     is_paged() const { return page_size != 0; }
+    uint32_t getPageNo(uint32_t id) const { return 1 + id / slots_per_page; }
+    uint32_t getSlot(uint32_t id)   const { return id % slots_per_page; }
+    uint32_t getFirstEntry(uint32_t page_no) const { return (page_no - 1) * slots_per_page; }
+    size_t   getPageOffset(uint32_t page_no) const { return size_t(page_no) * page_size; }
+    size_t   getEntryOffset(uint32_t id) const {
+        return getPageOffset(getPageNo(id)) + data_offset + size_t(getSlot(id)) * entry_size;
+    }
+    uint16_t getSlotOffset(uint32_t slot) const { return data_offset + slot * entry_size; }
+
+    /** @fn initPage(page, page_no)
+     * @brief 初始化一个空的数据页 */
+    void initPage(void *page, uint32_t page_no) const;
+}; // struct StoragePageLayout
+
+} // namespace mygsql
+
+#endif
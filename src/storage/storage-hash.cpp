@@ -0,0 +1,282 @@
+#include "storage-hash.hxx"
+#include "base/mtb-system.hxx"
+#include "base/sql-value.hxx"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <endian.h>
+#include <format>
+#include <utility>
+#include <vector>
+
+namespace mygsql {
+
+/** 线性哈希索引文件格式(大端序, 4字节对齐):
+ *  - 第0页是文件头: {magic, 页面大小, 键类型, 哈希函数校验值, 层数, 分裂指针, 页数, 项数,
+ *    空闲页链表头, 目录页个数}, 从`hash_dir_offset`开始是目录页的页号数组
+ *  - 目录页是桶号到桶首页页号的映射, 每页`hash_dir_fanout`项
+ *  - 桶页的页头是{项数, 下一个溢出页, 保留, 保留}, 后面紧跟着`项数`个(哈希值, 条目ID)
+ *
+ *  层数为L、分裂指针为S时一共有`2^L + S`个桶: 哈希值的低L位小于S的桶已经分裂过,
+ *  要再多看一位。 */
+constexpr uint32_t hash_magic       = 0x4D42'4858; // "MBHX"
+constexpr uint32_t hash_page_size   = 4096;
+constexpr uint32_t hash_page_header = 16;
+constexpr uint32_t hash_item_size   = 8;
+constexpr uint32_t hash_slots       = (hash_page_size - hash_page_header) / hash_item_size;
+constexpr uint32_t hash_dir_offset  = 64;
+constexpr uint32_t hash_dir_max     = (hash_page_size - hash_dir_offset) / 4;
+constexpr uint32_t hash_dir_fanout  = hash_page_size / 4;
+constexpr uint32_t hash_no_page     = 0;           // 第0页是文件头, 可以当成空页号
+/* 用一个固定的字符串检查建立索引时的哈希函数与现在的是否一致 */
+constexpr std::string_view hash_probe = "MYG-SQL hash probe";
+
+enum HashHeaderField: uint32_t {
+    HEADER_MAGIC = 0, HEADER_PAGE_SIZE, HEADER_KEY_TYPE, HEADER_HASH_CHECK,
+    HEADER_LEVEL, HEADER_SPLIT, HEADER_PAGE_COUNT, HEADER_ENTRY_COUNT,
+    HEADER_FREE_PAGE, HEADER_DIR_COUNT
+}; // enum HashHeaderField
+enum HashPageField: uint32_t {
+    PAGE_COUNT = 0, PAGE_NEXT
+}; // enum HashPageField
+
+static inline uint32_t load_u32(const uint8_t *ptr) {
+    uint32_t ret;
+    memcpy(&ret, ptr, sizeof(ret));
+    return be32toh(ret);
+}
+static inline void store_u32(uint8_t *ptr, uint32_t value) {
+    value = htobe32(value);
+    memcpy(ptr, &value, sizeof(value));
+}
+static inline uint32_t field(const uint8_t *base, uint32_t index) {
+    return load_u32(base + index * 4);
+}
+static inline void set_field(uint8_t *base, uint32_t index, uint32_t value) {
+    store_u32(base + index * 4, value);
+}
+static inline uint8_t *page_item(uint8_t *page, uint32_t index) {
+    return page + hash_page_header + index * hash_item_size;
+}
+static inline const uint8_t *page_item(const uint8_t *page, uint32_t index) {
+    return page + hash_page_header + index * hash_item_size;
+}
+
+static uint32_t hash_function_check()
+{
+    ValueView probe;
+    probe.type = Value::Type::STRING;
+    probe.string_value = hash_probe;
+    return StorageHashIndex::HashKey(probe);
+}
+
+StorageHashIndex::StorageHashIndex(std::string_view path, Value::Type key_type)
+    : _mapper(MTB::CreateFileMapper(path)),
+      _key_type(key_type) {
+    _mapper->reserve(hash_page_size);
+    uint8_t *header = _header();
+    if (field(header, HEADER_MAGIC) == 0) {
+        _initEmpty();
+        return;
+    }
+    if (field(header, HEADER_MAGIC)     != hash_magic     ||
+        field(header, HEADER_PAGE_SIZE) != hash_page_size ||
+        field(header, HEADER_KEY_TYPE)  != uint32_t(key_type)) {
+        throw Exception(MTB::ErrorLevel::CRITICAL,
+            std::format("hash index file {} is broken or has another key type",
+                        _mapper->get_filename()));
+    }
+    if (field(header, HEADER_HASH_CHECK) != hash_function_check())
+        _initEmpty();
+}
+
+uint8_t *StorageHashIndex::_header() const {
+    return static_cast<uint8_t*>(_mapper->get());
+}
+uint8_t *StorageHashIndex::_page(uint32_t page_no) const {
+    return _header() + size_t(page_no) * hash_page_size;
+}
+
+uint32_t StorageHashIndex::_allocatePage()
+{
+    uint32_t page_no = field(_header(), HEADER_FREE_PAGE);
+    if (page_no != hash_no_page) {
+        set_field(_header(), HEADER_FREE_PAGE, field(_page(page_no), PAGE_NEXT));
+    } else {
+        page_no = field(_header(), HEADER_PAGE_COUNT);
+        _mapper->reserve(size_t(page_no + 1) * hash_page_size);
+        set_field(_header(), HEADER_PAGE_COUNT, page_no + 1);
+    }
+    memset(_page(page_no), 0, hash_page_size);
+    return page_no;
+}
+
+void StorageHashIndex::_freePage(uint32_t page_no)
+{
+    uint8_t *page = _page(page_no);
+    set_field(page, PAGE_COUNT, 0);
+    set_field(page, PAGE_NEXT, field(_header(), HEADER_FREE_PAGE));
+    set_field(_header(), HEADER_FREE_PAGE, page_no);
+}
+
+void StorageHashIndex::_initEmpty()
+{
+    _is_new = true;
+    uint8_t *header = _header();
+    memset(header, 0, hash_page_size);
+    set_field(header, HEADER_MAGIC,      hash_magic);
+    set_field(header, HEADER_PAGE_SIZE,  hash_page_size);
+    set_field(header, HEADER_KEY_TYPE,   uint32_t(_key_type));
+    set_field(header, HEADER_HASH_CHECK, hash_function_check());
+    set_field(header, HEADER_PAGE_COUNT, 1);
+    /* 第0层只有一个桶 */
+    _setBucketPage(0, _allocatePage());
+}
+
+void StorageHashIndex::clear() {
+    _initEmpty();
+}
+
+uint32_t StorageHashIndex::get_entry_count() const {
+    return field(_header(), HEADER_ENTRY_COUNT);
+}
+uint32_t StorageHashIndex::get_bucket_count() const {
+    return (1u << field(_header(), HEADER_LEVEL)) + field(_header(), HEADER_SPLIT);
+}
+
+uint32_t StorageHashIndex::_getBucket(uint32_t hash) const
+{
+    uint32_t level  = field(_header(), HEADER_LEVEL);
+    uint32_t bucket = hash & ((1u << level) - 1);
+    if (bucket < field(_header(), HEADER_SPLIT))
+        bucket = hash & ((2u << level) - 1);
+    return bucket;
+}
+
+uint32_t StorageHashIndex::_getBucketPage(uint32_t bucket) const
+{
+    uint32_t dir_no = field(_header() + hash_dir_offset, bucket / hash_dir_fanout);
+    return field(_page(dir_no), bucket % hash_dir_fanout);
+}
+
+void StorageHashIndex::_setBucketPage(uint32_t bucket, uint32_t page_no)
+{
+    uint32_t dir_index = bucket / hash_dir_fanout;
+    if (dir_index >= field(_header(), HEADER_DIR_COUNT)) {
+        uint32_t dir_no = _allocatePage();
+        set_field(_header() + hash_dir_offset, dir_index, dir_no);
+        set_field(_header(), HEADER_DIR_COUNT, dir_index + 1);
+    }
+    uint32_t dir_no = field(_header() + hash_dir_offset, dir_index);
+    set_field(_page(dir_no), bucket % hash_dir_fanout, page_no);
+}
+
+void StorageHashIndex::_appendItem(uint32_t page_no, uint32_t hash, uint32_t entry_id)
+{
+    uint32_t next;
+    while ((next = field(_page(page_no), PAGE_NEXT)) != hash_no_page)
+        page_no = next;
+    uint32_t count = field(_page(page_no), PAGE_COUNT);
+    if (count == hash_slots) {
+        uint32_t overflow_no = _allocatePage();
+        set_field(_page(page_no), PAGE_NEXT, overflow_no);
+        page_no = overflow_no;
+        count   = 0;
+    }
+    uint8_t *page = _page(page_no);
+    store_u32(page_item(page, count), hash);
+    store_u32(page_item(page, count) + 4, entry_id);
+    set_field(page, PAGE_COUNT, count + 1);
+}
+
+bool StorageHashIndex::insert(uint32_t hash, uint32_t entry_id)
+{
+    uint32_t first_page = _getBucketPage(_getBucket(hash));
+    for (uint32_t page_no = first_page; page_no != hash_no_page; ) {
+        const uint8_t *page = _page(page_no);
+        uint32_t count = field(page, PAGE_COUNT);
+        for (uint32_t i = 0; i < count; i++) {
+            if (load_u32(page_item(page, i)) == hash &&
+                load_u32(page_item(page, i) + 4) == entry_id)
+                return false;
+        }
+        page_no = field(page, PAGE_NEXT);
+    }
+    _appendItem(first_page, hash, entry_id);
+    uint32_t entry_count = get_entry_count() + 1;
+    set_field(_header(), HEADER_ENTRY_COUNT, entry_count);
+    /* 每次插入最多分裂一个桶, 扩容的代价均摊到插入上 */
+    uint64_t capacity = uint64_t(get_bucket_count()) * hash_slots * LOAD_FACTOR_PERCENT / 100;
+    if (entry_count > capacity && get_bucket_count() < hash_dir_max * hash_dir_fanout)
+        _split();
+    return true;
+}
+
+void StorageHashIndex::_split()
+{
+    uint32_t level  = field(_header(), HEADER_LEVEL);
+    uint32_t split  = field(_header(), HEADER_SPLIT);
+    uint32_t buddy  = split + (1u << level);
+    uint32_t mask   = (2u << level) - 1;
+    /* 取出旧桶的所有项, 溢出页放回空闲链表, 再按多一位的哈希值分到两个桶里 */
+    uint32_t old_page = _getBucketPage(split);
+    std::vector<std::pair<uint32_t, uint32_t>> items;
+    for (uint32_t page_no = old_page; page_no != hash_no_page; ) {
+        const uint8_t *page = _page(page_no);
+        uint32_t count = field(page, PAGE_COUNT);
+        for (uint32_t i = 0; i < count; i++)
+            items.push_back({load_u32(page_item(page, i)), load_u32(page_item(page, i) + 4)});
+        uint32_t next = field(page, PAGE_NEXT);
+        if (page_no != old_page)
+            _freePage(page_no);
+        page_no = next;
+    }
+    set_field(_page(old_page), PAGE_COUNT, 0);
+    set_field(_page(old_page), PAGE_NEXT, hash_no_page);
+    uint32_t buddy_page = _allocatePage();
+    _setBucketPage(buddy, buddy_page);
+    for (auto [hash, entry_id]: items)
+        _appendItem((hash & mask) == split ? old_page : buddy_page, hash, entry_id);
+
+    if (++split == (1u << level)) {
+        set_field(_header(), HEADER_LEVEL, level + 1);
+        split = 0;
+    }
+    set_field(_header(), HEADER_SPLIT, split);
+}
+
+bool StorageHashIndex::remove(uint32_t hash, uint32_t entry_id)
+{
+    for (uint32_t page_no = _getBucketPage(_getBucket(hash)); page_no != hash_no_page; ) {
+        uint8_t *page = _page(page_no);
+        uint32_t count = field(page, PAGE_COUNT);
+        for (uint32_t i = 0; i < count; i++) {
+            if (load_u32(page_item(page, i)) != hash ||
+                load_u32(page_item(page, i) + 4) != entry_id)
+                continue;
+            /* 用这一页的最后一项填上空位 */
+            memcpy(page_item(page, i), page_item(page, count - 1), hash_item_size);
+            set_field(page, PAGE_COUNT, count - 1);
+            set_field(_header(), HEADER_ENTRY_COUNT, get_entry_count() - 1);
+            return true;
+        }
+        page_no = field(page, PAGE_NEXT);
+    }
+    return false;
+}
+
+void StorageHashIndex::traverseByHash(uint32_t hash, TraverseFunc fn) const
+{
+    for (uint32_t page_no = _getBucketPage(_getBucket(hash)); page_no != hash_no_page; ) {
+        const uint8_t *page = _page(page_no);
+        uint32_t count = field(page, PAGE_COUNT);
+        for (uint32_t i = 0; i < count; i++) {
+            if (load_u32(page_item(page, i)) == hash &&
+                !fn(load_u32(page_item(page, i) + 4)))
+                return;
+        }
+        page_no = field(page, PAGE_NEXT);
+    }
+}
+
+} // namespace mygsql
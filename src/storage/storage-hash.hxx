@@ -0,0 +1,111 @@
+#ifndef __MYG_SQL_STORAGE_HASH_H__
+#define __MYG_SQL_STORAGE_HASH_H__
+
+#include "base/mtb-exception.hxx"
+#include "base/mtb-object.hxx"
+#include "base/mtb-system.hxx"
+#include "base/sql-value.hxx"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string_view>
+
+namespace mygsql {
+
+/** @class StorageHashIndex
+ * @brief 持久化在映射文件里的线性哈希索引, 用来求解等值条件。
+ *        索引只保存(键的哈希值, 条目ID), 不保存键本身, 所以哈希值相同的条目要由调用者
+ *        读出列值再比较一次。同一个哈希值可以出现多次。
+ *
+ *        桶的个数每次只增加一个: 条目个数超过装载因子时分裂`分裂指针`指向的那一个桶,
+ *        扩容的代价分摊到每一次插入上, 不会有一次性的全表重新哈希。
+ * @warning 删除时不回收溢出页, 被删空的溢出页留在桶的链表里, 直到这个桶下一次分裂。 */
+class StorageHashIndex: public MTB::Object {
+public:
+    using FileMapperT  = std::unique_ptr<MTB::FileMapper>;
+    /** 遍历函数，参数是条目ID. 返回false时停止遍历. */
+    using TraverseFunc = std::function<bool(uint32_t)>;
+
+    /** 桶的装载因子(百分比), 平均每个桶的项数超过一页的这个比例时分裂一个桶 */
+    static constexpr uint32_t LOAD_FACTOR_PERCENT = 75;
+
+    /** @class Exception
+     * @brief 哈希索引文件损坏，或者文件里的键类型与打开时要求的不一致 */
+    class Exception: public MTB::Exception {
+    public:
+        using MTB::Exception::Exception;
+    }; // class StorageHashIndex::Exception
+public:
+    /** @fn StorageHashIndex(path, key_type)
+     * @brief 打开名为`path`的哈希索引文件，文件不存在时会创建一个空索引。
+     *        文件是用另一个哈希函数建立的(比如换了标准库)时也会清空它, 这两种情况下
+     *        `is_new()`为true, 调用者要重新填充索引。 */
+    StorageHashIndex(std::string_view path, Value::Type key_type);
+
+    /** @fn HashKey(value)
+     * @brief 索引使用的哈希值: 把`Value::hash()`折叠成32位 */
+    static uint32_t HashKey(ValueView const &value) {
+        size_t hash = value.hash();
+        return uint32_t(hash ^ (uint64_t(hash) >> 32));
+    }
+
+    /** @fn insert(hash, entry_id)
+     * @brief 插入(hash, entry_id)项。该项已经存在时返回false. */
+    bool insert(uint32_t hash, uint32_t entry_id);
+
+    /** @fn remove(hash, entry_id)
+     * @brief 删除(hash, entry_id)项。该项不存在时返回false. */
+    bool remove(uint32_t hash, uint32_t entry_id);
+
+    /** @fn traverseByHash(hash, fn)
+     * @brief 遍历哈希值为`hash`的所有条目ID, 顺序不确定 */
+    void traverseByHash(uint32_t hash, TraverseFunc fn) const;
+
+    /** @fn clear()
+     * @brief 清空索引, 只保留一个空桶 */
+    void clear();
+
+    /** @fn sync()
+     * @brief 把索引的映射区写回磁盘 */
+    void sync() { _mapper->sync(); }
+
+    /** @brief setter:索引文件的扩容策略 */
+    void set_growth_policy(MTB::FileMapper::GrowthPolicy policy) {
+        _mapper->set_growth_policy(policy);
+    }
+
+    /** @brief getter:打开时索引是不是新建的(或者被清空了), 需要调用者填充 */
+    bool is_new() const { return _is_new; }
+    Value::Type get_key_type() const { return _key_type; }
+    uint32_t get_entry_count()  const;
+    uint32_t get_bucket_count() const;
+    std::string_view get_filename() const { return _mapper->get_filename(); }
+private:
+    FileMapperT _mapper;    // 索引文件的映射器
+    Value::Type _key_type;  // 键类型
+    bool        _is_new = false;
+
+    uint8_t *_header() const;
+    uint8_t *_page(uint32_t page_no) const;
+    /** 分配一个空的桶页, 优先复用空闲链表里的页
+     *  @warning 分配页面可能会导致文件重新映射, 之前拿到的所有页指针都会失效! */
+    uint32_t _allocatePage();
+    void     _freePage(uint32_t page_no);
+    void     _initEmpty();
+
+    /** 哈希值`hash`所在的桶 */
+    uint32_t _getBucket(uint32_t hash) const;
+    /** 第`bucket`个桶的首页页号 */
+    uint32_t _getBucketPage(uint32_t bucket) const;
+    /** 登记新桶`bucket`的首页, 必要时分配目录页 */
+    void     _setBucketPage(uint32_t bucket, uint32_t page_no);
+    /** 把一项追加到以`page_no`开头的桶链表末尾, 最后一页满了时分配溢出页 */
+    void     _appendItem(uint32_t page_no, uint32_t hash, uint32_t entry_id);
+    /** 分裂分裂指针指向的桶, 然后移动分裂指针 */
+    void     _split();
+}; // class StorageHashIndex
+
+} // namespace mygsql
+
+#endif
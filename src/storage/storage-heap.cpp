@@ -0,0 +1,159 @@
+#include "storage-heap.hxx"
+#include <bit>
+#include <cstring>
+#include <endian.h>
+#include <format>
+#include <string>
+
+namespace mygsql {
+
+/* 堆文件头(大端序), 占据文件开头的heap_header_size字节:
+ * | u32 魔数 | u32 版本 | u64 已划分的末尾偏移 | u64 空闲链表头 x CLASS_COUNT |
+ * 空闲块的前8字节存放链表里下一个空闲块的偏移, 0表示链表结束. */
+constexpr uint32_t heap_magic         = 0x4D42'4850; // "MBHP"
+constexpr uint32_t heap_version       = 1;
+constexpr size_t   heap_header_size   = 512;
+constexpr size_t   heap_min_block     = 16;
+constexpr size_t   HEADER_MAGIC       = 0;
+constexpr size_t   HEADER_VERSION     = 4;
+constexpr size_t   HEADER_END         = 8;
+constexpr size_t   HEADER_FREE_HEADS  = 16;
+
+static_assert(HEADER_FREE_HEADS + 8 * StorageHeap::CLASS_COUNT <= heap_header_size);
+
+StorageHeap::StorageHeap(std::string_view path, StorageWAL *wal)
+    : _mapper(MTB::CreateFileMapper(path)), _wal(wal) {
+    uint8_t *header = _at(0);
+    uint32_t magic;
+    memcpy(&magic, header + HEADER_MAGIC, sizeof(magic));
+    if (be32toh(magic) == heap_magic)
+        return;
+    if (get_end() != 0 || magic != 0) {
+        throw Exception(MTB::ErrorLevel::CRITICAL,
+            std::format("heap file {} is broken", path));
+    }
+    /* 新文件: 文件头不写日志, 重放时如果文件头丢失会在这里重新初始化 */
+    uint32_t be_magic = htobe32(heap_magic), be_version = htobe32(heap_version);
+    memcpy(header + HEADER_MAGIC,   &be_magic,   sizeof(be_magic));
+    memcpy(header + HEADER_VERSION, &be_version, sizeof(be_version));
+    uint64_t be_end = htobe64(heap_header_size);
+    memcpy(header + HEADER_END, &be_end, sizeof(be_end));
+}
+
+uint32_t StorageHeap::GetSizeClass(size_t size)
+{
+    if (size <= heap_min_block)
+        return 0;
+    return std::bit_width(size - 1) - std::countr_zero(heap_min_block);
+}
+
+uint8_t *StorageHeap::_at(Offset offset) const {
+    return static_cast<uint8_t*>(_mapper->get()) + offset;
+}
+StorageHeap::Offset StorageHeap::_loadOffset(Offset position) const {
+    uint64_t value;
+    memcpy(&value, _at(position), sizeof(value));
+    return be64toh(value);
+}
+void StorageHeap::_storeOffset(Offset position, Offset value) {
+    uint64_t be_value = htobe64(value);
+    _write(position, &be_value, sizeof(be_value));
+}
+StorageHeap::Offset StorageHeap::get_end() const {
+    return _loadOffset(HEADER_END);
+}
+
+void StorageHeap::_write(Offset position, const void *data, size_t size)
+{
+    if (_in_transaction)
+        _logUndo(position, size);
+    memcpy(_at(position), data, size);
+    if (_wal == nullptr)
+        return;
+    /* 负载: | u64 偏移 | 数据 | */
+    std::string payload(sizeof(uint64_t) + size, '\0');
+    uint64_t be_position = htobe64(position);
+    memcpy(payload.data(), &be_position, sizeof(be_position));
+    memcpy(payload.data() + sizeof(be_position), data, size);
+    _wal->append(StorageWAL::RecordType::HEAP_WRITE, 0, 0,
+                 reinterpret_cast<const uint8_t*>(payload.data()), payload.size());
+}
+
+void StorageHeap::beginTransaction()
+{
+    _in_transaction  = _wal != nullptr;
+    _header_logged   = false;
+    _transaction_end = get_end();
+}
+
+void StorageHeap::_logUndo(Offset position, size_t size)
+{
+    if (position >= _transaction_end)
+        return;
+    if (position < heap_header_size) {
+        if (_header_logged)
+            return;
+        _header_logged = true;
+        position = 0;
+        size     = heap_header_size;
+    }
+    std::string payload(sizeof(uint64_t) + size, '\0');
+    uint64_t be_position = htobe64(position);
+    memcpy(payload.data(), &be_position, sizeof(be_position));
+    memcpy(payload.data() + sizeof(be_position), _at(position), size);
+    _wal->appendUndo(StorageWAL::RecordType::HEAP_UNDO, 0,
+                     reinterpret_cast<const uint8_t*>(payload.data()), payload.size());
+}
+
+StorageHeap::Offset StorageHeap::allocate(size_t size)
+{
+    uint32_t size_class = GetSizeClass(size);
+    if (size_class >= CLASS_COUNT) {
+        throw Exception(MTB::ErrorLevel::CRITICAL,
+            std::format("heap block of {} bytes is too large", size));
+    }
+    Offset head_position = HEADER_FREE_HEADS + 8 * size_class;
+    Offset block = _loadOffset(head_position);
+    if (block != 0) {
+        _storeOffset(head_position, _loadOffset(block));
+        return block;
+    }
+    /* 没有空闲块, 从堆的末尾划分一块 */
+    block = get_end();
+    Offset block_end = block + (heap_min_block << size_class);
+    _mapper->reserve(block_end);
+    _storeOffset(HEADER_END, block_end);
+    return block;
+}
+
+void StorageHeap::free(Offset offset, size_t size)
+{
+    uint32_t size_class = GetSizeClass(size);
+    Offset head_position = HEADER_FREE_HEADS + 8 * size_class;
+    _storeOffset(offset, _loadOffset(head_position));
+    _storeOffset(head_position, offset);
+}
+
+void StorageHeap::write(Offset offset, const void *data, size_t size)
+{
+    _write(offset, data, size);
+}
+
+std::string_view StorageHeap::read(Offset offset, size_t size) const
+{
+    return {reinterpret_cast<const char*>(_at(offset)), size};
+}
+
+void StorageHeap::redo(std::string_view payload)
+{
+    if (payload.size() < sizeof(uint64_t))
+        return;
+    uint64_t position;
+    memcpy(&position, payload.data(), sizeof(position));
+    position = be64toh(position);
+    payload.remove_prefix(sizeof(position));
+    _mapper->reserve(position + payload.size());
+    memcpy(_at(position), payload.data(), payload.size());
+}
+
+} // namespace mygsql
@@ -0,0 +1,102 @@
+#ifndef __MYG_SQL_STORAGE_HEAP_H__
+#define __MYG_SQL_STORAGE_HEAP_H__
+
+#include "base/mtb-exception.hxx"
+#include "base/mtb-object.hxx"
+#include "base/mtb-system.hxx"
+#include "storage-wal.hxx"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+
+namespace mygsql {
+
+/** @class StorageHeap
+ * @brief 存储表的溢出堆`${table}.heap`, 存放放不进条目槽位的长字符串。
+ *        堆按2的幂划分大小等级(16字节起), 每个等级有一个空闲块链表,
+ *        释放的块会被同一等级的下一次分配复用。块本身没有头部, 调用者用字符串
+ *        长度就能算出块属于哪个等级。
+ *
+ *        堆的每一次修改(数据、空闲链表、文件头)都以物理日志记录写入预写日志,
+ *        重放时按字节写回, 所以堆与条目文件在崩溃后总是一致的。 */
+class StorageHeap: public MTB::Object {
+public:
+    using FileMapperT = std::unique_ptr<MTB::FileMapper>;
+    using Offset      = uint64_t;
+
+    /** 大小等级个数: 第k级的块大小是`16 << k`字节 */
+    static constexpr uint32_t CLASS_COUNT = 28;
+
+    /** @class Exception
+     * @brief 堆文件损坏或者申请的块太大 */
+    class Exception: public MTB::Exception {
+    public:
+        using MTB::Exception::Exception;
+    }; // class StorageHeap::Exception
+public:
+    /** @fn StorageHeap(path, wal)
+     * @brief 打开名为`path`的堆文件, 文件不存在时创建一个空堆。
+     *        修改会记录到`wal`里, `wal`为空时不记录。 */
+    StorageHeap(std::string_view path, StorageWAL *wal);
+
+    /** @fn allocate(size)
+     * @brief 分配一个至少能放下`size`字节的块, 返回块在堆文件里的偏移量 */
+    Offset allocate(size_t size);
+
+    /** @fn free(offset, size)
+     * @brief 归还`allocate(size)`分配的块 */
+    void free(Offset offset, size_t size);
+
+    /** @fn write(offset, data, size)
+     * @brief 把数据写进块里 */
+    void write(Offset offset, const void *data, size_t size);
+
+    /** @fn read(offset, size)
+     * @brief 读取块里的数据。
+     * @warning 返回的视图只在堆文件下一次扩容之前有效。 */
+    std::string_view read(Offset offset, size_t size) const;
+
+    /** @fn redo(payload)
+     * @brief 重放一条`HEAP_WRITE`日志记录, 不会再写日志 */
+    void redo(std::string_view payload);
+
+    /** @fn beginTransaction()
+     * @brief 开始事务: 之后的修改先把前像作为`HEAP_UNDO`记录写进日志并落盘, 直到
+     *        `endTransaction`. 文件头只在第一次修改时记录一次整个文件头; 事务开始时的
+     *        末尾之后的块是事务里新划分的, 撤销文件头以后它们自然被丢弃, 不需要前像 */
+    void beginTransaction();
+    /** @fn endTransaction()
+     * @brief 结束事务, 之后的修改不再记录前像 */
+    void endTransaction() { _in_transaction = false; }
+
+    /** @fn sync()
+     * @brief 把堆文件写回磁盘 */
+    void sync() { _mapper->sync(); }
+
+    /** @brief getter:堆文件里已经划分出去的字节数(包括空闲块) */
+    Offset get_end() const;
+    std::string_view get_filename() const { return _mapper->get_filename(); }
+
+    /** @fn GetSizeClass(size)
+     * @brief 计算能放下`size`字节的最小大小等级 */
+    static uint32_t GetSizeClass(size_t size);
+private:
+    FileMapperT _mapper;  // 堆文件映射器
+    StorageWAL *_wal;     // 预写日志, 由所属的存储表持有
+    bool   _in_transaction = false; // 是否在事务里, 见`beginTransaction`
+    bool   _header_logged  = false; // 事务里是否已经记录过文件头的前像
+    Offset _transaction_end = 0;    // 事务开始时已经划分的末尾偏移
+
+    uint8_t *_at(Offset offset) const;
+    Offset   _loadOffset(Offset position) const;
+    /** 写入并记录日志。所有对堆文件的修改都要经过这里。 */
+    void     _write(Offset position, const void *data, size_t size);
+    /** 事务里修改`[position, position + size)`以前调用: 需要时把前像写进日志 */
+    void     _logUndo(Offset position, size_t size);
+    void     _storeOffset(Offset position, Offset value);
+}; // class StorageHeap
+
+} // namespace mygsql
+
+#endif
@@ -0,0 +1,208 @@
+#include "storage-scan.hxx"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MYG_SQL_SCAN_X86 1
+#endif
+
+namespace mygsql {
+
+/* 扫描内核: 每个实现处理整个range, 结果按位或进out. */
+using ScanKernelFunc = void(*)(ScanRange const &, TotalOrderRelation,
+                               int32_t, MTB::Bitmap &, size_t);
+
+static inline uint32_t load_u32(const uint8_t *ptr)
+{
+    uint32_t ret;
+    memcpy(&ret, ptr, sizeof(ret));
+    return ret;
+}
+
+static inline bool relation_has(TotalOrderRelation relation, TotalOrderRelation bit) {
+    return ((int8_t)relation & (int8_t)bit) != 0;
+}
+
+/** 标量实现, 也负责处理SIMD实现剩下的尾部条目 */
+static void scan_int32_scalar(ScanRange const &range, TotalOrderRelation relation,
+                              int32_t value, MTB::Bitmap &out, size_t out_offset)
+{
+    bool want_lt = relation_has(relation, TotalOrderRelation::LT);
+    bool want_eq = relation_has(relation, TotalOrderRelation::EQ);
+    bool want_gt = relation_has(relation, TotalOrderRelation::GT);
+    const uint8_t *entry = range.base;
+    for (size_t i = 0; i < range.count; i++, entry += range.stride) {
+        if (load_u32(entry) == 0)
+            continue;
+        int32_t column = int32_t(load_u32(entry + range.column_offset));
+        if ((want_lt && column < value) ||
+            (want_eq && column == value) ||
+            (want_gt && column > value)) {
+            out.set(out_offset + i);
+        }
+    }
+}
+
+#ifdef MYG_SQL_SCAN_X86
+/** SSE4.1实现: 一次比较4个条目。条目是定长交错存放的, 所以列值用标量读入后再拼成向量。 */
+__attribute__((target("sse4.1")))
+static void scan_int32_sse41(ScanRange const &range, TotalOrderRelation relation,
+                             int32_t value, MTB::Bitmap &out, size_t out_offset)
+{
+    const __m128i lt_mask = _mm_set1_epi32(relation_has(relation, TotalOrderRelation::LT) ? -1 : 0);
+    const __m128i eq_mask = _mm_set1_epi32(relation_has(relation, TotalOrderRelation::EQ) ? -1 : 0);
+    const __m128i gt_mask = _mm_set1_epi32(relation_has(relation, TotalOrderRelation::GT) ? -1 : 0);
+    const __m128i target  = _mm_set1_epi32(value);
+    const __m128i zero    = _mm_setzero_si128();
+    const size_t  stride  = range.stride;
+
+    size_t i = 0;
+    for (; i + 4 <= range.count; i += 4) {
+        const uint8_t *entry  = range.base + i * stride;
+        const uint8_t *column = entry + range.column_offset;
+        __m128i flags = _mm_setr_epi32(load_u32(entry),              load_u32(entry + stride),
+                                       load_u32(entry + 2 * stride), load_u32(entry + 3 * stride));
+        __m128i v = _mm_setr_epi32(load_u32(column),              load_u32(column + stride),
+                                   load_u32(column + 2 * stride), load_u32(column + 3 * stride));
+        __m128i m = _mm_or_si128(
+            _mm_or_si128(_mm_and_si128(_mm_cmplt_epi32(v, target), lt_mask),
+                         _mm_and_si128(_mm_cmpeq_epi32(v, target), eq_mask)),
+            _mm_and_si128(_mm_cmpgt_epi32(v, target), gt_mask));
+        m = _mm_andnot_si128(_mm_cmpeq_epi32(flags, zero), m);
+        unsigned bits = _mm_movemask_ps(_mm_castsi128_ps(m));
+        if (bits != 0)
+            out.orBits(out_offset + i, bits, 4);
+    }
+    ScanRange tail = range;
+    tail.base  += i * stride;
+    tail.count -= i;
+    scan_int32_scalar(tail, relation, value, out, out_offset + i);
+}
+
+/** AVX2实现: 一次比较8个条目, 用gather按步长读取列值与分配标记。
+ *  每64个条目合成一个字再写入位图。 */
+__attribute__((target("avx2")))
+static void scan_int32_avx2(ScanRange const &range, TotalOrderRelation relation,
+                            int32_t value, MTB::Bitmap &out, size_t out_offset)
+{
+    const __m256i lt_mask = _mm256_set1_epi32(relation_has(relation, TotalOrderRelation::LT) ? -1 : 0);
+    const __m256i eq_mask = _mm256_set1_epi32(relation_has(relation, TotalOrderRelation::EQ) ? -1 : 0);
+    const __m256i gt_mask = _mm256_set1_epi32(relation_has(relation, TotalOrderRelation::GT) ? -1 : 0);
+    const __m256i target  = _mm256_set1_epi32(value);
+    const __m256i zero    = _mm256_setzero_si256();
+    const size_t  stride  = range.stride;
+    const int32_t s = int32_t(stride);
+    const __m256i offsets = _mm256_setr_epi32(0, s, 2 * s, 3 * s, 4 * s, 5 * s, 6 * s, 7 * s);
+
+    size_t i = 0;
+    for (; i + 64 <= range.count; i += 64) {
+        uint64_t word = 0;
+        for (size_t k = 0; k < 64; k += 8) {
+            const uint8_t *entry = range.base + (i + k) * stride;
+            __m256i flags = _mm256_i32gather_epi32(
+                reinterpret_cast<const int*>(entry), offsets, 1);
+            __m256i v = _mm256_i32gather_epi32(
+                reinterpret_cast<const int*>(entry + range.column_offset), offsets, 1);
+            __m256i gt = _mm256_cmpgt_epi32(v, target);
+            __m256i lt = _mm256_cmpgt_epi32(target, v);
+            __m256i eq = _mm256_cmpeq_epi32(v, target);
+            __m256i m  = _mm256_or_si256(
+                _mm256_or_si256(_mm256_and_si256(lt, lt_mask),
+                                _mm256_and_si256(eq, eq_mask)),
+                _mm256_and_si256(gt, gt_mask));
+            m = _mm256_andnot_si256(_mm256_cmpeq_epi32(flags, zero), m);
+            word |= uint64_t(_mm256_movemask_ps(_mm256_castsi256_ps(m))) << k;
+        }
+        if (word != 0)
+            out.orBits(out_offset + i, word, 64);
+    }
+    ScanRange tail = range;
+    tail.base  += i * stride;
+    tail.count -= i;
+    scan_int32_sse41(tail, relation, value, out, out_offset + i);
+}
+#endif
+
+struct ScanKernel {
+    ScanKernelFunc int32_kernel;
+    const char    *name;
+}; // struct ScanKernel
+
+static ScanKernel const &scan_kernel_select()
+{
+    static const ScanKernel kernel = []() -> ScanKernel {
+#ifdef MYG_SQL_SCAN_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return {scan_int32_avx2, "avx2"};
+        if (__builtin_cpu_supports("sse4.1"))
+            return {scan_int32_sse41, "sse4.1"};
+#endif
+        return {scan_int32_scalar, "scalar"};
+    }();
+    return kernel;
+}
+
+void ScanInt32Column(ScanRange const &range, TotalOrderRelation relation,
+                     int32_t value, MTB::Bitmap &out, size_t out_offset)
+{
+    if (range.count == 0 || relation == TotalOrderRelation::NONE)
+        return;
+    scan_kernel_select().int32_kernel(range, relation, value, out, out_offset);
+}
+
+static std::mutex                        scan_pool_mutex;
+static std::shared_ptr<MTB::ThreadPool> scan_pool;
+static size_t                           scan_thread_count = 0;
+
+static size_t scan_thread_count_resolve(size_t count)
+{
+    if (count == 0)
+        count = std::thread::hardware_concurrency();
+    return std::max<size_t>(count, 1);
+}
+
+void ScanSetThreadCount(size_t count)
+{
+    std::lock_guard lock(scan_pool_mutex);
+    scan_thread_count = count;
+    /* 正在扫描的线程还持有旧线程池, 它会在扫描结束后销毁 */
+    scan_pool.reset();
+}
+
+size_t ScanGetThreadCount()
+{
+    std::lock_guard lock(scan_pool_mutex);
+    return scan_thread_count_resolve(scan_thread_count);
+}
+
+void ScanParallelFor(size_t morsel_count, MTB::ThreadPool::TaskFunc const &fn)
+{
+    std::shared_ptr<MTB::ThreadPool> pool;
+    {
+        std::lock_guard lock(scan_pool_mutex);
+        size_t nthreads = scan_thread_count_resolve(scan_thread_count);
+        if (nthreads > 1 && morsel_count > 1) {
+            if (scan_pool == nullptr)
+                scan_pool = std::make_shared<MTB::ThreadPool>(nthreads);
+            pool = scan_pool;
+        }
+    }
+    if (pool == nullptr) {
+        for (size_t i = 0; i < morsel_count; i++)
+            fn(i, 0);
+        return;
+    }
+    pool->parallelFor(morsel_count, fn);
+}
+
+const char *ScanKernelGetName()
+{
+    return scan_kernel_select().name;
+}
+
+} // namespace mygsql
@@ -0,0 +1,54 @@
+#ifndef __MYG_SQL_STORAGE_SCAN_H__
+#define __MYG_SQL_STORAGE_SCAN_H__
+
+#include "base/sql-value.hxx"
+#include "base/util/mtb-bitmap.hxx"
+#include "base/util/mtb-thread-pool.hxx"
+#include <cstddef>
+#include <cstdint>
+
+namespace mygsql {
+
+/** @struct ScanRange
+ * @brief 扫描内核的输入: 一段定长条目组成的内存区。
+ *        每个条目以4字节的`is_allocated`字段开头, 整数列以本机字节序存放在
+ *        条目内偏移为`column_offset`的位置。 */
+struct ScanRange {
+    const uint8_t *base;          // 第一个条目的首地址
+    size_t         stride;        // 条目长度
+    size_t         count;         // 条目个数
+    size_t         column_offset; // 被比较的列在条目内的偏移量
+}; // struct ScanRange
+
+/** @fn ScanInt32Column(range, relation, value, out, out_offset)
+ * @brief 对`range`里的每个条目求`列值 relation value`, 并且要求条目已经分配。
+ *        第i个条目满足条件时，把`out`的第`out_offset + i`位置为1, 不满足时不修改。
+ *        CPU支持时使用AVX2或SSE4.1, 否则使用标量实现。
+ * @warning `out`至少要有`out_offset + range.count`位。 */
+void ScanInt32Column(ScanRange const &range, TotalOrderRelation relation,
+                     int32_t value, MTB::Bitmap &out, size_t out_offset = 0);
+
+/** 并行扫描时每个任务(morsel)处理的条目个数。是64的倍数, 所以不同的任务不会写位图的同一个字 */
+constexpr size_t SCAN_MORSEL_SIZE = 16 * 1024;
+
+/** @fn ScanSetThreadCount(count)
+ * @brief 设置并行扫描使用的线程数(包括调用者). 0表示使用所有CPU核, 1表示不并行。
+ *        默认为0. */
+void ScanSetThreadCount(size_t count);
+
+/** @fn ScanGetThreadCount()
+ * @brief 并行扫描实际使用的线程数 */
+size_t ScanGetThreadCount();
+
+/** @fn ScanParallelFor(morsel_count, fn)
+ * @brief 在扫描线程池上执行`morsel_count`个任务, 见`MTB::ThreadPool::parallelFor`.
+ *        线程数为1时在调用者的线程上顺序执行。 */
+void ScanParallelFor(size_t morsel_count, MTB::ThreadPool::TaskFunc const &fn);
+
+/** @fn ScanKernelGetName()
+ * @brief 当前CPU上实际使用的扫描内核的名称("avx2", "sse4.1"或"scalar"). */
+const char *ScanKernelGetName();
+
+} // namespace mygsql
+
+#endif
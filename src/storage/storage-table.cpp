@@ -1,11 +1,15 @@
 #include "storage-table.hxx"
+#include "storage-format.hxx"
+#include "storage-scan.hxx"
 #include "base/mtb-object.hxx"
 #include "base/mtb-stl-accel.hxx"
 #include "base/mtb-system.hxx"
 #include "base/sql-value.hxx"
 #include "base/util/mtb-id-allocator.hxx"
+#include <algorithm>
 #include <cstdio>
 #include <filesystem>
+#include <format>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
@@ -42,11 +46,40 @@ constexpr size_t DataTypeGetSize(const Value::Type self)
 constexpr uint32_t i32size   = DataTypeGetSize(Value::Type::INT);
 constexpr uint32_t unit_size = i32size * 3;
 
+/* 定长字符串列(旧格式)的最大长度 */
+constexpr uint32_t fixed_string_max  = DataTypeGetSize(Value::Type::STRING) - i32size;
+/* 变长字符串列的槽位:
+ *   长度 <= 12: | u32 长度 | 12字节内联数据 |
+ *   长度 >  12: | u32 长度 | 4字节前缀 | u64 溢出堆偏移 | */
+constexpr uint32_t varlen_slot_size  = 16;
+constexpr uint32_t varlen_inline_max = 12;
+constexpr uint32_t varlen_heap_field = 8;
+/* 索引文件里类型字的第16位: 字符串列使用变长编码 */
+constexpr uint32_t type_flag_varlen  = 0x0001'0000;
+
+/** 列在条目里占用的字节数 */
+static inline uint32_t ColumnGetSize(StorageTypeItem const &item)
+{
+    if (item.type == Value::Type::STRING && item.is_varlen)
+        return varlen_slot_size;
+    return DataTypeGetSize(item.type);
+}
+
+/** 条目在条目文件里的偏移量. 没有分页的旧格式里, 条目紧接着条目个数存放 */
+static inline size_t EntryGetOffset(StoragePageLayout const &layout,
+                                    uint32_t header_size, size_t id)
+{
+    if (layout.is_paged())
+        return layout.getEntryOffset(id);
+    return header_size + i32size + id * layout.entry_size;
+}
+
 struct IndexFile {
     struct IndexUnit {
         uint32_t    name_index;  // 名称字符串首地址所属的索引
         uint32_t    name_length; // 名称长度所属的索引
         Value::Type data_type;   // 数据类型
+        bool        is_varlen;   // 字符串是否使用变长编码
 
         /** 计算结果 */
         std::string_view name;   // 名称字符串
@@ -63,13 +96,14 @@ public:
     std::vector<IndexUnit> index_units;
 
     static IndexFile CreateFromTypeList(StorageTable::TypeItemListT const &item_list);
-    static IndexFile LoadFromBuffer(pointer start)
+    /** 从文件头后面的`start`开始读取, 整数字段的字节序是`order` */
+    static IndexFile LoadFromBuffer(pointer start, StorageByteOrder order)
     {
         IndexFile self;
         uint32_t *u32start = reinterpret_cast<uint32_t*>(start);
-        
-        self.index_size    = be32toh(u32start[0]);
-        self.primary_index = be32toh(u32start[1]);
+
+        self.index_size    = StorageLoadU32(order, u32start + 0);
+        self.primary_index = StorageLoadU32(order, u32start + 1);
         mtb_ptr_advance(start, i32size * 2);
         self.index_units_raw = start;
 
@@ -81,9 +115,11 @@ public:
         for (int i = 0; i < self.index_size; i++) {
             IndexUnit unit;
             u32start = reinterpret_cast<uint32_t*>(start);
-            unit.name_index  = be32toh(u32start[0]);
-            unit.name_length = be32toh(u32start[1]);
-            unit.data_type   = Value::Type(be32toh(u32start[2]));
+            unit.name_index  = StorageLoadU32(order, u32start + 0);
+            unit.name_length = StorageLoadU32(order, u32start + 1);
+            uint32_t type_word = StorageLoadU32(order, u32start + 2);
+            unit.data_type   = Value::Type(type_word & 0xFFFF);
+            unit.is_varlen   = (type_word & type_flag_varlen) != 0;
             unit.name = {(char*)(string_area + unit.name_index), unit.name_length};
             self.index_units.push_back(unit);
 
@@ -91,8 +127,11 @@ public:
         }
         return self;
     }
+    /** 写入文件头与本机字节序的索引区 */
     void saveToBuffer(pointer start)
     {
+        StorageFileHeader::Create(StorageFileHeader::INDEX_MAGIC).saveToBuffer(start);
+        mtb_ptr_advance(start, StorageFileHeader::SIZE);
         int cur_index = 0;
         for (auto &i: index_units) {
             i.name_index  = cur_index;
@@ -101,21 +140,22 @@ public:
         }
 
         uint32_t *u32start = reinterpret_cast<uint32_t*>(start);
-        u32start[0] = htobe32(index_size);
-        u32start[1] = htobe32(primary_index);
+        u32start[0] = index_size;
+        u32start[1] = primary_index;
 
         uint32_t *u32unit     = u32start + 2;
         uint8_t  *string_area = reinterpret_cast<uint8_t*>(u32unit) + unit_size * index_size;
         for (auto &i: index_units) {
-            u32unit[0] = htobe32(i.name_index);
-            u32unit[1] = htobe32(i.name_length);
-            u32unit[2] = htobe32(uint32_t(i.data_type));
+            u32unit[0] = i.name_index;
+            u32unit[1] = i.name_length;
+            u32unit[2] = uint32_t(i.data_type) | (i.is_varlen ? type_flag_varlen : 0);
             u32unit += 3;
             memcpy(string_area + i.name_index, i.name.data(), i.name_length);
         }
     }
     uint32_t get_storage_size() const {
-        uint32_t size = i32size + i32size + index_units.size() * unit_size;
+        uint32_t size = StorageFileHeader::SIZE + i32size + i32size
+                      + index_units.size() * unit_size;
         for (auto &i: index_units)
             size += i.name.size();
         return size;
@@ -130,7 +170,7 @@ IndexFile IndexFile::CreateFromTypeList(StorageTable::TypeItemListT const &item_
     };
     for (int cnt = 0;
          auto &i: item_list) {
-        ret.index_units.push_back({0, 0, i.type, i.name});
+        ret.index_units.push_back({0, 0, i.type, i.is_varlen, i.name});
         if (i.is_primary == true && ret.primary_index == 0xFFFF'FFFF)
             ret.primary_index = cnt;
         cnt++;
@@ -141,7 +181,7 @@ IndexFile IndexFile::CreateFromTypeList(StorageTable::TypeItemListT const &item_
 /* class StorageTable::Entry */
 StorageTable::Entry::Entry(StorageTable const &table, int index)
     : _table(table), _header_index(index) {
-    _header_offset = _header_index * table._entry_size;
+    _header_offset = table._getEntryOffset(index);
 }
 StorageTable::Entry::Entry(Entry const &another)
     : _table(another._table),
@@ -157,81 +197,106 @@ MTB::pointer StorageTable::Entry::get() const {
     mtb_ptr_advance(ret, i32size);
     return ret;
 }
-owned<Value> StorageTable::Entry::get(std::string_view name) const
+ValueView StorageTable::Entry::view(size_t index) const
+{
+    StorageTypeItem const &type_item = _table._type_item_list[index];
+    auto target = static_cast<const uint8_t*>(_table._getEntryMemory(_header_index))
+                + type_item.offset;
+    return _table._decodeColumn(type_item, target);
+}
+owned<Value> StorageTable::Entry::getFromIndex(size_t index,
+                                              std::pmr::memory_resource *arena) const
 {
-    TypeItemMapT const& type_item_map = _table._type_item_map;
-    if (!type_item_map.contains(name))
+    if (index >= _table._type_item_list.size())
         return nullptr;
-
-    auto &type_item = type_item_map.at(name);
-    Value *ret    = nullptr;
-    void  *target = _table._getEntryMemory(_header_index);
-    mtb_ptr_advance(target, type_item->offset);
-
-    switch (type_item->type) {
-    case Value::Type::INT: {
-        int32_t &i32raw = *reinterpret_cast<int32_t*>(target);
-        ret = new IntValue(be32toh(i32raw));
-    }   break;
-    case Value::Type::STRING: {
-        int32_t *pi32length_raw = reinterpret_cast<int32_t*>(target);
-        int32_t i32length = int32_t(be32toh(*pi32length_raw));
-        mtb_ptr_advance(target, i32size);
-        std::string_view content {
-            reinterpret_cast<char*>(target),
-            size_t(i32length)
-        };
-        ret = new StringValue(content);
-    }   break;
-    default:
+    return view(index).materialize(arena);
+}
+owned<Value> StorageTable::Entry::get(std::string_view name) const
+{
+    int32_t index = _table.getTypeIndex(name);
+    if (index < 0)
         return nullptr;
-    } // switch (type_item->type)
-    return owned<Value>(ret);
+    return getFromIndex(index);
 }
 bool StorageTable::Entry::set(std::string_view name, int32_t value)
 {
-    TypeItemMapT const& type_item_map = _table._type_item_map;
-    if (!type_item_map.contains(name))
+    auto iter = _table._type_item_map.find(name);
+    if (iter == _table._type_item_map.end())
         return false;
-    StorageTypeItem *type_item = type_item_map.at(name);
-    if (type_item->type != Value::Type::INT)
-        return false;
-
-    void *target = MTB::pointer((size_t)get() + type_item->offset - i32size);
-    *reinterpret_cast<int32_t*>(target) = htobe32(value);
-    return true;
+    return _setInt(*iter->second, value);
 }
 bool StorageTable::Entry::set(std::string_view name, std::string_view value)
 {
-    if (value.length() > 256)
+    auto iter = _table._type_item_map.find(name);
+    if (iter == _table._type_item_map.end())
         return false;
-    TypeItemMapT const& type_item_map = _table._type_item_map;
-    if (!type_item_map.contains(name))
+    return _setString(*iter->second, value);
+}
+bool StorageTable::Entry::_setInt(StorageTypeItem const &type_item, int32_t value,
+                                  bool is_new)
+{
+    if (type_item.type != Value::Type::INT)
         return false;
-    StorageTypeItem *type_item = type_item_map.at(name);
-    if (type_item->type != Value::Type::STRING)
+    uint32_t raw = value;
+    return _table._storeColumn(_header_index, type_item,
+                               reinterpret_cast<uint8_t*>(&raw), i32size, is_new);
+}
+bool StorageTable::Entry::_setString(StorageTypeItem const &type_item, std::string_view value,
+                                     bool is_new)
+{
+    if (type_item.type != Value::Type::STRING)
         return false;
 
-    void *target = MTB::pointer((size_t)get() + type_item->offset - i32size);
-    // 长度字段
-    *reinterpret_cast<int32_t*>(target) = htobe32(value.length());
-    // 字符串数据字段
-    mtb_ptr_advance(target, i32size);
-    memcpy(target, value.data(), value.length());
+    ValueView view;
+    view.type = Value::Type::STRING;
+    view.string_value = value;
+    uint8_t slot[DataTypeGetSize(Value::Type::STRING)];
+    StorageHeap::Offset block = 0;
+    size_t raw_size = _table._encodeColumn(type_item, view, slot, block);
+    if (raw_size == 0)
+        return false;
+    if (!type_item.is_varlen)
+        return _table._storeColumn(_header_index, type_item, slot, raw_size, is_new);
+    /* 记下旧值, 写入成功以后归还它占用的堆块 */
+    uint8_t old_slot[varlen_slot_size];
+    memcpy(old_slot, static_cast<const uint8_t*>(_table._getEntryMemory(_header_index))
+                     + type_item.offset, varlen_slot_size);
+    if (!_table._storeColumn(_header_index, type_item, slot, varlen_slot_size, is_new)) {
+        if (block != 0)
+            _table._heap->free(block, value.length());
+        return false;
+    }
+    _table._releaseColumn(type_item, old_slot);
     return true;
 }
 bool StorageTable::Entry::set(std::string_view name, Value const &value)
+{
+    auto iter = _table._type_item_map.find(name);
+    if (iter == _table._type_item_map.end())
+        return false;
+    return _setValue(*iter->second, value);
+}
+bool StorageTable::Entry::setFromIndex(size_t index, Value const &value)
+{
+    if (index >= _table._type_item_list.size())
+        return false;
+    return _setValue(_table._type_item_list[index], value);
+}
+bool StorageTable::Entry::_setValue(StorageTypeItem const &type_item, Value const &value,
+                                   bool is_new)
 {
     if (value.get_value_type() == Value::Type::INT)
-        return set(name, ((IntValue&)value).value());
+        return _setInt(type_item, static_cast<IntValue const&>(value).value(), is_new);
     else
-        return set(name, reinterpret_cast<const StringValue*>(&value)->getString());
+        return _setString(type_item, static_cast<StringValue const&>(value).value(), is_new);
 }
 /* end class StorageTable::Entry */
 
 /** class StorageTable */
-StorageTable::StorageTable(std::string_view storage_directory, std::string_view name)
-    : _name(name), _work_dir(storage_directory) {
+StorageTable::StorageTable(std::string_view storage_directory, std::string_view name,
+                           StorageCommitLog const *commit_log)
+    : _name(name), _work_dir(storage_directory),
+      _entry_allocated_num(0), _entry_list_num(0) {
     std::string idx_name(name), dat_name(name);
     idx_name.append(".idx");
     dat_name.append(".dat");
@@ -250,10 +315,30 @@ StorageTable::StorageTable(std::string_view storage_directory, std::string_view
     }
     idx_name = idx_path.string();
     dat_name = dat_path.string();
-    _loadIndexFile(idx_name);
+    bool index_needs_migration = _loadIndexFile(idx_name);
     _loadEntryFile(dat_name);
+    if (_has_error)
+        return;
     _dumpTypeItemNameBuffer();
     _initKeyIndexMap();
+    if (index_needs_migration)
+        _migrateIndexFile(idx_name);
+    std::string bpt_name = (_work_dir / (_name + ".bpt")).string();
+    /* 日志记录的是条目文件原来字节序的原始字节, 所以要先重放再迁移 */
+    bool replayed = _replayWAL((_work_dir / (_name + ".wal")).string(), commit_log) > 0;
+    if (replayed) /* 重放的修改没有进入B+树, 删掉索引文件让它从条目重建 */
+        std::filesystem::remove(bpt_name);
+    if (!_page_layout.is_paged() || _entry_byte_order != StorageNativeByteOrder) {
+        checkpoint(); /* 迁移以前清空日志, 旧字节序的记录不能重放到新文件上 */
+        _migrateEntryFile(dat_name);
+    }
+    else if (replayed) /* 页头不写日志, 重放以后按条目重新统计 */
+        _rebuildPageHeaders();
+    if (has_primary_key())
+        _loadPrimaryTree(bpt_name);
+    _loadSecondaryIndexes(replayed);
+    if (replayed)
+        checkpoint();
 }
 StorageTable::StorageTable(std::string_view storage_directory, std::string_view name,
                            TypeItemListT const& type_items)
@@ -282,72 +367,141 @@ StorageTable::StorageTable(std::string_view storage_directory, std::string_view
     }
     idx_name = idx_path.string();
     dat_name = dat_path.string();
-    int offset = 0;
+    int offset = i32size; // 4 byte -- is_allocated
     for (int cnt = 0;
          auto &item: _type_item_list) {
-        item.offset = offset + i32size;
-        _type_item_map.insert({item.name, &item});
+        item.offset    = offset;
+        item.is_varlen = (item.type == Value::Type::STRING);
         if (_primary_index_order == 0xFFFF'FFFF && item.is_primary == true)
             _primary_index_order = cnt;
-        offset += DataTypeGetSize(item.type);
+        offset += ColumnGetSize(item);
+        cnt++;
     }
     _entry_size = offset;
     _dumpTypeItemNameBuffer();
     _initKeyIndexMap();
     _createIndexFile(idx_path);
     _createEntryFile(dat_path);
+    if (_has_error) /* 一页放不下一个条目 */
+        return;
+    if (has_primary_key())
+        _loadPrimaryTree((_work_dir / (_name + ".bpt")).string());
+    /* 同名的旧表可能留下了日志、溢出堆与索引目录, 新表不能使用它们 */
+    _wal = std::make_unique<StorageWAL>((_work_dir / (_name + ".wal")).string());
+    _wal->truncate();
+    std::filesystem::remove(_work_dir / (_name + ".heap"));
+    std::filesystem::remove(_work_dir / (_name + ".sdx"));
+    _openHeap();
+}
+StorageTable::~StorageTable()
+{
+    if (_wal != nullptr && _entry_mapper != nullptr)
+        checkpoint();
 }
 
 /** private class StorageTable */
-void StorageTable::_loadIndexFile(std::string const &path)
+bool StorageTable::_loadIndexFile(std::string const &path)
 {
     /* 把索引文件映射到内存处理 */
     _index_mapper = std::unique_ptr<MTB::FileMapper>(MTB::CreateFileMapper(path));
+    /* 检查文件头. 没有文件头的是大端序的旧格式 */
+    pointer start = _index_mapper->get();
+    StorageFileHeader header;
+    StorageByteOrder  order = StorageByteOrder::BIG;
+    bool needs_migration = true;
+    switch (StorageFileHeader::Load(start, _index_mapper->get_file_size(),
+                                    StorageFileHeader::INDEX_MAGIC, header)) {
+    case StorageFileHeader::LoadResult::OK:
+        order = header.byte_order;
+        needs_migration = header.needsMigration();
+        mtb_ptr_advance(start, StorageFileHeader::SIZE);
+        break;
+    case StorageFileHeader::LoadResult::LEGACY:
+        break;
+    default:
+        _has_error = true;
+        return false;
+    }
     /* 读取映射以后的内存 */
-    IndexFile index_file = IndexFile::LoadFromBuffer(_index_mapper->get());
+    IndexFile index_file = IndexFile::LoadFromBuffer(start, order);
     /* 遍历类型列表，构建`type_item_list`类型 - 偏移量列表 */
     uint32_t current_offset = DataTypeGetSize(Value::Type::INT); // 4 byte -- is_allocated
     for (auto &i: index_file.index_units) {
         if (_type_item_map.contains(i.name)) {
-            _has_error = true; return;
+            _has_error = true; return false;
         } // 检查是否有键名重复问题
         _type_item_list.push_back({
             i.name, i.data_type,
             false,
-            current_offset 
+            current_offset,
+            i.is_varlen
         });
         auto &back = _type_item_list.back();
         _type_item_map.insert({back.name, &back});
-        current_offset += DataTypeGetSize(i.data_type);
+        current_offset += ColumnGetSize(back);
     }
     if (index_file.primary_index != 0xFFFF'FFFF)
         _type_item_list[index_file.primary_index].is_primary = true;
     _primary_index_order = index_file.primary_index;
     /* 条目大小信息, 读取条目文件用 */
     _entry_size = current_offset;
+    return needs_migration;
 }
 
 void StorageTable::_loadEntryFile(std::string const &path)
 {
-    constexpr size_t file_header_size = i32size;
     _entry_mapper = std::unique_ptr<MTB::FileMapper>{
                         MTB::CreateFileMapper(path)
                     };
-    pointer start = _entry_mapper->get();
-    _entry_list_num = be32toh(*(uint32_t*)start); // 文件头: entry个数,4字节
+    StorageFileHeader header;
+    _page_layout.entry_size = _entry_size;
+    switch (StorageFileHeader::Load(_entry_mapper->get(), _entry_mapper->get_file_size(),
+                                    StorageFileHeader::ENTRY_MAGIC, header)) {
+    case StorageFileHeader::LoadResult::OK:
+        _entry_header_size = header.header_size;
+        _entry_byte_order  = header.byte_order;
+        if (header.version != StorageFileHeader::FLAT_VERSION)
+            _page_layout = StoragePageLayout::Create(header.page_size, _entry_size);
+        break;
+    case StorageFileHeader::LoadResult::LEGACY:
+        _entry_header_size = 0;
+        _entry_byte_order  = StorageByteOrder::BIG;
+        break;
+    default:
+        _has_error = true;
+        return;
+    }
+    // 文件头后面是entry个数,4字节. 分页的文件后面还有数据页个数,4字节
+    _entry_list_num = StorageLoadU32(_entry_byte_order, _getEntryCountMemory());
     /* 检查条目是否溢出 */
-    size_t file_least_size = _entry_list_num * _entry_size + file_header_size;
+    size_t file_least_size = _getEntryOffset(_entry_list_num);
+    if (_page_layout.is_paged()) {
+        if (_page_layout.slots_per_page == 0) {
+            _has_error = true;
+            return;
+        }
+        _page_count = StorageLoadU32(_entry_byte_order, _getPageCountMemory());
+        file_least_size = _page_layout.getPageOffset(_page_count + 1);
+        if (_entry_list_num > size_t(_page_count) * _page_layout.slots_per_page) {
+            _has_error = true;
+            return;
+        }
+    }
     if (file_least_size > _entry_mapper->get_file_size()) {
         _has_error = true;
         return;
     }
-    /* 加载条目 */
+    /* 条目分配器等到第一次用到时再加载, 这样打开表的开销与条目个数无关 */
+}
+void StorageTable::_loadEntryAllocator() const
+{
+    std::lock_guard lock(_entry_allocator_mutex);
+    if (_entry_allocator != nullptr)
+        return;
     bool8vec vec;
+    _entry_allocated_num = 0;
     for (int i = 0; i < _entry_list_num; i++) {
         pointer entry_begin_addr     = _getEntryMemory(i);
-        // for (int j = 0; j < 8; j++) {
-        //     printf("%02hhx ", ((char*)entry_begin_addr)[j]);
-        // }printf("\n");
         uint32_t &entry_is_allocated = *reinterpret_cast<uint32_t*>(entry_begin_addr);
         /* 往后压入分配情况 */
         vec.push_back(MTB::bool8_t(entry_is_allocated));
@@ -361,34 +515,615 @@ void StorageTable::_createIndexFile(std::string const &path)
     IndexFile index_file = IndexFile::CreateFromTypeList(_type_item_list);
     _index_mapper = std::unique_ptr<MTB::FileMapper>(MTB::CreateFileMapper(path));
     size_t mapper_size = index_file.get_storage_size();
-    while (_index_mapper->get_file_size() <= mapper_size)
-        _index_mapper->resizeAppend();
+    _index_mapper->reserve(mapper_size + 1);
     index_file.saveToBuffer(_index_mapper->get());
+    _index_mapper->sync();
 }
 void StorageTable::_createEntryFile(std::string const &path)
 {
     _entry_mapper = std::unique_ptr<MTB::FileMapper> {
                         MTB::CreateFileMapper(path)
                     };
-    uint32_t &index_size = *reinterpret_cast<uint32_t*>(_entry_mapper->get());
-    index_size = 0;
+    /* 页面大小取逻辑块大小, 放不下一个条目时用最大的页面 */
+    uint32_t page_size = std::min(MTB::FileMapper::GetLogicalBlockSize(),
+                                  StoragePageLayout::MAX_PAGE_SIZE);
+    _page_layout = StoragePageLayout::Create(page_size, _entry_size);
+    if (_page_layout.slots_per_page == 0)
+        _page_layout = StoragePageLayout::Create(StoragePageLayout::MAX_PAGE_SIZE, _entry_size);
+    if (_page_layout.slots_per_page == 0) {
+        _has_error = true;
+        return;
+    }
+    _entry_header_size = StorageFileHeader::SIZE;
+    _entry_byte_order  = StorageNativeByteOrder;
+    _page_count        = 0;
+    _entry_mapper->reserve(_page_layout.getPageOffset(1));
+    StorageFileHeader header = StorageFileHeader::Create(StorageFileHeader::ENTRY_MAGIC);
+    header.page_size = _page_layout.page_size;
+    header.saveToBuffer(_entry_mapper->get());
+    _storeEntryWord(_getEntryCountMemory(), 0);
+    _storeEntryWord(_getPageCountMemory(), 0);
+}
+
+void StorageTable::_migrateIndexFile(std::string const &path)
+{
+    /* 先写到临时文件再改名覆盖, 迁移中途崩溃时旧文件仍然完整 */
+    std::string migrate_path = path + ".migrate";
+    std::filesystem::remove(migrate_path);
+    _index_mapper.reset();
+    _createIndexFile(migrate_path);
+    _index_mapper.reset();
+    std::filesystem::rename(migrate_path, path);
+    _index_mapper = std::unique_ptr<MTB::FileMapper>(MTB::CreateFileMapper(path));
 }
 
-pointer StorageTable::_getEntryStartMemory() const noexcept {
+void StorageTable::_migrateEntryFile(std::string const &path)
+{
+    std::string migrate_path = path + ".migrate";
+    std::filesystem::remove(migrate_path);
+    /* 记下旧文件的布局, 然后在新文件上按分配条目的路径逐个写入 */
+    FileMapperT       source        = std::move(_entry_mapper);
+    StoragePageLayout source_layout = _page_layout;
+    uint32_t          source_header = _entry_header_size;
+    bool              swap          = _entry_byte_order != StorageNativeByteOrder;
+    _createEntryFile(migrate_path);
+    if (_has_error)
+        return;
+
+    /* 字节序不同时翻转所有整数字段 */
+    auto swap32 = [](uint8_t *ptr) {
+        uint32_t value;
+        memcpy(&value, ptr, sizeof(value));
+        value = __builtin_bswap32(value);
+        memcpy(ptr, &value, sizeof(value));
+        return value;
+    };
+    for (uint32_t id = 0; id < _entry_list_num; id++) {
+        _reserveEntry(id);
+        auto entry = static_cast<uint8_t*>(_getEntryMemory(id));
+        memcpy(entry, static_cast<const uint8_t*>(source->get())
+                      + EntryGetOffset(source_layout, source_header, id), _entry_size);
+        bool allocated = *reinterpret_cast<uint32_t*>(entry) != 0;
+        *reinterpret_cast<uint32_t*>(entry) = 0;
+        if (swap) {
+            for (StorageTypeItem const &item: _type_item_list) {
+                uint8_t *column = entry + item.offset;
+                uint32_t value  = swap32(column); // INT的值或者STRING的长度
+                if (item.is_varlen && value > varlen_inline_max) {
+                    uint64_t block;
+                    memcpy(&block, column + varlen_heap_field, sizeof(block));
+                    block = __builtin_bswap64(block);
+                    memcpy(column + varlen_heap_field, &block, sizeof(block));
+                }
+            }
+        }
+        _setEntryAllocated(id, allocated);
+    }
+    _storeEntryWord(_getEntryCountMemory(), _entry_list_num);
+    _entry_mapper->sync();
+    _entry_mapper.reset();
+    _dirty_pages.clear();
+    source.reset();
+    std::filesystem::rename(migrate_path, path);
+    _entry_mapper = FileMapperT{MTB::CreateFileMapper(path)};
+}
+
+void StorageTable::_loadPrimaryTree(std::string const &path)
+{
+    bool tree_exists = std::filesystem::exists(path);
+    StorageTypeItem const &primary = *getPrimaryIndex();
+    _primary_tree = std::make_unique<StorageBTree>(
+                        path, primary.type, DataTypeGetSize(primary.type));
+    if (tree_exists)
+        return;
+    /* 旧版本的表没有索引文件, 从条目文件重建一次 */
+    uint8_t key[DataTypeGetSize(Value::Type::STRING)];
+    traverseReadEntries([this, &key](Entry const &entry) {
+        _makeIndexKey(entry.view(_primary_index_order), key);
+        _primary_tree->insert(key, entry.get_header_index());
+    });
+}
+
+/* 索引目录`${name}.sdx`(大端序):
+ * | u32 魔数 | u32 索引个数 | 每个索引: | u32 列下标 | u32 名称长度 | 名称 | |
+ * 列下标字的高16位是索引的种类(IndexKind) */
+constexpr uint32_t index_catalog_magic = 0x4D42'5358; // "MBSX"
+
+std::filesystem::path StorageTable::_getSecondaryIndexPath(SecondaryIndex const &index) const
+{
+    std::string_view extension = (index.kind == IndexKind::HASH) ? "hash" : "bpt";
+    return _work_dir / std::format("{}.{}.{}", _name, index.name, extension);
+}
+
+void StorageTable::_loadSecondaryIndexes(bool rebuild)
+{
+    std::filesystem::path catalog_path = _work_dir / (_name + ".sdx");
+    if (!std::filesystem::exists(catalog_path))
+        return;
+    FileMapperT catalog{MTB::CreateFileMapper(catalog_path.string())};
+    auto load_u32 = [&catalog](size_t offset) {
+        uint32_t value;
+        memcpy(&value, static_cast<uint8_t*>(catalog->get()) + offset, sizeof(value));
+        return be32toh(value);
+    };
+    size_t file_size = catalog->get_file_size();
+    if (file_size < 2 * i32size || load_u32(0) != index_catalog_magic) {
+        throw StorageBTree::Exception(MTB::ErrorLevel::CRITICAL,
+            std::format("index catalog {} is broken", catalog_path.string()));
+    }
+    uint32_t count = load_u32(i32size);
+    size_t   offset = 2 * i32size;
+    for (uint32_t i = 0; i < count; i++) {
+        if (offset + 2 * i32size > file_size)
+            break;
+        uint32_t column_word = load_u32(offset);
+        uint32_t length      = load_u32(offset + i32size);
+        uint32_t column      = column_word & 0xFFFF;
+        offset += 2 * i32size;
+        if (offset + length > file_size || column >= _type_item_list.size())
+            break;
+        std::string name(static_cast<char*>(catalog->get()) + offset, length);
+        offset += length;
+        _secondary_indexes.push_back({std::move(name), column,
+                                      IndexKind(column_word >> 16), nullptr, nullptr});
+    }
+    for (SecondaryIndex &index: _secondary_indexes) {
+        /* 重放的修改没有进入索引, 和主键索引一样从条目重建 */
+        if (rebuild)
+            std::filesystem::remove(_getSecondaryIndexPath(index));
+        _openSecondaryIndex(index);
+    }
+}
+
+void StorageTable::_openSecondaryIndex(SecondaryIndex &index)
+{
+    std::string path = _getSecondaryIndexPath(index).string();
+    bool index_exists = std::filesystem::exists(path);
+    StorageTypeItem const &item = _type_item_list[index.column];
+    if (index.kind == IndexKind::HASH) {
+        index.hash = std::make_unique<StorageHashIndex>(path, item.type);
+        if (!index.hash->is_new())
+            return;
+        StorageHashIndex &hash = *index.hash;
+        traverseReadEntries([&hash, column = index.column](Entry const &entry) {
+            hash.insert(StorageHashIndex::HashKey(entry.view(column)), entry.get_header_index());
+        });
+        return;
+    }
+    index.tree = std::make_unique<StorageBTree>(path, item.type, DataTypeGetSize(item.type));
+    if (index_exists)
+        return;
+    uint8_t key[DataTypeGetSize(Value::Type::STRING)];
+    StorageBTree &tree = *index.tree;
+    traverseReadEntries([this, &key, &tree, column = index.column](Entry const &entry) {
+        _makeIndexKey(entry.view(column), key);
+        tree.insert(key, entry.get_header_index());
+    });
+}
+
+void StorageTable::_saveIndexCatalog() const
+{
+    std::string buffer;
+    auto append_u32 = [&buffer](uint32_t value) {
+        value = htobe32(value);
+        buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    };
+    append_u32(index_catalog_magic);
+    append_u32(_secondary_indexes.size());
+    for (SecondaryIndex const &index: _secondary_indexes) {
+        append_u32(index.column | (uint32_t(index.kind) << 16));
+        append_u32(index.name.length());
+        buffer.append(index.name);
+    }
+    FileMapperT catalog{MTB::CreateFileMapper((_work_dir / (_name + ".sdx")).string())};
+    catalog->reserve(buffer.size());
+    memcpy(catalog->get(), buffer.data(), buffer.size());
+    catalog->sync();
+}
+
+void StorageTable::_openHeap()
+{
+    bool has_varlen = std::any_of(_type_item_list.begin(), _type_item_list.end(),
+        [](StorageTypeItem const &item) { return item.is_varlen; });
+    if (!has_varlen)
+        return;
+    _heap = std::make_unique<StorageHeap>(
+                (_work_dir / (_name + ".heap")).string(), _wal.get());
+}
+
+size_t StorageTable::_replayWAL(std::string const &path, StorageCommitLog const *commit_log)
+{
+    _wal = std::make_unique<StorageWAL>(path);
+    _openHeap();
+    /* 先重做所有记录。最后一条`BEGIN`之后没有`COMMIT`的事务是崩溃时没有结束的事务,
+     * 如果它也不在提交日志里, 就按相反的次序写回它的前像 */
+    struct UndoRecord {
+        StorageWAL::RecordType type;
+        uint32_t               id;
+        std::string            image;
+    };
+    std::vector<UndoRecord> pending_undo;
+    bool     in_transaction = false;
+    uint64_t transaction_id = 0;
+    uint32_t entry_base     = 0;
+    size_t ret = _wal->replay([&](StorageWAL::Record const &record) {
+        switch (record.type) {
+        case StorageWAL::RecordType::BEGIN:
+            if (record.payload.size() != sizeof(transaction_id))
+                break;
+            pending_undo.clear();
+            in_transaction = true;
+            memcpy(&transaction_id, record.payload.data(), sizeof(transaction_id));
+            transaction_id = be64toh(transaction_id);
+            entry_base     = record.entry_id;
+            break;
+        case StorageWAL::RecordType::COMMIT:
+            pending_undo.clear();
+            in_transaction = false;
+            break;
+        case StorageWAL::RecordType::UNDO:
+        case StorageWAL::RecordType::HEAP_UNDO:
+            pending_undo.push_back({record.type, record.entry_id, std::string(record.payload)});
+            break;
+        default:
+            _redo(record);
+        }
+    });
+    bool committed = commit_log != nullptr && commit_log->contains(transaction_id);
+    if (in_transaction && !committed) {
+        for (auto iter = pending_undo.rbegin(); iter != pending_undo.rend(); ++iter) {
+            if (iter->type == StorageWAL::RecordType::UNDO)
+                _undo(iter->id, iter->image);
+            else if (_heap != nullptr)
+                _heap->redo(iter->image);
+        }
+        /* 事务里新分配的条目没有前像, 直接丢弃 */
+        for (uint32_t id = entry_base; id < _entry_list_num; id++)
+            _setEntryAllocated(id, false);
+        _rollbackEntryCount(entry_base);
+    }
+    if (_bulk_rollback != NO_BULK_LOAD) {
+        /* 导入的条目没有写日志, 可能只写回了一半. 它们占用的溢出堆块没法安全地归还, 只能泄漏 */
+        _rollbackEntryCount(_bulk_rollback);
+        _bulk_rollback = NO_BULK_LOAD;
+    }
+    return ret;
+}
+
+void StorageTable::_rollbackEntryCount(uint32_t count)
+{
+    if (count >= _entry_list_num)
+        return;
+    _entry_list_num = count;
+    _storeEntryWord(_getEntryCountMemory(), _entry_list_num);
+}
+
+void StorageTable::_redo(StorageWAL::Record const &record)
+{
+    uint32_t id = record.entry_id;
+    switch (record.type) {
+    case StorageWAL::RecordType::ALLOCATE: {
+        _reserveEntry(id);
+        memset(static_cast<uint8_t*>(_getEntryMemory(id)) + i32size, 0, _entry_size - i32size);
+        _setEntryAllocated(id, true);
+        if (id >= _entry_list_num) {
+            _entry_list_num = id + 1;
+            _storeEntryWord(_getEntryCountMemory(), _entry_list_num);
+        }
+    }   break;
+    case StorageWAL::RecordType::WRITE: {
+        if (id >= _entry_list_num || record.column >= _type_item_list.size())
+            break;
+        StorageTypeItem const &item = _type_item_list[record.column];
+        if (record.payload.size() > ColumnGetSize(item))
+            break;
+        auto target = static_cast<uint8_t*>(_getEntryMemory(id)) + item.offset;
+        memcpy(target, record.payload.data(), record.payload.size());
+        _markDirty(_getEntryOffset(id));
+    }   break;
+    case StorageWAL::RecordType::FREE:
+        if (id < _entry_list_num)
+            _setEntryAllocated(id, false);
+        break;
+    case StorageWAL::RecordType::HEAP_WRITE:
+        if (_heap != nullptr)
+            _heap->redo(record.payload);
+        break;
+    case StorageWAL::RecordType::BULK_LOAD:
+        _bulk_rollback = id;
+        break;
+    case StorageWAL::RecordType::UNDO:
+    case StorageWAL::RecordType::HEAP_UNDO:
+    case StorageWAL::RecordType::COMMIT:
+    case StorageWAL::RecordType::BEGIN:
+        break; /* 由`_replayWAL`处理 */
+    }
+}
+
+void StorageTable::_undo(uint32_t id, std::string_view image)
+{
+    if (image.size() != _entry_size)
+        return;
+    _reserveEntry(id);
+    memcpy(_getEntryMemory(id), image.data(), _entry_size);
+    _markDirty(_getEntryOffset(id));
+}
+
+void StorageTable::_logUndo(uint32_t id) const
+{
+    if (!_in_transaction || id >= _transaction_entry_base || !_undo_entries.insert(id).second)
+        return;
+    _wal->appendUndo(StorageWAL::RecordType::UNDO, id,
+                     static_cast<const uint8_t*>(_getEntryMemory(id)), _entry_size);
+}
+
+void StorageTable::_reserveEntry(uint32_t id)
+{
+    if (!_isPageMaintained()) {
+        _entry_mapper->reserve(_getEntryOffset(id) + _entry_size);
+        return;
+    }
+    uint32_t page_no = _page_layout.getPageNo(id);
+    if (page_no > _page_count) {
+        _entry_mapper->reserve(_page_layout.getPageOffset(page_no + 1));
+        _page_count = page_no;
+        _storeEntryWord(_getPageCountMemory(), _page_count);
+    }
+    /* 页头不写日志: 重放时内核可能已经写回了一部分页面, 所以按页号判断是否初始化过 */
+    auto page = static_cast<StoragePageHeader*>(_getPageMemory(page_no));
+    if (page->page_no != page_no) {
+        _page_layout.initPage(page, page_no);
+        _markDirty(_page_layout.getPageOffset(page_no));
+    }
+    uint32_t slot = _page_layout.getSlot(id);
+    if (slot < page->slot_count)
+        return;
+    _markDirty(_page_layout.getPageOffset(page_no));
+    auto directory = reinterpret_cast<uint16_t*>(page + 1);
+    for (uint32_t i = page->slot_count; i <= slot; i++)
+        directory[i] = _page_layout.getSlotOffset(i);
+    page->slot_count = slot + 1;
+}
+
+void StorageTable::_setEntryAllocated(uint32_t id, bool allocated)
+{
+    pointer memory = _getEntryMemory(id);
+    bool was_allocated = *static_cast<uint32_t*>(memory) != 0;
+    _storeEntryWord(memory, allocated);
+    if (was_allocated == allocated || !_isPageMaintained())
+        return;
+    auto page = static_cast<StoragePageHeader*>(_getPageMemory(_page_layout.getPageNo(id)));
+    if (allocated)
+        page->allocated_count++;
+    else
+        page->allocated_count--;
+}
+
+void StorageTable::_rebuildPageHeaders()
+{
+    for (uint32_t page_no = 1; page_no <= _page_count; page_no++) {
+        auto page = static_cast<StoragePageHeader*>(_getPageMemory(page_no));
+        uint32_t first = _page_layout.getFirstEntry(page_no);
+        uint32_t count = std::min(_page_layout.slots_per_page,
+                                  std::max(_entry_list_num, first) - first);
+        _page_layout.initPage(page, page_no);
+        _markDirty(_page_layout.getPageOffset(page_no));
+        if (count > 0)
+            _reserveEntry(first + count - 1);
+        for (uint32_t id = first; id < first + count; id++) {
+            if (*static_cast<uint32_t*>(_getEntryMemory(id)) != 0)
+                page->allocated_count++;
+        }
+    }
+}
+
+size_t StorageTable::_encodeColumn(StorageTypeItem const &item, ValueView const &value,
+                                   uint8_t *out, StorageHeap::Offset &out_block) const
+{
+    out_block = 0;
+    if (item.type == Value::Type::INT) {
+        memcpy(out, &value.int_value, i32size);
+        return i32size;
+    }
+    uint32_t length = value.string_value.length();
+    if (!item.is_varlen) {
+        if (length > fixed_string_max)
+            return 0;
+        // 长度字段 + 字符串数据字段
+        memcpy(out, &length, i32size);
+        memcpy(out + i32size, value.string_value.data(), length);
+        return i32size + length;
+    }
+    if (length > STRING_MAX_LENGTH)
+        return 0;
+    /* 变长编码: 短字符串内联, 长字符串写进溢出堆 */
+    memset(out, 0, varlen_slot_size);
+    memcpy(out, &length, i32size);
+    if (length <= varlen_inline_max) {
+        memcpy(out + i32size, value.string_value.data(), length);
+    } else {
+        memcpy(out + i32size, value.string_value.data(), i32size);
+        out_block = _heap->allocate(length);
+        _heap->write(out_block, value.string_value.data(), length);
+        memcpy(out + varlen_heap_field, &out_block, sizeof(out_block));
+    }
+    return varlen_slot_size;
+}
+
+ValueView StorageTable::_decodeColumn(StorageTypeItem const &item,
+                                     const uint8_t *raw) const
+{
+    ValueView ret;
+    ret.type = item.type;
+    switch (item.type) {
+    case Value::Type::INT:
+        ret.int_value = *reinterpret_cast<const int32_t*>(raw);
+        break;
+    case Value::Type::STRING: {
+        uint32_t length = *reinterpret_cast<const uint32_t*>(raw);
+        if (item.is_varlen && length > varlen_inline_max) {
+            uint64_t block;
+            memcpy(&block, raw + varlen_heap_field, sizeof(block));
+            ret.string_value = _heap->read(block, length);
+        } else {
+            ret.string_value = {reinterpret_cast<const char*>(raw + i32size), length};
+        }
+    }   break;
+    default:
+        ret.type = Value::Type::NONE;
+    }
+    return ret;
+}
+
+void StorageTable::_releaseColumn(StorageTypeItem const &item, const uint8_t *raw) const
+{
+    if (!item.is_varlen)
+        return;
+    uint32_t length = *reinterpret_cast<const uint32_t*>(raw);
+    if (length <= varlen_inline_max)
+        return;
+    uint64_t block;
+    memcpy(&block, raw + varlen_heap_field, sizeof(block));
+    _heap->free(block, length);
+}
+
+void StorageTable::_makeIndexKey(ValueView const &value, uint8_t *out_key) const
+{
+    if (value.type == Value::Type::INT) {
+        uint32_t raw = htobe32(value.int_value);
+        memcpy(out_key, &raw, i32size);
+        return;
+    }
+    /* 字符串键: | u32 长度 | 前256字节 |, 无效部分清零 */
+    size_t key_size = DataTypeGetSize(Value::Type::STRING);
+    uint32_t length = std::min<uint32_t>(value.string_value.length(), fixed_string_max);
+    memset(out_key, 0, key_size);
+    uint32_t be_length = htobe32(length);
+    memcpy(out_key, &be_length, i32size);
+    memcpy(out_key + i32size, value.string_value.data(), length);
+}
+
+bool StorageTable::_storeColumn(uint32_t id, StorageTypeItem const &item,
+                                const uint8_t *raw, size_t raw_size, bool is_new) const
+{
+    _logUndo(id);
+    auto target = static_cast<uint8_t*>(_getEntryMemory(id)) + item.offset;
+    uint16_t column = getTypeIndex(item.name);
+    _markDirty(_getEntryOffset(id));
+    StorageBTree *tree = _getIndexTree(column);
+    StorageHashIndex *hash_index = (tree == nullptr) ? _getHashIndex(column) : nullptr;
+    if (tree == nullptr && hash_index == nullptr) {
+        memcpy(target, raw, raw_size);
+        _wal->append(StorageWAL::RecordType::WRITE, id, column, raw, raw_size);
+        return true;
+    }
+    if (hash_index != nullptr) {
+        /* 旧值可能内联在要被覆盖的槽位里, 先求出新旧两个哈希值。新条目的槽位是清零的,
+         * 不在索引里, 哈希值与新值相同(比如0)时也要插入 */
+        uint32_t old_hash = StorageHashIndex::HashKey(_decodeColumn(item, target));
+        uint32_t new_hash = StorageHashIndex::HashKey(_decodeColumn(item, raw));
+        memcpy(target, raw, raw_size);
+        if (is_new) {
+            hash_index->insert(new_hash, id);
+        } else if (old_hash != new_hash) {
+            hash_index->remove(old_hash, id);
+            hash_index->insert(new_hash, id);
+        }
+        _wal->append(StorageWAL::RecordType::WRITE, id, column, raw, raw_size);
+        return true;
+    }
+    /* 有B+树索引的列: 主键列先检查新键是否已经被别的条目占用, 然后替换索引里的旧键。
+     * 新条目的槽位是清零的, 与新键相同(比如0)时也要插入 */
+    uint8_t old_key[DataTypeGetSize(Value::Type::STRING)];
+    uint8_t new_key[DataTypeGetSize(Value::Type::STRING)];
+    _makeIndexKey(_decodeColumn(item, target), old_key);
+    _makeIndexKey(_decodeColumn(item, raw), new_key);
+    bool key_changed = is_new || memcmp(old_key, new_key, DataTypeGetSize(item.type)) != 0;
+    /* 截断的键相同不代表列值相同, 唯一性按完整的列值检查 */
+    if (column == _primary_index_order) {
+        ValueView new_value = _decodeColumn(item, raw);
+        bool value_changed = is_new || _decodeColumn(item, target).compare(new_value) != 0;
+        if (value_changed && _containsKey(*tree, column, new_value))
+            return false;
+    }
+    if (key_changed && !is_new)
+        tree->remove(old_key, id);
+    memcpy(target, raw, raw_size);
+    if (key_changed)
+        tree->insert(new_key, id);
+    _wal->append(StorageWAL::RecordType::WRITE, id, column, raw, raw_size);
+    return true;
+}
+
+pointer StorageTable::_getEntryCountMemory() const noexcept {
     pointer ret = _entry_mapper->get();
+    mtb_ptr_advance(ret, _entry_header_size);
+    return ret;
+}
+pointer StorageTable::_getPageCountMemory() const noexcept {
+    pointer ret = _getEntryCountMemory();
     mtb_ptr_advance(ret, i32size);
     return ret;
 }
+pointer StorageTable::_getPageMemory(uint32_t page_no) const noexcept {
+    pointer ret = _entry_mapper->get();
+    mtb_ptr_advance(ret, _page_layout.getPageOffset(page_no));
+    return ret;
+}
 /** @fn StorageTable::_getEntryMemory(index)
  * @brief 根据条目的下标获取条目存储区的内存起始地址。
  * @return pointer 条目的内存起始地址，指向`is_allocated`字段。 */
 pointer StorageTable::_getEntryMemory(size_t index) const noexcept {
-    pointer ret = _getEntryStartMemory();
-    mtb_ptr_advance(ret, _entry_size * index);
+    pointer ret = _entry_mapper->get();
+    mtb_ptr_advance(ret, _getEntryOffset(index));
     return ret;
 }
 size_t StorageTable::_getEntryOffset(size_t index) const noexcept {
-    return i32size + index * _entry_size;
+    return EntryGetOffset(_page_layout, _entry_header_size, index);
+}
+/** @fn StorageTable::_storeEntryWord(memory, value)
+ * @brief 按条目文件的字节序写入分配标记或条目个数。只有重放旧格式文件的日志时
+ *        字节序才可能不是本机字节序。 */
+void StorageTable::_storeEntryWord(pointer memory, uint32_t value) const noexcept {
+    if (_entry_byte_order != StorageNativeByteOrder)
+        value = __builtin_bswap32(value);
+    memcpy(memory, &value, sizeof(value));
+    _markDirty(static_cast<const uint8_t*>(memory)
+               - static_cast<const uint8_t*>(_entry_mapper->get()));
+}
+
+void StorageTable::_markDirty(size_t offset) const
+{
+    if (!_page_layout.is_paged())
+        return;
+    size_t page_no = offset / _page_layout.page_size;
+    if (page_no >= _dirty_pages.size())
+        _dirty_pages.resize(std::max<size_t>(page_no + 1, _dirty_pages.size() * 2));
+    _dirty_pages.set(page_no);
+}
+
+void StorageTable::_syncDirtyPages()
+{
+    if (!_page_layout.is_paged()) {
+        _entry_mapper->sync();
+        return;
+    }
+    /* 相邻的脏页合并成一段写回 */
+    size_t page_size = _page_layout.page_size;
+    size_t run_begin = 0, run_end = 0;
+    _dirty_pages.traverseSet([&](size_t page_no) {
+        if (run_end != run_begin && page_no == run_end) {
+            run_end++;
+            return;
+        }
+        if (run_end != run_begin)
+            _entry_mapper->syncRange(run_begin * page_size, (run_end - run_begin) * page_size);
+        run_begin = page_no;
+        run_end   = page_no + 1;
+    });
+    if (run_end != run_begin)
+        _entry_mapper->syncRange(run_begin * page_size, (run_end - run_begin) * page_size);
+    _dirty_pages.clear();
 }
 
 void StorageTable::_dumpTypeItemNameBuffer()
@@ -413,23 +1148,119 @@ void StorageTable::_dumpTypeItemNameBuffer()
 
 void StorageTable::_initKeyIndexMap()
 {
+    /* 名称必须指向_type_item_name_buffer, 所以要在转储名称以后重建这两张表 */
+    _type_item_map.clear();
+    _type_item_index_map.clear();
     for (int index = 0; StorageTypeItem &i : _type_item_list) {
+        _type_item_map.insert({i.name, &i});
         _type_item_index_map.insert({i.name, index});
         index++;
     }
 }
 
 /* public class StorageTable */
+void StorageTable::filterEntries(size_t column_index, TotalOrderRelation relation,
+                                 Value const *value, MTB::Bitmap &out) const
+{
+    filterEntryRange(0, _entry_list_num, column_index, relation, value, out);
+}
+
+void StorageTable::filterEntryRange(uint32_t first, uint32_t last, size_t column_index,
+                                    TotalOrderRelation relation, Value const *value,
+                                    MTB::Bitmap &out) const
+{
+    last  = std::min(last, _entry_list_num);
+    first = std::min(first, last);
+    out.resize(last - first);
+    out.clear();
+    /* 条目按ID切成morsel并行扫描, 每个morsel写位图里不同的字, 不需要合并 */
+    size_t morsel_count = (size_t(last - first) + SCAN_MORSEL_SIZE - 1) / SCAN_MORSEL_SIZE;
+    ScanParallelFor(morsel_count, [&](size_t morsel, size_t) {
+        uint32_t morsel_first = first + morsel * SCAN_MORSEL_SIZE;
+        uint32_t morsel_last  = std::min<size_t>(morsel_first + SCAN_MORSEL_SIZE, last);
+        _filterRange(morsel_first, morsel_last, column_index, relation, value, out, first);
+    });
+}
+
+void StorageTable::_filterRange(uint32_t first, uint32_t last, size_t column_index,
+                                TotalOrderRelation relation, Value const *value,
+                                MTB::Bitmap &out, uint32_t out_base) const
+{
+    StorageTypeItem const &item = _type_item_list[column_index];
+    if (item.is_varlen && value->get_value_type() == Value::Type::STRING &&
+        (relation == TotalOrderRelation::EQ || relation == TotalOrderRelation::NE)) {
+        /* 字符串的相等比较: 先比较槽位里的长度与前缀, 长度不同的条目不需要解码,
+         * 长字符串只有前缀也相同时才读溢出堆 */
+        std::string_view target = static_cast<StringValue const*>(value)->value();
+        uint32_t target_length = target.length();
+        bool want_equal = (relation == TotalOrderRelation::EQ);
+        for (uint32_t id = first; id < last; id++) {
+            auto memory = static_cast<const uint8_t*>(_getEntryMemory(id));
+            if (*reinterpret_cast<const uint32_t*>(memory) == 0)
+                continue;
+            const uint8_t *slot = memory + item.offset;
+            uint32_t length;
+            memcpy(&length, slot, i32size);
+            bool is_inline = length <= varlen_inline_max;
+            bool equal = length == target_length &&
+                memcmp(slot + i32size, target.data(), is_inline ? length : i32size) == 0 &&
+                (is_inline || _decodeColumn(item, slot).string_value == target);
+            if (equal == want_equal)
+                out.set(id - out_base);
+        }
+        return;
+    }
+    if (item.type != Value::Type::INT ||
+        value->get_value_type() != Value::Type::INT) {
+        /* 常量只打包一次, 类型也只检查一次; 循环里的比较不调用虚函数 */
+        CompactValue target = CompactValue::FromValue(value);
+        bool consistent = (item.type == value->get_value_type());
+        for (uint32_t id = first; id < last; id++) {
+            if (*static_cast<const uint32_t*>(_getEntryMemory(id)) == 0)
+                continue;
+            if (!consistent)
+                throw Value::InconsistantTypeException(item.type, value->get_value_type());
+            CompactValue left = CompactValue::FromView(Entry(*this, id).view(column_index));
+            if (left.meets(relation, target))
+                out.set(id - out_base);
+        }
+        return;
+    }
+    /* 逐页扫描, 一页里的槽位是连续的定长数组. 没有已分配条目的页直接跳过 */
+    int32_t target = static_cast<IntValue const*>(value)->value();
+    for (uint32_t id = first; id < last; ) {
+        uint32_t page_no    = _page_layout.getPageNo(id);
+        uint32_t page_first = _page_layout.getFirstEntry(page_no);
+        uint32_t page_last  = std::min(page_first + _page_layout.slots_per_page, last);
+        StoragePageHeader const *page = getPageHeader(page_no);
+        if (page->allocated_count != 0) {
+            ScanRange range {
+                reinterpret_cast<const uint8_t*>(page) + _page_layout.data_offset
+                    + size_t(id - page_first) * _entry_size,
+                _entry_size,
+                page_last - id,
+                item.offset
+            };
+            ScanInt32Column(range, relation, target, out, id - out_base);
+        }
+        id = page_last;
+    }
+}
+
 void StorageTable::traverseReadEntries(StorageTable::EntryTraverseReadFunc fn) const
 {
-    for (int index: *_entry_allocator) {
+    for (uint32_t index = 0; index < _entry_list_num; index++) {
+        if (*reinterpret_cast<uint32_t*>(_getEntryMemory(index)) == 0)
+            continue;
         Entry entry(*this, index);
         fn(entry);
     }
 }
 void StorageTable::traverseRWEntries(StorageTable::EntryTraverseRWFunc fn)
 {
-    for (int index: *_entry_allocator) {
+    for (uint32_t index = 0; index < _entry_list_num; index++) {
+        if (*reinterpret_cast<uint32_t*>(_getEntryMemory(index)) == 0)
+            continue;
         Entry entry(*this, index);
         fn(entry);
     }
@@ -437,37 +1268,82 @@ void StorageTable::traverseRWEntries(StorageTable::EntryTraverseRWFunc fn)
 
 StorageTable::Entry StorageTable::allocateEntry()
 {
-    int id = _entry_allocator->allocate();
+    _loadEntryAllocator();
+    return _initializeEntry(_entry_allocator->allocate());
+}
+StorageTable::Entry StorageTable::_initializeEntry(uint32_t id)
+{
+    _logUndo(id);
     if (id >= _entry_list_num)
-        _entry_list_num++;
+        _entry_list_num = id + 1;
     _entry_allocated_num++;
-    while (_getEntryOffset(id) >= _entry_mapper->get_file_size())
-        _entry_mapper->resizeAppend();
-    /* 同步分配情况到文件映射的内存区域 */
-    uint32_t &allocate_status = *reinterpret_cast<uint32_t*>(_getEntryMemory(id));
-    allocate_status = htobe32(true);
+    _reserveEntry(id);
+    /* 同步分配情况到文件映射的内存区域. 复用的条目里可能有旧数据, 先清零 */
+    memset(static_cast<uint8_t*>(_getEntryMemory(id)) + i32size, 0, _entry_size - i32size);
+    _setEntryAllocated(id, true);
     /* 同步总条目个数到文件映射区域 */
-    uint32_t &entry_list_length = *reinterpret_cast<uint32_t*>(_entry_mapper->get());
-    entry_list_length = htobe32(_entry_list_num);
+    _storeEntryWord(_getEntryCountMemory(), _entry_list_num);
+    _wal->append(StorageWAL::RecordType::ALLOCATE, id);
     return Entry(*this, id);
 }
-StorageTable::Entry StorageTable::appendEntry(std::vector<owned<Value>> const &value_list)
+void StorageTable::_checkDuplicateKey(ValueListT const &value_list) const
 {
+    if (_primary_tree == nullptr || _primary_index_order >= value_list.size())
+        return;
+    Value *key_value = value_list[_primary_index_order].get();
+    bool key_exists = false;
+    traverseByPrimaryKey(TotalOrderRelation::EQ, key_value,
+        [&key_exists](uint32_t) { key_exists = true; return false; });
+    if (key_exists)
+        throw DuplicateKeyException(_name, key_value->getString());
+}
+void StorageTable::_storeNewEntry(Entry &entry, ValueListT const &value_list)
+{
+    size_t ncolumns = std::min(value_list.size(), _type_item_list.size());
+    for (size_t index = 0; index < ncolumns; index++)
+        entry._setValue(_type_item_list[index], *value_list[index], true);
+}
+StorageTable::Entry StorageTable::appendEntry(ValueListT const &value_list)
+{
+    /* 主键重复时不能分配条目 */
+    _checkDuplicateKey(value_list);
     Entry entry = allocateEntry();
-    for (int index = 0; owned<Value> const &i: value_list) {
-        entry.set(_type_item_list[index].name, *i.get());
-        index++;
-    }
+    _storeNewEntry(entry, value_list);
+    return entry;
+}
+StorageTable::Entry StorageTable::restoreEntry(uint32_t id, ValueListT const &value_list)
+{
+    _checkDuplicateKey(value_list);
+    _loadEntryAllocator();
+    if (!_entry_allocator->allocateAt(id))
+        throw EntryAllocatedException(_name, id);
+    Entry entry = _initializeEntry(id);
+    _storeNewEntry(entry, value_list);
     return entry;
 }
 
 bool StorageTable::deleteEntryByID(int32_t id)
 {
+    _loadEntryAllocator();
     if (_entry_allocator->isAllocated(id) == false)
         return false;
-    uint32_t &allocate_status = *((uint32_t*)_getEntryMemory(id));
-    allocate_status = htobe32(false);
+    _logUndo(id);
+    Entry entry(*this, id);
+    if (_primary_tree != nullptr) {
+        uint8_t key[DataTypeGetSize(Value::Type::STRING)];
+        _makeIndexKey(entry.view(_primary_index_order), key);
+        _primary_tree->remove(key, id);
+    }
+    _removeSecondaryKeys(id);
+    if (_heap != nullptr) { /* 归还长字符串占用的堆块 */
+        auto memory = static_cast<const uint8_t*>(_getEntryMemory(id));
+        for (StorageTypeItem const &item: _type_item_list)
+            _releaseColumn(item, memory + item.offset);
+    }
+    _setEntryAllocated(id, false);
+    _wal->append(StorageWAL::RecordType::FREE, id);
     _entry_allocator->free(id);
+    _entry_allocated_num--;
     return true;
 }
 bool StorageTable::deleteEntry(StorageTable::Entry *entry) {
@@ -475,19 +1351,234 @@ bool StorageTable::deleteEntry(StorageTable::Entry *entry) {
 }
 bool StorageTable::deleteEntryByPrimaryKey(Value *value)
 {
-    auto index_type = getPrimaryIndex();
-    std::list<Entry> deleted_entries;
-    if (value->get_value_type() != index_type->type)
+    std::list<uint32_t> deleted_entries;
+    bool indexed = traverseByPrimaryKey(TotalOrderRelation::EQ, value,
+        [&deleted_entries](uint32_t id) {
+            deleted_entries.push_back(id);
+            return true;
+        });
+    if (!indexed)
+        return false;
+    for (uint32_t id : deleted_entries)
+        deleteEntryByID(id);
+    return true;
+}
+
+bool StorageTable::traverseByPrimaryKey(TotalOrderRelation relation, Value const *value,
+                                        EntryIDTraverseFunc fn) const
+{
+    if (_primary_tree == nullptr)
+        return false;
+    return traverseByIndex(_primary_index_order, relation, value, fn);
+}
+
+bool StorageTable::traverseInIndexOrder(uint32_t column_index, EntryIDTraverseFunc fn) const
+{
+    StorageBTree *tree = _getIndexTree(column_index);
+    if (tree == nullptr)
         return false;
-    traverseReadEntries(
-        [&deleted_entries](Entry const &entry) {
-            deleted_entries.push_back(entry);
+    _traverseInValueOrder(column_index,
+        [tree](EntryIDTraverseFunc const &visit) { tree->traverseAll(visit); }, fn);
+    return true;
+}
+
+bool StorageTable::traverseByIndex(uint32_t column_index, TotalOrderRelation relation,
+                                   Value const *value, EntryIDTraverseFunc fn) const
+{
+    StorageBTree *tree = _getIndexTree(column_index);
+    StorageHashIndex *hash_index = (tree == nullptr) ? _getHashIndex(column_index) : nullptr;
+    if ((tree == nullptr && hash_index == nullptr) || value == nullptr)
+        return false;
+    StorageTypeItem const &item = _type_item_list[column_index];
+    if (value->get_value_type() != item.type)
+        return false;
+    ValueView view;
+    view.type = item.type;
+    if (item.type == Value::Type::INT)
+        view.int_value = static_cast<IntValue const*>(value)->value();
+    else
+        view.string_value = static_cast<StringValue const*>(value)->value();
+    if (hash_index != nullptr) {
+        if (relation != TotalOrderRelation::EQ)
+            return false;
+        /* 哈希值相同的条目再比较一次列值, 排除哈希冲突 */
+        hash_index->traverseByHash(StorageHashIndex::HashKey(view),
+            [this, column_index, value, &fn](uint32_t id) {
+                if (Entry(*this, id).view(column_index).compare(value) != 0)
+                    return true;
+                return fn(id);
+            });
+        return true;
+    }
+    return _traverseTree(*tree, column_index, relation, view, fn);
+}
+
+bool StorageTable::_containsKey(StorageBTree const &tree, uint32_t column,
+                                ValueView const &value) const
+{
+    uint8_t key[DataTypeGetSize(Value::Type::STRING)];
+    _makeIndexKey(value, key);
+    bool found = false;
+    tree.traverseByCondition(TotalOrderRelation::EQ, key,
+        [this, column, &value, &found](uint32_t id) {
+            found = Entry(*this, id).view(column).compare(value) == 0;
+            return !found;
         });
-    for (auto &i : deleted_entries)
-        deleteEntry(&i);
+    return found;
+}
+
+bool StorageTable::_traverseTree(StorageBTree const &tree, uint32_t column,
+                                 TotalOrderRelation relation, ValueView const &value,
+                                 EntryIDTraverseFunc const &fn) const
+{
+    uint8_t key[DataTypeGetSize(Value::Type::STRING)];
+    _makeIndexKey(value, key);
+    /* 键被截断时前缀相同的列值在树里都等于这个键, 严格的关系要带上等于,
+     * 再逐条比较完整的列值 */
+    bool truncated = value.type == Value::Type::STRING &&
+                     value.string_value.length() >= fixed_string_max;
+    TotalOrderRelation tree_relation = relation;
+    if (truncated && (relation == TotalOrderRelation::LT || relation == TotalOrderRelation::GT))
+        tree_relation = TotalOrderRelation(int8_t(relation) | int8_t(TotalOrderRelation::EQ));
+    bool indexed = false;
+    _traverseInValueOrder(column, [&](EntryIDTraverseFunc const &visit) {
+        indexed = tree.traverseByCondition(tree_relation, key,
+            [this, column, relation, truncated, &value, &visit](uint32_t id) {
+                if (truncated &&
+                    !ValueMeetsCondition(relation, Entry(*this, id).view(column), value))
+                    return true;
+                return visit(id);
+            });
+    }, fn);
+    return indexed;
+}
+
+void StorageTable::_traverseInValueOrder(uint32_t column,
+        std::function<void(EntryIDTraverseFunc const&)> const &traverse,
+        EntryIDTraverseFunc const &fn) const
+{
+    if (_type_item_list[column].type != Value::Type::STRING) {
+        traverse(fn);
+        return;
+    }
+    std::vector<uint32_t> run;   // 前缀相同的长字符串
+    std::string run_prefix;
+    bool stopped = false;
+    auto flush_run = [this, column, &run, &stopped, &fn]() {
+        std::stable_sort(run.begin(), run.end(), [this, column](uint32_t lhs, uint32_t rhs) {
+            return Entry(*this, lhs).view(column).compare(Entry(*this, rhs).view(column)) < 0;
+        });
+        for (uint32_t id: run) {
+            if (!fn(id)) {
+                stopped = true;
+                break;
+            }
+        }
+        run.clear();
+        return !stopped;
+    };
+    traverse([&](uint32_t id) {
+        std::string_view value = Entry(*this, id).view(column).string_value;
+        bool is_long = value.length() >= fixed_string_max;
+        if (!run.empty() && (!is_long || value.substr(0, fixed_string_max) != run_prefix) &&
+            !flush_run())
+            return false;
+        if (!is_long) {
+            stopped = !fn(id);
+            return !stopped;
+        }
+        if (run.empty())
+            run_prefix.assign(value.substr(0, fixed_string_max));
+        run.push_back(id);
+        return true;
+    });
+    if (!stopped && !run.empty())
+        flush_run();
+}
+
+bool StorageTable::createIndex(std::string_view name, uint32_t column_index, IndexKind kind)
+{
+    if (column_index >= _type_item_list.size() || hasIndex(column_index))
+        return false;
+    for (SecondaryIndex const &index: _secondary_indexes) {
+        if (index.name == name)
+            return false;
+    }
+    SecondaryIndex index{std::string(name), column_index, kind, nullptr, nullptr};
+    /* 同名的旧表可能留下了索引文件 */
+    std::filesystem::remove(_getSecondaryIndexPath(index));
+    _openSecondaryIndex(index);
+    /* 索引文件先落盘, 再登记进索引目录 */
+    if (index.tree != nullptr)
+        index.tree->sync();
+    else
+        index.hash->sync();
+    _secondary_indexes.push_back(std::move(index));
+    _saveIndexCatalog();
     return true;
 }
 
+StorageBTree *StorageTable::_getIndexTree(uint32_t column) const
+{
+    if (column == _primary_index_order)
+        return _primary_tree.get();
+    for (SecondaryIndex const &index: _secondary_indexes) {
+        if (index.column == column)
+            return index.tree.get();
+    }
+    return nullptr;
+}
+
+StorageHashIndex *StorageTable::_getHashIndex(uint32_t column) const
+{
+    for (SecondaryIndex const &index: _secondary_indexes) {
+        if (index.column == column)
+            return index.hash.get();
+    }
+    return nullptr;
+}
+
+void StorageTable::_insertSecondaryKeys(uint32_t id) const
+{
+    if (_secondary_indexes.empty())
+        return;
+    uint8_t key[DataTypeGetSize(Value::Type::STRING)];
+    Entry entry(*this, id);
+    for (SecondaryIndex const &index: _secondary_indexes) {
+        ValueView value = entry.view(index.column);
+        if (index.hash != nullptr) {
+            index.hash->insert(StorageHashIndex::HashKey(value), id);
+            continue;
+        }
+        _makeIndexKey(value, key);
+        index.tree->insert(key, id);
+    }
+}
+
+void StorageTable::_removeSecondaryKeys(uint32_t id) const
+{
+    if (_secondary_indexes.empty())
+        return;
+    uint8_t key[DataTypeGetSize(Value::Type::STRING)];
+    Entry entry(*this, id);
+    for (SecondaryIndex const &index: _secondary_indexes) {
+        ValueView value = entry.view(index.column);
+        if (index.hash != nullptr) {
+            index.hash->remove(StorageHashIndex::HashKey(value), id);
+            continue;
+        }
+        _makeIndexKey(value, key);
+        index.tree->remove(key, id);
+    }
+}
+
+StoragePageHeader const *StorageTable::getPageHeader(uint32_t page_no) const
+{
+    if (page_no == 0 || page_no > _page_count)
+        return nullptr;
+    return static_cast<StoragePageHeader const*>(_getPageMemory(page_no));
+}
+
 const StorageTypeItem *StorageTable::getPrimaryIndex() const 
 {
     return &_type_item_list[_primary_index_order];
@@ -500,11 +1591,177 @@ int32_t StorageTable::getTypeIndex(std::string_view name) const
     return _type_item_index_map.at(name);
 }
 
+void StorageTable::beginBulkLoad(size_t expected_count)
+{
+    checkpoint();
+    _loadEntryAllocator();
+    _bulk_load_begin = _entry_list_num;
+    _wal->commit(_wal->append(StorageWAL::RecordType::BULK_LOAD, _bulk_load_begin));
+    /* 一次扩大到位, 导入过程中不再重映射 */
+    size_t last_id = std::min<size_t>(size_t(_entry_list_num) + expected_count,
+                                      NO_BULK_LOAD - 1);
+    if (expected_count > 0)
+        _reserveEntry(last_id - 1);
+}
+
+void StorageTable::bulkAppend(ValueView const *row)
+{
+    uint32_t id = _entry_list_num;
+    uint8_t key[DataTypeGetSize(Value::Type::STRING)];
+    if (_primary_tree != nullptr) {
+        _makeIndexKey(row[_primary_index_order], key);
+        if (_containsKey(*_primary_tree, _primary_index_order, row[_primary_index_order])) {
+            throw DuplicateKeyException(_name,
+                    row[_primary_index_order].materialize()->getString());
+        }
+    }
+    _reserveEntry(id);
+    auto entry = static_cast<uint8_t*>(_getEntryMemory(id));
+    memset(entry + i32size, 0, _entry_size - i32size);
+    for (size_t index = 0; index < _type_item_list.size(); index++) {
+        StorageTypeItem const &item = _type_item_list[index];
+        ValueView const &value = row[index];
+        StorageHeap::Offset block;
+        if (value.type == item.type && _encodeColumn(item, value, entry + item.offset, block) != 0)
+            continue;
+        /* 这一行不会被导入, 归还前面的列已经占用的溢出堆块 */
+        for (size_t i = 0; i < index; i++)
+            _releaseColumn(_type_item_list[i], entry + _type_item_list[i].offset);
+        memset(entry + i32size, 0, _entry_size - i32size);
+        throw Value::InconsistantTypeException(item.type, value.type);
+    }
+    _setEntryAllocated(id, true);
+    _entry_list_num++;
+    _entry_allocated_num++;
+    _storeEntryWord(_getEntryCountMemory(), _entry_list_num);
+    if (_primary_tree != nullptr)
+        _primary_tree->insert(key, id);
+    _insertSecondaryKeys(id);
+    /* 长字符串写溢出堆时会写日志 */
+    if (_wal->get_size() > WAL_CHECKPOINT_SIZE)
+        _bulkCheckpoint();
+}
+
+void StorageTable::_bulkCheckpoint()
+{
+    checkpoint();
+    _wal->commit(_wal->append(StorageWAL::RecordType::BULK_LOAD, _bulk_load_begin));
+}
+
+void StorageTable::finishBulkLoad()
+{
+    if (!is_bulk_loading())
+        return;
+    _bulk_load_begin = NO_BULK_LOAD;
+    /* 分配器里没有导入的条目, 下一次用到时重新扫描 */
+    _entry_allocator.reset();
+    checkpoint();
+}
+
+void StorageTable::abortBulkLoad()
+{
+    if (!is_bulk_loading())
+        return;
+    uint8_t key[DataTypeGetSize(Value::Type::STRING)];
+    for (uint32_t id = _bulk_load_begin; id < _entry_list_num; id++) {
+        if (*static_cast<uint32_t*>(_getEntryMemory(id)) == 0)
+            continue;
+        if (_primary_tree != nullptr) {
+            _makeIndexKey(Entry(*this, id).view(_primary_index_order), key);
+            _primary_tree->remove(key, id);
+        }
+        _removeSecondaryKeys(id);
+        if (_heap != nullptr) {
+            auto memory = static_cast<const uint8_t*>(_getEntryMemory(id));
+            for (StorageTypeItem const &item: _type_item_list)
+                _releaseColumn(item, memory + item.offset);
+        }
+        _setEntryAllocated(id, false);
+    }
+    _rollbackEntryCount(_bulk_load_begin);
+    _bulk_load_begin = NO_BULK_LOAD;
+    _entry_allocator.reset();
+    checkpoint();
+}
+
+void StorageTable::beginTransaction(uint64_t transaction_id)
+{
+    if (_in_transaction || _wal == nullptr)
+        return;
+    _in_transaction = true;
+    _transaction_entry_base = _entry_list_num;
+    /* `BEGIN`记录要比这个事务的任何修改先落盘, 重放时才知道要撤销到哪里 */
+    uint64_t be_id = htobe64(transaction_id);
+    _wal->commit(_wal->append(StorageWAL::RecordType::BEGIN, _entry_list_num, 0,
+                              reinterpret_cast<const uint8_t*>(&be_id), sizeof(be_id)));
+    if (_heap != nullptr)
+        _heap->beginTransaction();
+}
+
+void StorageTable::prepare()
+{
+    if (_wal != nullptr)
+        _wal->commit();
+}
+
+void StorageTable::commit(bool durable)
+{
+    if (_wal == nullptr)
+        return;
+    if (_in_transaction) {
+        _wal->append(StorageWAL::RecordType::COMMIT, 0);
+        _in_transaction = false;
+        _undo_entries.clear();
+        if (_heap != nullptr)
+            _heap->endTransaction();
+    }
+    if (durable)
+        _wal->commit();
+    if (_wal->get_size() > WAL_CHECKPOINT_SIZE)
+        checkpoint();
+}
+
+void StorageTable::checkpoint()
+{
+    if (_wal == nullptr)
+        return;
+    /* 先让条目与索引落盘, 日志里的记录才可以丢弃 */
+    _syncDirtyPages();
+    if (_primary_tree != nullptr)
+        _primary_tree->sync();
+    for (SecondaryIndex const &index: _secondary_indexes) {
+        if (index.tree != nullptr)
+            index.tree->sync();
+        else
+            index.hash->sync();
+    }
+    if (_heap != nullptr)
+        _heap->sync();
+    /* 事务没有提交的修改已经写回了文件, 崩溃以后还要用日志里的撤销记录撤销它们 */
+    if (!_in_transaction)
+        _wal->truncate();
+}
+
 void StorageTable::eraseAndMakeUnavailable()
 {
     std::string entry_filename(_entry_mapper->get_filename());
     std::string index_filename(_index_mapper->get_filename());
+    std::string tree_filename;
+    if (_primary_tree != nullptr)
+        tree_filename = _primary_tree->get_filename();
+    std::string wal_filename, heap_filename;
+    if (_wal != nullptr)
+        wal_filename = _wal->get_filename();
+    if (_heap != nullptr)
+        heap_filename = _heap->get_filename();
+    std::vector<std::filesystem::path> secondary_paths;
+    for (SecondaryIndex const &index: _secondary_indexes)
+        secondary_paths.push_back(_getSecondaryIndexPath(index));
+    _secondary_indexes.clear();
+    _heap.reset();
+    _wal.reset();
     _entry_allocator.reset();
+    _primary_tree.reset();
     _entry_mapper.reset();
     _index_mapper.reset();
     _type_item_index_map.clear();
@@ -516,6 +1773,15 @@ void StorageTable::eraseAndMakeUnavailable()
     std::filesystem::path index_path(index_filename);
     std::filesystem::remove(entry_path);
     std::filesystem::remove(index_path);
+    if (!tree_filename.empty())
+        std::filesystem::remove(std::filesystem::path(tree_filename));
+    if (!wal_filename.empty())
+        std::filesystem::remove(std::filesystem::path(wal_filename));
+    if (!heap_filename.empty())
+        std::filesystem::remove(std::filesystem::path(heap_filename));
+    for (std::filesystem::path const &path: secondary_paths)
+        std::filesystem::remove(path);
+    std::filesystem::remove(_work_dir / (_name + ".sdx"));
 }
 /* end class StorageTable */
 
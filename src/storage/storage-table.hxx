@@ -4,14 +4,25 @@
 #include "base/mtb-object.hxx"
 #include "base/mtb-system.hxx"
 #include "base/sql-value.hxx"
+#include "base/util/mtb-bitmap.hxx"
 #include "base/util/mtb-id-allocator.hxx"
+#include "storage-btree.hxx"
+#include "storage-commit-log.hxx"
+#include "storage-format.hxx"
+#include "storage-hash.hxx"
+#include "storage-heap.hxx"
+#include "storage-wal.hxx"
 #include <cstddef>
 #include <cstdint>
 #include <deque>
 #include <filesystem>
+#include <format>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <string_view>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace mygsql {
@@ -24,6 +35,7 @@ struct StorageTypeItem {
     bool   is_primary = false; // 是否为主键
     /* 下面的字段在传入时不用填 */
     uint32_t   offset = 0; // 索引在实际内存中的偏移量, 作为输入参数时填0即可.
+    bool    is_varlen = false; // 字符串列是否使用变长编码(短字符串内联, 长字符串放进溢出堆)
 }; // struct StorageTypeItem
 
 class StorageTable: public MTB::Object {
@@ -35,10 +47,46 @@ public:
     using TypeItemMapT  = std::unordered_map<std::string_view, StorageTypeItem*>;
     using TypeItemListT = std::deque<StorageTypeItem>;
     using EntryAllocator= std::unique_ptr<MTB::IDAllocator>;
+    using BTreeT        = std::unique_ptr<StorageBTree>;
+    using HashIndexT    = std::unique_ptr<StorageHashIndex>;
+    using WALT          = std::unique_ptr<StorageWAL>;
+    using HeapT         = std::unique_ptr<StorageHeap>;
     // 类型遍历函数
     class Entry;
     using EntryTraverseRWFunc   = std::function<void(Entry &)>;     // 读遍历
     using EntryTraverseReadFunc = std::function<void(Entry const&)>;// 读写遍历
+    using EntryIDTraverseFunc   = StorageBTree::TraverseFunc;       // 按条目ID遍历
+
+    /** @enum IndexKind
+     * @brief 二级索引的种类 */
+    enum class IndexKind: uint32_t {
+        BTREE = 0, // 有序的B+树, 可以求解等值与范围条件
+        HASH  = 1, // 线性哈希, 只能求解等值条件, 但是查找是常数时间
+    }; // enum class IndexKind
+
+    /** @class DuplicateKeyException
+     * @brief 插入或者更新条目时，主键`key`已经存在 */
+    class DuplicateKeyException: public MTB::Exception {
+    public:
+        DuplicateKeyException(std::string_view table, std::string_view key)
+            : MTB::Exception(MTB::ErrorLevel::CRITICAL,
+                std::format("DuplicateKeyException: primary key {} already exists in table {}",
+                            key, table)),
+              key(key) {}
+        std::string key;
+    }; // class DuplicateKeyException
+
+    /** @class EntryAllocatedException
+     * @brief 要在指定的ID上建立条目, 但这个ID已经被分配了 */
+    class EntryAllocatedException: public MTB::Exception {
+    public:
+        EntryAllocatedException(std::string_view table, uint32_t id)
+            : MTB::Exception(MTB::ErrorLevel::CRITICAL,
+                std::format("EntryAllocatedException: entry {} is already allocated in table {}",
+                            id, table)),
+              id(id) {}
+        uint32_t id;
+    }; // class EntryAllocatedException
 
     class Entry: public MTB::Object {
     public:
@@ -51,11 +99,16 @@ public:
 
         size_t length() const;    // 对应内存单元的长度
         ValuePtrT get(std::string_view name) const;          // 根据名称取值
-        ValuePtrT getFromIndex(size_t index) const;          // 根据索引取值
+        // 根据索引取值, `arena`不为空时从这个内存池分配(见`Value::New`)
+        ValuePtrT getFromIndex(size_t index, std::pmr::memory_resource *arena = nullptr) const;
+        ValueView view(size_t index) const;  // 根据索引取值视图, 直接读映射区, 不分配内存
         bool set(std::string_view name, Value const &value); // 根据名称设置值
         bool set(std::string_view name, int32_t value);
         bool set(std::string_view name, std::string_view value);
-        bool isAllocated() const { return *((int32_t*)get()) != 0; }
+        bool setFromIndex(size_t index, Value const &value); // 根据索引设置值, 不按名称查找
+        bool isAllocated() const {
+            return *((int32_t*)_table._getEntryMemory(_header_index)) != 0;
+        }
         /** @fn get_header_index() const
          * @brief getter:header_index 当前条目相对于StorageTable的整数索引 */
         uint32_t get_header_index() const { return _header_index; }
@@ -68,18 +121,31 @@ public:
         uint32_t     _header_index; // 当前条目的整数索引
 
         MTB::pointer get() const; // 获取内存单元的首地址
+        /* 按类型写入一列. 类型与列的类型不一致时返回false.
+         * `is_new`: 条目刚分配, 这一列还没有写过, 索引里没有它的旧键 */
+        bool _setValue(StorageTypeItem const &type_item, Value const &value,
+                       bool is_new = false);
+        bool _setInt(StorageTypeItem const &type_item, int32_t value, bool is_new = false);
+        bool _setString(StorageTypeItem const &type_item, std::string_view value,
+                        bool is_new = false);
     }; // class Entry
 
 public:
-    /** @fn StorageTable(string_view sd, string_view name)
-     *  @brief 打开一个名称为name的StorageTable */
-    StorageTable(std::string_view storage_directory, std::string_view name);
+    /** @fn StorageTable(string_view sd, string_view name, commit_log)
+     *  @brief 打开一个名称为name的StorageTable. 重放预写日志时, 没有`COMMIT`记录的事务
+     *         在`commit_log`里有记录就算已经提交 */
+    StorageTable(std::string_view storage_directory, std::string_view name,
+                 StorageCommitLog const *commit_log = nullptr);
 
     /** @fn StorageTable(string_view sd, string_view name, StorageTypeItem [])
      *  @brief 创建一个名称为`name`的StorageTable, 类型列表为`type_items` */
     StorageTable(std::string_view cwd, std::string_view name,
                  TypeItemListT const& type_items);
     
+    /** @fn ~StorageTable()
+     * @brief 关闭表之前做一次检查点 */
+    ~StorageTable() override;
+
     /** @brief getter:验证这个类是否有错误 */
     bool has_error() const { return _has_error; }
 
@@ -90,8 +156,46 @@ public:
     /** @brief getter:条目长度 */
     size_t get_entry_size() const { return _entry_size; }
 
+    /** @brief getter:已分配与未分配的所有条目个数, 即条目ID的上界 */
+    uint32_t get_entry_list_num() const { return _entry_list_num; }
+    /** @brief getter:已分配的条目个数 */
+    size_t get_entry_count() const {
+        _loadEntryAllocator();
+        return _entry_allocated_num;
+    }
+
+    /** @fn set_growth_policy(policy)
+     * @brief 设置这张表的条目文件与主键索引文件的扩容策略。
+     *        批量导入大量条目前可以调大增长比例, 减少重映射。 */
+    void set_growth_policy(MTB::FileMapper::GrowthPolicy policy) {
+        _entry_mapper->set_growth_policy(policy);
+        if (_primary_tree != nullptr)
+            _primary_tree->set_growth_policy(policy);
+        for (SecondaryIndex const &index: _secondary_indexes) {
+            if (index.tree != nullptr)
+                index.tree->set_growth_policy(policy);
+            else
+                index.hash->set_growth_policy(policy);
+        }
+    }
+
     /** @brief getter:名称 */
     std::string_view get_name() const { return _name; }
+    /** @brief getter:工作目录, 也就是数据库目录 */
+    std::filesystem::path const &get_work_directory() const { return _work_dir; }
+
+    /** @brief getter:条目文件的分页方式 */
+    StoragePageLayout const &get_page_layout() const { return _page_layout; }
+    /** @brief getter:条目文件的数据页个数, 不包括第0页 */
+    uint32_t get_page_count() const { return _page_count; }
+    /** @brief getter:上次检查点以后被修改过的页数(包括第0页) */
+    size_t get_dirty_page_count() const { return _dirty_pages.count(); }
+
+    /** @fn getPageHeader(page_no)
+     * @brief 第`page_no`个数据页(从1开始)的页头
+     * @return 页号超出范围时返回`nullptr`
+     * @warning 返回的指针只在条目文件下一次扩容之前有效。 */
+    StoragePageHeader const *getPageHeader(uint32_t page_no) const;
 
     /** @fn getType(string name)
      * @brief 根据字段`name`的名称查找`name`的类型信息
@@ -113,6 +217,8 @@ public:
     size_t get_primary_index_order() const {
         return _primary_index_order;
     }
+    /** @brief getter:这张表是否有主键 */
+    bool has_primary_key() const { return _primary_index_order != 0xFFFF'FFFF; }
 
     /** @fn getPrimaryKey() const
      * @brief  查找主索引
@@ -126,12 +232,19 @@ public:
 
     /** @fn appendEntry
      * @brief 申请一个条目, 然后把写入条目值 */
-    Entry appendEntry(std::vector<owned<Value>> const &value_list);
+    Entry appendEntry(ValueListT const &value_list);
 
     /** @fn appendEntry
      * @brief 申请一个条目, 然后把写入条目值 */
     Entry appendEntry(std::unordered_map<std::string_view, Value*> const &value_list);
 
+    /** @fn restoreEntry(id, value_list)
+     * @brief 在指定的ID上重新建立一个被删除的条目, 写入值列表。撤销删除时使用,
+     *        这样条目的ID不会变化。
+     * @throw EntryAllocatedException ID已经被分配
+     * @throw DuplicateKeyException 主键已经存在 */
+    Entry restoreEntry(uint32_t id, ValueListT const &value_list);
+
     /** @fn deleteEntry
      * @brief 根据条目本身删除一个条目。这个函数比较安全。 */
     bool deleteEntry(Entry *entry);
@@ -145,14 +258,139 @@ public:
      * @brief 删除所有首要索引为`key`的条目。 */
     bool deleteEntryByPrimaryKey(Value *value);
     
+    /** @fn traverseByPrimaryKey(relation, value, fn)
+     * @brief 使用主键的B+树索引，按主键升序遍历所有满足`主键 relation value`的条目ID.
+     * @return 没有主键、值的类型与主键不一致或者关系不能用索引求解(比如`NE`)时返回false,
+     *         这时调用者应该退回到全表扫描. */
+    bool traverseByPrimaryKey(TotalOrderRelation relation, Value const *value,
+                              EntryIDTraverseFunc fn) const;
+
+    /** @fn createIndex(name, column_index, kind)
+     * @brief 在第`column_index`列上建立名为`name`的二级索引, 并用已有的条目填充它。
+     *        B+树索引是允许重复键的B+树`${表名}.${索引名}.bpt`, 哈希索引是线性哈希文件
+     *        `${表名}.${索引名}.hash`. 之后插入、更新与删除条目时和主键索引一起维护。
+     *        表的所有二级索引登记在索引目录`${表名}.sdx`里。
+     * @return 同名的索引已经存在, 或者这一列已经有索引(包括主键索引)时返回false */
+    bool createIndex(std::string_view name, uint32_t column_index,
+                     IndexKind kind = IndexKind::BTREE);
+
+    /** @fn hasIndex(column_index)
+     * @brief 第`column_index`列有没有主键索引或者二级索引 */
+    bool hasIndex(uint32_t column_index) const {
+        return _getIndexTree(column_index) != nullptr ||
+               _getHashIndex(column_index) != nullptr;
+    }
+
+    /** @fn hasOrderedIndex(column_index)
+     * @brief 第`column_index`列有没有B+树索引(主键索引或者B+树二级索引) */
+    bool hasOrderedIndex(uint32_t column_index) const {
+        return _getIndexTree(column_index) != nullptr;
+    }
+
+    /** @fn traverseInIndexOrder(column_index, fn)
+     * @brief 用第`column_index`列的B+树索引按列值升序遍历所有条目ID, 列值相同的条目按ID升序。
+     *        列值的次序与`ValueView::compare`一致。
+     * @return 这一列没有B+树索引时返回false */
+    bool traverseInIndexOrder(uint32_t column_index, EntryIDTraverseFunc fn) const;
+
+    /** @fn traverseByIndex(column_index, relation, value, fn)
+     * @brief 同`traverseByPrimaryKey`, 使用第`column_index`列的主键索引或者二级索引,
+     *        遍历满足`列值 relation value`的条目ID. B+树索引按列值升序遍历, 列值相同的条目
+     *        按ID升序; 哈希索引只能求解`EQ`, 顺序不确定.
+     * @return 这一列没有索引、值的类型与列不一致或者关系不能用索引求解时返回false */
+    bool traverseByIndex(uint32_t column_index, TotalOrderRelation relation,
+                         Value const *value, EntryIDTraverseFunc fn) const;
+
+    /** @fn filterEntries(column_index, relation, value, out)
+     * @brief 全表扫描第`column_index`列, 求每个已分配条目是否满足`列值 relation value`.
+     *        结果写入`out`: 位图有`条目总数`位, 第i位为1表示ID为i的条目被选中。
+     *        整数列使用向量化的扫描内核，其他列逐条比较映射区里的值视图。
+     *        条目很多时按`SCAN_MORSEL_SIZE`切分, 在扫描线程池上并行执行(见`ScanSetThreadCount`).
+     * @throw Value::InconsistantTypeException 列类型与`value`的类型不一致 */
+    void filterEntries(size_t column_index, TotalOrderRelation relation,
+                       Value const *value, MTB::Bitmap &out) const;
+
+    /** @fn filterEntryRange(first, last, column_index, relation, value, out)
+     * @brief 同`filterEntries`, 只扫描ID在`[first, last)`之间的条目。
+     *        `out`有`last - first`位, 第i位对应ID为`first + i`的条目。
+     *        `last`超过条目总数时按条目总数截断。 */
+    void filterEntryRange(uint32_t first, uint32_t last, size_t column_index,
+                          TotalOrderRelation relation, Value const *value,
+                          MTB::Bitmap &out) const;
+
+    /** @fn isEntryAllocated(id)
+     * @brief ID为`id`的条目是否已经分配. ID超出条目总数时返回false */
+    bool isEntryAllocated(uint32_t id) const {
+        return id < _entry_list_num &&
+               *static_cast<const uint32_t*>(_getEntryMemory(id)) != 0;
+    }
+
     /** @fn traverseReadEntries
-     * @brief 遍历每一个条目,然后读取它 */
+     * @brief 按条目ID的升序遍历每一个已分配的条目,然后读取它。遍历时直接检查映射区里的
+     *        分配标记，所以可以在遍历过程中删除当前条目。 */
     void traverseReadEntries(EntryTraverseReadFunc fn) const;
 
     /** @fn traverseRWEntries
      * @brief 遍历每一个条目,然后调用读写函数 */
     void traverseRWEntries(EntryTraverseRWFunc fn);
 
+    /** @fn beginBulkLoad(expected_count)
+     * @brief 开始批量导入。先做检查点, 再往日志里写一条`BULK_LOAD`记录并落盘,
+     *        然后按预计的条目个数一次扩大条目文件。导入的条目只追加在所有条目之后,
+     *        不写日志; 导入没有完成就崩溃时, 重放到这条记录会把条目个数恢复到导入之前。 */
+    void beginBulkLoad(size_t expected_count);
+
+    /** @fn bulkAppend(row)
+     * @brief 批量导入一行: 把值直接写进映射区。`row`按列的顺序排列, 类型必须与列一致。
+     * @throw Value::InconsistantTypeException 值的类型与列不一致
+     * @throw DuplicateKeyException 主键已经存在 */
+    void bulkAppend(ValueView const *row);
+
+    /** @fn finishBulkLoad()
+     * @brief 结束批量导入并做检查点, 导入的条目从此持久化 */
+    void finishBulkLoad();
+
+    /** @fn abortBulkLoad()
+     * @brief 放弃批量导入, 删除这次导入的所有条目 */
+    void abortBulkLoad();
+
+    /** @brief getter:是否正在批量导入 */
+    bool is_bulk_loading() const { return _bulk_load_begin != NO_BULK_LOAD; }
+
+    /** @fn beginTransaction(transaction_id)
+     * @brief 开始ID为`transaction_id`的事务: 先写一条落盘的`BEGIN`记录, 之后每个条目
+     *        第一次被修改以前把它的前像作为撤销记录写进日志并落盘, 溢出堆的修改也一样,
+     *        直到`commit`. 事务开始以后新分配的条目不需要前像, 撤销时把条目个数恢复到开始时。
+     *        崩溃以后重放日志时撤销没有提交的事务。已经在事务里时什么都不做。 */
+    void beginTransaction(uint64_t transaction_id);
+    /** @brief getter:是否在事务里 */
+    bool in_transaction() const { return _in_transaction; }
+
+    /** @fn prepare()
+     * @brief 两阶段提交的准备: 等待这张表目前为止的所有记录落盘, 不结束事务 */
+    void prepare();
+
+    /** @fn commit(durable)
+     * @brief 提交: 在事务里时先追加提交记录并结束事务; `durable`为true时等待这张表目前为止
+     *        的所有记录落盘。多表事务已经在提交日志里落盘时传入false.
+     *        日志超过`WAL_CHECKPOINT_SIZE`时顺便做一次检查点。 */
+    void commit(bool durable = true);
+
+    /** @fn checkpoint()
+     * @brief 检查点: 把条目文件与索引文件写回磁盘, 然后清空预写日志。
+     *        条目文件只写回上次检查点以后被修改过的页, 相邻的脏页合并成一次写回。
+     *        事务进行中时不清空日志, 撤销记录还要用。 */
+    void checkpoint();
+
+    /** @brief getter:预写日志, 表不可用时为空 */
+    StorageWAL *get_wal() const { return _wal.get(); }
+
+    /** 变长字符串列能存放的最大长度 */
+    static constexpr size_t STRING_MAX_LENGTH = 16 * 1024 * 1024;
+
+    /** 预写日志超过这个大小时, 提交会触发检查点 */
+    static constexpr size_t WAL_CHECKPOINT_SIZE = 16 * 1024 * 1024;
+
     /** @fn eraseAndMakeUnavailable
      * @brief 清除这张表所有的文件，执行后这张表不可用。 */
     void eraseAndMakeUnavailable();
@@ -164,27 +402,138 @@ private:
     std::string   _name;           // 名称
     uint32_t      _entry_size;     // 条目大小
     uint32_t      _entry_list_num; // 已分配与未分配的所有条目个数
-    uint32_t _entry_allocated_num; // 已分配的条目个数
+    mutable uint32_t _entry_allocated_num; // 已分配的条目个数, 与条目分配器一起懒加载
     uint32_t _primary_index_order; // 主索引的次序
     std::filesystem::path _work_dir; // 工作目录
-    EntryAllocator _entry_allocator; // 条目分配器
+    mutable EntryAllocator _entry_allocator; // 条目分配器. 打开表时不建立, 第一次用到时才扫描条目文件
+    mutable std::mutex     _entry_allocator_mutex; // 多个读者可能同时第一次用到条目分配器
+    BTreeT        _primary_tree;   // 主键的B+树索引文件`${name}.bpt`, 没有主键时为空
+    /** @struct SecondaryIndex
+     * @brief 一个二级索引: 名称、被索引的列与它的B+树或者哈希索引 */
+    struct SecondaryIndex {
+        std::string name;
+        uint32_t    column;
+        IndexKind   kind;
+        BTreeT      tree; // B+树索引, 哈希索引时为空
+        HashIndexT  hash; // 哈希索引, B+树索引时为空
+    }; // struct SecondaryIndex
+    std::vector<SecondaryIndex> _secondary_indexes; // 二级索引, 按建立的次序排列
+    WALT          _wal;            // 预写日志`${name}.wal`
+    HeapT         _heap;           // 长字符串的溢出堆`${name}.heap`, 没有变长字符串列时为空
     // 类型描述对象的字符缓冲区。解决类型描述对象没有对名称的所有权的漏洞。
     std::string   _type_item_name_buffer;
     std::unordered_map<std::string_view, int32_t> _type_item_index_map;
     bool _has_error = false;     // 是否出错
+    uint32_t _entry_header_size = 0; // 条目文件头的大小, 旧格式的文件没有文件头
+    StoragePageLayout _page_layout;  // 条目文件的分页方式
+    uint32_t _page_count = 0;        // 数据页个数
+    mutable MTB::Bitmap _dirty_pages; // 条目文件的脏页位图, 第i位对应第i页
+    static constexpr uint32_t NO_BULK_LOAD = 0xFFFF'FFFF;
+    uint32_t _bulk_load_begin = NO_BULK_LOAD; // 正在进行的批量导入开始时的条目个数
+    uint32_t _bulk_rollback   = NO_BULK_LOAD; // 重放时遇到的没有完成的批量导入
+    StorageByteOrder _entry_byte_order = StorageNativeByteOrder; // 条目文件的字节序
+    bool _in_transaction = false; // 是否在事务里, 见`beginTransaction`
+    uint32_t _transaction_entry_base = 0; // 事务开始时的条目个数, 之后分配的条目不记录前像
+    mutable std::unordered_set<uint32_t> _undo_entries; // 事务里已经记录了前像的条目
 
     /** 加载函数 */
-    void _loadIndexFile(std::string const &idx_path);
+    bool _loadIndexFile(std::string const &idx_path); // 返回索引文件是否需要迁移
     void _loadEntryFile(std::string const &dat_path);
+    void _loadEntryAllocator() const; // 扫描条目文件的分配标记, 建立条目分配器
     void _createIndexFile(std::string const &idx_path);
     void _createEntryFile(std::string const &dat_path);
+    /** 把旧格式或者其他字节序的文件升级成当前版本、本机字节序的格式 */
+    void _migrateIndexFile(std::string const &idx_path);
+    void _migrateEntryFile(std::string const &dat_path);
+    void _loadPrimaryTree(std::string const &bpt_path); // 打开主键索引, 索引文件不存在时从条目重建
+    /** 读取索引目录, 打开所有二级索引。`rebuild`为true时丢弃索引文件, 从条目重建 */
+    void _loadSecondaryIndexes(bool rebuild);
+    /** 打开二级索引, 索引文件不存在时从条目建立 */
+    void _openSecondaryIndex(SecondaryIndex &index);
+    void _saveIndexCatalog() const; // 把二级索引列表写进索引目录
+    std::filesystem::path _getSecondaryIndexPath(SecondaryIndex const &index) const;
+    void   _openHeap();  // 表里有变长字符串列时打开溢出堆. 要在预写日志打开以后调用
+    /** 打开预写日志并重放, 返回重放的记录条数。最后一个事务没有结束, 也不在`commit_log`里时撤销它 */
+    size_t _replayWAL(std::string const &wal_path, StorageCommitLog const *commit_log);
+    void _redo(StorageWAL::Record const &record);   // 重放一条日志记录
+    void _undo(uint32_t id, std::string_view image); // 重放时用前像撤销一个条目
     void _dumpTypeItemNameBuffer(); // 保存类型对象列表的名称到私有缓冲区，防止UAF问题
-    void _initKeyIndexMap();        // 加载column名称-column顺序的映射表
+    void _initKeyIndexMap();        // 加载column名称-类型与column名称-column顺序的映射表
 
     /** 其他私有方法 */
-    MTB::pointer _getEntryStartMemory() const noexcept;
+    MTB::pointer _getEntryCountMemory() const noexcept; // 条目个数字段的地址
+    MTB::pointer _getPageCountMemory() const noexcept;  // 数据页个数字段的地址
+    MTB::pointer _getPageMemory(uint32_t page_no) const noexcept;
     MTB::pointer _getEntryMemory(size_t index) const noexcept;
     size_t       _getEntryOffset(size_t index) const noexcept;
+    void         _storeEntryWord(MTB::pointer memory, uint32_t value) const noexcept;
+    /** 扩大条目文件, 直到能放下第`id`个条目。按扩容策略一次扩到位,
+     *  同时初始化新的数据页, 并在槽位目录里登记这个槽位 */
+    void _reserveEntry(uint32_t id);
+    /** 初始化一个刚从分配器里取出的条目: 清零、设置分配标记并写日志 */
+    Entry _initializeEntry(uint32_t id);
+    /** 值列表的主键已经存在时抛出`DuplicateKeyException` */
+    void _checkDuplicateKey(ValueListT const &value_list) const;
+    /** 写入刚初始化的条目的每一列, 并把每一列的键插入它的索引 */
+    void _storeNewEntry(Entry &entry, ValueListT const &value_list);
+    /** 把条目文件偏移量`offset`所在的页标记为脏页 */
+    void _markDirty(size_t offset) const;
+    /** 写回条目文件的脏页. 没有分页的旧格式文件整个写回 */
+    void _syncDirtyPages();
+    /** 设置条目的分配标记, 同时维护页头里的已分配条目个数 */
+    void _setEntryAllocated(uint32_t id, bool allocated);
+    /** 重放日志以后按分配标记重新统计每一页的页头 */
+    void _rebuildPageHeaders();
+    /** 只有分页且是本机字节序的文件才维护页头. 迁移前的文件只需要条目本身正确 */
+    bool _isPageMaintained() const {
+        return _page_layout.is_paged() && _entry_byte_order == StorageNativeByteOrder;
+    }
+    /** 把列值的原始字节写入条目。写入主键列时会同步维护B+树索引，主键重复时返回false.
+     *  写入成功时追加一条预写日志。`is_new`表示条目刚分配、这一列第一次写入: 槽位是清零的,
+     *  不是旧键, 所以不从索引里删除它, 新键总是插入(主键列先检查重复)。 */
+    bool _storeColumn(uint32_t id, StorageTypeItem const &item,
+                      const uint8_t *raw, size_t raw_size, bool is_new = false) const;
+    /** 把值编码成列的原始字节, 写入`out`(至少`ColumnGetSize`字节)。长字符串会分配溢出堆块并
+     *  写入, 块的偏移量放进`out_block`, 没有分配时为0。
+     *  @return 原始字节的有效长度. 值放不进这一列时返回0 */
+    size_t _encodeColumn(StorageTypeItem const &item, ValueView const &value,
+                         uint8_t *out, StorageHeap::Offset &out_block) const;
+    /** 批量导入时日志太大: 做检查点以后重新写入`BULK_LOAD`记录 */
+    void _bulkCheckpoint();
+    /** 把导入没有完成的条目丢弃, 条目个数恢复到`count` */
+    void _rollbackEntryCount(uint32_t count);
+    /** 事务里第一次修改条目`id`以前调用: 把它的前像写进日志文件 */
+    void _logUndo(uint32_t id) const;
+    /** 扫描ID在`[first, last)`之间的条目, 是`filterEntryRange`的一个morsel.
+     *  ID为`id`的条目对应`out`的第`id - out_base`位 */
+    void _filterRange(uint32_t first, uint32_t last, size_t column_index,
+                      TotalOrderRelation relation, Value const *value,
+                      MTB::Bitmap &out, uint32_t out_base) const;
+    /** 把列的原始字节解码成值视图。长字符串指向溢出堆。 */
+    ValueView _decodeColumn(StorageTypeItem const &item, const uint8_t *raw) const;
+    /** 归还列的原始字节引用的溢出堆块。列被覆盖或者条目被删除时调用。 */
+    void _releaseColumn(StorageTypeItem const &item, const uint8_t *raw) const;
+    /** 从列值生成B+树的键。字符串键只取前256字节, 无效部分会被清零。
+     *  前256字节相同的长字符串的键相等, 所以树里的键不唯一, 命中的条目要用完整的列值再比较一次 */
+    void _makeIndexKey(ValueView const &value, uint8_t *out_key) const;
+    /** 第`column`列的B+树`tree`里有没有列值等于`value`的条目 */
+    bool _containsKey(StorageBTree const &tree, uint32_t column, ValueView const &value) const;
+    /** 在第`column`列的B+树`tree`上遍历满足`列值 relation value`的条目ID.
+     *  键被截断时先按放宽的关系遍历树, 再用完整的列值过滤 */
+    bool _traverseTree(StorageBTree const &tree, uint32_t column, TotalOrderRelation relation,
+                       ValueView const &value, EntryIDTraverseFunc const &fn) const;
+    /** `traverse`按树的次序把条目ID交给它的参数。前缀相同的长字符串在树里按条目ID排序,
+     *  这样连续的一段条目先收集起来, 按完整的列值稳定排序以后再交给fn */
+    void _traverseInValueOrder(uint32_t column,
+                               std::function<void(EntryIDTraverseFunc const&)> const &traverse,
+                               EntryIDTraverseFunc const &fn) const;
+    /** 第`column`列的索引: 主键列是主键索引, 否则是二级索引. 没有索引时返回nullptr */
+    StorageBTree *_getIndexTree(uint32_t column) const;
+    /** 第`column`列的哈希索引, 没有时返回nullptr */
+    StorageHashIndex *_getHashIndex(uint32_t column) const;
+    /** 把条目`id`加入所有二级索引, 或者从所有二级索引里删除 */
+    void _insertSecondaryKeys(uint32_t id) const;
+    void _removeSecondaryKeys(uint32_t id) const;
 };// class StorageTable
 
 } // namespace mygsql
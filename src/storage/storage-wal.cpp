@@ -0,0 +1,155 @@
+#include "storage-wal.hxx"
+#include "base/util/mtb-crc32.hxx"
+#include <cstring>
+#include <endian.h>
+
+namespace mygsql {
+
+/* 记录格式(大端序):
+ * | u32 校验和 | u32 负载长度 | u32 条目ID | u16 列下标 | u8 类型 | u8 保留 | 负载 |
+ * 校验和是从"负载长度"开始到负载末尾的CRC32. */
+constexpr size_t record_header_size = 16;
+
+static inline void store_u32(uint8_t *ptr, uint32_t value) {
+    value = htobe32(value);
+    memcpy(ptr, &value, sizeof(value));
+}
+static inline uint32_t load_u32(const uint8_t *ptr) {
+    uint32_t value;
+    memcpy(&value, ptr, sizeof(value));
+    return be32toh(value);
+}
+
+StorageWAL::StorageWAL(std::string_view path)
+    : _file(MTB::CreateAppendFile(path)),
+      _appended_lsn(0), _durable_lsn(0),
+      _flushing(false), _flush_count(0) {
+}
+
+StorageWAL::LSN StorageWAL::append(RecordType type, uint32_t entry_id, uint16_t column,
+                                   const uint8_t *data, size_t size)
+{
+    uint8_t header[record_header_size];
+    store_u32(header + 4, size);
+    store_u32(header + 8, entry_id);
+    uint16_t be_column = htobe16(column);
+    memcpy(header + 12, &be_column, sizeof(be_column));
+    header[14] = uint8_t(type);
+    header[15] = 0;
+    /* 校验和覆盖头部剩下的部分与负载 */
+    uint32_t crc = MTB::Crc32Update(0xFFFF'FFFF, header + 4, record_header_size - 4);
+    crc = MTB::Crc32Update(crc, data, size);
+    store_u32(header, ~crc);
+
+    std::lock_guard<std::mutex> guard(_lock);
+    _buffer.append(reinterpret_cast<const char*>(header), record_header_size);
+    if (size > 0)
+        _buffer.append(reinterpret_cast<const char*>(data), size);
+    _appended_lsn += record_header_size + size;
+    return _appended_lsn;
+}
+
+StorageWAL::LSN StorageWAL::appendUndo(RecordType type, uint32_t entry_id,
+                                       const uint8_t *data, size_t size)
+{
+    LSN ret = append(type, entry_id, 0, data, size);
+    commit(ret);
+    return ret;
+}
+
+void StorageWAL::commit(LSN lsn)
+{
+    std::unique_lock<std::mutex> guard(_lock);
+    while (_durable_lsn < lsn) {
+        if (_flushing) {
+            /* 已经有领导者在落盘, 等它完成后再检查自己的记录有没有被带上 */
+            _flushed_cond.wait(guard);
+            continue;
+        }
+        /* 成为领导者: 带走缓冲区里所有会话的记录 */
+        _flushing = true;
+        std::string batch;
+        batch.swap(_buffer);
+        LSN target = _appended_lsn;
+        guard.unlock();
+        try {
+            _file->append(batch.data(), batch.size());
+            _file->sync();
+        } catch (...) {
+            guard.lock();
+            _flushing = false;
+            _flushed_cond.notify_all();
+            throw;
+        }
+        guard.lock();
+        _durable_lsn = target;
+        _flushing    = false;
+        _flush_count++;
+        _flushed_cond.notify_all();
+    }
+}
+
+void StorageWAL::commit()
+{
+    LSN lsn;
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        lsn = _appended_lsn;
+    }
+    commit(lsn);
+}
+
+size_t StorageWAL::replay(ReplayFunc fn)
+{
+    std::string content = _file->readAll();
+    auto begin = reinterpret_cast<const uint8_t*>(content.data());
+    size_t offset = 0, count = 0;
+    while (offset + record_header_size <= content.size()) {
+        const uint8_t *record = begin + offset;
+        uint32_t size = load_u32(record + 4);
+        if (size > content.size() - offset - record_header_size)
+            break; // 写了一半的记录
+        if (MTB::Crc32(record + 4, record_header_size - 4 + size) != load_u32(record))
+            break; // 校验和不对
+        uint16_t column;
+        memcpy(&column, record + 12, sizeof(column));
+        Record decoded {
+            RecordType(record[14]),
+            load_u32(record + 8),
+            be16toh(column),
+            {reinterpret_cast<const char*>(record + record_header_size), size}
+        };
+        fn(decoded);
+        offset += record_header_size + size;
+        count++;
+    }
+    return count;
+}
+
+void StorageWAL::truncate()
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    _buffer.clear();
+    _file->truncate();
+    _durable_lsn = _appended_lsn;
+}
+
+size_t StorageWAL::get_size()
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    return _file->get_file_size() + _buffer.size();
+}
+
+StorageWAL::LSN StorageWAL::get_durable_lsn()
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    return _durable_lsn;
+}
+
+uint64_t StorageWAL::get_flush_count()
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    return _flush_count;
+}
+
+} // namespace mygsql
@@ -0,0 +1,124 @@
+#ifndef __MYG_SQL_STORAGE_WAL_H__
+#define __MYG_SQL_STORAGE_WAL_H__
+
+#include "base/mtb-exception.hxx"
+#include "base/mtb-object.hxx"
+#include "base/mtb-system.hxx"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+namespace mygsql {
+
+/** @class StorageWAL
+ * @brief 存储表的预写日志`${table}.wal`. 存储表每次修改映射区时追加一条紧凑的重做(redo)
+ *        记录, 提交时只需要把新追加的记录落盘, 代价与修改量有关而与表的大小无关。
+ *
+ *        事务里还要记录撤销(undo)信息: 修改是直接写进映射区的, 内核随时可能把它们写回文件,
+ *        所以事务开始时先写一条落盘的`BEGIN`记录, 每个条目第一次被修改以前再用`appendUndo`
+ *        把它的前像写进日志并落盘, 然后才修改映射区(先写日志). 事务结束时追加一条`COMMIT`
+ *        记录。重放时没有`COMMIT`的事务如果也不在数据库的提交日志里(见`StorageCommitLog`),
+ *        它的撤销记录按相反的次序写回。
+ *
+ *        多个会话同时提交时使用组提交: 第一个到达的提交者成为领导者, 把缓冲区里
+ *        所有会话追加的记录一次写入并调用一次`fdatasync`; 其他提交者等待领导者
+ *        完成, 如果自己的记录已经被这一批带上就直接返回。 *
+ * @warning 事务以外的语句不记录撤销信息, 崩溃时执行了一半的语句会被重做。 */
+class StorageWAL: public MTB::Object {
+public:
+    using AppendFileT = std::unique_ptr<MTB::AppendFile>;
+    /** 日志序列号: 从打开日志开始单调增长的字节位置 */
+    using LSN = uint64_t;
+
+    /** @enum RecordType
+     * @brief 日志记录类型 */
+    enum class RecordType: uint8_t {
+        ALLOCATE   = 1, // 分配条目: 清零条目并设置分配标记, 没有负载
+        WRITE      = 2, // 写入列: 负载是列的原始字节
+        FREE       = 3, // 释放条目: 清除分配标记, 没有负载
+        HEAP_WRITE = 4, // 写入溢出堆: 负载是| u64 堆偏移 | 数据 |, 不使用条目ID与列下标
+        BULK_LOAD  = 5, // 批量导入开始: 条目ID是导入前的条目个数, 没有负载. 导入完成时的检查点会清空它
+        UNDO       = 6, // 条目的前像: 负载是整个条目的原始字节
+        HEAP_UNDO  = 7, // 溢出堆的前像: 负载格式与HEAP_WRITE相同
+        COMMIT     = 8, // 事务结束(提交或者回滚完成), 没有负载. 它之前的撤销记录都不再需要
+        BEGIN      = 9, // 事务开始: 条目ID是开始时的条目个数, 负载是| u64 事务ID |
+    }; // enum class RecordType
+
+    /** @struct Record
+     * @brief 解码后的日志记录。负载指向重放缓冲区, 只在重放回调里有效。 */
+    struct Record {
+        RecordType       type;
+        uint32_t         entry_id;
+        uint16_t         column;
+        std::string_view payload;
+    }; // struct Record
+    using ReplayFunc = std::function<void(Record const&)>;
+
+    /** @class Exception
+     * @brief 日志文件读写失败 */
+    class Exception: public MTB::Exception {
+    public:
+        using MTB::Exception::Exception;
+    }; // class StorageWAL::Exception
+public:
+    /** @fn StorageWAL(path)
+     * @brief 打开名为`path`的日志文件, 文件不存在时会创建它。 */
+    StorageWAL(std::string_view path);
+
+    /** @fn append(type, entry_id, column, data, size)
+     * @brief 追加一条记录到内存缓冲区, 不落盘。
+     * @return 这条记录末尾的日志序列号, 把它传给`commit()`就能等待这条记录落盘。 */
+    LSN append(RecordType type, uint32_t entry_id, uint16_t column = 0,
+               const uint8_t *data = nullptr, size_t size = 0);
+
+    /** @fn appendUndo(type, entry_id, data, size)
+     * @brief 追加一条撤销记录并等待它落盘(和`commit`一样参与组提交).
+     *        调用者在修改映射区以前调用它, 掉电以后前像一定比修改先到达磁盘。
+     * @return 同`append` */
+    LSN appendUndo(RecordType type, uint32_t entry_id,
+                   const uint8_t *data = nullptr, size_t size = 0);
+
+    /** @fn commit(lsn)
+     * @brief 等待序列号`lsn`之前的所有记录落盘。多个线程同时调用时会合并成一次落盘。 */
+    void commit(LSN lsn);
+    /** @fn commit()
+     * @brief 等待目前追加的所有记录落盘 */
+    void commit();
+
+    /** @fn replay(fn)
+     * @brief 从头读取日志文件, 按顺序对每一条完整的记录调用`fn`.
+     *        遇到写了一半或者校验和不对的记录时停止, 它和它后面的内容会被丢弃。
+     * @return 重放的记录条数 */
+    size_t replay(ReplayFunc fn);
+
+    /** @fn truncate()
+     * @brief 检查点用: 清空日志文件。调用者必须保证日志里的修改都已经写回条目文件,
+     *        而且截断期间没有别的线程追加记录。 */
+    void truncate();
+
+    /** @brief getter:日志文件大小, 包括还没有落盘的缓冲区 */
+    size_t get_size();
+    /** @brief getter:已经落盘的最大日志序列号 */
+    LSN get_durable_lsn();
+    /** @brief getter:落盘(fdatasync)的次数。组提交生效时会小于提交的次数。 */
+    uint64_t get_flush_count();
+    std::string_view get_filename() const { return _file->get_filename(); }
+private:
+    AppendFileT _file;            // 日志文件
+    std::mutex  _lock;            // 保护下面所有的字段
+    std::condition_variable _flushed_cond; // 一批记录落盘以后通知等待者
+    std::string _buffer;          // 已经追加但还没有写入文件的记录
+    LSN         _appended_lsn;    // 已经追加的最大序列号
+    LSN         _durable_lsn;     // 已经落盘的最大序列号
+    bool        _flushing;        // 是否有领导者正在落盘
+    uint64_t    _flush_count;     // 落盘次数
+}; // class StorageWAL
+
+} // namespace mygsql
+
+#endif
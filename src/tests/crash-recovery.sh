@@ -0,0 +1,65 @@
+#!/bin/sh
+# 用法: crash-recovery.sh <mygsql> <expected>
+# 事务执行到一半时用kill -9杀掉进程, 重启以后没有提交的修改必须被撤销(包括修改了
+# 两张表的事务), 之前提交的事务必须还在。数据库放在临时目录里
+set -e
+work=$(mktemp -d)
+trap 'kill -9 $pid 2>/dev/null || true; rm -rf "$work"' EXIT
+ln -s "$1" "$work/mygsql"
+long="a-string-that-does-not-fit-into-the-slot-and-goes-to-the-heap"
+
+mkfifo "$work/input"
+"$work/mygsql" < "$work/input" > "$work/crashed" 2>&1 &
+pid=$!
+exec 3> "$work/input"
+cat >&3 <<SQL
+create database d
+use d
+create table c (id int primary, v int, s string)
+create table o (id int primary, n int)
+insert o values (1, 10)
+insert c values (3, 30, "three")
+insert c values (9, 90, "$long-9")
+insert c values (12, 120, "twelve")
+begin
+insert c values (20, 200, "$long-20")
+commit
+sync
+begin
+insert o values (2, 20)
+update o set n = 11 where id = 1
+update c set v = 91 where id = 9
+commit
+begin
+insert o values (3, 30)
+delete o where id = 1
+insert c values (1000, 1, "$long-1000")
+update c set v = 77 where id = 9
+update c set s = "$long-updated" where id = 12
+update c set s = "short" where id = 9
+delete c where id = 3
+delete c where id = 20
+insert c values (3, 33, "three-again")
+select count(*) from c
+SQL
+# 等事务里最后一条语句执行完, 再在提交以前杀掉进程
+for i in $(seq 100); do
+    grep -q "count(\*)" "$work/crashed" && break
+    sleep 0.1
+done
+if ! grep -q "count(\*)" "$work/crashed"; then
+    cat "$work/crashed"
+    exit 1
+fi
+kill -9 $pid
+wait $pid 2>/dev/null || true
+exec 3>&-
+
+"$work/mygsql" > "$work/output" 2>&1 <<SQL
+use d
+select id, v, s from c
+select id, n from o
+select id from c where id = 3
+select id from c where s = "$long-9"
+SQL
+diff -u "$2" "$work/output"
@@ -0,0 +1,16 @@
+create database d;
+use d;
+create table h (id int primary, v int, s string);
+create index hv on h(v) using hash;
+create index hs on h(s) using hash;
+insert h values (1, 0, "a");
+insert h values (2, 3, "b");
+insert h values (3, 0, "a");
+select id from h where v = 0;
+select id from h where s = "a";
+update h set v = 0 where id = 2;
+select id from h where v = 0;
+update h set v = 4 where id = 1;
+select id from h where v = 0;
+delete h where id = 3;
+select id from h where v = 0;
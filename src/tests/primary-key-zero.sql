@@ -0,0 +1,17 @@
+create database d;
+use d;
+create table z (id int primary, v int, s string);
+create index zv on z(v);
+insert z values (0, 0, "x");
+insert z values (0, 1, "y");
+insert z values (1, 0, "z");
+select id, v from z where id = 0;
+select id from z where v = 0;
+select id from z where v <= 0;
+update z set v = 5 where id = 0;
+select id, v from z where id = 0;
+select id from z where v = 5;
+delete z where id = 0;
+select id from z where id = 0;
+insert z values (0, 7, "w");
+select id, v from z where id <= 0;
@@ -0,0 +1,10 @@
+#!/bin/sh
+# 用法: run-sql-test.sh <mygsql> <test.sql> <expected>
+# 在临时目录里执行test.sql, 输出与expected逐行比较。数据库放在程序所在目录的storage里,
+# 所以在临时目录里建一个指向程序的符号链接
+set -e
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+ln -s "$1" "$work/mygsql"
+"$work/mygsql" < "$2" > "$work/output" 2>&1
+diff -u "$3" "$work/output"
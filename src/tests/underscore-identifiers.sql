@@ -0,0 +1,13 @@
+create database d_1;
+use d_1;
+create table user_info (user_id int primary, _name string, score_2 int);
+create index idx_score on user_info(score_2);
+insert user_info values (1, "a_b", 10);
+insert user_info values (2, "c", 20);
+select user_id, _name from user_info where score_2 > 15;
+update user_info set score_2 = 5 where _name = "a_b";
+select user_id from user_info where score_2 = 5 and user_id <= 1;
+delete user_info where user_id = 2;
+select user_id, _name, score_2 from user_info;
+drop table user_info;
+drop database d_1;